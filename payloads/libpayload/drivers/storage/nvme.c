@@ -25,6 +25,16 @@
 #define NVME_SQ_ENTRY_SIZE 64
 #define NVME_CQ_ENTRY_SIZE 16
 
+#define NVME_IO_QUEUE_DEPTH CONFIG_LP_STORAGE_NVME_QUEUE_DEPTH
+
+#define NVME_PAGE_SIZE 0x1000
+/* Largest read command we issue, if the controller's MDTS allows it. */
+#define NVME_MAX_TRANSFER (4 * MiB)
+/* Read command size used when the controller can't be identified. */
+#define NVME_DEFAULT_TRANSFER (256 * KiB)
+/* Entries per PRP list page. The last one points to the next page if more entries follow. */
+#define NVME_PRP_PER_PAGE (NVME_PAGE_SIZE / sizeof(uint64_t))
+
 struct nvme_dev {
 	storage_dev_t storage_dev;
 
@@ -37,7 +47,16 @@ struct nvme_dev {
 		uint16_t round; // bool round 0 or 1+0xd
 	} queue[4];
 
-	uint64_t *prp_list;
+	/* Read commands on the I/O queue, the index is the command ID. */
+	struct {
+		uint64_t *prp_list;
+		size_t offset; // first block relative to the request
+		int busy;
+	} io_cmd[NVME_IO_QUEUE_DEPTH];
+	unsigned int io_depth; // commands in flight, the I/O queues have one entry more
+	unsigned int max_blocks; // per read command
+
+	uint64_t *prp_lists;
 };
 
 
@@ -167,70 +186,191 @@ static void nvme_detach_device(struct storage_dev *dev)
 	uint16_t command = pci_read_config16(nvme->pci_dev, PCI_COMMAND);
 	pci_write_config16(nvme->pci_dev, PCI_COMMAND, command & ~PCI_COMMAND_MASTER);
 
-	free(nvme->prp_list);
+	free(nvme->prp_lists);
 }
 
-static int nvme_read(struct nvme_dev *nvme, unsigned char *buffer, uint64_t base, uint16_t count)
+/* Number of PRP list pages a read command of up to `blocks` blocks needs. */
+static size_t nvme_prp_list_pages(unsigned int blocks)
 {
-	if (count == 0 || count > 512)
-		return -1;
+	/* A buffer that isn't page aligned touches one page more. PRP1 covers the first. */
+	const size_t entries = (size_t)blocks * 512 / NVME_PAGE_SIZE;
 
-	struct nvme_s_queue_entry e = {
-		.dw[0] = 0x02,
-		.dw[1] = 0x1,
-		.dw[6] = virt_to_phys(buffer),
-		.dw[10] = base,
-		.dw[11] = base >> 32,
-		.dw[12] = count - 1,
-	};
+	/* Only the last page of a chain uses its last entry for data. */
+	if (entries <= NVME_PRP_PER_PAGE)
+		return 1;
+	return DIV_ROUND_UP(entries - 1, NVME_PRP_PER_PAGE - 1);
+}
+
+static void nvme_set_prps(struct nvme_s_queue_entry *e, uint64_t *prp_list,
+			  unsigned char *buffer, size_t size)
+{
+	const uint64_t prp1 = virt_to_phys(buffer);
+	e->dw[6] = prp1;
+	e->dw[7] = prp1 >> 32;
 
 	const unsigned int start_page = (uintptr_t)buffer >> 12;
-	const unsigned int end_page = ((uintptr_t)buffer + count * 512 - 1) >> 12;
+	const unsigned int end_page = ((uintptr_t)buffer + size - 1) >> 12;
+	uint64_t prp2 = 0;
 	if (end_page == start_page) {
 		/* No page crossing, PRP2 is reserved */
 	} else if (end_page == start_page + 1) {
 		/* Crossing exactly one page boundary, PRP2 is second page */
-		e.dw[8] = virt_to_phys(buffer + 0x1000) & ~0xfff;
+		prp2 = virt_to_phys(buffer + 0x1000) & ~0xfff;
 	} else {
-		/* Use a single page as PRP list, PRP2 points to the list */
-		unsigned int i;
-		for (i = 0; i < end_page - start_page; ++i) {
-			buffer += 0x1000;
-			nvme->prp_list[i] = virt_to_phys(buffer) & ~0xfff;
+		/* PRP2 points to the list. A full list page chains to the next one. */
+		unsigned int page, i = 0;
+		prp2 = virt_to_phys(prp_list);
+		for (page = 1; page <= end_page - start_page; ++page) {
+			if (i == NVME_PRP_PER_PAGE - 1 && page < end_page - start_page) {
+				prp_list[i] = virt_to_phys(prp_list + NVME_PRP_PER_PAGE);
+				prp_list += NVME_PRP_PER_PAGE;
+				i = 0;
+			}
+			prp_list[i++] = virt_to_phys(buffer + page * 0x1000) & ~0xfff;
 		}
-		e.dw[8] = virt_to_phys(nvme->prp_list);
 	}
+	e->dw[8] = prp2;
+	e->dw[9] = prp2 >> 32;
+}
+
+/* Put a read on the I/O submission queue. The doorbell is left to the caller. */
+static void nvme_queue_read(struct nvme_dev *nvme, unsigned int cid, unsigned char *buffer,
+			    uint64_t base, unsigned int count)
+{
+	struct nvme_s_queue_entry e = {
+		.dw[0] = 0x02 | cid << 16,
+		.dw[1] = 0x1,
+		.dw[10] = base,
+		.dw[11] = base >> 32,
+		.dw[12] = count - 1,
+	};
+
+	nvme_set_prps(&e, nvme->io_cmd[cid].prp_list, buffer, count * 512);
+
+	void *s_entry = nvme->queue[ios].base + (nvme->queue[ios].idx * NVME_SQ_ENTRY_SIZE);
+	memcpy(s_entry, &e, NVME_SQ_ENTRY_SIZE);
+	nvme->queue[ios].idx = (nvme->queue[ios].idx + 1) % (nvme->io_depth + 1);
+}
+
+/* Wait for the next I/O completion. Returns its command ID and the status in *status. */
+static unsigned int nvme_wait_read(struct nvme_dev *nvme, int *status)
+{
+	struct nvme_c_queue_entry *c_entry = nvme->queue[ioc].base +
+		(nvme->queue[ioc].idx * NVME_CQ_ENTRY_SIZE);
+	uint32_t dw3;
+	while (((dw3 = read32(&c_entry->dw[3])) >> 16 & 0x1) == nvme->queue[ioc].round)
+		;
+	nvme->queue[ioc].idx = (nvme->queue[ioc].idx + 1) % (nvme->io_depth + 1);
+	write32(nvme->queue[ioc].bell, nvme->queue[ioc].idx);
+	if (nvme->queue[ioc].idx == 0)
+		nvme->queue[ioc].round = (nvme->queue[ioc].round + 1) & 1;
 
-	return nvme_cmd(nvme, ios, &e);
+	*status = dw3 >> 17;
+	return dw3 & 0xffff;
 }
 
 static ssize_t nvme_read_blocks512(
 		struct storage_dev *const dev,
 		const lba_t start, const size_t count, unsigned char *const buf)
 {
-	unsigned int off = 0;
-	while (off < count) {
-		const unsigned int blocks = MIN(count - off, 512);
-		if (nvme_read((struct nvme_dev *)dev, buf + (off * 512), start + off, blocks))
-			return off;
-		off += blocks;
+	struct nvme_dev *nvme = (struct nvme_dev *)dev;
+	unsigned int in_flight = 0, cid;
+	size_t off = 0, failed = count;
+	int status;
+
+	while (off < count || in_flight) {
+		/* Fill up the queue and ring the doorbell once for all new commands. */
+		const unsigned int queued = in_flight;
+		for (cid = 0; cid < nvme->io_depth && off < count && failed == count; ++cid) {
+			if (nvme->io_cmd[cid].busy)
+				continue;
+			const unsigned int blocks = MIN(count - off, nvme->max_blocks);
+			nvme_queue_read(nvme, cid, buf + (off * 512), start + off, blocks);
+			nvme->io_cmd[cid].offset = off;
+			nvme->io_cmd[cid].busy = 1;
+			off += blocks;
+			in_flight++;
+		}
+		if (in_flight != queued)
+			write32(nvme->queue[ios].bell, nvme->queue[ios].idx);
+		if (!in_flight)
+			break;
+
+		cid = nvme_wait_read(nvme, &status);
+		if (cid >= nvme->io_depth || !nvme->io_cmd[cid].busy) {
+			printf("NVMe ERROR: Completion for unknown command %u.\n", cid);
+			continue;
+		}
+		nvme->io_cmd[cid].busy = 0;
+		in_flight--;
+
+		/* Stop queueing after an error, but let the commands in flight finish. */
+		if (status)
+			failed = MIN(failed, nvme->io_cmd[cid].offset);
 	}
-	return count;
+
+	return failed;
+}
+
+/* Read the maximum transfer size and set up a PRP list for each command. */
+static int nvme_setup_reads(struct nvme_dev *nvme)
+{
+	const uint64_t cap = read64(nvme->config);
+	uint64_t max_transfer = NVME_DEFAULT_TRANSFER;
+	size_t pages;
+	unsigned int i;
+
+	uint8_t *const id = memalign(0x1000, 0x1000);
+	if (id) {
+		const struct nvme_s_queue_entry e = {
+			.dw[0]  = 0x06,
+			.dw[6]  = virt_to_phys(id),
+			.dw[10] = 1,
+		};
+
+		/* MDTS is in units of CAP.MPSMIN, 0 means no limit. */
+		if (!nvme_cmd(nvme, NVME_ADMIN_QUEUE, &e)) {
+			const uint8_t mdts = id[77];
+			max_transfer = NVME_MAX_TRANSFER;
+			if (mdts && mdts < 32)
+				max_transfer = MIN(max_transfer,
+					(uint64_t)NVME_PAGE_SIZE << (cap >> 48 & 0xf) << mdts);
+		}
+		free(id);
+	}
+	nvme->max_blocks = max_transfer / 512;
+
+	/* CAP.MQES is zero based, one queue entry stays unused. */
+	nvme->io_depth = MIN(NVME_IO_QUEUE_DEPTH, (unsigned int)MAX(cap & 0xffff, 1));
+
+	pages = nvme_prp_list_pages(nvme->max_blocks);
+	nvme->prp_lists = memalign(0x1000, nvme->io_depth * pages * NVME_PAGE_SIZE);
+	if (!nvme->prp_lists) {
+		printf("NVMe ERROR: Failed to allocate buffer for PRP lists\n");
+		return -1;
+	}
+	for (i = 0; i < nvme->io_depth; ++i) {
+		nvme->io_cmd[i].prp_list = nvme->prp_lists + i * pages * NVME_PRP_PER_PAGE;
+		nvme->io_cmd[i].busy = 0;
+	}
+
+	return 0;
 }
 
 static int create_io_submission_queue(struct nvme_dev *nvme)
 {
-	void *sq_buffer = memalign(0x1000, NVME_SQ_ENTRY_SIZE * NVME_QUEUE_SIZE);
+	const unsigned int size = nvme->io_depth + 1;
+	void *sq_buffer = memalign(0x1000, NVME_SQ_ENTRY_SIZE * size);
 	if (!sq_buffer) {
 		printf("NVMe ERROR: Failed to allocate memory for io submission queue.\n");
 		return -1;
 	}
-	memset(sq_buffer, 0, NVME_SQ_ENTRY_SIZE * NVME_QUEUE_SIZE);
+	memset(sq_buffer, 0, NVME_SQ_ENTRY_SIZE * size);
 
 	struct nvme_s_queue_entry e = {
 		.dw[0]  = 0x01,
 		.dw[6]  = virt_to_phys(sq_buffer),
-		.dw[10] = ((NVME_QUEUE_SIZE - 1) << 16) | ios >> 1,
+		.dw[10] = ((size - 1) << 16) | ios >> 1,
 		.dw[11] = (1 << 16) | 1,
 	};
 
@@ -250,17 +390,18 @@ static int create_io_submission_queue(struct nvme_dev *nvme)
 
 static int create_io_completion_queue(struct nvme_dev *nvme)
 {
-	void *const cq_buffer = memalign(0x1000, NVME_CQ_ENTRY_SIZE * NVME_QUEUE_SIZE);
+	const unsigned int size = nvme->io_depth + 1;
+	void *const cq_buffer = memalign(0x1000, NVME_CQ_ENTRY_SIZE * size);
 	if (!cq_buffer) {
 		printf("NVMe ERROR: Failed to allocate memory for io completion queue.\n");
 		return -1;
 	}
-	memset(cq_buffer, 0, NVME_CQ_ENTRY_SIZE * NVME_QUEUE_SIZE);
+	memset(cq_buffer, 0, NVME_CQ_ENTRY_SIZE * size);
 
 	const struct nvme_s_queue_entry e = {
 		.dw[0]  = 0x05,
 		.dw[6]  = virt_to_phys(cq_buffer),
-		.dw[10] = ((NVME_QUEUE_SIZE - 1) << 16) | ioc >> 1,
+		.dw[10] = ((size - 1) << 16) | ioc >> 1,
 		.dw[11] = 1,
 	};
 
@@ -337,12 +478,7 @@ static void nvme_init(pcidev_t dev)
 	nvme->storage_dev.detach_device		= nvme_detach_device;
 	nvme->pci_dev				= dev;
 	nvme->config				= pci_bar0;
-	nvme->prp_list				= memalign(0x1000, 0x1000);
-
-	if (!nvme->prp_list) {
-		printf("NVMe ERROR: Failed to allocate buffer for PRP list\n");
-		goto _free_abort;
-	}
+	nvme->prp_lists				= NULL;
 
 	const uint32_t cc = NVME_CC_EN | NVME_CC_CSS | NVME_CC_MPS | NVME_CC_AMS | NVME_CC_SHN
 			| NVME_CC_IOSQES | NVME_CC_IOCQES;
@@ -380,6 +516,8 @@ static void nvme_init(pcidev_t dev)
 
 	uint16_t command = pci_read_config16(dev, PCI_COMMAND);
 	pci_write_config16(dev, PCI_COMMAND, command | PCI_COMMAND_MASTER);
+	if (nvme_setup_reads(nvme))
+		goto _delete_admin_abort;
 	if (create_io_completion_queue(nvme))
 		goto _delete_admin_abort;
 	if (create_io_submission_queue(nvme))
@@ -393,7 +531,7 @@ _delete_completion_abort:
 _delete_admin_abort:
 	delete_admin_queues(nvme);
 _free_abort:
-	free(nvme->prp_list);
+	free(nvme->prp_lists);
 	free(nvme);
 	printf("NVMe init failed.\n");
 }
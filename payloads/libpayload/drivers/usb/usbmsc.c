@@ -382,6 +382,112 @@ readwrite_chunk(usbdev_t *dev, int start, int n, cbw_direction dir, u8 *buf)
 		!= MSC_COMMAND_OK ? 1 : 0;
 }
 
+/* Number of READ(10) commands kept in flight if the controller can queue. */
+#define MSC_QUEUE_DEPTH 2
+
+typedef struct {
+	cbw_t cbw[MSC_QUEUE_DEPTH];
+	csw_t csw[MSC_QUEUE_DEPTH];
+} msc_queue_t;
+
+static int
+queue_read_chunk(usbdev_t *dev, cbw_t *cbw, csw_t *csw, int start, int n,
+		 u8 *buf)
+{
+	usbmsc_inst_t *msc = MSC_INST(dev);
+	hci_t *ctrlr = dev->controller;
+	const int len = n * msc->blocksize;
+	cmdblock_t cb;
+
+	memset(&cb, 0, sizeof(cb));
+	cb.command = 0x28;
+	cb.block = htonl(start);
+	cb.numblocks = htonw(n);
+	wrap_cbw(cbw, len, cbw_direction_data_in, (u8 *) &cb, sizeof(cb),
+		 msc->lun);
+
+	if (ctrlr->bulk_queue(msc->bulk_out, sizeof(cbw_t), (u8 *) cbw) < 0 ||
+	    ctrlr->bulk_queue(msc->bulk_in, len, buf) < 0 ||
+	    ctrlr->bulk_queue(msc->bulk_in, sizeof(csw_t), (u8 *) csw) < 0)
+		return 1;
+	return 0;
+}
+
+static int
+finish_read_chunk(usbdev_t *dev, const cbw_t *cbw, const csw_t *csw, int n)
+{
+	usbmsc_inst_t *msc = MSC_INST(dev);
+	hci_t *ctrlr = dev->controller;
+
+	if (ctrlr->bulk_wait(msc->bulk_out) != sizeof(cbw_t) ||
+	    ctrlr->bulk_wait(msc->bulk_in) != n * msc->blocksize ||
+	    ctrlr->bulk_wait(msc->bulk_in) != sizeof(csw_t))
+		return 1;
+	if (csw->dCSWSignature != csw_signature ||
+	    csw->dCSWTag != cbw->dCBWTag ||
+	    csw->bCSWStatus != 0 || csw->dCSWDataResidue != 0)
+		return 1;
+	return 0;
+}
+
+/**
+ * Reads sequential blocks with up to MSC_QUEUE_DEPTH commands in flight, so
+ * the device can start on the next command while we collect the status of
+ * the last one. Any failure cancels the queued transfers and resets the
+ * transport, and the device will use single commands from then on.
+ *
+ * @param dev device to access
+ * @param start first sector to access
+ * @param n number of sectors to access
+ * @param buf DMA coherent buffer to read into
+ * @return number of sectors read before the first failure,
+ *         -1 if the device got detached
+ */
+static int
+read_blocks_queued(usbdev_t *dev, int start, int n, u8 *buf)
+{
+	usbmsc_inst_t *msc = MSC_INST(dev);
+	hci_t *ctrlr = dev->controller;
+	const int chunk_size = MAX_CHUNK_BYTES / msc->blocksize;
+	int queued = 0, done = 0, count, i;
+
+	msc_queue_t *q = dma_malloc(sizeof(*q));
+	if (!q)
+		return 0;
+
+	while (done < n) {
+		while (queued < n &&
+		       queued - done < MSC_QUEUE_DEPTH * chunk_size) {
+			i = (queued / chunk_size) % MSC_QUEUE_DEPTH;
+			count = MIN(n - queued, chunk_size);
+			if (queue_read_chunk(dev, &q->cbw[i], &q->csw[i],
+					     start + queued, count,
+					     buf + queued * msc->blocksize))
+				goto fail;
+			queued += count;
+		}
+
+		i = (done / chunk_size) % MSC_QUEUE_DEPTH;
+		count = MIN(n - done, chunk_size);
+		if (finish_read_chunk(dev, &q->cbw[i], &q->csw[i], count))
+			goto fail;
+		done += count;
+	}
+
+	free(q);
+	return done;
+
+fail:
+	usb_debug("MSC: queued read failed, using single commands.\n");
+	free(q);
+	msc->queued_reads_failed = 1;
+	ctrlr->bulk_cancel(msc->bulk_out);
+	ctrlr->bulk_cancel(msc->bulk_in);
+	if (reset_transport(dev) == MSC_COMMAND_DETACHED)
+		return -1;
+	return done;
+}
+
 /**
  * Reads or writes a number of sequential blocks on a USB storage device
  * that is split into MAX_CHUNK_BYTES size requests.
@@ -402,10 +508,21 @@ int
 readwrite_blocks(usbdev_t *dev, int start, int n, cbw_direction dir, u8 *buf)
 {
 	int chunk_size = MAX_CHUNK_BYTES / MSC_INST(dev)->blocksize;
-	int chunk;
+	int chunk, done = 0;
+
+	/* Pipeline larger reads where the controller supports it. */
+	if (CONFIG(LP_USB_MSC_QUEUED_READS) &&
+	    dir == cbw_direction_data_in && n > chunk_size &&
+	    dev->controller->bulk_queue && dma_coherent(buf) &&
+	    !(MSC_INST(dev)->quirks & USB_MSC_QUIRK_NO_RESET) &&
+	    !MSC_INST(dev)->queued_reads_failed) {
+		done = read_blocks_queued(dev, start, n, buf);
+		if (done < 0)
+			return 1;
+	}
 
 	/* Read as many full chunks as needed. */
-	for (chunk = 0; chunk < (n / chunk_size); chunk++) {
+	for (chunk = done / chunk_size; chunk < (n / chunk_size); chunk++) {
 		if (readwrite_chunk(dev, start + (chunk * chunk_size),
 				     chunk_size, dir,
 				     buf + (chunk * MAX_CHUNK_BYTES))
@@ -414,7 +531,7 @@ readwrite_blocks(usbdev_t *dev, int start, int n, cbw_direction dir, u8 *buf)
 	}
 
 	/* Read any remaining partial chunk at the end. */
-	if (n % chunk_size) {
+	if ((n % chunk_size) && done < n) {
 		if (readwrite_chunk(dev, start + (chunk * chunk_size),
 				     n % chunk_size, dir,
 				     buf + (chunk * MAX_CHUNK_BYTES))
@@ -651,6 +768,7 @@ void usb_msc_force_init(usbdev_t *dev, u32 quirks)
 	MSC_INST(dev)->bulk_out = 0;
 	MSC_INST(dev)->usbdisk_created = 0;
 	MSC_INST(dev)->quirks = quirks;
+	MSC_INST(dev)->queued_reads_failed = 0;
 
 	for (i = 1; i <= dev->num_endp; i++) {
 		if (dev->endpoints[i].endpoint == 0)
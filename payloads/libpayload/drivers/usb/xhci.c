@@ -40,6 +40,9 @@ static void xhci_reset(hci_t *controller);
 static void xhci_reinit(hci_t *controller);
 static void xhci_shutdown(hci_t *controller);
 static int xhci_bulk(endpoint_t *ep, int size, u8 *data, int finalize);
+static int xhci_bulk_queue(endpoint_t *ep, int size, u8 *data);
+static int xhci_bulk_wait(endpoint_t *ep);
+static void xhci_bulk_cancel(endpoint_t *ep);
 static int xhci_control(usbdev_t *dev, direction_t dir, int drlen, void *devreq,
 			 int dalen, u8 *data);
 static void* xhci_create_intr_queue(endpoint_t *ep, int reqsize, int reqcount, int reqtiming);
@@ -165,6 +168,9 @@ xhci_init(unsigned long physical_bar)
 	controller->init		= xhci_reinit;
 	controller->shutdown		= xhci_shutdown;
 	controller->bulk		= xhci_bulk;
+	controller->bulk_queue		= xhci_bulk_queue;
+	controller->bulk_wait		= xhci_bulk_wait;
+	controller->bulk_cancel		= xhci_bulk_cancel;
 	controller->control		= xhci_control;
 	controller->set_address		= xhci_set_address;
 	controller->finish_device_config = xhci_finish_device_config;
@@ -794,6 +800,111 @@ xhci_bulk(endpoint_t *const ep, const int size, u8 *const src,
 	return ret;
 }
 
+/*
+ * Queue a bulk transfer without waiting for it. Only works for DMA coherent
+ * buffers and as long as the transfer ring has room; returns -1 otherwise,
+ * in which case the caller can still use xhci_bulk().
+ */
+static int
+xhci_bulk_queue(endpoint_t *const ep, const int size, u8 *const data)
+{
+	xhci_t *const xhci = XHCI_INST(ep->dev->controller);
+	const int slot_id = ep->dev->address;
+	const int ep_id = xhci_ep_id(ep);
+	epctx_t *const epctx = xhci->dev[slot_id].ctx.ep[ep_id];
+	transfer_ring_t *const tr = xhci->dev[slot_id].transfer_rings[ep_id];
+	bulkq_t *bulkq = xhci->dev[slot_id].bulk_queues[ep_id];
+
+	if (!dma_coherent(data))
+		return -1;
+
+	if (!bulkq) {
+		bulkq = malloc(sizeof(*bulkq));
+		if (!bulkq)
+			return -1;
+		memset(bulkq, 0, sizeof(*bulkq));
+		xhci->dev[slot_id].bulk_queues[ep_id] = bulkq;
+	}
+
+	/* One TRB per 64KiB boundary crossed, plus the Event Data TRB */
+	const size_t off = (size_t)data & 0xffff;
+	const int trbs = MAX((off + size + 0xffff) >> 16, 1) + 1;
+	if (bulkq->count == BULKQ_SIZE ||
+			bulkq->trbs + trbs > TRANSFER_RING_SIZE - 2)
+		return -1;
+
+	/* Reset endpoint if it's not running and nothing is queued */
+	if (EC_GET(STATE, epctx) > 1) {
+		if (bulkq->count || xhci_reset_endpoint(ep->dev, ep))
+			return -1;
+	}
+
+	const unsigned mps = EC_GET(MPS, epctx);
+	const unsigned dir = (ep->direction == OUT) ? TRB_DIR_OUT : TRB_DIR_IN;
+	xhci_enqueue_td(tr, ep_id, mps, size, data, dir);
+	xhci_ring_doorbell(ep);
+
+	const int i = (bulkq->head + bulkq->count++) % BULKQ_SIZE;
+	bulkq->td[i].trbs = trbs;
+	bulkq->trbs += trbs;
+	return 0;
+}
+
+/* Wait for the oldest transfer queued by xhci_bulk_queue() */
+static int
+xhci_bulk_wait(endpoint_t *const ep)
+{
+	xhci_t *const xhci = XHCI_INST(ep->dev->controller);
+	const int slot_id = ep->dev->address;
+	const int ep_id = xhci_ep_id(ep);
+	bulkq_t *const bulkq = xhci->dev[slot_id].bulk_queues[ep_id];
+
+	if (!bulkq || !bulkq->count)
+		return -1;
+
+	/* Events for this endpoint end up here, all others in the queues */
+	if (!bulkq->completed) {
+		const int ret = xhci_wait_for_transfer(xhci, slot_id, ep_id);
+		if (ret == TIMEOUT) {
+			xhci_debug("Queued bulk transfer on ID %d EP %d timed out\n",
+				   slot_id, ep_id);
+			return ret;
+		}
+		bulkq->td[bulkq->head].result = ret;
+		bulkq->completed++;
+	}
+
+	const int ret = bulkq->td[bulkq->head].result;
+	bulkq->trbs -= bulkq->td[bulkq->head].trbs;
+	bulkq->head = (bulkq->head + 1) % BULKQ_SIZE;
+	bulkq->count--;
+	bulkq->completed--;
+	return ret;
+}
+
+/* Drop all queued transfers and reset the transfer ring */
+static void
+xhci_bulk_cancel(endpoint_t *const ep)
+{
+	xhci_t *const xhci = XHCI_INST(ep->dev->controller);
+	const int slot_id = ep->dev->address;
+	const int ep_id = xhci_ep_id(ep);
+	epctx_t *const epctx = xhci->dev[slot_id].ctx.ep[ep_id];
+	bulkq_t *const bulkq = xhci->dev[slot_id].bulk_queues[ep_id];
+
+	if (!bulkq || !bulkq->count)
+		return;
+
+	bulkq->head = 0;
+	bulkq->count = 0;
+	bulkq->completed = 0;
+	bulkq->trbs = 0;
+
+	if (EC_GET(STATE, epctx) == 1)
+		xhci_cmd_stop_endpoint(xhci, slot_id, ep_id);
+	xhci_reset_endpoint(ep->dev, ep);
+}
+
 static trb_t *
 xhci_next_trb(trb_t *cur, int *const pcs)
 {
@@ -86,6 +86,7 @@ xhci_handle_transfer_event(xhci_t *const xhci)
 	const int ep = TRB_GET(EP, ev);
 
 	intrq_t *intrq;
+	bulkq_t *bulkq;
 
 	if (id && id <= xhci->max_slots_en &&
 			(intrq = xhci->dev[id].interrupt_queues[ep])) {
@@ -101,6 +102,15 @@ xhci_handle_transfer_event(xhci_t *const xhci)
 		}
 	} else if (cc == CC_STOPPED || cc == CC_STOPPED_LENGTH_INVALID) {
 		/* Ignore 'Forced Stop Events' */
+	} else if (id && id <= xhci->max_slots_en &&
+			(bulkq = xhci->dev[id].bulk_queues[ep]) &&
+			bulkq->completed < bulkq->count) {
+		/* It's a queued bulk transfer, keep the result for bulk_wait() */
+		const int i = (bulkq->head + bulkq->completed++) % BULKQ_SIZE;
+		if (cc == CC_SUCCESS || cc == CC_SHORT_PACKET)
+			bulkq->td[i].result = TRB_GET(EVTL, ev);
+		else
+			bulkq->td[i].result = -cc;
 	} else {
 		xhci_debug("Warning: "
 			   "Spurious transfer event for ID %d, EP %d:\n"
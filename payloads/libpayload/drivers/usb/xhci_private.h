@@ -306,10 +306,23 @@ typedef struct intrq {
 	endpoint_t *ep;
 } intrq_t;
 
+#define BULKQ_SIZE 8
+typedef struct bulkq {
+	struct {
+		int trbs;	/* TRBs used on the transfer ring */
+		int result;	/* Transferred length or negative completion code */
+	} td[BULKQ_SIZE];
+	int head;	/* The oldest transfer not returned by bulk_wait() yet */
+	int count;	/* The number of transfers queued */
+	int completed;	/* The number of those the controller has finished */
+	int trbs;	/* TRBs used by all queued transfers */
+} bulkq_t;
+
 typedef struct devinfo {
 	devctx_t ctx;
 	transfer_ring_t *transfer_rings[NUM_EPS];
 	intrq_t *interrupt_queues[NUM_EPS];
+	bulkq_t *bulk_queues[NUM_EPS];
 } devinfo_t;
 
 typedef struct erst_entry {
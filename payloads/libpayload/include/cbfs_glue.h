@@ -10,6 +10,7 @@
 
 #define CBFS_ENABLE_HASHING CONFIG(LP_CBFS_VERIFICATION)
 #define CBFS_HASH_HWCRYPTO cbfs_hwcrypto_allowed()
+#define CBFS_MCACHE_INDEX 0
 
 #define ERROR(...) printf("CBFS ERROR: " __VA_ARGS__)
 #define LOG(...) printf("CBFS: " __VA_ARGS__)
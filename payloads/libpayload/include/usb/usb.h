@@ -255,6 +255,15 @@ struct usbdev_hc {
 	void (*shutdown) (hci_t *controller);
 
 	int (*bulk) (endpoint_t *ep, int size, u8 *data, int finalize);
+	/* bulk_queue():		Optional. Queue a bulk transfer without
+					waiting for it, returns <0 if it can't
+					and bulk() has to be used instead.
+	   bulk_wait():			Wait for the oldest queued transfer on
+					the endpoint, returns like bulk().
+	   bulk_cancel():		Drop all queued transfers. */
+	int (*bulk_queue) (endpoint_t *ep, int size, u8 *data);
+	int (*bulk_wait) (endpoint_t *ep);
+	void (*bulk_cancel) (endpoint_t *ep);
 	int (*control) (usbdev_t *dev, direction_t pid, int dr_length,
 			void *devreq, int data_length, u8 *data);
 	void* (*create_intr_queue) (endpoint_t *ep, int reqsize, int reqcount, int reqtiming);
@@ -35,6 +35,7 @@ typedef struct {
 	endpoint_t *bulk_out;
 	u8 quirks		: 7;
 	u8 usbdisk_created	: 1;
+	u8 queued_reads_failed	: 1; /* Don't queue reads ahead anymore. */
 	s8 ready;
 	u8 lun;
 	u8 num_luns;
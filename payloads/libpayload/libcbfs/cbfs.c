@@ -6,6 +6,7 @@
 #include <cbfs.h>
 #include <cbfs_glue.h>
 #include <commonlib/bsd/cbfs_private.h>
+#include <commonlib/bsd/compression.h>
 #include <commonlib/bsd/fmap_serialized.h>
 #include <libpayload.h>
 #include <lz4.h>
@@ -137,6 +138,11 @@ static size_t cbfs_load_and_decompress(size_t offset, size_t in_size, void *buff
 			goto out;
 		out_size = ulzman(load, in_size, buffer, buffer_size);
 		break;
+	case CBFS_COMPRESS_ZSTD:
+		if (!CONFIG(LP_ZSTD))
+			goto out;
+		out_size = uzstdn(load, in_size, buffer, buffer_size);
+		break;
 	default:
 		ERROR("'%s' decompression algo %d not supported\n", mdata->h.filename,
 		      compression);
@@ -28,6 +28,7 @@
 #include <device/pci.h>
 #include <pc80/mc146818rtc.h>
 #include <string.h>
+#include <table_cache.h>
 #include <types.h>
 #include <version.h>
 
@@ -2014,7 +2015,10 @@ unsigned long write_acpi_tables(unsigned long start)
 
 	printk(BIOS_DEBUG, "ACPI:     * SSDT\n");
 	ssdt = (acpi_header_t *)current;
-	acpi_create_ssdt_generator(ssdt, ACPI_TABLE_CREATOR);
+	if (!table_cache_load(TABLE_CACHE_SSDT, ssdt)) {
+		acpi_create_ssdt_generator(ssdt, ACPI_TABLE_CREATOR);
+		table_cache_store(TABLE_CACHE_SSDT, ssdt, ssdt->length);
+	}
 	if (ssdt->length > sizeof(acpi_header_t)) {
 		current += ssdt->length;
 		acpi_add_table(rsdp, ssdt);
@@ -196,9 +196,8 @@ void acpigen_write_name_unicode(const char *name, const char *string)
 
 void acpigen_emit_stream(const char *data, int size)
 {
-	int i;
-	for (i = 0; i < size; i++)
-		acpigen_emit_byte(data[i]);
+	memcpy(gencurrent, data, size);
+	gencurrent += size;
 }
 
 void acpigen_emit_string(const char *string)
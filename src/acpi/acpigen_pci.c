@@ -6,6 +6,8 @@
 #include <device/device.h>
 #include <device/pci_def.h>
 #include <device/pci_type.h>
+#include <endian.h>
+#include <string.h>
 #include <types.h>
 
 void acpigen_write_ADR_pci_devfn(pci_devfn_t devfn)
@@ -25,6 +27,70 @@ void acpigen_write_ADR_pci_device(const struct device *dev)
 	acpigen_write_ADR_pci_devfn(dev->path.pci.devfn);
 }
 
+/*
+ * Device (name) { Name (_ADR, adr) Method (_STA, 0, NotSerialized) { Return (status) } }
+ * encoded exactly like the acpigen calls would do it. Everything apart from the name, the
+ * address and the status is constant, so the compiler does the encoding.
+ */
+struct pci_device_aml {
+	uint8_t device_op[2];
+	uint8_t device_len[3];
+	char name[4];
+	uint8_t adr_name_op;
+	char adr_name[4];
+	uint8_t adr_prefix;
+	uint64_t adr;
+	uint8_t sta_method_op;
+	uint8_t sta_len[3];
+	char sta_name[4];
+	uint8_t sta_flags;
+	uint8_t sta_return_op;
+	uint8_t sta_prefix;
+	uint8_t status;
+} __packed;
+
+/* Length of a package which starts at member and ends with the device */
+#define AML_LEN(member) (sizeof(struct pci_device_aml) - offsetof(struct pci_device_aml, member))
+
+/* Package length as acpigen_pop_len() writes it, always three bytes */
+#define AML_PKG_LEN(len) { 0x80 | ((len) & 0xf), (len) >> 4 & 0xff, (len) >> 12 & 0xff }
+
+static const struct pci_device_aml pci_device_aml_template = {
+	.device_op	= { EXT_OP_PREFIX, DEVICE_OP },
+	.device_len	= AML_PKG_LEN(AML_LEN(device_len)),
+	.adr_name_op	= NAME_OP,
+	.adr_name	= { '_', 'A', 'D', 'R' },
+	.adr_prefix	= QWORD_PREFIX,
+	.sta_method_op	= METHOD_OP,
+	.sta_len	= AML_PKG_LEN(AML_LEN(sta_len)),
+	.sta_name	= { '_', 'S', 'T', 'A' },
+	.sta_flags	= 0,
+	.sta_return_op	= RETURN_OP,
+	.sta_prefix	= BYTE_PREFIX,
+};
+
+void acpigen_write_pci_device(const char *name, pci_devfn_t devfn, uint8_t status)
+{
+	struct pci_device_aml aml;
+
+	/* Only a single NameSeg fits into the template. */
+	if (strlen(name) != sizeof(aml.name) || strchr(name, '.') || strchr(name, '\\') ||
+	    strchr(name, '^')) {
+		acpigen_write_device(name);
+		acpigen_write_ADR_pci_devfn(devfn);
+		acpigen_write_STA(status);
+		acpigen_pop_len(); /* Device */
+		return;
+	}
+
+	memcpy(&aml, &pci_device_aml_template, sizeof(aml));
+	memcpy(aml.name, name, sizeof(aml.name));
+	aml.adr = cpu_to_le64(PCI_SLOT(devfn) << 16 | PCI_FUNC(devfn));
+	aml.status = status;
+
+	acpigen_emit_stream((const char *)&aml, sizeof(aml));
+}
+
 void acpigen_write_PRT_GSI_entry(unsigned int pci_dev, unsigned int acpi_pin, unsigned int gsi)
 {
 	acpigen_write_package(4);
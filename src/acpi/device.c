@@ -1196,12 +1196,7 @@ void acpi_device_write_pci_dev(const struct device *dev)
 	assert(scope);
 
 	acpigen_write_scope(scope);
-	acpigen_write_device(name);
-
-	acpigen_write_ADR_pci_device(dev);
-	acpigen_write_STA(acpi_device_status(dev));
-
-	acpigen_pop_len(); /* Device */
+	acpigen_write_pci_device(name, dev->path.pci.devfn, acpi_device_status(dev));
 	acpigen_pop_len(); /* Scope */
 }
 
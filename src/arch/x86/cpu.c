@@ -186,6 +186,7 @@ static void identify_cpu(struct device *cpu)
 			break;
 		}
 	}
+	dev_index_invalidate();
 }
 
 struct cpu_driver *find_cpu_driver(struct device *cpu)
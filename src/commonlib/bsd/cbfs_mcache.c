@@ -21,11 +21,21 @@
  * metadata (entry->file.h.offset). The next mcache_entry begins at the next
  * CBFS_MCACHE_ALIGNMENT boundary after that. The cache is terminated by a special 4-byte
  * mcache_entry that consists only of a magic number (MCACHE_MAGIC_END or MCACHE_MAGIC_FULL).
+ *
+ * If CBFS_MCACHE_INDEX is enabled and the cache was terminated with MCACHE_MAGIC_END, the space
+ * left over at the end of the cache may hold a hash index over the file names. It is placed
+ * flush with the end of the cache: an open-addressing table of uint32_t entry offsets (relative
+ * to the cache start, MCACHE_INDEX_EMPTY for free buckets), followed by a struct mcache_index.
+ * When the cache is copied with cbfs_mcache_copy(), the index moves to directly behind the
+ * terminator so that it is again flush with the end of the (now smaller) cache.
  */
 
 #define MCACHE_MAGIC_FILE	0x454c4946	/* 'FILE' */
 #define MCACHE_MAGIC_FULL	0x4c4c5546	/* 'FULL' */
 #define MCACHE_MAGIC_END	0x444e4524	/* '$END' */
+#define MCACHE_MAGIC_INDEX	0x58444948	/* 'HIDX' */
+
+#define MCACHE_INDEX_EMPTY	0xffffffff
 
 union mcache_entry {
 	union cbfs_mdata file;
@@ -35,6 +45,115 @@ union mcache_entry {
 	};
 };
 
+struct mcache_index {
+	uint32_t entries_size;	/* Offset of the terminating MCACHE_MAGIC_END. */
+	uint32_t buckets;	/* Power of two. Bucket array sits directly before this struct. */
+	uint32_t magic;
+};
+
+/* FNV-1a. Cheap, and good enough to spread short file names over a sparse table. */
+static uint32_t mcache_name_hash(const char *name)
+{
+	uint32_t hash = 0x811c9dc5;
+
+	while (*name) {
+		hash ^= (uint8_t)*name++;
+		hash *= 0x01000193;
+	}
+
+	return hash;
+}
+
+static const struct mcache_index *mcache_get_index(const void *mcache, size_t mcache_size)
+{
+	const void *end = mcache + ALIGN_DOWN(mcache_size, CBFS_MCACHE_ALIGNMENT);
+	const struct mcache_index *index;
+	size_t table_size;
+
+	if (end - mcache < sizeof(*index))
+		return NULL;
+
+	index = end - sizeof(*index);
+	if (index->magic != MCACHE_MAGIC_INDEX)
+		return NULL;
+
+	/* Only trust the index if it is consistent with the entries in front of it. */
+	table_size = (size_t)index->buckets * sizeof(uint32_t);
+	if (!index->buckets || (index->buckets & (index->buckets - 1)) ||
+	    table_size > (const void *)index - mcache ||
+	    (size_t)index->entries_size + sizeof(uint32_t) >
+		    (size_t)((const void *)index - table_size - mcache) ||
+	    !IS_ALIGNED(index->entries_size, CBFS_MCACHE_ALIGNMENT) ||
+	    *(const uint32_t *)(mcache + index->entries_size) != MCACHE_MAGIC_END)
+		return NULL;
+
+	return index;
+}
+
+static const uint32_t *mcache_index_table(const struct mcache_index *index)
+{
+	return (const uint32_t *)index - index->buckets;
+}
+
+/*
+ * Return the location for the index trailer of an mcache terminated at |terminator|, or NULL
+ * if it would overlap live data. The trailer is cleared so that no stale index left in the
+ * buffer from an earlier boot can be picked up.
+ */
+static struct mcache_index *mcache_index_slot(void *mcache, size_t mcache_size,
+					      void *terminator)
+{
+	void *end = mcache + ALIGN_DOWN(mcache_size, CBFS_MCACHE_ALIGNMENT);
+	struct mcache_index *index;
+
+	/* If the trailer overlaps live data, mcache_get_index() will reject it anyway. */
+	if (end - (terminator + sizeof(uint32_t)) < sizeof(*index))
+		return NULL;
+
+	index = end - sizeof(*index);
+	index->magic = 0;
+
+	return index;
+}
+
+/* Build the name index into the unused space at the end of the mcache, if it fits. */
+static void mcache_build_index(void *mcache, struct mcache_index *index, void *terminator,
+			       uint32_t count)
+{
+	void *free_space = terminator + sizeof(uint32_t);
+	uint32_t *table;
+	uint32_t buckets = 1;
+	void *current;
+
+	/* Keep the load factor at or below 3/4 so that probe sequences stay short. */
+	while (buckets * 3 < count * 4)
+		buckets <<= 1;
+
+	if ((void *)index - free_space < buckets * sizeof(uint32_t)) {
+		LOG("mcache has no room for a %u bucket name index\n", buckets);
+		return;
+	}
+
+	index->entries_size = terminator - mcache;
+	index->buckets = buckets;
+	table = (uint32_t *)index - buckets;
+	for (uint32_t i = 0; i < buckets; i++)
+		table[i] = MCACHE_INDEX_EMPTY;
+
+	for (current = mcache; current < terminator;) {
+		const union mcache_entry *entry = current;
+		uint32_t bucket = mcache_name_hash(entry->file.h.filename) & (buckets - 1);
+
+		while (table[bucket] != MCACHE_INDEX_EMPTY)
+			bucket = (bucket + 1) & (buckets - 1);
+		table[bucket] = current - mcache;
+
+		current += ALIGN_UP(be32toh(entry->file.h.offset), CBFS_MCACHE_ALIGNMENT);
+	}
+
+	index->magic = MCACHE_MAGIC_INDEX;
+}
+
 struct cbfs_mcache_build_args {
 	void *mcache;
 	void *end;
@@ -84,17 +203,78 @@ enum cb_err cbfs_mcache_build(cbfs_dev_t dev, void *mcache, size_t size,
 		entry->magic = MCACHE_MAGIC_FULL;
 	}
 
+	struct mcache_index *index = mcache_index_slot(mcache, size, entry);
+	if (CBFS_MCACHE_INDEX && index && entry->magic == MCACHE_MAGIC_END)
+		mcache_build_index(mcache, index, entry, args.count);
+
 	LOG("mcache @%p built for %d files, used %#zx of %#zx bytes\n", mcache,
 	    args.count, args.mcache + sizeof(entry->magic) - mcache, size);
 	return ret;
 }
 
+static bool mcache_entry_matches(const union mcache_entry *entry, const char *name,
+				 size_t namesize)
+{
+	const uint32_t data_offset = be32toh(entry->file.h.offset);
+
+	return namesize <= data_offset - offsetof(union cbfs_mdata, h.filename) &&
+	       memcmp(name, entry->file.h.filename, namesize) == 0;
+}
+
+static enum cb_err mcache_found(const union mcache_entry *entry, const char *name,
+				union cbfs_mdata *mdata_out, size_t *data_offset_out)
+{
+	const uint32_t data_offset = be32toh(entry->file.h.offset);
+
+	LOG("Found '%s' @%#x size %#x in mcache @%p\n",
+	    name, entry->offset, be32toh(entry->file.h.len), entry);
+	*data_offset_out = entry->offset + data_offset;
+	memcpy(mdata_out, &entry->file, data_offset);
+	return CB_SUCCESS;
+}
+
+static enum cb_err mcache_index_lookup(const void *mcache, const struct mcache_index *index,
+				       const char *name, size_t namesize,
+				       union cbfs_mdata *mdata_out, size_t *data_offset_out)
+{
+	const uint32_t *table = mcache_index_table(index);
+	const uint32_t mask = index->buckets - 1;
+	uint32_t bucket = mcache_name_hash(name) & mask;
+
+	for (uint32_t probes = 0; probes < index->buckets; probes++) {
+		const uint32_t entry_offset = table[bucket];
+
+		if (entry_offset == MCACHE_INDEX_EMPTY)
+			return CB_CBFS_NOT_FOUND;
+		if (entry_offset >= index->entries_size)
+			break;
+
+		const union mcache_entry *entry = mcache + entry_offset;
+		assert(entry->magic == MCACHE_MAGIC_FILE);
+		if (mcache_entry_matches(entry, name, namesize))
+			return mcache_found(entry, name, mdata_out, data_offset_out);
+
+		bucket = (bucket + 1) & mask;
+	}
+
+	ERROR("CBFS mcache index is corrupt!\n");	/* should never happen */
+	return CB_ERR;
+}
+
 enum cb_err cbfs_mcache_lookup(const void *mcache, size_t mcache_size, const char *name,
 			       union cbfs_mdata *mdata_out, size_t *data_offset_out)
 {
 	const size_t namesize = strlen(name) + 1; /* Count trailing \0 so we can memcmp() it. */
 	const void *end = mcache + mcache_size;
 	const void *current = mcache;
+	const struct mcache_index *index = mcache_get_index(mcache, mcache_size);
+
+	if (index) {
+		enum cb_err err = mcache_index_lookup(mcache, index, name, namesize,
+						      mdata_out, data_offset_out);
+		if (err != CB_ERR)
+			return err;
+	}
 
 	while (current + sizeof(uint32_t) <= end) {
 		const union mcache_entry *entry = current;
@@ -105,25 +285,17 @@ enum cb_err cbfs_mcache_lookup(const void *mcache, size_t mcache_size, const cha
 			return CB_CBFS_CACHE_FULL;
 
 		assert(entry->magic == MCACHE_MAGIC_FILE);
-		const uint32_t data_offset = be32toh(entry->file.h.offset);
-		const uint32_t data_length = be32toh(entry->file.h.len);
-		if (namesize <= data_offset - offsetof(union cbfs_mdata, h.filename) &&
-		    memcmp(name, entry->file.h.filename, namesize) == 0) {
-			LOG("Found '%s' @%#x size %#x in mcache @%p\n",
-			    name, entry->offset, data_length, current);
-			*data_offset_out = entry->offset + data_offset;
-			memcpy(mdata_out, &entry->file, data_offset);
-			return CB_SUCCESS;
-		}
+		if (mcache_entry_matches(entry, name, namesize))
+			return mcache_found(entry, name, mdata_out, data_offset_out);
 
-		current += ALIGN_UP(data_offset, CBFS_MCACHE_ALIGNMENT);
+		current += ALIGN_UP(be32toh(entry->file.h.offset), CBFS_MCACHE_ALIGNMENT);
 	}
 
 	ERROR("CBFS mcache is not terminated!\n");	/* should never happen */
 	return CB_ERR;
 }
 
-size_t cbfs_mcache_real_size(const void *mcache, size_t mcache_size)
+static size_t mcache_entries_size(const void *mcache, size_t mcache_size)
 {
 	const void *end = mcache + mcache_size;
 	const void *current = mcache;
@@ -142,3 +314,27 @@ size_t cbfs_mcache_real_size(const void *mcache, size_t mcache_size)
 
 	return current - mcache;
 }
+
+size_t cbfs_mcache_real_size(const void *mcache, size_t mcache_size)
+{
+	const struct mcache_index *index = mcache_get_index(mcache, mcache_size);
+	size_t size = mcache_entries_size(mcache, mcache_size);
+
+	if (index)
+		size += index->buckets * sizeof(uint32_t) + sizeof(*index);
+
+	return size;
+}
+
+void cbfs_mcache_copy(void *dst, const void *mcache, size_t mcache_size)
+{
+	const struct mcache_index *index = mcache_get_index(mcache, mcache_size);
+	const size_t entries_size = mcache_entries_size(mcache, mcache_size);
+
+	memcpy(dst, mcache, entries_size);
+
+	/* Entry offsets in the index are relative to the mcache start and stay valid. */
+	if (index)
+		memcpy(dst + entries_size, mcache_index_table(index),
+		       index->buckets * sizeof(uint32_t) + sizeof(*index));
+}
@@ -30,6 +30,9 @@
  * CBFS_HASH_HWCRYPTO	Should evaluate to true to allow using vboot hardware crypto routines
  *			for hashing, false to forbid. This macro may expand to a function call
  *			to decide this at runtime.
+ * CBFS_MCACHE_INDEX	Should be 1 to have cbfs_mcache_build() add a file name hash index
+ *			to the mcache if it fits, 0 otherwise. (Lookups always use an index
+ *			that is present, no matter who built it.)
  * ERROR(...)		printf-style macro to print errors.
  * LOG(...)		printf-style macro to print normal-operation log messages.
  * DEBUG(...)		printf-style macro to print detailed debug output.
@@ -121,4 +124,8 @@ enum cb_err cbfs_mcache_lookup(const void *mcache, size_t mcache_size, const cha
 /* Returns the amount of bytes actually used by the CBFS metadata cache in |mcache|. */
 size_t cbfs_mcache_real_size(const void *mcache, size_t mcache_size);
 
+/* Copy the CBFS metadata cache in |mcache| into a cbfs_mcache_real_size() bytes large buffer
+ * at |dst|, keeping its name index (if any) usable. */
+void cbfs_mcache_copy(void *dst, const void *mcache, size_t mcache_size);
+
 #endif	/* _COMMONLIB_BSD_CBFS_PRIVATE_H_ */
@@ -18,4 +18,12 @@ size_t ulz4fn(const void *src, size_t srcn, void *dst, size_t dstn);
 /* Same as ulz4fn() but does not perform any bounds checks. */
 size_t ulz4f(const void *src, void *dst);
 
+/* Decompresses a Zstandard image (one or more frames) from src to dst, ensuring that it
+ * doesn't read more than srcn bytes and doesn't write more than dstn. Dictionaries are not
+ * supported and the whole output must fit into dst, since it also serves as the window.
+ * Not reentrant, and the buffers must not overlap.
+ * Returns amount of decompressed bytes, or 0 on error.
+ */
+size_t uzstdn(const void *src, size_t srcn, void *dst, size_t dstn);
+
 #endif	/* _COMMONLIB_COMPRESSION_H_ */
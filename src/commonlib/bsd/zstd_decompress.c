@@ -0,0 +1,980 @@
+/* SPDX-License-Identifier: BSD-3-Clause OR GPL-2.0-only */
+
+/*
+ * Zstandard decoder (RFC 8878). This is deliberately not a complete implementation: it
+ * decompresses whole frames into one output buffer, which doubles as the match window, so
+ * it needs no window or block buffers. Huffman-coded literals are decoded into the unused
+ * end of that buffer before the sequences of their block are executed. Dictionaries are
+ * not supported and the optional content checksum is skipped, not verified (CBFS has its
+ * own hashes). All tables live in a static workspace, which makes it non-reentrant.
+ */
+
+#include <commonlib/bsd/compression.h>
+#include <commonlib/bsd/helpers.h>
+#include <commonlib/bsd/sysincludes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#define ZSTD_MAGIC		0xfd2fb528
+#define SKIPPABLE_MAGIC		0x184d2a50
+#define SKIPPABLE_MAGIC_MASK	0xfffffff0
+
+#define FHD_FCS_FLAG(fhd)	((fhd) >> 6)
+#define FHD_SINGLE_SEGMENT	(1 << 5)
+#define FHD_RESERVED		(1 << 3)
+#define FHD_CHECKSUM		(1 << 2)
+#define FHD_DICT_ID_FLAG(fhd)	((fhd) & 0x3)
+
+enum block_type {
+	BLOCK_RAW = 0,
+	BLOCK_RLE = 1,
+	BLOCK_COMPRESSED = 2,
+};
+#define BLOCK_SIZE_MAX		(128 * KiB)
+
+enum literals_type {
+	LITERALS_RAW = 0,
+	LITERALS_RLE = 1,
+	LITERALS_COMPRESSED = 2,
+	LITERALS_TREELESS = 3,
+};
+
+enum seq_mode {
+	SEQ_PREDEFINED = 0,
+	SEQ_RLE = 1,
+	SEQ_FSE = 2,
+	SEQ_REPEAT = 3,
+};
+
+#define HUF_LOG_MAX		11
+#define HUF_WEIGHTS_LOG_MAX	6
+#define HUF_SYMBOLS_MAX		256
+#define LL_LOG_MAX		9
+#define ML_LOG_MAX		9
+#define OF_LOG_MAX		8
+#define LL_SYMBOL_MAX		35
+#define ML_SYMBOL_MAX		52
+#define OF_SYMBOL_MAX		31
+
+static const int16_t ll_predefined[LL_SYMBOL_MAX + 1] = {
+	4, 3, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 1, 1, 1,
+	2, 2, 2, 2, 2, 2, 2, 2, 2, 3, 2, 1, 1, 1, 1, 1,
+	-1, -1, -1, -1,
+};
+#define LL_PREDEFINED_LOG	6
+
+static const int16_t ml_predefined[ML_SYMBOL_MAX + 1] = {
+	1, 4, 3, 2, 2, 2, 2, 2, 2, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, -1, -1,
+	-1, -1, -1, -1, -1,
+};
+#define ML_PREDEFINED_LOG	6
+
+static const int16_t of_predefined[] = {
+	1, 1, 1, 1, 1, 1, 2, 2, 2, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, -1, -1, -1, -1, -1,
+};
+#define OF_PREDEFINED_LOG	5
+
+static const uint32_t ll_base[LL_SYMBOL_MAX + 1] = {
+	0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
+	16, 18, 20, 22, 24, 28, 32, 40, 48, 64, 128, 256, 512, 1024, 2048, 4096,
+	8192, 16384, 32768, 65536,
+};
+
+static const uint8_t ll_bits[LL_SYMBOL_MAX + 1] = {
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	1, 1, 1, 1, 2, 2, 3, 3, 4, 6, 7, 8, 9, 10, 11, 12,
+	13, 14, 15, 16,
+};
+
+static const uint32_t ml_base[ML_SYMBOL_MAX + 1] = {
+	3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 18,
+	19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31, 32, 33, 34,
+	35, 37, 39, 41, 43, 47, 51, 59, 67, 83, 99, 131, 259, 515, 1027, 2051,
+	4099, 8195, 16387, 32771, 65539,
+};
+
+static const uint8_t ml_bits[ML_SYMBOL_MAX + 1] = {
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	1, 1, 1, 1, 2, 2, 3, 3, 4, 4, 5, 7, 8, 9, 10, 11,
+	12, 13, 14, 15, 16,
+};
+
+struct fse_entry {
+	uint16_t base;
+	uint8_t symbol;
+	uint8_t nbits;
+};
+
+struct fse_table {
+	struct fse_entry *entries;
+	unsigned int log;
+	bool valid;
+};
+
+struct huf_entry {
+	uint8_t symbol;
+	uint8_t nbits;
+};
+
+static struct {
+	struct fse_entry ll_entries[1 << LL_LOG_MAX];
+	struct fse_entry ml_entries[1 << ML_LOG_MAX];
+	struct fse_entry of_entries[1 << OF_LOG_MAX];
+	struct fse_entry weights_entries[1 << HUF_WEIGHTS_LOG_MAX];
+	struct huf_entry huf[1 << HUF_LOG_MAX];
+	uint8_t weights[HUF_SYMBOLS_MAX];
+	unsigned int huf_log;
+	bool huf_valid;
+	struct fse_table ll, ml, of;
+	uint32_t rep[3];
+} ws;
+
+static inline unsigned int highbit(uint32_t x)
+{
+	return 31 - __builtin_clz(x);
+}
+
+static inline uint32_t read_le16(const uint8_t *p)
+{
+	return p[0] | p[1] << 8;
+}
+
+static inline uint32_t read_le24(const uint8_t *p)
+{
+	return read_le16(p) | p[2] << 16;
+}
+
+static inline uint32_t read_le32(const uint8_t *p)
+{
+	return read_le24(p) | (uint32_t)p[3] << 24;
+}
+
+static inline uint64_t read_le64(const uint8_t *p)
+{
+	uint64_t v;
+
+	memcpy(&v, p, sizeof(v));
+	return le64toh(v);
+}
+
+/*
+ * Backward bitstream as used by FSE and Huffman coded data: it is read from the end and the
+ * highest set bit of the last byte marks where the data starts. Bits are taken from the top
+ * of a 64-bit container, |consumed| counts how many of them have been used up already.
+ * Reading past the start of the stream yields zeroes and makes |consumed| exceed 64.
+ */
+struct bitstream {
+	const uint8_t *start;
+	const uint8_t *ptr;
+	uint64_t container;
+	unsigned int consumed;
+};
+
+static bool bits_init(struct bitstream *bs, const uint8_t *src, size_t size)
+{
+	size_t i;
+
+	if (size == 0 || src[size - 1] == 0)
+		return false;
+
+	bs->start = src;
+	bs->consumed = 8 - highbit(src[size - 1]);
+	if (size >= sizeof(bs->container)) {
+		bs->ptr = src + size - sizeof(bs->container);
+		bs->container = read_le64(bs->ptr);
+	} else {
+		/* Short streams are loaded as if the missing top bytes were already used up. */
+		bs->ptr = src;
+		bs->container = 0;
+		for (i = 0; i < size; i++)
+			bs->container |= (uint64_t)src[i] << (8 * i);
+		bs->consumed += 8 * (sizeof(bs->container) - size);
+	}
+
+	return true;
+}
+
+/* Refill the container. Returns false once more bits were read than the stream has. */
+static inline bool bits_reload(struct bitstream *bs)
+{
+	size_t nbytes;
+
+	if (bs->consumed > 64)
+		return false;
+	if (bs->ptr == bs->start)
+		return true;
+
+	nbytes = MIN((size_t)(bs->consumed / 8), (size_t)(bs->ptr - bs->start));
+	bs->ptr -= nbytes;
+	bs->consumed -= nbytes * 8;
+	bs->container = read_le64(bs->ptr);
+
+	return true;
+}
+
+/* |n| may be 0. The caller has to reload often enough that |consumed| + |n| <= 64. */
+static inline uint32_t bits_peek(const struct bitstream *bs, unsigned int n)
+{
+	if (bs->consumed >= 64)
+		return 0;
+	return (bs->container << bs->consumed) >> 1 >> (63 - n);
+}
+
+static inline uint32_t bits_read(struct bitstream *bs, unsigned int n)
+{
+	uint32_t v = bits_peek(bs, n);
+
+	bs->consumed += n;
+	return v;
+}
+
+static bool bits_finished(struct bitstream *bs)
+{
+	bits_reload(bs);
+	return bs->ptr == bs->start && bs->consumed == 64;
+}
+
+/* Little-endian forward bit reader, only used for FSE table descriptions. */
+static uint32_t fwd_bits_peek(const uint8_t *src, size_t size, size_t pos, unsigned int n)
+{
+	uint32_t v = 0;
+	size_t i;
+
+	for (i = 0; i < 4 && pos / 8 + i < size; i++)
+		v |= (uint32_t)src[pos / 8 + i] << (8 * i);
+
+	return (v >> (pos % 8)) & ((1U << n) - 1);
+}
+
+/*
+ * Reads the normalized counts of an FSE table description. On entry, |max_symbol| is the
+ * largest symbol allowed, on return it is the largest symbol described. Returns the number
+ * of bytes used, 0 on error.
+ */
+static size_t read_fse_counts(const uint8_t *src, size_t size, int16_t *counts,
+			      unsigned int *max_symbol, unsigned int *log, unsigned int log_max)
+{
+	unsigned int symbol = 0;
+	int remaining, threshold, nbits;
+	size_t pos = 0;
+
+	*log = fwd_bits_peek(src, size, pos, 4) + 5;
+	pos += 4;
+	if (*log > log_max)
+		return 0;
+
+	remaining = (1 << *log) + 1;
+	threshold = 1 << *log;
+	nbits = *log + 1;
+
+	while (remaining > 1) {
+		const int max = 2 * threshold - 1 - remaining;
+		int count = fwd_bits_peek(src, size, pos, nbits);
+
+		if ((count & (threshold - 1)) < max) {
+			count &= threshold - 1;
+			pos += nbits - 1;
+		} else {
+			if (count >= threshold)
+				count -= max;
+			pos += nbits;
+		}
+
+		/* Values are stored off by one, -1 stands for a "less than 1" probability. */
+		count--;
+		if (symbol > *max_symbol)
+			return 0;
+		counts[symbol++] = count;
+		remaining -= count < 0 ? -count : count;
+		if (remaining < 1)
+			return 0;
+
+		if (count == 0) {
+			unsigned int repeat;
+
+			/* Followed by 2-bit counts of further zeroes, 3 means another one follows. */
+			do {
+				unsigned int i;
+
+				repeat = fwd_bits_peek(src, size, pos, 2);
+				pos += 2;
+				if (symbol + repeat > *max_symbol + 1)
+					return 0;
+				for (i = 0; i < repeat; i++)
+					counts[symbol++] = 0;
+			} while (repeat == 3);
+		}
+
+		while (remaining < threshold) {
+			nbits--;
+			threshold >>= 1;
+		}
+	}
+
+	if (remaining != 1 || pos > size * 8)
+		return 0;
+
+	*max_symbol = symbol - 1;
+	return DIV_ROUND_UP(pos, 8);
+}
+
+static bool build_fse_table(struct fse_table *t, const int16_t *counts,
+			    unsigned int max_symbol, unsigned int log)
+{
+	const uint32_t size = 1 << log;
+	const uint32_t step = (size >> 1) + (size >> 3) + 3;
+	uint32_t high = size - 1, pos = 0, i;
+	uint16_t next[ML_SYMBOL_MAX + 1];
+	unsigned int s;
+	int j;
+
+	t->valid = false;
+
+	for (s = 0; s <= max_symbol; s++) {
+		if (counts[s] == -1) {
+			t->entries[high--].symbol = s;
+			next[s] = 1;
+		} else {
+			next[s] = counts[s];
+		}
+	}
+
+	for (s = 0; s <= max_symbol; s++) {
+		for (j = 0; j < counts[s]; j++) {
+			t->entries[pos].symbol = s;
+			do {
+				pos = (pos + step) & (size - 1);
+			} while (pos > high);
+		}
+	}
+	if (pos != 0)
+		return false;
+
+	for (i = 0; i < size; i++) {
+		struct fse_entry *e = &t->entries[i];
+		const uint32_t n = next[e->symbol]++;
+
+		e->nbits = log - highbit(n);
+		e->base = (n << e->nbits) - size;
+	}
+
+	t->log = log;
+	t->valid = true;
+
+	return true;
+}
+
+static inline uint8_t fse_decode(const struct fse_table *t, uint16_t *state,
+				 struct bitstream *bs)
+{
+	const struct fse_entry *e = &t->entries[*state];
+
+	*state = e->base + bits_read(bs, e->nbits);
+	return e->symbol;
+}
+
+/* Decodes FSE-compressed Huffman weights into ws.weights. Returns their number, 0 on error. */
+static size_t read_huf_weights_fse(const uint8_t *src, size_t size)
+{
+	struct fse_table t = { .entries = ws.weights_entries };
+	int16_t counts[HUF_LOG_MAX + 2];
+	unsigned int max_symbol = HUF_LOG_MAX + 1, log;
+	struct bitstream bs;
+	uint16_t state1, state2;
+	size_t n;
+
+	n = read_fse_counts(src, size, counts, &max_symbol, &log, HUF_WEIGHTS_LOG_MAX);
+	if (!n || !build_fse_table(&t, counts, max_symbol, log))
+		return 0;
+	if (!bits_init(&bs, src + n, size - n))
+		return 0;
+
+	state1 = bits_read(&bs, log);
+	state2 = bits_read(&bs, log);
+
+	/* The two interleaved states are decoded until the stream is overrun. */
+	n = 0;
+	while (1) {
+		if (n > HUF_SYMBOLS_MAX - 3)
+			return 0;
+		ws.weights[n++] = fse_decode(&t, &state1, &bs);
+		if (!bits_reload(&bs)) {
+			ws.weights[n++] = t.entries[state2].symbol;
+			break;
+		}
+		ws.weights[n++] = fse_decode(&t, &state2, &bs);
+		if (!bits_reload(&bs)) {
+			ws.weights[n++] = t.entries[state1].symbol;
+			break;
+		}
+	}
+
+	return n;
+}
+
+/* Reads a Huffman tree description and builds ws.huf. Returns the bytes used, 0 on error. */
+static size_t read_huf_table(const uint8_t *src, size_t size)
+{
+	uint32_t rank_start[HUF_LOG_MAX + 2] = { 0 };
+	uint32_t total = 0, rest;
+	size_t nweights, used, s;
+	unsigned int log, w;
+
+	if (size < 1)
+		return 0;
+
+	if (src[0] >= 128) {
+		nweights = src[0] - 127;
+		used = 1 + DIV_ROUND_UP(nweights, 2);
+		if (used > size)
+			return 0;
+		for (s = 0; s < nweights; s++)
+			ws.weights[s] = (src[1 + s / 2] >> (s % 2 ? 0 : 4)) & 0xf;
+	} else {
+		used = 1 + src[0];
+		if (used > size)
+			return 0;
+		nweights = read_huf_weights_fse(src + 1, src[0]);
+		if (!nweights)
+			return 0;
+	}
+
+	for (s = 0; s < nweights; s++) {
+		if (ws.weights[s] > HUF_LOG_MAX)
+			return 0;
+		if (ws.weights[s])
+			total += 1 << (ws.weights[s] - 1);
+	}
+	if (!total)
+		return 0;
+
+	/* The weight of the last symbol is implied by filling up to the next power of 2. */
+	log = highbit(total) + 1;
+	if (log > HUF_LOG_MAX)
+		return 0;
+	rest = (1 << log) - total;
+	if (rest & (rest - 1))
+		return 0;
+	ws.weights[nweights++] = highbit(rest) + 1;
+
+	/* Longer codes (smaller weights) come first, ties are sorted by symbol value. */
+	for (s = 0; s < nweights; s++) {
+		if (ws.weights[s])
+			rank_start[ws.weights[s]] += 1 << (ws.weights[s] - 1);
+	}
+	for (w = 1, total = 0; w <= log; w++) {
+		rest = rank_start[w];
+		rank_start[w] = total;
+		total += rest;
+	}
+
+	for (s = 0; s < nweights; s++) {
+		uint32_t i, len;
+
+		w = ws.weights[s];
+		if (!w)
+			continue;
+		len = 1 << (w - 1);
+		for (i = rank_start[w]; i < rank_start[w] + len; i++) {
+			ws.huf[i].symbol = s;
+			ws.huf[i].nbits = log + 1 - w;
+		}
+		rank_start[w] += len;
+	}
+
+	ws.huf_log = log;
+	ws.huf_valid = true;
+
+	return used;
+}
+
+static bool decode_huf_stream(const uint8_t *src, size_t size, uint8_t *dst, size_t dstn)
+{
+	const unsigned int log = ws.huf_log;
+	uint8_t *const end = dst + dstn;
+	struct bitstream bs;
+	struct huf_entry e;
+
+	if (!bits_init(&bs, src, size))
+		return false;
+
+#define HUF_DECODE_ONE()	do {				\
+		e = ws.huf[bits_peek(&bs, log)];		\
+		bs.consumed += e.nbits;				\
+		*dst++ = e.symbol;				\
+	} while (0)
+
+	while (end - dst >= 4) {
+		bits_reload(&bs);
+		HUF_DECODE_ONE();
+		HUF_DECODE_ONE();
+		HUF_DECODE_ONE();
+		HUF_DECODE_ONE();
+	}
+	while (dst < end) {
+		bits_reload(&bs);
+		HUF_DECODE_ONE();
+	}
+
+#undef HUF_DECODE_ONE
+
+	return bits_finished(&bs);
+}
+
+/*
+ * Decodes the literals section of a block. Raw literals are used in place, all others are
+ * decoded to the end of the output buffer [op, oend). Returns the bytes used, 0 on error.
+ */
+static size_t decode_literals(const uint8_t *src, size_t size, uint8_t *op, uint8_t *oend,
+			      const uint8_t **lits, size_t *lit_size)
+{
+	const enum literals_type type = src[0] & 0x3;
+	const unsigned int format = (src[0] >> 2) & 0x3;
+	size_t header, regen, csize, total, segment;
+	unsigned int streams = 4;
+	uint8_t *out;
+	uint64_t sizes;
+
+	if (type == LITERALS_RAW || type == LITERALS_RLE) {
+		switch (format) {
+		case 1:
+			header = 2;
+			break;
+		case 3:
+			header = 3;
+			break;
+		default:
+			header = 1;
+			break;
+		}
+		if (size < header + (type == LITERALS_RLE))
+			return 0;
+		if (header == 1)
+			regen = src[0] >> 3;
+		else
+			regen = (header == 2 ? read_le16(src) : read_le24(src)) >> 4;
+
+		if (type == LITERALS_RAW) {
+			if (regen > size - header)
+				return 0;
+			*lits = src + header;
+			*lit_size = regen;
+			return header + regen;
+		}
+
+		if (regen > (size_t)(oend - op))
+			return 0;
+		out = oend - regen;
+		memset(out, src[header], regen);
+		*lits = out;
+		*lit_size = regen;
+		return header + 1;
+	}
+
+	header = format < 2 ? 3 : format + 2;
+	if (size < header)
+		return 0;
+	sizes = (header == 3 ? read_le24(src) : read_le32(src)) >> 4;
+	if (header == 5)
+		sizes |= (uint64_t)src[4] << 28;
+	if (format == 0)
+		streams = 1;
+
+	/* Both sizes take 10, 10, 14 or 18 bits respectively. */
+	if (format < 2) {
+		regen = sizes & 0x3ff;
+		csize = (sizes >> 10) & 0x3ff;
+	} else {
+		const unsigned int bits = format == 2 ? 14 : 18;
+
+		regen = sizes & ((1 << bits) - 1);
+		csize = (sizes >> bits) & ((1 << bits) - 1);
+	}
+	if (csize > size - header || regen > (size_t)(oend - op) || regen > BLOCK_SIZE_MAX)
+		return 0;
+	total = header + csize;
+	src += header;
+
+	if (type == LITERALS_COMPRESSED) {
+		const size_t n = read_huf_table(src, csize);
+
+		if (!n)
+			return 0;
+		src += n;
+		csize -= n;
+	} else if (!ws.huf_valid) {
+		return 0;
+	}
+
+	out = oend - regen;
+	*lits = out;
+	*lit_size = regen;
+
+	if (streams == 1) {
+		if (!decode_huf_stream(src, csize, out, regen))
+			return 0;
+	} else {
+		size_t s1, s2, s3;
+
+		if (csize < 6)
+			return 0;
+		s1 = read_le16(src);
+		s2 = read_le16(src + 2);
+		s3 = read_le16(src + 4);
+		if (s1 + s2 + s3 > csize - 6)
+			return 0;
+		segment = DIV_ROUND_UP(regen, 4);
+		if (3 * segment > regen)
+			return 0;
+		src += 6;
+		if (!decode_huf_stream(src, s1, out, segment) ||
+		    !decode_huf_stream(src + s1, s2, out + segment, segment) ||
+		    !decode_huf_stream(src + s1 + s2, s3, out + 2 * segment, segment) ||
+		    !decode_huf_stream(src + s1 + s2 + s3, csize - 6 - s1 - s2 - s3,
+				       out + 3 * segment, regen - 3 * segment))
+			return 0;
+	}
+
+	return total;
+}
+
+static bool read_seq_table(struct fse_table *t, enum seq_mode mode, const uint8_t **ip,
+			   const uint8_t *iend, const int16_t *predefined,
+			   unsigned int predefined_max, unsigned int predefined_log,
+			   unsigned int symbol_max, unsigned int log_max)
+{
+	int16_t counts[ML_SYMBOL_MAX + 1];
+	unsigned int max_symbol = symbol_max, log;
+	size_t n;
+
+	switch (mode) {
+	case SEQ_PREDEFINED:
+		return build_fse_table(t, predefined, predefined_max, predefined_log);
+	case SEQ_RLE:
+		if (*ip >= iend || **ip > symbol_max)
+			return false;
+		t->entries[0].symbol = *(*ip)++;
+		t->entries[0].nbits = 0;
+		t->entries[0].base = 0;
+		t->log = 0;
+		t->valid = true;
+		return true;
+	case SEQ_FSE:
+		n = read_fse_counts(*ip, iend - *ip, counts, &max_symbol, &log, log_max);
+		if (!n)
+			return false;
+		*ip += n;
+		return build_fse_table(t, counts, max_symbol, log);
+	case SEQ_REPEAT:
+	default:
+		return t->valid;
+	}
+}
+
+static uint32_t resolve_offset(uint32_t value, uint32_t ll)
+{
+	uint32_t offset;
+
+	if (value > 3) {
+		offset = value - 3;
+	} else {
+		/* Repeat offsets, shifted by one if there are no literals. */
+		if (ll == 0)
+			value++;
+		if (value == 1)
+			return ws.rep[0];
+		offset = value == 4 ? ws.rep[0] - 1 : ws.rep[value - 1];
+		if (value == 2) {
+			ws.rep[1] = ws.rep[0];
+			ws.rep[0] = offset;
+			return offset;
+		}
+	}
+
+	ws.rep[2] = ws.rep[1];
+	ws.rep[1] = ws.rep[0];
+	ws.rep[0] = offset;
+
+	return offset;
+}
+
+/*
+ * Decodes one compressed block from [src, src + size) to *op. |frame_start| is where the
+ * output of the current frame starts, matches can't reach back any further.
+ */
+static bool decode_block(const uint8_t *src, size_t size, uint8_t **op, uint8_t *oend,
+			 const uint8_t *frame_start)
+{
+	const uint8_t *ip = src, *iend = src + size;
+	const uint8_t *lits, *lit_end;
+	uint8_t *out = *op;
+	const uint8_t *limit;
+	size_t lit_size, n;
+	uint32_t nseq, i;
+	uint16_t ll_state, of_state, ml_state;
+	struct bitstream bs;
+
+	if (size < 1)
+		return false;
+	n = decode_literals(ip, size, out, oend, &lits, &lit_size);
+	if (!n)
+		return false;
+	ip += n;
+	lit_end = lits + lit_size;
+
+	/* Literals that were decoded to the end of the output must not be overwritten. */
+	limit = lits >= out && lits < oend ? lits : oend;
+
+	if (ip >= iend)
+		return false;
+	nseq = *ip++;
+	if (nseq >= 128) {
+		if (nseq == 255) {
+			if (iend - ip < 2)
+				return false;
+			nseq = read_le16(ip) + 0x7f00;
+			ip += 2;
+		} else {
+			if (ip >= iend)
+				return false;
+			nseq = ((nseq - 128) << 8) + *ip++;
+		}
+	}
+
+	if (nseq) {
+		uint8_t modes;
+
+		if (ip >= iend)
+			return false;
+		modes = *ip++;
+		if (modes & 0x3)
+			return false;
+		if (!read_seq_table(&ws.ll, modes >> 6, &ip, iend, ll_predefined,
+				    ARRAY_SIZE(ll_predefined) - 1, LL_PREDEFINED_LOG,
+				    LL_SYMBOL_MAX, LL_LOG_MAX) ||
+		    !read_seq_table(&ws.of, (modes >> 4) & 0x3, &ip, iend, of_predefined,
+				    ARRAY_SIZE(of_predefined) - 1, OF_PREDEFINED_LOG,
+				    OF_SYMBOL_MAX, OF_LOG_MAX) ||
+		    !read_seq_table(&ws.ml, (modes >> 2) & 0x3, &ip, iend, ml_predefined,
+				    ARRAY_SIZE(ml_predefined) - 1, ML_PREDEFINED_LOG,
+				    ML_SYMBOL_MAX, ML_LOG_MAX))
+			return false;
+
+		if (!bits_init(&bs, ip, iend - ip))
+			return false;
+		ll_state = bits_read(&bs, ws.ll.log);
+		of_state = bits_read(&bs, ws.of.log);
+		ml_state = bits_read(&bs, ws.ml.log);
+	} else if (ip != iend) {
+		return false;
+	}
+
+	for (i = 0; i < nseq; i++) {
+		const uint8_t ll_code = ws.ll.entries[ll_state].symbol;
+		const uint8_t of_code = ws.of.entries[of_state].symbol;
+		const uint8_t ml_code = ws.ml.entries[ml_state].symbol;
+		uint32_t offset, ml, ll;
+		const uint8_t *match;
+
+		bits_reload(&bs);
+		offset = (1U << of_code) + bits_read(&bs, of_code);
+		bits_reload(&bs);
+		ml = ml_base[ml_code] + bits_read(&bs, ml_bits[ml_code]);
+		ll = ll_base[ll_code] + bits_read(&bs, ll_bits[ll_code]);
+		bits_reload(&bs);
+
+		if (i + 1 < nseq) {
+			fse_decode(&ws.ll, &ll_state, &bs);
+			fse_decode(&ws.ml, &ml_state, &bs);
+			fse_decode(&ws.of, &of_state, &bs);
+		}
+
+		offset = resolve_offset(offset, ll);
+
+		if (ll > (size_t)(lit_end - lits) || ll > (size_t)(oend - out))
+			return false;
+		memmove(out, lits, ll);
+		out += ll;
+		lits += ll;
+		if (limit != oend)
+			limit = lits;
+
+		if (offset == 0 || offset > (size_t)(out - frame_start) ||
+		    ml > (size_t)(limit - out))
+			return false;
+
+		/* The pattern doubles with every copy, overlapping matches need no byte loop. */
+		match = out - offset;
+		while (ml) {
+			n = MIN((size_t)ml, (size_t)(out - match));
+			memcpy(out, match, n);
+			out += n;
+			ml -= n;
+		}
+	}
+
+	if (nseq && !bits_finished(&bs))
+		return false;
+
+	lit_size = lit_end - lits;
+	if (lit_size > (size_t)(oend - out))
+		return false;
+	memmove(out, lits, lit_size);
+	*op = out + lit_size;
+
+	return true;
+}
+
+/* Decodes one frame to *op. Returns the number of input bytes used, 0 on error. */
+static size_t decode_frame(const uint8_t *src, size_t size, uint8_t **op, uint8_t *oend)
+{
+	static const uint8_t dict_id_sizes[] = { 0, 1, 2, 4 };
+	static const uint8_t fcs_sizes[] = { 0, 2, 4, 8 };
+	const uint8_t *ip = src + sizeof(uint32_t), *iend = src + size;
+	uint8_t *const frame_start = *op;
+	uint64_t content_size = 0;
+	size_t dict_id_size, fcs_size;
+	bool last = false;
+	uint8_t fhd;
+
+	if (iend - ip < 1)
+		return 0;
+	fhd = *ip++;
+	if (fhd & FHD_RESERVED)
+		return 0;
+
+	dict_id_size = dict_id_sizes[FHD_DICT_ID_FLAG(fhd)];
+	fcs_size = fcs_sizes[FHD_FCS_FLAG(fhd)];
+	if ((fhd & FHD_SINGLE_SEGMENT) && fcs_size == 0)
+		fcs_size = 1;
+
+	/* The window descriptor doesn't matter, the whole output is the window. */
+	if (!(fhd & FHD_SINGLE_SEGMENT)) {
+		if (iend - ip < 1)
+			return 0;
+		ip++;
+	}
+	if (iend - ip < (ptrdiff_t)(dict_id_size + fcs_size))
+		return 0;
+
+	while (dict_id_size--) {
+		if (*ip++)
+			return 0;	/* dictionaries are not supported */
+	}
+
+	switch (fcs_size) {
+	case 1:
+		content_size = ip[0];
+		break;
+	case 2:
+		content_size = read_le16(ip) + 256;
+		break;
+	case 4:
+		content_size = read_le32(ip);
+		break;
+	case 8:
+		content_size = read_le32(ip) | (uint64_t)read_le32(ip + 4) << 32;
+		break;
+	}
+	ip += fcs_size;
+	if (fcs_size && content_size > (uint64_t)(oend - *op))
+		return 0;
+
+	ws.rep[0] = 1;
+	ws.rep[1] = 4;
+	ws.rep[2] = 8;
+	ws.ll = (struct fse_table){ .entries = ws.ll_entries };
+	ws.ml = (struct fse_table){ .entries = ws.ml_entries };
+	ws.of = (struct fse_table){ .entries = ws.of_entries };
+	ws.huf_valid = false;
+
+	while (!last) {
+		uint32_t header, block_size;
+
+		if (iend - ip < 3)
+			return 0;
+		header = read_le24(ip);
+		ip += 3;
+		last = header & 1;
+		block_size = header >> 3;
+
+		switch ((header >> 1) & 0x3) {
+		case BLOCK_RAW:
+			if (block_size > (size_t)(iend - ip) || block_size > (size_t)(oend - *op))
+				return 0;
+			memcpy(*op, ip, block_size);
+			*op += block_size;
+			ip += block_size;
+			break;
+		case BLOCK_RLE:
+			if (iend - ip < 1 || block_size > (size_t)(oend - *op))
+				return 0;
+			memset(*op, *ip, block_size);
+			*op += block_size;
+			ip++;
+			break;
+		case BLOCK_COMPRESSED:
+			if (block_size > (size_t)(iend - ip) || block_size > BLOCK_SIZE_MAX)
+				return 0;
+			if (!decode_block(ip, block_size, op, oend, frame_start))
+				return 0;
+			ip += block_size;
+			break;
+		default:
+			return 0;
+		}
+	}
+
+	if (fhd & FHD_CHECKSUM) {
+		if (iend - ip < 4)
+			return 0;
+		ip += 4;
+	}
+
+	if (fcs_size && content_size != (uint64_t)(*op - frame_start))
+		return 0;
+
+	return ip - src;
+}
+
+size_t uzstdn(const void *src, size_t srcn, void *dst, size_t dstn)
+{
+	const uint8_t *ip = src, *iend = ip + srcn;
+	uint8_t *op = dst, *oend = op + dstn;
+	uint32_t magic, skip;
+	size_t n;
+
+	if (srcn == 0)
+		return 0;
+
+	/* There may be any number of frames, including skippable ones. */
+	while (ip < iend) {
+		if (iend - ip < 4)
+			return 0;
+		magic = read_le32(ip);
+
+		if ((magic & SKIPPABLE_MAGIC_MASK) == SKIPPABLE_MAGIC) {
+			if (iend - ip < 8)
+				return 0;
+			skip = read_le32(ip + 4);
+			if (skip > (size_t)(iend - ip) - 8)
+				return 0;
+			ip += 8 + skip;
+			continue;
+		}
+
+		if (magic != ZSTD_MAGIC)
+			return 0;
+		n = decode_frame(ip, iend - ip, &op, oend);
+		if (!n)
+			return 0;
+		ip += n;
+	}
+
+	return op - (uint8_t *)dst;
+}
@@ -0,0 +1,28 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+
+#ifndef COMMONLIB_HEAP_STATS_SERIALIZED_H
+#define COMMONLIB_HEAP_STATS_SERIALIZED_H
+
+#include <commonlib/bsd/helpers.h>
+#include <stdint.h>
+
+/* Number of power-of-two size classes the free list heap sorts its free blocks into. */
+#define HEAP_STATS_NUM_CLASSES 16
+
+/* Snapshot of the ramstage heap, stored in CBMEM_ID_HEAP_STATS. All sizes are in bytes. */
+struct heap_stats {
+	uint64_t heap_size;
+	uint64_t in_use;		/* Allocated bytes, including block headers */
+	uint64_t peak_in_use;		/* Highest value |in_use| ever reached */
+	uint64_t free_bytes;		/* Free bytes, including block headers */
+	uint64_t largest_free;		/* Largest single free block */
+	uint32_t allocations;		/* Successful malloc()/memalign()/calloc() calls */
+	uint32_t frees;
+	uint32_t free_blocks;
+	uint32_t class_unit;		/* Smallest block size */
+	/* Number of free blocks of at least (class_unit << i) bytes, but smaller than twice
+	   that. The last class also counts all larger blocks. */
+	uint32_t class_free_blocks[HEAP_STATS_NUM_CLASSES];
+} __packed;
+
+#endif
@@ -4,6 +4,7 @@
 #define _MEM_POOL_H_
 
 #include <assert.h>
+#include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 
@@ -17,6 +18,17 @@
  * were chosen to optimize for the CBFS cache case which may need two buffers
  * to map a single compressed file, and will free them in reverse order.)
  *
+ * Pools initialized with MEM_POOL_INIT_ANY_ORDER() or mem_pool_init_any_order()
+ * lift that limitation: every allocation is preceded by a small header, so
+ * allocations can be freed in any order. Freed space at the top of the pool is
+ * returned immediately, freed space below it is merged with free neighbours
+ * and reused by later allocations that fit. The buffer of such a pool must be
+ * at least 4 byte aligned.
+ *
+ * In both modes, mem_pool_get_mark() and mem_pool_release_to_mark() can be
+ * used to free everything allocated after a certain point at once, and
+ * mem_pool_high_water() reports how much of the buffer was ever in use.
+ *
  * You must ensure the backing buffer is 'alignment' aligned.
  */
 
@@ -27,9 +39,18 @@ struct mem_pool {
 	uint8_t *last_alloc;
 	uint8_t *second_to_last_alloc;
 	size_t free_offset;
+	size_t high_water;
+	uint32_t seq;
+	bool any_order;
+};
+
+/* Position in the allocation history of a pool, see mem_pool_release_to_mark(). */
+struct mem_pool_mark {
+	size_t free_offset;
+	uint32_t seq;
 };
 
-#define MEM_POOL_INIT(buf_, size_, alignment_)	\
+#define _MEM_POOL_INIT(buf_, size_, alignment_, any_order_)	\
 	{					\
 		.buf = (buf_),			\
 		.size = (size_),		\
@@ -37,8 +58,16 @@ struct mem_pool {
 		.last_alloc = NULL,		\
 		.second_to_last_alloc = NULL,	\
 		.free_offset = 0,		\
+		.high_water = 0,		\
+		.seq = 0,			\
+		.any_order = (any_order_),	\
 	}
 
+#define MEM_POOL_INIT(buf_, size_, alignment_) \
+	_MEM_POOL_INIT(buf_, size_, alignment_, false)
+#define MEM_POOL_INIT_ANY_ORDER(buf_, size_, alignment_) \
+	_MEM_POOL_INIT(buf_, size_, alignment_, true)
+
 static inline void mem_pool_reset(struct mem_pool *mp)
 {
 	mp->last_alloc = NULL;
@@ -56,13 +85,42 @@ static inline void mem_pool_init(struct mem_pool *mp, void *buf, size_t sz,
 	mp->buf = buf;
 	mp->size = sz;
 	mp->alignment = alignment;
+	mp->high_water = 0;
+	mp->seq = 0;
+	mp->any_order = false;
 	mem_pool_reset(mp);
 }
 
+/* Initialize a memory pool whose allocations can be freed in any order. */
+static inline void mem_pool_init_any_order(struct mem_pool *mp, void *buf, size_t sz,
+					   size_t alignment)
+{
+	mem_pool_init(mp, buf, sz, alignment);
+	mp->any_order = true;
+}
+
 /* Allocate requested size from the memory pool. NULL returned on error. */
 void *mem_pool_alloc(struct mem_pool *mp, size_t sz);
 
 /* Free allocation from memory pool. */
 void mem_pool_free(struct mem_pool *mp, void *alloc);
 
+/* Record the current state of the pool, to be passed to mem_pool_release_to_mark(). */
+static inline struct mem_pool_mark mem_pool_get_mark(const struct mem_pool *mp)
+{
+	return (struct mem_pool_mark){ .free_offset = mp->free_offset, .seq = mp->seq };
+}
+
+/*
+ * Free all allocations made since |mark| was taken. Allocations from before the mark stay
+ * valid, but in the default (stack) mode they can no longer be freed individually.
+ */
+void mem_pool_release_to_mark(struct mem_pool *mp, struct mem_pool_mark mark);
+
+/* Return the largest number of bytes of the buffer that were ever in use at once. */
+static inline size_t mem_pool_high_water(const struct mem_pool *mp)
+{
+	return mp->high_water;
+}
+
 #endif /* _MEM_POOL_H_ */
@@ -0,0 +1,42 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+
+#ifndef COMMONLIB_MEMTEST_SERIALIZED_H
+#define COMMONLIB_MEMTEST_SERIALIZED_H
+
+#include <commonlib/bsd/helpers.h>
+#include <stdint.h>
+
+enum memtest_pattern {
+	MEMTEST_WALKING_ONES,		/* One bit set, moving with the address */
+	MEMTEST_ADDRESS,		/* Every word holds its own address */
+	MEMTEST_RANDOM,			/* xorshift64 sequence from |seed| */
+	MEMTEST_NUM_PATTERNS,
+};
+
+struct memtest_pattern_result {
+	uint64_t bytes;			/* Bytes written plus bytes read back */
+	uint64_t usecs;			/* Wall clock time over all CPUs */
+} __packed;
+
+struct memtest_cpu_result {
+	uint64_t tested;		/* Bytes in this CPU's share, per pattern */
+	uint64_t errors;		/* Mismatching 64-bit words, all patterns */
+	/* First mismatch, only valid if |errors| is not 0 */
+	uint64_t error_addr;
+	uint64_t expected;
+	uint64_t actual;
+	uint32_t error_pattern;
+	uint32_t reserved;
+} __packed;
+
+/* Results of the ramstage memory test, stored in CBMEM_ID_MEMTEST. */
+struct memtest_results {
+	uint64_t tested;		/* Bytes tested by all CPUs */
+	uint64_t seed;
+	uint32_t num_patterns;
+	uint32_t num_cpus;
+	struct memtest_pattern_result patterns[MEMTEST_NUM_PATTERNS];
+	struct memtest_cpu_result cpus[];
+} __packed;
+
+#endif
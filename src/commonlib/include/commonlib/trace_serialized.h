@@ -0,0 +1,32 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+
+#ifndef COMMONLIB_TRACE_SERIALIZED_H
+#define COMMONLIB_TRACE_SERIALIZED_H
+
+#include <commonlib/bsd/helpers.h>
+#include <stdint.h>
+
+#define TRACE_SPAN_NAME_LEN 32
+
+/* Span recorded by trace_span_begin() and trace_span_end(). */
+struct trace_span {
+	uint64_t start;			/* Timestamp ticks, relative to base_time */
+	uint64_t end;			/* 0 while the span is still open */
+	uint64_t payload;		/* Optional, e.g. number of bytes processed */
+	uint32_t id;			/* enum timestamp_id of the traced event, or 0 */
+	uint16_t parent;		/* Index of the enclosing span + 1, 0 for none */
+	uint8_t cpu;
+	uint8_t thread;
+	char name[TRACE_SPAN_NAME_LEN];
+} __packed;
+
+/* Contents of CBMEM_ID_TRACE. */
+struct trace_table {
+	uint64_t base_time;		/* Same base as the timestamp table */
+	uint16_t tick_freq_mhz;
+	uint32_t max_entries;
+	uint32_t num_entries;
+	struct trace_span spans[];
+} __packed;
+
+#endif
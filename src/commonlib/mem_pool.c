@@ -3,6 +3,110 @@
 #include <commonlib/helpers.h>
 #include <commonlib/mem_pool.h>
 
+/* Header in front of every allocation in an any-order pool. */
+struct mem_pool_chunk {
+	uint32_t size;		/* Including the header */
+	uint32_t seq;		/* Value of mp->seq when allocated */
+	uint32_t in_use;
+};
+
+/* Chunks are kept aligned to at least the alignment of their header. */
+static size_t chunk_alignment(const struct mem_pool *mp)
+{
+	return MAX(mp->alignment, sizeof(uint32_t));
+}
+
+static size_t chunk_header_size(const struct mem_pool *mp)
+{
+	return ALIGN_UP(sizeof(struct mem_pool_chunk), chunk_alignment(mp));
+}
+
+static struct mem_pool_chunk *next_chunk(struct mem_pool_chunk *c)
+{
+	return (void *)c + c->size;
+}
+
+/* Drop free chunks at the top of the pool and merge free chunks below it. */
+static void mem_pool_compact(struct mem_pool *mp)
+{
+	struct mem_pool_chunk *c = (void *)mp->buf;
+	struct mem_pool_chunk *end = (void *)&mp->buf[mp->free_offset];
+
+	while (c < end) {
+		if (!c->in_use) {
+			struct mem_pool_chunk *n = next_chunk(c);
+
+			while (n < end && !n->in_use) {
+				c->size += n->size;
+				n = next_chunk(c);
+			}
+			if (n == end) {
+				mp->free_offset = (uint8_t *)c - mp->buf;
+				return;
+			}
+		}
+		c = next_chunk(c);
+	}
+}
+
+static void *any_order_alloc(struct mem_pool *mp, size_t sz)
+{
+	const size_t header = chunk_header_size(mp);
+	struct mem_pool_chunk *c = (void *)mp->buf;
+	struct mem_pool_chunk *end = (void *)&mp->buf[mp->free_offset];
+
+	if (mp->size < header || sz > mp->size - header || sz > UINT32_MAX - header)
+		return NULL;
+	sz = ALIGN_UP(sz, chunk_alignment(mp)) + header;
+
+	/* First fit among the free chunks below the top, splitting off any rest. */
+	for (; c < end; c = next_chunk(c)) {
+		if (c->in_use || c->size < sz)
+			continue;
+		if (c->size - sz > header) {
+			struct mem_pool_chunk *rest = (void *)c + sz;
+
+			rest->size = c->size - sz;
+			rest->in_use = 0;
+			c->size = sz;
+		}
+		break;
+	}
+
+	if (c == end) {
+		if ((mp->size - mp->free_offset) < sz)
+			return NULL;
+		c->size = sz;
+		mp->free_offset += sz;
+	}
+
+	c->in_use = 1;
+	c->seq = mp->seq++;
+
+	return (void *)c + header;
+}
+
+static void any_order_free(struct mem_pool *mp, void *p)
+{
+	const size_t header = chunk_header_size(mp);
+	struct mem_pool_chunk *c = (void *)mp->buf;
+	struct mem_pool_chunk *end = (void *)&mp->buf[mp->free_offset];
+
+	/* Ignore pointers that aren't ours, like mem_pool_free() always did. */
+	if ((uint8_t *)p < mp->buf + header || p >= (void *)end)
+		return;
+
+	for (; c < end; c = next_chunk(c)) {
+		if ((void *)c + header == p) {
+			if (c->in_use) {
+				c->in_use = 0;
+				mem_pool_compact(mp);
+			}
+			return;
+		}
+	}
+}
+
 void *mem_pool_alloc(struct mem_pool *mp, size_t sz)
 {
 	void *p;
@@ -13,23 +117,37 @@ void *mem_pool_alloc(struct mem_pool *mp, size_t sz)
 	/* We assume that mp->buf started mp->alignment aligned */
 	sz = ALIGN_UP(sz, mp->alignment);
 
-	/* Determine if any space available. */
-	if ((mp->size - mp->free_offset) < sz)
-		return NULL;
+	if (mp->any_order) {
+		p = any_order_alloc(mp, sz);
+	} else {
+		/* Determine if any space available. */
+		if ((mp->size - mp->free_offset) < sz)
+			return NULL;
 
-	p = &mp->buf[mp->free_offset];
+		p = &mp->buf[mp->free_offset];
 
-	mp->free_offset += sz;
-	mp->second_to_last_alloc = mp->last_alloc;
-	mp->last_alloc = p;
+		mp->free_offset += sz;
+		mp->second_to_last_alloc = mp->last_alloc;
+		mp->last_alloc = p;
+	}
+
+	mp->high_water = MAX(mp->high_water, mp->free_offset);
 
 	return p;
 }
 
 void mem_pool_free(struct mem_pool *mp, void *p)
 {
+	if (p == NULL)
+		return;
+
+	if (mp->any_order) {
+		any_order_free(mp, p);
+		return;
+	}
+
 	/* Determine if p was the most recent allocation. */
-	if (p == NULL || mp->last_alloc != p)
+	if (mp->last_alloc != p)
 		return;
 
 	mp->free_offset = mp->last_alloc - mp->buf;
@@ -37,3 +155,30 @@ void mem_pool_free(struct mem_pool *mp, void *p)
 	/* No way to track allocation before this one. */
 	mp->second_to_last_alloc = NULL;
 }
+
+void mem_pool_release_to_mark(struct mem_pool *mp, struct mem_pool_mark mark)
+{
+	if (mp->any_order) {
+		struct mem_pool_chunk *c = (void *)mp->buf;
+		struct mem_pool_chunk *end = (void *)&mp->buf[mp->free_offset];
+
+		/* Allocations after the mark may also have reused space below it. */
+		for (; c < end; c = next_chunk(c)) {
+			if ((uint32_t)(c->seq - mark.seq) < (uint32_t)(mp->seq - mark.seq))
+				c->in_use = 0;
+		}
+		mem_pool_compact(mp);
+		return;
+	}
+
+	if (mp->free_offset <= mark.free_offset)
+		return;
+
+	mp->free_offset = mark.free_offset;
+	if (mp->second_to_last_alloc >= &mp->buf[mark.free_offset])
+		mp->second_to_last_alloc = NULL;
+	if (mp->last_alloc >= &mp->buf[mark.free_offset]) {
+		mp->last_alloc = mp->second_to_last_alloc;
+		mp->second_to_last_alloc = NULL;
+	}
+}
@@ -52,9 +52,14 @@ void console_interactive_tx_byte(unsigned char byte, void *data_unused)
 	__simnow_console_tx_byte(byte);
 }
 
-void console_stored_tx_byte(unsigned char byte, void *data_unused)
+void console_stored_tx_byte_no_cbmem(unsigned char byte)
 {
 	__flashconsole_tx_byte(byte);
+}
+
+void console_stored_tx_byte(unsigned char byte, void *data_unused)
+{
+	console_stored_tx_byte_no_cbmem(byte);
 	__cbmemc_tx_byte(byte);
 }
 
@@ -81,9 +86,12 @@ void console_write_line(uint8_t *buffer, size_t number_of_bytes)
 		return;
 	}
 
-	/* Output the console data */
-	while (number_of_bytes--)
-		console_tx_byte(*buffer++);
+	/* Output the console data, the CBMEM console gets it in one piece. */
+	for (size_t i = 0; i < number_of_bytes; i++) {
+		console_interactive_tx_byte(buffer[i], NULL);
+		console_stored_tx_byte_no_cbmem(buffer[i]);
+	}
+	__cbmemc_write(buffer, number_of_bytes);
 }
 
 #if CONFIG(GDB_STUB) && (ENV_ROMSTAGE || ENV_RAMSTAGE)
@@ -13,6 +13,10 @@
 #include <timer.h>
 #include <types.h>
 
+#if CONFIG(CONSOLE_CBMEM_CPU_TAGS)
+#include <arch/cpu.h>
+#endif
+
 DECLARE_SPIN_LOCK(console_lock)
 
 #define TRACK_CONSOLE_TIME (!ENV_SMM && CONFIG(HAVE_MONOTONIC_TIMER))
@@ -70,6 +74,62 @@ union log_state {
 
 #define LOG_FAST(state) (HAS_ONLY_FAST_CONSOLES || ((state).speed == CONSOLE_LOG_FAST))
 
+/*
+ * The CBMEM console gets its output a line at a time, instead of byte by byte. This saves a
+ * cursor update per byte and keeps SMM from interleaving its output with a line.
+ */
+#define CBMEMC_LINE_SIZE 128
+
+static struct {
+	u8 buf[CBMEMC_LINE_SIZE];
+	size_t len;
+} cbmemc_line;
+
+static void cbmemc_line_flush(void)
+{
+	__cbmemc_write(cbmemc_line.buf, cbmemc_line.len);
+	cbmemc_line.len = 0;
+}
+
+static void cbmemc_line_tx_byte(unsigned char byte)
+{
+	if (!__CBMEM_CONSOLE_ENABLE__)
+		return;
+
+	cbmemc_line.buf[cbmemc_line.len++] = byte;
+	if (byte == '\n' || cbmemc_line.len == sizeof(cbmemc_line.buf))
+		cbmemc_line_flush();
+}
+
+#if CONFIG(CONSOLE_CBMEM_CPU_TAGS)
+static void cbmemc_line_tx_string(const char *str)
+{
+	while (*str)
+		cbmemc_line_tx_byte(*str++);
+}
+
+static void cbmemc_line_tx_dec(unsigned long value)
+{
+	if (value >= 10)
+		cbmemc_line_tx_dec(value / 10);
+	cbmemc_line_tx_byte('0' + value % 10);
+}
+
+/* Tell where a line came from, unless it's the boot CPU outside of SMM. */
+static void cbmemc_line_tag(void)
+{
+	if (ENV_SMM) {
+		cbmemc_line_tx_string("[SMM] ");
+	} else if (ENV_RAMSTAGE && !boot_cpu()) {
+		cbmemc_line_tx_string("[CPU ");
+		cbmemc_line_tx_dec(cpu_index());
+		cbmemc_line_tx_string("] ");
+	}
+}
+#else
+static void cbmemc_line_tag(void) {}
+#endif
+
 static void wrap_interactive_printf(const char *fmt, ...)
 {
 	va_list args;
@@ -80,18 +140,20 @@ static void wrap_interactive_printf(const char *fmt, ...)
 
 static void line_start(union log_state state)
 {
-	if (state.level > BIOS_LOG_PREFIX_MAX_LEVEL)
+	if (state.level > BIOS_LOG_PREFIX_MAX_LEVEL) {
+		cbmemc_line_tag();
 		return;
+	}
 
 	/* Stored consoles just get a single control char marker to save space. If we are in
 	   LOG_FAST mode, just write the marker to CBMC and exit -- the rest of this function
 	   implements the LOG_ALL case. */
 	unsigned char marker = BIOS_LOG_LEVEL_TO_MARKER(state.level);
-	if (LOG_FAST(state)) {
-		__cbmemc_tx_byte(marker);
+	cbmemc_line_tx_byte(marker);
+	cbmemc_line_tag();
+	if (LOG_FAST(state))
 		return;
-	}
-	console_stored_tx_byte(marker, NULL);
+	console_stored_tx_byte_no_cbmem(marker);
 
 	/* Interactive consoles get a `[DEBUG]  ` style readable prefix,
 	   and potentially an escape sequence for highlighting. */
@@ -120,10 +182,11 @@ static void wrap_putchar(unsigned char byte, void *data)
 		line_started = true;
 	}
 
-	if (LOG_FAST(state))
-		__cbmemc_tx_byte(byte);
-	else
-		console_tx_byte(byte);
+	if (!LOG_FAST(state)) {
+		console_interactive_tx_byte(byte, NULL);
+		console_stored_tx_byte_no_cbmem(byte);
+	}
+	cbmemc_line_tx_byte(byte);
 }
 
 int vprintk(int msg_level, const char *fmt, va_list args)
@@ -143,6 +206,7 @@ int vprintk(int msg_level, const char *fmt, va_list args)
 	console_time_run();
 
 	i = vtxprintf(wrap_putchar, fmt, args, state.as_ptr);
+	cbmemc_line_flush();
 	if (LOG_FAST(state))
 		console_tx_flush();
 
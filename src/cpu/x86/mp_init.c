@@ -893,6 +893,12 @@ static enum cb_err run_ap_work(struct mp_callback *val, long expire_us, bool wai
 		return CB_ERR;
 	}
 
+	/*
+	 * An AP only takes the call once it finished its queued work. Finish all
+	 * of it first, so that it doesn't count against the timeout below.
+	 */
+	mp_work_finish_all();
+
 	/* Signal to all the APs to run the func. */
 	for (i = 0; i < ARRAY_SIZE(ap_callbacks); i++) {
 		if (cur_cpu == i)
@@ -961,7 +967,14 @@ static void ap_wait_for_instruction(void)
 		struct mp_callback *cb = read_callback(per_cpu_slot);
 
 		if (cb == NULL) {
-			asm ("pause");
+			if (!mp_work_queued()) {
+				asm ("pause");
+				continue;
+			}
+
+			atomic_set(&ap_status[cur_cpu], AP_BUSY);
+			mp_work_run_queued();
+			atomic_set(&ap_status[cur_cpu], AP_NOT_BUSY);
 			continue;
 		}
 		/*
@@ -1022,6 +1035,11 @@ enum cb_err mp_run_on_all_aps(void (*func)(void *), void *arg, long expire_us,
 	return CB_SUCCESS;
 }
 
+int mp_get_num_aps(void)
+{
+	return global_num_aps;
+}
+
 enum cb_err mp_run_on_all_cpus(void (*func)(void *), void *arg)
 {
 	/* Run on BSP first. */
@@ -1049,6 +1067,8 @@ enum cb_err mp_park_aps(void)
 
 	stopwatch_init(&sw);
 
+	mp_work_stop();
+
 	ret = mp_run_on_aps(park_this_cpu, NULL, MP_RUN_ON_ALL_CPUS,
 				1000 * USECS_PER_MSEC);
 
@@ -0,0 +1,132 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+
+#include <arch/cpu.h>
+#include <console/console.h>
+#include <cpu/x86/mp.h>
+#include <smp/atomic.h>
+#include <smp/spinlock.h>
+#include <timer.h>
+#include <types.h>
+
+enum MP_WORK_STATE {
+	MP_WORK_QUEUED,
+	MP_WORK_RUNNING,
+	MP_WORK_DONE
+};
+
+/* FIFO of work for the next idle AP, see mp_queue_work(). */
+DECLARE_SPIN_LOCK(work_queue_lock);
+static struct mp_work *work_queue_head;
+static struct mp_work *work_queue_tail;
+/* Number of queued items that didn't finish yet */
+static atomic_t work_pending;
+static bool work_queue_stopped;
+
+bool mp_work_queued(void)
+{
+	/* Idle APs poll this, don't take the lock just to find it empty. */
+	return *(struct mp_work *volatile *)&work_queue_head != NULL;
+}
+
+static struct mp_work *dequeue_work(void)
+{
+	struct mp_work *work;
+
+	if (!mp_work_queued())
+		return NULL;
+
+	spin_lock(&work_queue_lock);
+	work = work_queue_head;
+	if (work != NULL) {
+		work_queue_head = work->next;
+		if (work_queue_head == NULL)
+			work_queue_tail = NULL;
+	}
+	spin_unlock(&work_queue_lock);
+
+	return work;
+}
+
+static void run_work(struct mp_work *work)
+{
+	atomic_set(&work->state, MP_WORK_RUNNING);
+	work->func(work->arg);
+	atomic_dec(&work_pending);
+	/* The caller may reuse the storage from here on. */
+	atomic_set(&work->state, MP_WORK_DONE);
+}
+
+bool mp_work_run_queued(void)
+{
+	struct mp_work *work = dequeue_work();
+
+	if (work == NULL)
+		return false;
+
+	run_work(work);
+	return true;
+}
+
+void mp_work_finish_all(void)
+{
+	while (atomic_read(&work_pending)) {
+		if (!mp_work_run_queued())
+			cpu_relax();
+	}
+}
+
+void mp_work_stop(void)
+{
+	/* Nobody would pick up queued work after this, finish it first. */
+	mp_work_finish_all();
+	work_queue_stopped = true;
+}
+
+void mp_queue_work(struct mp_work *work, void (*func)(void *), void *arg)
+{
+	work->func = func;
+	work->arg = arg;
+	work->next = NULL;
+	atomic_set(&work->state, MP_WORK_QUEUED);
+	atomic_inc(&work_pending);
+
+	if (!CONFIG(PARALLEL_MP_AP_WORK) || !mp_get_num_aps() || work_queue_stopped) {
+		run_work(work);
+		return;
+	}
+
+	spin_lock(&work_queue_lock);
+	if (work_queue_tail != NULL)
+		work_queue_tail->next = work;
+	else
+		work_queue_head = work;
+	work_queue_tail = work;
+	spin_unlock(&work_queue_lock);
+}
+
+bool mp_work_done(struct mp_work *work)
+{
+	return atomic_read(&work->state) == MP_WORK_DONE;
+}
+
+enum cb_err mp_work_wait(struct mp_work *work, long expire_us)
+{
+	struct stopwatch sw;
+
+	if (expire_us > 0)
+		stopwatch_init_usecs_expire(&sw, expire_us);
+
+	while (!mp_work_done(work)) {
+		/* Help out instead of waiting for an AP to get to it. */
+		if (!mp_work_run_queued())
+			cpu_relax();
+
+		if (expire_us > 0 && stopwatch_expired(&sw) && !mp_work_done(work)) {
+			printk(BIOS_ERR, "Queued AP work %p didn't finish in time.\n",
+			       work->func);
+			return CB_ERR;
+		}
+	}
+
+	return CB_SUCCESS;
+}
@@ -13,6 +13,8 @@
 #include <string.h>
 #include <smp/spinlock.h>
 #include <timer.h>
+#include <timestamp.h>
+#include <trace.h>
 
 /** Pointer to the last device */
 extern struct device *last_dev;
@@ -112,6 +114,7 @@ static struct device *__alloc_dev(struct bus *parent, struct device_path *path)
 	 */
 	last_dev->next = dev;
 	last_dev = dev;
+	dev_index_invalidate();
 
 	return dev;
 }
@@ -516,6 +519,7 @@ static void init_dev(struct device *dev)
 	if (!dev->initialized && dev->ops && dev->ops->init) {
 		struct stopwatch sw;
 		long init_time;
+		int span;
 
 		if (dev->path.type == DEVICE_PATH_I2C) {
 			printk(BIOS_DEBUG, "smbus: %s[%d]->",
@@ -524,9 +528,11 @@ static void init_dev(struct device *dev)
 
 		printk(BIOS_DEBUG, "%s init\n", dev_path(dev));
 
+		span = trace_span_begin(TS_DEVICE_INITIALIZE, dev_path(dev));
 		stopwatch_init(&sw);
 		dev->initialized = 1;
 		dev->ops->init(dev);
+		trace_span_end(span, 0);
 
 		init_time = stopwatch_duration_msecs(&sw);
 		printk(BIOS_DEBUG, "%s init finished in %ld msecs\n", dev_path(dev),
@@ -567,9 +573,13 @@ void dev_initialize(void)
 	init_dev(&dev_root);
 
 	/* Now initialize everything. */
-	for (link = dev_root.link_list; link; link = link->next)
-		init_link(link);
-	post_log_clear();
+	if (CONFIG(PARALLEL_DEVICE_INIT)) {
+		dev_initialize_parallel();
+	} else {
+		for (link = dev_root.link_list; link; link = link->next)
+			init_link(link);
+		post_log_clear();
+	}
 
 	printk(BIOS_INFO, "Devices initialized\n");
 	show_all_devs(BIOS_SPEW, "After init.");
@@ -30,6 +30,10 @@ static DEVTREE_CONST struct device *dev_find_slot(unsigned int bus,
 						unsigned int devfn)
 {
 	DEVTREE_CONST struct device *dev, *result;
+	struct device *found;
+
+	if (!DEVTREE_EARLY && dev_index_find(DEV_INDEX_SLOT, bus << 8 | devfn, NULL, &found))
+		return found;
 
 	result = 0;
 	for (dev = all_devices; dev; dev = dev->next) {
@@ -212,6 +216,27 @@ DEVTREE_CONST struct device *find_dev_nested_path(
 	return find_dev_nested_path(child->link_list, nested_path + 1, nested_path_length - 1);
 }
 
+/*
+ * Binary search in the sorted index of the PCI root bus that sconfig generates
+ * along with the static device tree.
+ */
+static DEVTREE_CONST struct device *pci_root_index_find(pci_devfn_t devfn)
+{
+	size_t lo = 0, hi = pci_root_index_count;
+
+	while (lo < hi) {
+		const size_t mid = lo + (hi - lo) / 2;
+
+		if (pci_root_index[mid].devfn == devfn)
+			return pci_root_index[mid].dev;
+		if (pci_root_index[mid].devfn < devfn)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return NULL;
+}
+
 DEVTREE_CONST struct device *pcidev_path_behind(
 	const struct bus *parent, pci_devfn_t devfn)
 {
@@ -219,6 +244,15 @@ DEVTREE_CONST struct device *pcidev_path_behind(
 		.type = DEVICE_PATH_PCI,
 		.pci.devfn = devfn,
 	};
+
+	/*
+	 * Before ramstage the device tree is constant, so the index always
+	 * matches the children of the root bus. In ramstage, devices get
+	 * remapped and unlinked, so walk the list of children there.
+	 */
+	if (DEVTREE_EARLY && parent && parent == pci_root_index_bus)
+		return pci_root_index_find(devfn);
+
 	return find_dev_path(parent, &path);
 }
 
@@ -0,0 +1,163 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+
+/*
+ * Sorted indices over all_devices for dev_find_device(), dev_find_class() and
+ * dev_find_slot(), so that these don't have to walk the whole list every time.
+ *
+ * IDs, class codes and bus numbers are only final once enumeration is done, and PCIe root
+ * port functions get remapped while the buses are scanned. So the indices are only used
+ * from then on, the lookups walk the list before that. The indices are built on first use
+ * and dropped by dev_index_invalidate() whenever a device is added or its keys change.
+ */
+
+#include <bootstate.h>
+#include <console/console.h>
+#include <device/device.h>
+#include <device/path.h>
+#include <stdlib.h>
+#include <types.h>
+
+struct dev_index_entry {
+	uint32_t key;
+	struct device *dev;
+};
+
+struct dev_index {
+	/* Sorted by key, devices with the same key in all_devices order */
+	struct dev_index_entry *entries;
+	size_t count;
+	size_t capacity;
+};
+
+static struct dev_index indices[DEV_INDEX_KINDS];
+static bool dev_index_enabled;
+static bool dev_index_valid;
+
+void dev_index_invalidate(void)
+{
+	dev_index_valid = false;
+}
+
+/* Returns false if the device doesn't go into the index of this kind. */
+static bool dev_index_key(enum dev_index_kind kind, const struct device *dev, uint32_t *key)
+{
+	switch (kind) {
+	case DEV_INDEX_ID:
+		*key = (uint32_t)dev->vendor << 16 | dev->device;
+		return true;
+	case DEV_INDEX_CLASS:
+		*key = dev->class & 0xffffff00;
+		return true;
+	case DEV_INDEX_SLOT:
+		if (dev->path.type != DEVICE_PATH_PCI)
+			return false;
+		*key = (uint32_t)dev->bus->secondary << 8 | dev->path.pci.devfn;
+		return true;
+	default:
+		return false;
+	}
+}
+
+static void dev_index_build(struct dev_index *index, enum dev_index_kind kind, size_t max)
+{
+	struct device *dev;
+	size_t i, j;
+
+	/* Devices are only added, so keep the old array if it is big enough. */
+	if (max > index->capacity) {
+		free(index->entries);
+		index->capacity = max + max / 4;
+		index->entries = malloc(index->capacity * sizeof(*index->entries));
+		if (!index->entries)
+			die("%s: out of memory.\n", __func__);
+	}
+
+	index->count = 0;
+	for (dev = all_devices; dev; dev = dev->next) {
+		struct dev_index_entry *e = &index->entries[index->count];
+
+		if (dev_index_key(kind, dev, &e->key)) {
+			e->dev = dev;
+			index->count++;
+		}
+	}
+
+	/* Insertion sort keeps devices with the same key in list order. It is rebuilt rarely
+	   and there are a few hundred devices at most, so that is fast enough. */
+	for (i = 1; i < index->count; i++) {
+		const struct dev_index_entry e = index->entries[i];
+
+		for (j = i; j > 0 && index->entries[j - 1].key > e.key; j--)
+			index->entries[j] = index->entries[j - 1];
+		index->entries[j] = e;
+	}
+}
+
+static void dev_index_build_all(void)
+{
+	struct device *dev;
+	size_t count = 0;
+	int kind;
+
+	for (dev = all_devices; dev; dev = dev->next)
+		count++;
+
+	for (kind = 0; kind < DEV_INDEX_KINDS; kind++)
+		dev_index_build(&indices[kind], kind, count);
+
+	dev_index_valid = true;
+}
+
+bool dev_index_find(enum dev_index_kind kind, uint32_t key, const struct device *from,
+		    struct device **result)
+{
+	const struct dev_index *index = &indices[kind];
+	size_t lo = 0, hi, i;
+
+	if (!dev_index_enabled)
+		return false;
+
+	if (!dev_index_valid)
+		dev_index_build_all();
+
+	/* Find the first entry with the key. */
+	hi = index->count;
+	while (lo < hi) {
+		const size_t mid = lo + (hi - lo) / 2;
+
+		if (index->entries[mid].key < key)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	/* Without a previous match, it is the first device with the key. */
+	if (!from) {
+		*result = NULL;
+		if (lo < index->count && index->entries[lo].key == key)
+			*result = index->entries[lo].dev;
+		return true;
+	}
+
+	/* Otherwise it is the one after the previous match, if that has the key, too. */
+	for (i = lo; i < index->count && index->entries[i].key == key; i++) {
+		if (index->entries[i].dev != from)
+			continue;
+
+		*result = NULL;
+		if (i + 1 < index->count && index->entries[i + 1].key == key)
+			*result = index->entries[i + 1].dev;
+		return true;
+	}
+
+	/* The caller started somewhere else, it has to walk the list from there. */
+	return false;
+}
+
+static void dev_index_enable(void *unused)
+{
+	dev_index_enabled = true;
+	dev_index_invalidate();
+}
+
+BOOT_STATE_INIT_ENTRY(BS_DEV_ENUMERATE, BS_ON_EXIT, dev_index_enable, NULL);
@@ -43,6 +43,11 @@ struct device *dev_find_lapic(unsigned int apic_id)
  */
 struct device *dev_find_device(u16 vendor, u16 device, struct device *from)
 {
+	struct device *dev;
+
+	if (dev_index_find(DEV_INDEX_ID, (uint32_t)vendor << 16 | device, from, &dev))
+		return dev;
+
 	if (!from)
 		from = all_devices;
 	else
@@ -65,6 +70,11 @@ struct device *dev_find_device(u16 vendor, u16 device, struct device *from)
  */
 struct device *dev_find_class(unsigned int class, struct device *from)
 {
+	struct device *dev;
+
+	if (dev_index_find(DEV_INDEX_CLASS, class, from, &dev))
+		return dev;
+
 	if (!from)
 		from = all_devices;
 	else
@@ -0,0 +1,265 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+
+/*
+ * Device initialization on the BSP and the APs together, for PARALLEL_DEVICE_INIT.
+ *
+ * Devices are initialized in the same order as dev_initialize() walks the tree serially,
+ * except that a run of consecutive devices with device_operations.ap_safe_init set forms a
+ * batch. All CPUs take devices from the batch until it is empty, but a device only starts
+ * once its closest ancestor with an init() callback is done. The BSP waits for the whole
+ * batch before it moves on, so all other devices are still initialized on the BSP alone,
+ * with the APs idle and available for mp_run_on_aps().
+ */
+
+#include <arch/cpu.h>
+#include <console/console.h>
+#include <cpu/x86/mp.h>
+#include <device/device.h>
+#include <post.h>
+#include <smp/atomic.h>
+#include <smp/spinlock.h>
+#include <stdlib.h>
+#include <string.h>
+#include <timer.h>
+#include <timestamp.h>
+#include <trace.h>
+
+enum job_state {
+	JOB_PENDING,
+	JOB_RUNNING,
+	JOB_DONE,
+};
+
+struct init_job {
+	struct device *dev;
+	/* Job of the closest ancestor with an init() callback, NULL if there is none. */
+	struct init_job *parent;
+	atomic_t state;
+};
+
+struct init_batch {
+	struct init_job *jobs;
+	size_t count;
+	size_t claimed;
+	atomic_t done;
+};
+
+/* Protects the batch, the CMOS POST log and dev_path(), which returns a static buffer. */
+DECLARE_SPIN_LOCK(batch_lock)
+
+/* An AP may only get to look at the batch after the BSP finished it, so it is static. Once
+   all jobs are claimed, the APs don't touch the jobs anymore. */
+static struct init_batch batch;
+
+static bool has_init(const struct device *dev)
+{
+	return dev->ops && dev->ops->init;
+}
+
+static bool job_is_ap_safe(const struct init_job *job)
+{
+	return job->dev->ops->ap_safe_init;
+}
+
+static void init_device(struct device *dev)
+{
+	char path[DEVICE_PATH_MAX];
+	char bus_path[DEVICE_PATH_MAX] = "";
+	struct stopwatch sw;
+	long init_time;
+	int span;
+
+	if (!dev->enabled || dev->initialized)
+		return;
+
+	spin_lock(&batch_lock);
+	post_code(POST_BS_DEV_INIT);
+	post_log_path(dev);
+	strncpy(path, dev_path(dev), sizeof(path) - 1);
+	if (dev->path.type == DEVICE_PATH_I2C)
+		strncpy(bus_path, dev_path(dev->bus->dev), sizeof(bus_path) - 1);
+	spin_unlock(&batch_lock);
+	path[sizeof(path) - 1] = '\0';
+	bus_path[sizeof(bus_path) - 1] = '\0';
+
+	/* One printk, so that lines of other CPUs don't end up in between. */
+	if (dev->path.type == DEVICE_PATH_I2C)
+		printk(BIOS_DEBUG, "smbus: %s[%d]->%s init on CPU %lu\n", bus_path,
+		       dev->bus->link_num, path, cpu_index());
+	else
+		printk(BIOS_DEBUG, "%s init on CPU %lu\n", path, cpu_index());
+
+	span = trace_span_begin(TS_DEVICE_INITIALIZE, path);
+	stopwatch_init(&sw);
+	dev->initialized = 1;
+	dev->ops->init(dev);
+	trace_span_end(span, 0);
+
+	init_time = stopwatch_duration_msecs(&sw);
+	printk(BIOS_DEBUG, "%s init finished in %ld msecs\n", path, init_time);
+}
+
+/* Claim the first job whose parent is done. Returns NULL if none is ready (yet). */
+static struct init_job *claim_job(struct init_batch *b, bool *all_claimed)
+{
+	struct init_job *job = NULL;
+	size_t i;
+
+	spin_lock(&batch_lock);
+
+	*all_claimed = b->claimed == b->count;
+
+	for (i = 0; i < b->count && !*all_claimed; i++) {
+		struct init_job *j = &b->jobs[i];
+
+		if (atomic_read(&j->state) != JOB_PENDING)
+			continue;
+		if (j->parent && atomic_read(&j->parent->state) != JOB_DONE)
+			continue;
+
+		atomic_set(&j->state, JOB_RUNNING);
+		b->claimed++;
+		job = j;
+		break;
+	}
+
+	spin_unlock(&batch_lock);
+
+	return job;
+}
+
+/* Runs on all CPUs until every job of the batch has been claimed. */
+static void run_batch(void *arg)
+{
+	struct init_batch *b = arg;
+	struct init_job *job;
+	bool all_claimed;
+
+	while (1) {
+		job = claim_job(b, &all_claimed);
+		if (all_claimed)
+			break;
+		if (!job) {
+			/* Parent of every remaining job is still running. */
+			asm volatile ("pause");
+			continue;
+		}
+
+		init_device(job->dev);
+		mfence();
+		atomic_set(&job->state, JOB_DONE);
+		atomic_inc(&b->done);
+	}
+}
+
+static void init_batch(struct init_job *jobs, size_t count)
+{
+	spin_lock(&batch_lock);
+	batch.jobs = jobs;
+	batch.count = count;
+	batch.claimed = 0;
+	atomic_set(&batch.done, 0);
+	spin_unlock(&batch_lock);
+
+	if (mp_get_num_aps() > 0 && count > 1 &&
+	    mp_run_on_aps(run_batch, &batch, MP_RUN_ON_ALL_CPUS,
+			  1000 * USECS_PER_MSEC) != CB_SUCCESS)
+		printk(BIOS_ERR, "Initializing %zu devices on the BSP only\n", count);
+
+	run_batch(&batch);
+
+	while (atomic_read(&batch.done) != count)
+		asm volatile ("pause");
+
+	/* Keep APs that arrive late from looking at the jobs. */
+	spin_lock(&batch_lock);
+	batch.count = 0;
+	batch.claimed = 0;
+	spin_unlock(&batch_lock);
+}
+
+static size_t count_jobs(struct bus *link)
+{
+	struct device *dev;
+	struct bus *c_link;
+	size_t count = 0;
+
+	for (dev = link->children; dev; dev = dev->sibling) {
+		if (has_init(dev))
+			count++;
+		for (c_link = dev->link_list; c_link; c_link = c_link->next)
+			count += count_jobs(c_link);
+	}
+
+	return count;
+}
+
+static struct init_job *find_job(struct init_job *jobs, size_t count, const struct device *dev)
+{
+	while (count--) {
+		if (jobs[count].dev == dev)
+			return &jobs[count];
+	}
+
+	return NULL;
+}
+
+/* Same order as init_link() in device.c: all children of a link, then their links. */
+static void add_jobs(struct bus *link, struct init_job *jobs, size_t *count)
+{
+	struct device *dev;
+	struct bus *c_link;
+
+	for (dev = link->children; dev; dev = dev->sibling) {
+		struct init_job *job = &jobs[*count];
+		const struct device *ancestor = dev->bus->dev;
+
+		if (!has_init(dev))
+			continue;
+
+		job->dev = dev;
+		job->parent = NULL;
+		atomic_set(&job->state, JOB_PENDING);
+		for (; ancestor && ancestor != &dev_root && !job->parent;
+		     ancestor = ancestor->bus->dev)
+			job->parent = find_job(jobs, *count, ancestor);
+		(*count)++;
+	}
+
+	for (dev = link->children; dev; dev = dev->sibling) {
+		for (c_link = dev->link_list; c_link; c_link = c_link->next)
+			add_jobs(c_link, jobs, count);
+	}
+}
+
+void dev_initialize_parallel(void)
+{
+	struct init_job *jobs;
+	struct bus *link;
+	size_t count = 0, i, end;
+
+	for (link = dev_root.link_list; link; link = link->next)
+		count += count_jobs(link);
+
+	jobs = malloc(count * sizeof(*jobs));
+	count = 0;
+	for (link = dev_root.link_list; link; link = link->next)
+		add_jobs(link, jobs, &count);
+
+	for (i = 0; i < count; i = end) {
+		end = i + 1;
+
+		if (!job_is_ap_safe(&jobs[i])) {
+			init_device(jobs[i].dev);
+			atomic_set(&jobs[i].state, JOB_DONE);
+			continue;
+		}
+
+		while (end < count && job_is_ap_safe(&jobs[end]))
+			end++;
+		init_batch(&jobs[i], end - i);
+	}
+
+	post_log_clear();
+	free(jobs);
+}
@@ -7,6 +7,7 @@
 #include <fsp/util.h>
 #include <mode_switch.h>
 #include <timestamp.h>
+#include <trace.h>
 #include <types.h>
 
 struct fsp_notify_phase_data {
@@ -60,6 +61,7 @@ static void fsp_notify(enum fsp_notify_phase phase)
 	struct fsp_notify_params notify_params = { .phase = phase };
 	fsp_notify_fn fspnotify;
 	uint32_t ret;
+	int span;
 
 	if (data->skip) {
 		printk(BIOS_INFO, "coreboot skipped calling FSP notify phase: %08x.\n", phase);
@@ -74,6 +76,7 @@ static void fsp_notify(enum fsp_notify_phase phase)
 	fsp_before_debug_notify(fspnotify, &notify_params);
 
 	timestamp_add_now(data->timestamp_before);
+	span = trace_span_begin(data->timestamp_before, "FspNotify");
 	post_code(data->post_code_before);
 
 	/* FSP disables the interrupt handler so remove debug exceptions temporarily  */
@@ -84,6 +87,7 @@ static void fsp_notify(enum fsp_notify_phase phase)
 		ret = fspnotify(&notify_params);
 	null_breakpoint_init();
 
+	trace_span_end(span, phase);
 	timestamp_add_now(data->timestamp_after);
 	post_code(data->post_code_after);
 
@@ -15,6 +15,7 @@
 #include <stage_cache.h>
 #include <string.h>
 #include <timestamp.h>
+#include <trace.h>
 #include <types.h>
 #include <mode_switch.h>
 
@@ -96,6 +97,7 @@ static void do_silicon_init(struct fsp_header *hdr)
 	fsp_multi_phase_si_init_fn multi_phase_si_init;
 	struct fsp_multi_phase_params multi_phase_params;
 	struct fsp_multi_phase_get_number_of_phases_params multi_phase_get_number;
+	int span;
 
 	supd = (FSPS_UPD *)(uintptr_t)(hdr->cfg_region_offset + hdr->image_base);
 
@@ -133,6 +135,7 @@ static void do_silicon_init(struct fsp_header *hdr)
 	fsp_debug_before_silicon_init(silicon_init, supd, upd);
 
 	timestamp_add_now(TS_FSP_SILICON_INIT_START);
+	span = trace_span_begin(TS_FSP_SILICON_INIT_START, "FspSiliconInit");
 	post_code(POST_FSP_SILICON_INIT);
 
 	/* FSP disables the interrupt handler so remove debug exceptions temporarily  */
@@ -145,6 +148,7 @@ static void do_silicon_init(struct fsp_header *hdr)
 
 	printk(BIOS_INFO, "FSPS returned %x\n", status);
 
+	trace_span_end(span, 0);
 	timestamp_add_now(TS_FSP_SILICON_INIT_END);
 	post_code(POST_FSP_SILICON_EXIT);
 
@@ -175,6 +179,7 @@ static void do_silicon_init(struct fsp_header *hdr)
 
 	post_code(POST_FSP_MULTI_PHASE_SI_INIT_ENTRY);
 	timestamp_add_now(TS_FSP_MULTI_PHASE_SI_INIT_START);
+	span = trace_span_begin(TS_FSP_MULTI_PHASE_SI_INIT_START, "FspMultiPhaseSiInit");
 	/* Get NumberOfPhases Value */
 	multi_phase_params.multi_phase_action = GET_NUMBER_OF_PHASES;
 	multi_phase_params.phase_index = 0;
@@ -199,6 +204,7 @@ static void do_silicon_init(struct fsp_header *hdr)
 			status = fsp_get_pch_reset_status();
 		fsps_return_value_handler(FSP_MULTI_PHASE_SI_INIT_EXECUTE_PHASE_API, status);
 	}
+	trace_span_end(span, multi_phase_get_number.number_of_phases);
 	timestamp_add_now(TS_FSP_MULTI_PHASE_SI_INIT_END);
 	post_code(POST_FSP_MULTI_PHASE_SI_INIT_EXIT);
 }
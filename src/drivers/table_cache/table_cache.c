@@ -0,0 +1,301 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+
+#include <bootstate.h>
+#include <cbmem.h>
+#include <console/console.h>
+#include <device/device.h>
+#include <fmap.h>
+#include <fw_config.h>
+#include <memory_info.h>
+#include <region_file.h>
+#include <string.h>
+#include <table_cache.h>
+#include <version.h>
+#include <xxhash.h>
+
+#if ENV_X86
+#include <arch/cpu.h>
+#endif
+
+#define TABLE_CACHE_REGION	"RW_TABLE_CACHE"
+#define TABLE_CACHE_SIGNATURE	(('T'<<0)|('B'<<8)|('L'<<16)|('C'<<24))
+#define TABLE_CACHE_VERSION	2
+
+struct table_cache_blob_header {
+	uint64_t address;	/* Address the blob was generated at */
+	uint64_t hash;		/* xxh64 of the blob */
+	uint32_t size;
+	uint32_t reserved;
+} __packed;
+
+struct table_cache_header {
+	uint32_t signature;
+	uint32_t version;
+	uint64_t fingerprint;
+	struct table_cache_blob_header blobs[TABLE_CACHE_NUM_BLOBS];
+	uint64_t header_hash;	/* xxh64 of everything above */
+} __packed;
+
+static const char *const blob_names[TABLE_CACHE_NUM_BLOBS] = {
+	[TABLE_CACHE_SSDT]	= "SSDT",
+};
+
+/* The CBMEM entries the blobs are written into */
+static const uint32_t blob_cbmem_ids[TABLE_CACHE_NUM_BLOBS] = {
+	[TABLE_CACHE_SSDT]	= CBMEM_ID_ACPI,
+};
+
+static struct {
+	bool initialized;
+	bool valid;		/* The header in flash matches this boot */
+	uint64_t fingerprint;
+	struct table_cache_header header;
+	struct region_device data;	/* Latest file data, header included */
+	/* Blobs of this boot, written back if any of them wasn't a hit */
+	const void *stored[TABLE_CACHE_NUM_BLOBS];
+	size_t stored_size[TABLE_CACHE_NUM_BLOBS];
+	bool hit[TABLE_CACHE_NUM_BLOBS];
+} cache;
+
+__weak void table_cache_platform_fingerprint(struct xxh64_state *state)
+{
+}
+
+static void hash_string(struct xxh64_state *state, const char *s)
+{
+	xxh64_update(state, s, strlen(s) + 1);
+}
+
+static void hash_device(struct xxh64_state *state, const struct device *dev)
+{
+	const struct resource *res;
+	const uint32_t ids[] = {
+		dev->enabled, dev->bus ? dev->bus->secondary : 0,
+		dev->vendor, dev->device, dev->class,
+		dev->subsystem_vendor, dev->subsystem_device,
+	};
+
+	xxh64_update(state, &dev->path, sizeof(dev->path));
+	xxh64_update(state, ids, sizeof(ids));
+
+	for (res = dev->resource_list; res; res = res->next) {
+		const uint64_t r[] = { res->base, res->size, res->flags, res->index };
+		xxh64_update(state, r, sizeof(r));
+	}
+}
+
+static void hash_cbmem_entry(u32 id, const void *start, size_t size, void *arg)
+{
+	const uint64_t e[] = { id, (uintptr_t)start, size };
+
+	xxh64_update(arg, e, sizeof(e));
+}
+
+/*
+ * Everything the SSDT generators depend on has to end up in here. Platforms with other inputs add them through
+ * table_cache_platform_fingerprint().
+ */
+static uint64_t table_cache_fingerprint(void)
+{
+	struct xxh64_state state;
+	const struct device *dev;
+	const struct memory_info *meminfo;
+
+	xxh64_reset(&state, TABLE_CACHE_VERSION);
+
+	hash_string(&state, coreboot_version);
+	hash_string(&state, coreboot_extra_version);
+	hash_string(&state, coreboot_build);
+	hash_string(&state, coreboot_compile_time);
+
+	/*
+	 * The AML points into CBMEM, e.g. to GNVS, the coreboot table and
+	 * the console, so all entries have to stay where they were.
+	 */
+	cbmem_walk_entries(hash_cbmem_entry, &state);
+
+	for (dev = all_devices; dev; dev = dev->next)
+		hash_device(&state, dev);
+
+	if (CONFIG(FW_CONFIG)) {
+		const uint64_t fw_config = fw_config_get();
+		xxh64_update(&state, &fw_config, sizeof(fw_config));
+	}
+
+	/* Filled from the SPDs, including serial and part numbers. */
+	meminfo = cbmem_find(CBMEM_ID_MEMINFO);
+	if (meminfo)
+		xxh64_update(&state, meminfo, sizeof(*meminfo));
+
+#if ENV_X86
+	const uint32_t cpuid = cpu_get_cpuid();
+	xxh64_update(&state, &cpuid, sizeof(cpuid));
+#endif
+
+	table_cache_platform_fingerprint(&state);
+
+	return xxh64_digest(&state);
+}
+
+/* Space left in the CBMEM entry of the blob from dest on */
+static size_t blob_space(enum table_cache_blob blob, const void *dest)
+{
+	const struct cbmem_entry *entry = cbmem_entry_find(blob_cbmem_ids[blob]);
+	uintptr_t start, end;
+
+	if (!entry)
+		return 0;
+
+	start = (uintptr_t)cbmem_entry_start(entry);
+	end = start + cbmem_entry_size(entry);
+	if ((uintptr_t)dest < start || (uintptr_t)dest >= end)
+		return 0;
+
+	return end - (uintptr_t)dest;
+}
+
+static void table_cache_init(void)
+{
+	struct region_device rdev;
+	struct region_file file;
+	struct table_cache_header *header = &cache.header;
+	size_t size = sizeof(*header);
+	int i;
+
+	if (cache.initialized)
+		return;
+	cache.initialized = true;
+
+	cache.fingerprint = table_cache_fingerprint();
+
+	if (fmap_locate_area_as_rdev(TABLE_CACHE_REGION, &rdev) < 0) {
+		printk(BIOS_ERR, "TABLE CACHE: No '%s' region\n", TABLE_CACHE_REGION);
+		return;
+	}
+
+	if (region_file_init(&file, &rdev) < 0 ||
+	    region_file_data(&file, &cache.data) < 0) {
+		printk(BIOS_INFO, "TABLE CACHE: No data in '%s'\n", TABLE_CACHE_REGION);
+		return;
+	}
+
+	if (rdev_readat(&cache.data, header, 0, sizeof(*header)) != sizeof(*header) ||
+	    header->signature != TABLE_CACHE_SIGNATURE ||
+	    header->version != TABLE_CACHE_VERSION ||
+	    header->header_hash != xxh64(header, offsetof(typeof(*header), header_hash), 0)) {
+		printk(BIOS_ERR, "TABLE CACHE: Invalid header\n");
+		return;
+	}
+
+	/* region_file pads the data to its block size. */
+	for (i = 0; i < TABLE_CACHE_NUM_BLOBS; i++)
+		size += header->blobs[i].size;
+	if (size > region_device_sz(&cache.data)) {
+		printk(BIOS_ERR, "TABLE CACHE: Size mismatch\n");
+		return;
+	}
+
+	if (header->fingerprint != cache.fingerprint) {
+		printk(BIOS_INFO, "TABLE CACHE: Fingerprint changed, regenerating tables\n");
+		return;
+	}
+
+	cache.valid = true;
+}
+
+size_t table_cache_load(enum table_cache_blob blob, void *dest)
+{
+	const struct table_cache_blob_header *bh = &cache.header.blobs[blob];
+	size_t offset = sizeof(cache.header);
+	int i;
+
+	table_cache_init();
+
+	if (!cache.valid || !bh->size)
+		return 0;
+
+	if (bh->address != (uintptr_t)dest) {
+		printk(BIOS_INFO, "TABLE CACHE: %s moved, regenerating\n", blob_names[blob]);
+		return 0;
+	}
+
+	if (bh->size > blob_space(blob, dest)) {
+		printk(BIOS_ERR, "TABLE CACHE: %s doesn't fit, regenerating\n", blob_names[blob]);
+		return 0;
+	}
+
+	for (i = 0; i < blob; i++)
+		offset += cache.header.blobs[i].size;
+
+	if (rdev_readat(&cache.data, dest, offset, bh->size) != bh->size ||
+	    xxh64(dest, bh->size, 0) != bh->hash) {
+		printk(BIOS_ERR, "TABLE CACHE: %s corrupted, regenerating\n", blob_names[blob]);
+		memset(dest, 0, bh->size);
+		return 0;
+	}
+
+	printk(BIOS_DEBUG, "TABLE CACHE: Using cached %s, %u bytes\n", blob_names[blob],
+	       bh->size);
+	cache.hit[blob] = true;
+	table_cache_store(blob, dest, bh->size);
+	return bh->size;
+}
+
+void table_cache_store(enum table_cache_blob blob, const void *data, size_t size)
+{
+	cache.stored[blob] = data;
+	cache.stored_size[blob] = size;
+}
+
+static void table_cache_update(void *unused)
+{
+	struct table_cache_header header = {
+		.signature = TABLE_CACHE_SIGNATURE,
+		.version = TABLE_CACHE_VERSION,
+	};
+	struct update_region_file_entry entries[1 + TABLE_CACHE_NUM_BLOBS] = {
+		[0] = {
+			.size = sizeof(header),
+			.data = &header,
+		},
+	};
+	struct region_device rdev;
+	struct region_file file;
+	size_t num_entries = 1;
+	bool all_hit = true;
+	int i;
+
+	if (!cache.initialized)
+		return;
+
+	for (i = 0; i < TABLE_CACHE_NUM_BLOBS; i++) {
+		/* Tables that weren't written this boot are left out. */
+		if (!cache.stored[i] || !cache.stored_size[i])
+			continue;
+		all_hit &= cache.hit[i];
+
+		header.blobs[i].address = (uintptr_t)cache.stored[i];
+		header.blobs[i].size = cache.stored_size[i];
+		header.blobs[i].hash = xxh64(cache.stored[i], cache.stored_size[i], 0);
+		entries[num_entries].size = cache.stored_size[i];
+		entries[num_entries].data = cache.stored[i];
+		num_entries++;
+	}
+
+	if (all_hit)
+		return;
+
+	header.fingerprint = cache.fingerprint;
+	header.header_hash = xxh64(&header, offsetof(typeof(header), header_hash), 0);
+
+	if (fmap_locate_area_as_rdev_rw(TABLE_CACHE_REGION, &rdev) < 0 ||
+	    region_file_init(&file, &rdev) < 0 ||
+	    region_file_update_data_arr(&file, entries, num_entries) < 0) {
+		printk(BIOS_ERR, "TABLE CACHE: Failed to update '%s'\n", TABLE_CACHE_REGION);
+		return;
+	}
+
+	printk(BIOS_DEBUG, "TABLE CACHE: Updated '%s'\n", TABLE_CACHE_REGION);
+}
+
+BOOT_STATE_INIT_ENTRY(BS_WRITE_TABLES, BS_ON_EXIT, table_cache_update, NULL);
@@ -10,6 +10,9 @@
 void acpigen_write_ADR_pci_devfn(pci_devfn_t devfn);
 void acpigen_write_ADR_pci_device(const struct device *dev);
 
+/* Device (name) with _ADR and a _STA method returning status */
+void acpigen_write_pci_device(const char *name, pci_devfn_t devfn, uint8_t status);
+
 void acpigen_write_PRT_GSI_entry(unsigned int pci_dev, unsigned int acpi_pin, unsigned int gsi);
 void acpigen_write_PRT_source_entry(unsigned int pci_dev, unsigned int acpi_pin,
 				    const char *source_path, unsigned int index);
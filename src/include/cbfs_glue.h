@@ -25,6 +25,7 @@
 				 (verstage_should_load() && \
 				  CONFIG(VBOOT_RETURN_FROM_VERSTAGE))))))
 #define CBFS_HASH_HWCRYPTO vboot_hwcrypto_allowed()
+#define CBFS_MCACHE_INDEX CONFIG(CBFS_MCACHE_INDEX)
 
 #define ERROR(...) printk(BIOS_ERR, "CBFS ERROR: " __VA_ARGS__)
 #define LOG(...) printk(BIOS_INFO, "CBFS: " __VA_ARGS__)
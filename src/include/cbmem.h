@@ -105,6 +105,9 @@ void cbmem_add_bootmem(void);
 void cbmem_get_region(void **baseptr, size_t *size);
 void cbmem_list(void);
 void cbmem_add_records_to_cbtable(struct lb_header *header);
+/* Call fn for every CBMEM entry except the IMD metadata, in table order. */
+void cbmem_walk_entries(void (*fn)(u32 id, const void *start, size_t size, void *arg),
+			void *arg);
 
 #define _CBMEM_INIT_HOOK_UNUSED(init_fn_) __attribute__((unused)) \
 	static cbmem_init_hook_t init_fn_ ## _unused_ = init_fn_
@@ -7,6 +7,8 @@
 
 void cbmemc_init(void);
 void cbmemc_tx_byte(unsigned char data);
+/* Append |len| bytes at once. They are never interleaved with data written concurrently. */
+void cbmemc_write(const void *data, size_t len);
 
 #define __CBMEM_CONSOLE_ENABLE__	(CONFIG(CONSOLE_CBMEM) && \
 	(ENV_RAMSTAGE || ENV_SEPARATE_VERSTAGE || ENV_POSTCAR  || \
@@ -16,9 +18,11 @@ void cbmemc_tx_byte(unsigned char data);
 #if __CBMEM_CONSOLE_ENABLE__
 static inline void __cbmemc_init(void)	{ cbmemc_init(); }
 static inline void __cbmemc_tx_byte(u8 data)	{ cbmemc_tx_byte(data); }
+static inline void __cbmemc_write(const void *data, size_t len)	{ cbmemc_write(data, len); }
 #else
 static inline void __cbmemc_init(void)	{}
 static inline void __cbmemc_tx_byte(u8 data)	{}
+static inline void __cbmemc_write(const void *data, size_t len)	{}
 #endif
 
 /*
@@ -14,6 +14,9 @@ void console_tx_flush(void);
 void console_interactive_tx_byte(unsigned char byte, void *data_unused);
 /* Consoles that store logs on some medium for later retrieval. */
 void console_stored_tx_byte(unsigned char byte, void *data_unused);
+/* Same as console_stored_tx_byte(), but leaves out the CBMEM console for callers that write
+   to it in bulk with __cbmemc_write(). */
+void console_stored_tx_byte_no_cbmem(unsigned char byte);
 
 /*
  * Write number_of_bytes data bytes from buffer to the serial device.
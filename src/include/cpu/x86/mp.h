@@ -4,6 +4,7 @@
 #define _X86_MP_H_
 
 #include <cpu/x86/smm.h>
+#include <smp/atomic.h>
 #include <types.h>
 
 #define CACHELINE_SIZE 64
@@ -122,6 +123,9 @@ enum cb_err mp_run_on_aps(void (*func)(void *), void *arg, int logical_cpu_num,
 enum cb_err mp_run_on_all_aps(void (*func)(void *), void *arg, long expire_us,
 			      bool run_parallel);
 
+/* Return the number of APs started by mp_init_with_smm(), 0 if it hasn't run yet. */
+int mp_get_num_aps(void);
+
 /* Like mp_run_on_aps() but also runs func on BSP. */
 enum cb_err mp_run_on_all_cpus(void (*func)(void *), void *arg);
 
@@ -129,9 +133,52 @@ enum cb_err mp_run_on_all_cpus(void (*func)(void *), void *arg);
    function call. The time limit on a function call is 1 second per AP. */
 enum cb_err mp_run_on_all_cpus_synchronously(void (*func)(void *), void *arg);
 
+/*
+ * Work queued with mp_queue_work() is picked up by whichever AP becomes idle
+ * first, so the BSP can go on and check on it later. Any number of items can
+ * be outstanding. The storage belongs to the caller and must stay valid until
+ * the work is done. Without APs to run it (PARALLEL_MP_AP_WORK not selected,
+ * no APs started or APs already parked), the work runs on the BSP right away.
+ *
+ * The per-AP calls above finish all queued work before they hand out the call,
+ * so that their timeouts only cover the call itself. For the same reason, they
+ * must not be called from queued work.
+ */
+struct mp_work {
+	void (*func)(void *arg);
+	void *arg;
+	struct mp_work *next;
+	atomic_t state;
+};
+
+void mp_queue_work(struct mp_work *work, void (*func)(void *), void *arg);
+
+/* Return true once the queued work has finished. */
+bool mp_work_done(struct mp_work *work);
+
+/*
+ * Wait for queued work to finish. While the work hasn't been picked up, the
+ * BSP runs queued items itself. Input parameter expire_us <= 0 to specify an
+ * infinite timeout. After a timeout the work may still run later.
+ */
+enum cb_err mp_work_wait(struct mp_work *work, long expire_us);
+
+/*
+ * The following are used by mp_init.c to run the queue. mp_work_queued() returns true if
+ * there is queued work that no CPU took yet, mp_work_run_queued() runs the next queued item
+ * on the calling CPU and returns false if there was none. mp_work_finish_all() returns once
+ * all queued work has finished, running items on the calling CPU as long as there are any,
+ * so it must not be called from queued work. mp_work_stop() finishes all queued work and
+ * makes mp_queue_work() run later work right away.
+ */
+bool mp_work_queued(void);
+bool mp_work_run_queued(void);
+void mp_work_finish_all(void);
+void mp_work_stop(void);
+
 /*
  * Park all APs to prepare for OS boot. This is handled automatically
- * by the coreboot infrastructure.
+ * by the coreboot infrastructure. All queued work is finished first.
  */
 enum cb_err mp_park_aps(void);
 
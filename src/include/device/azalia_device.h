@@ -28,7 +28,10 @@ void azalia_codecs_init(u8 *base, u16 codec_mask);
 void azalia_audio_init(struct device *dev);
 extern struct device_operations default_azalia_audio_ops;
 
-/* Optional hook to program codec settings that are only known at runtime */
+/*
+ * Optional hook to program codec settings that are only known at runtime. With
+ * PARALLEL_DEVICE_INIT, it may run on an AP, see AZALIA_RUNTIME_VERBS_BSP_ONLY.
+ */
 void mainboard_azalia_program_runtime_verbs(u8 *base, u32 viddid);
 
 extern const u32 cim_verb_data[];
@@ -69,6 +69,14 @@ struct device_operations {
 	const struct pnp_mode_ops *ops_pnp_mode;
 	const struct gpio_operations *ops_gpio;
 	const struct mdio_bus_operations *ops_mdio;
+	/*
+	 * With PARALLEL_DEVICE_INIT, init() may run on an AP, concurrently with
+	 * the init() of other devices that set this. It is still called after
+	 * init() of the parent device. It must not use anything that isn't
+	 * SMP-safe, like malloc(), threads, dev_path() or dev_find_device(),
+	 * and must make do with the small AP stack.
+	 */
+	bool ap_safe_init;
 };
 
 /**
@@ -171,6 +179,19 @@ struct device {
 extern DEVTREE_CONST struct device	dev_root;
 /* list of all devices */
 extern DEVTREE_CONST struct device * DEVTREE_CONST all_devices;
+
+/*
+ * Devices on the PCI root bus of the static device tree, sorted by devfn.
+ * Also generated by the config tool, see pcidev_path_behind().
+ */
+struct pci_root_index_entry {
+	pci_devfn_t devfn;
+	DEVTREE_CONST struct device *dev;
+};
+extern DEVTREE_CONST struct bus *const pci_root_index_bus;
+extern const struct pci_root_index_entry pci_root_index[];
+extern const size_t pci_root_index_count;
+
 extern struct resource	*free_resources;
 extern struct bus	*free_links;
 
@@ -181,6 +202,7 @@ void dev_enumerate(void);
 void dev_configure(void);
 void dev_enable(void);
 void dev_initialize(void);
+void dev_initialize_parallel(void);
 void dev_finalize(void);
 void dev_finalize_chips(void);
 /* Function used to override device state */
@@ -223,6 +245,22 @@ DEVTREE_CONST struct device *find_dev_nested_path(
 struct device *alloc_find_dev(struct bus *parent, struct device_path *path);
 struct device *dev_find_device(u16 vendor, u16 device, struct device *from);
 struct device *dev_find_class(unsigned int class, struct device *from);
+
+/* Lookup indices over all_devices for the ramstage, see device_index.c. */
+enum dev_index_kind {
+	DEV_INDEX_ID,		/* vendor << 16 | device */
+	DEV_INDEX_CLASS,	/* class & 0xffffff00 */
+	DEV_INDEX_SLOT,		/* bus->secondary << 8 | devfn, only PCI devices */
+	DEV_INDEX_KINDS
+};
+/*
+ * Find the next device with the key after from, or the first one if from is NULL. Returns
+ * false if the index can't tell, then the caller has to walk all_devices instead.
+ */
+bool dev_index_find(enum dev_index_kind kind, uint32_t key, const struct device *from,
+		    struct device **result);
+/* Call after adding a device or changing its IDs, class, bus number or devfn. */
+void dev_index_invalidate(void);
 DEVTREE_CONST struct device *dev_find_path(
 		DEVTREE_CONST struct device *prev_match,
 		enum device_path_type path_type);
@@ -0,0 +1,49 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+
+#ifndef __RAM_SPLIT_H__
+#define __RAM_SPLIT_H__
+
+#include <memrange.h>
+#include <stdint.h>
+
+/*
+ * Splits the BM_MEM_RAM ranges of a struct memranges into one contiguous share per CPU,
+ * counted as if all ranges were back to back, for work like clearing or testing all of DRAM.
+ * Share 0 runs on the calling CPU and the other shares are queued for the APs with
+ * mp_queue_work(). A share keeps its index whichever CPU runs it, so the index can select
+ * per share resources.
+ */
+struct ram_split {
+	const struct memranges *mem;
+	uint64_t limit;		/* Memory at and above this address isn't split */
+	uint64_t align;		/* Shares start at multiples of this, a power of 2 */
+	uint64_t total;		/* Bytes of BM_MEM_RAM below limit */
+	unsigned int shares;	/* Number of shares, at most one per CPU */
+};
+
+struct ram_share {
+	const struct ram_split *split;
+	unsigned int index;
+	uint64_t first;		/* Offset of the share in the back to back ranges */
+	uint64_t last;		/* Offset of the end of the share */
+};
+
+/*
+ * Set up a split of the BM_MEM_RAM in mem below limit into one share per CPU. This sets
+ * split->shares. The ranges may still change until ram_split_run().
+ */
+void ram_split_init(struct ram_split *split, const struct memranges *mem, uint64_t limit,
+		    uint64_t align);
+
+/* Call func for every piece of the share, with its physical address and size. */
+void ram_share_for_each_piece(const struct ram_share *share,
+			      void (*func)(uint64_t base, uint64_t size, void *arg), void *arg);
+
+/*
+ * Call func once for every share, and return once all shares have finished. There is no
+ * timeout. This sets split->total. Only the BSP may call this, and not from queued work.
+ */
+void ram_split_run(struct ram_split *split,
+		   void (*func)(const struct ram_share *share, void *arg), void *arg);
+
+#endif /* __RAM_SPLIT_H__ */
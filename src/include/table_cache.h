@@ -0,0 +1,57 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+
+#ifndef _TABLE_CACHE_H_
+#define _TABLE_CACHE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <xxhash.h>
+
+/*
+ * The table cache keeps generated tables in the RW_TABLE_CACHE FMAP region,
+ * keyed by a fingerprint of everything the generators read: the devicetree
+ * with its resources, fw_config, the DIMM configuration, the CPU signature,
+ * the CBMEM layout and the build. On a matching boot the tables are copied
+ * from flash instead of being generated again.
+ *
+ * SMBIOS is not cached. Its strings come from callbacks that read VPD,
+ * EEPROMs or the EC at runtime, which the fingerprint can't cover.
+ */
+
+enum table_cache_blob {
+	TABLE_CACHE_SSDT,
+	TABLE_CACHE_NUM_BLOBS,
+};
+
+#if CONFIG(TABLE_CACHE)
+
+/*
+ * Copy the cached blob to dest. The blob is only used if it was generated at
+ * the same address with the same fingerprint and fits into the CBMEM entry
+ * dest points into. Returns the size of the blob, or 0 if it has to be
+ * generated and passed to table_cache_store().
+ */
+size_t table_cache_load(enum table_cache_blob blob, void *dest);
+
+/*
+ * Record a generated blob. The data has to stay in place until the cache is
+ * written back when leaving BS_WRITE_TABLES.
+ */
+void table_cache_store(enum table_cache_blob blob, const void *data, size_t size);
+
+/* Add platform specific inputs, like option values, to the fingerprint. */
+void table_cache_platform_fingerprint(struct xxh64_state *state);
+
+#else
+
+static inline size_t table_cache_load(enum table_cache_blob blob, void *dest)
+{
+	return 0;
+}
+
+static inline void table_cache_store(enum table_cache_blob blob, const void *data,
+				     size_t size) {}
+
+#endif
+
+#endif /* _TABLE_CACHE_H_ */
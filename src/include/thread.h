@@ -4,10 +4,15 @@
 
 #include <arch/cpu.h>
 #include <bootstate.h>
+#include <timer.h>
 #include <types.h>
 
+struct thread;
+
 struct thread_mutex {
 	bool locked;
+	/* Threads blocked in thread_mutex_lock(), in order of arrival */
+	struct thread *waiters;
 };
 
 enum thread_state {
@@ -20,6 +25,20 @@ struct thread_handle {
 	enum thread_state state;
 	/* Only valid when state == THREAD_DONE */
 	enum cb_err error;
+	/* Threads blocked in thread_join() */
+	struct thread *waiters;
+};
+
+/* Runnable threads with a higher priority run first. Threads of the same
+ * priority take turns. A thread keeps running until it yields or blocks, so a
+ * higher priority thread has to wait or sleep for lower priority ones to run.
+ * A thread that only yields still lets a lower priority thread run after it
+ * has been picked over that one a few times in a row, so it can't starve it. */
+enum thread_priority {
+	THREAD_PRIORITY_LOW,
+	THREAD_PRIORITY_NORMAL,
+	THREAD_PRIORITY_HIGH,
+	THREAD_NUM_PRIORITIES,
 };
 
 /* Run func(arg) on a new thread. Return 0 on successful start of thread, < 0
@@ -28,6 +47,12 @@ struct thread_handle {
  */
 int thread_run(struct thread_handle *handle, enum cb_err (*func)(void *), void *arg);
 
+/* thread_run_prio is the same as thread_run() except that the thread gets the
+ * given priority instead of THREAD_PRIORITY_NORMAL. A thread with a lower
+ * priority than the calling thread doesn't start until the caller blocks. */
+int thread_run_prio(struct thread_handle *handle, enum thread_priority prio,
+		    enum cb_err (*func)(void *), void *arg);
+
 /* thread_run_until is the same as thread_run() except that it blocks state
  * transitions from occurring in the (state, seq) pair of the boot state
  * machine. */
@@ -47,7 +72,14 @@ struct thread {
 	enum cb_err (*entry)(void *);
 	void *entry_arg;
 	int can_yield;
+	enum thread_priority priority;
 	struct thread_handle *handle;
+	/* Times passed over for higher priority threads while runnable */
+	unsigned int passed_over;
+	/* Accounting, the run time is the payload of the trace span of the thread */
+	int64_t run_time_us;
+	unsigned int yields;
+	unsigned int waits;
 };
 
 /* Return 0 on successful yield, < 0 when thread did not yield. */
@@ -72,6 +104,9 @@ void thread_coop_disable(void);
 void thread_mutex_lock(struct thread_mutex *mutex);
 void thread_mutex_unlock(struct thread_mutex *mutex);
 
+/* Return the id of the running thread, 0 for the main thread and on APs. */
+int thread_current_id(void);
+
 /* Architecture specific thread functions. */
 asmlinkage void switch_to_thread(uintptr_t new_stack, uintptr_t *saved_stack);
 /* Set up the stack frame for a new thread so that a switch_to_thread() call
@@ -94,6 +129,11 @@ static inline void thread_coop_disable(void) {}
 static inline void thread_mutex_lock(struct thread_mutex *mutex) {}
 
 static inline void thread_mutex_unlock(struct thread_mutex *mutex) {}
+
+static inline int thread_current_id(void)
+{
+	return 0;
+}
 #endif
 
 #endif /* THREAD_H_ */
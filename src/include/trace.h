@@ -0,0 +1,31 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+
+#ifndef __TRACE_H__
+#define __TRACE_H__
+
+#include <commonlib/trace_serialized.h>
+#include <stdint.h>
+
+/*
+ * Nested boot time trace spans, see CONFIG(TRACE_SPANS). A span that is begun while another
+ * span of the same CPU and thread is open becomes its child. The first span of an AP or of
+ * a thread becomes a child of the innermost open span of the main thread on the BSP, which
+ * usually is the one that dispatched the work.
+ *
+ * |id| is the enum timestamp_id of the traced event, or 0 if there is none. The name is
+ * truncated to TRACE_SPAN_NAME_LEN - 1 characters.
+ */
+#if ENV_RAMSTAGE && CONFIG(TRACE_SPANS)
+/* Returns a handle for trace_span_end(), < 0 if the span could not be recorded. */
+int trace_span_begin(uint32_t id, const char *name);
+/* Close the span. |payload| is optional data like the number of bytes processed. */
+void trace_span_end(int span, uint64_t payload);
+#else
+static inline int trace_span_begin(uint32_t id, const char *name)
+{
+	return -1;
+}
+static inline void trace_span_end(int span, uint64_t payload) {}
+#endif
+
+#endif /* __TRACE_H__ */
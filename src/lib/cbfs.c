@@ -2,6 +2,7 @@
 
 #include <assert.h>
 #include <boot_device.h>
+#include <bootstate.h>
 #include <cbfs.h>
 #include <cbmem.h>
 #include <commonlib/bsd/cbfs_private.h>
@@ -19,22 +20,46 @@
 #include <symbols.h>
 #include <thread.h>
 #include <timestamp.h>
+#include <trace.h>
 
 #if ENV_HAS_DATA_SECTION
 struct mem_pool cbfs_cache =
-	MEM_POOL_INIT(_cbfs_cache, REGION_SIZE(cbfs_cache), CONFIG_CBFS_CACHE_ALIGN);
+	_MEM_POOL_INIT(_cbfs_cache, REGION_SIZE(cbfs_cache), CONFIG_CBFS_CACHE_ALIGN,
+		       CONFIG(CBFS_CACHE_ANY_ORDER));
 #else
 struct mem_pool cbfs_cache = MEM_POOL_INIT(NULL, 0, 0);
 #endif
 
+/* Helps sizing CBFS_CACHE in memlayout to what a board really needs. */
+static void cbfs_cache_report(void)
+{
+	printk(BIOS_DEBUG, "CBFS: cache high-water mark: %zu of %zu bytes\n",
+	       mem_pool_high_water(&cbfs_cache), cbfs_cache.size);
+}
+
 static void switch_to_postram_cache(int unused)
 {
-	if (_preram_cbfs_cache != _postram_cbfs_cache)
-		mem_pool_init(&cbfs_cache, _postram_cbfs_cache, REGION_SIZE(postram_cbfs_cache),
-			      CONFIG_CBFS_CACHE_ALIGN);
+	if (_preram_cbfs_cache != _postram_cbfs_cache) {
+		cbfs_cache_report();
+		if (CONFIG(CBFS_CACHE_ANY_ORDER))
+			mem_pool_init_any_order(&cbfs_cache, _postram_cbfs_cache,
+						REGION_SIZE(postram_cbfs_cache),
+						CONFIG_CBFS_CACHE_ALIGN);
+		else
+			mem_pool_init(&cbfs_cache, _postram_cbfs_cache,
+				      REGION_SIZE(postram_cbfs_cache), CONFIG_CBFS_CACHE_ALIGN);
+	}
 }
 CBMEM_CREATION_HOOK(switch_to_postram_cache);
 
+#if ENV_RAMSTAGE
+static void cbfs_cache_report_hook(void *unused)
+{
+	cbfs_cache_report();
+}
+BOOT_STATE_INIT_ENTRY(BS_PAYLOAD_BOOT, BS_ON_ENTRY, cbfs_cache_report_hook, NULL);
+#endif
+
 enum cb_err _cbfs_boot_lookup(const char *name, bool force_ro,
 			      union cbfs_mdata *mdata, struct region_device *rdev)
 {
@@ -149,6 +174,36 @@ static inline bool cbfs_lzma_enabled(void)
 	return true;
 }
 
+static inline bool cbfs_zstd_enabled(void)
+{
+	/* Like LZMA, only ramstage and payloads are compressed with Zstandard. */
+	if (ENV_BOOTBLOCK || ENV_SEPARATE_VERSTAGE)
+		return false;
+	if (ENV_ROMSTAGE && CONFIG(POSTCAR_STAGE))
+		return false;
+	if ((ENV_ROMSTAGE || ENV_POSTCAR) && !CONFIG(COMPRESS_RAMSTAGE_ZSTD))
+		return false;
+	if (ENV_SMM)
+		return false;
+	return true;
+}
+
+static void cbfs_file_hash_verify_failed(const union cbfs_mdata *mdata, vb2_error_t rv)
+{
+	ERROR("'%s' file hash mismatch!\n", mdata->h.filename);
+	if (CONFIG(VBOOT_CBFS_INTEGRATION) && !vboot_recovery_mode_enabled()
+	    && vboot_logic_executed())
+		vboot_fail_and_reboot(vboot_get_context(), VB2_RECOVERY_FW_BODY, rv);
+}
+
+static void cbfs_file_measure(const union cbfs_mdata *mdata, const struct vb2_hash *hash)
+{
+	if (!hash ||
+	    tspi_cbfs_measurement(mdata->h.filename, be32toh(mdata->h.type), hash))
+		ERROR("failed to measure '%s' into TPM log\n", mdata->h.filename);
+		/* We intentionally continue to boot on measurement errors. */
+}
+
 static bool cbfs_file_hash_mismatch(const void *buffer, size_t size,
 				    const union cbfs_mdata *mdata, bool skip_verification)
 {
@@ -167,11 +222,7 @@ static bool cbfs_file_hash_mismatch(const void *buffer, size_t size,
 
 		vb2_error_t rv = vb2_hash_verify(vboot_hwcrypto_allowed(), buffer, size, hash);
 		if (rv != VB2_SUCCESS) {
-			ERROR("'%s' file hash mismatch!\n", mdata->h.filename);
-			if (CONFIG(VBOOT_CBFS_INTEGRATION) && !vboot_recovery_mode_enabled()
-			    && vboot_logic_executed())
-				vboot_fail_and_reboot(vboot_get_context(), VB2_RECOVERY_FW_BODY,
-						      rv);
+			cbfs_file_hash_verify_failed(mdata, rv);
 			return true;
 		}
 	}
@@ -188,15 +239,167 @@ static bool cbfs_file_hash_mismatch(const void *buffer, size_t size,
 				hash = &calculated_hash;
 		}
 
-		if (!hash ||
-		    tspi_cbfs_measurement(mdata->h.filename, be32toh(mdata->h.type), hash))
-			ERROR("failed to measure '%s' into TPM log\n", mdata->h.filename);
-			/* We intentionally continue to boot on measurement errors. */
+		cbfs_file_measure(mdata, hash);
+	}
+
+	return false;
+}
+
+/*
+ * Incremental counterpart of cbfs_file_hash_mismatch(), for files that are hashed piece by
+ * piece while they are being read instead of in one go over a finished buffer.
+ */
+struct cbfs_file_hasher {
+	const union cbfs_mdata *mdata;
+	const struct vb2_hash *hash;		/* Expected hash, NULL if not verifying. */
+	struct vb2_digest_context verify_dc;
+	struct vb2_digest_context measure_dc;
+	bool measure;				/* measure_dc is in use. */
+	vb2_error_t verify_rv;
+	vb2_error_t measure_rv;
+};
+
+/* Returns false if the file cannot be verified at all. */
+static bool cbfs_file_hasher_init(struct cbfs_file_hasher *h, const union cbfs_mdata *mdata,
+				  size_t size, bool skip_verification)
+{
+	h->mdata = mdata;
+	h->hash = NULL;
+	h->measure = false;
+	h->verify_rv = VB2_SUCCESS;
+	h->measure_rv = VB2_SUCCESS;
+
+	if (CONFIG(CBFS_VERIFICATION) && !skip_verification) {
+		h->hash = cbfs_file_hash(mdata);
+		if (!h->hash) {
+			ERROR("'%s' does not have a file hash!\n", mdata->h.filename);
+			return false;
+		}
+		h->verify_rv = vb2_digest_init(&h->verify_dc, vboot_hwcrypto_allowed(),
+					       h->hash->algo, size);
+	}
+
+	/* No need to hash the file twice if verification already uses the TPM algorithm. */
+	if (CONFIG(TPM_MEASURED_BOOT) && !ENV_SMM &&
+	    (!h->hash || h->hash->algo != TPM_MEASURE_ALGO)) {
+		h->measure = true;
+		h->measure_rv = vb2_digest_init(&h->measure_dc, vboot_hwcrypto_allowed(),
+						TPM_MEASURE_ALGO, size);
+	}
+
+	return true;
+}
+
+static void cbfs_file_hasher_extend(struct cbfs_file_hasher *h, const void *buf, size_t size)
+{
+	if (h->hash && h->verify_rv == VB2_SUCCESS)
+		h->verify_rv = vb2_digest_extend(&h->verify_dc, buf, size);
+	if (h->measure && h->measure_rv == VB2_SUCCESS)
+		h->measure_rv = vb2_digest_extend(&h->measure_dc, buf, size);
+}
+
+/* Returns true if the file must not be used. */
+static bool cbfs_file_hasher_mismatch(struct cbfs_file_hasher *h)
+{
+	const struct vb2_hash *hash = NULL;
+	struct vb2_hash calculated_hash;
+
+	if (h->hash) {
+		size_t hash_size = vb2_digest_size(h->hash->algo);
+		vb2_error_t rv = h->verify_rv;
+
+		if (rv == VB2_SUCCESS)
+			rv = vb2_digest_finalize(&h->verify_dc, calculated_hash.raw, hash_size);
+		if (rv == VB2_SUCCESS && memcmp(calculated_hash.raw, h->hash->raw, hash_size))
+			rv = VB2_ERROR_SHA_MISMATCH;
+		if (rv != VB2_SUCCESS) {
+			cbfs_file_hash_verify_failed(h->mdata, rv);
+			return true;
+		}
+		hash = h->hash;
+	}
+
+	if (CONFIG(TPM_MEASURED_BOOT) && !ENV_SMM) {
+		if (h->measure) {
+			calculated_hash.algo = TPM_MEASURE_ALGO;
+			if (h->measure_rv == VB2_SUCCESS &&
+			    !vb2_digest_finalize(&h->measure_dc, calculated_hash.raw,
+						 vb2_digest_size(TPM_MEASURE_ALGO)))
+				hash = &calculated_hash;
+			else
+				hash = NULL;
+		}
+
+		cbfs_file_measure(h->mdata, hash);
 	}
 
 	return false;
 }
 
+/*
+ * Size of the pieces in which files are read and hashed by cbfs_read_and_hash(). Small
+ * enough that a piece is still cached when it gets hashed, large enough to keep the
+ * per-transfer overhead of SPI controllers low.
+ */
+#define CBFS_READ_CHUNK_SIZE (16 * KiB)
+
+/*
+ * Read a whole file into |buffer| and verify/measure it on the way. Each chunk is hashed
+ * right after it arrives, so the data is only pulled through the cache once. Returns false
+ * on I/O error or hash mismatch.
+ */
+static bool cbfs_read_and_hash(const struct region_device *rdev, void *buffer, size_t size,
+			       const union cbfs_mdata *mdata, bool skip_verification)
+{
+	struct cbfs_file_hasher hasher;
+	size_t offset, len;
+
+	/* Avoid linking hash functions when verification and measurement are disabled. */
+	if (!CONFIG(CBFS_VERIFICATION) && !CONFIG(TPM_MEASURED_BOOT))
+		return rdev_readat(rdev, buffer, 0, size) == size;
+
+	if (!cbfs_file_hasher_init(&hasher, mdata, size, skip_verification))
+		return false;
+
+	for (offset = 0; offset < size; offset += len) {
+		len = MIN(size - offset, (size_t)CBFS_READ_CHUNK_SIZE);
+		if (rdev_readat(rdev, buffer + offset, offset, len) != len)
+			return false;
+		cbfs_file_hasher_extend(&hasher, buffer + offset, len);
+	}
+
+	return !cbfs_file_hasher_mismatch(&hasher);
+}
+
+static size_t cbfs_decompress(const void *in, size_t in_size, void *buffer,
+			      size_t buffer_size, uint32_t compression)
+{
+	size_t out_size = 0;
+
+	switch (compression) {
+	case CBFS_COMPRESS_LZ4:
+		timestamp_add_now(TS_ULZ4F_START);
+		out_size = ulz4fn(in, in_size, buffer, buffer_size);
+		timestamp_add_now(TS_ULZ4F_END);
+		break;
+
+	case CBFS_COMPRESS_LZMA:
+		/* Note: timestamp not useful for memory-mapped media (x86) */
+		timestamp_add_now(TS_ULZMA_START);
+		out_size = ulzman(in, in_size, buffer, buffer_size);
+		timestamp_add_now(TS_ULZMA_END);
+		break;
+
+	case CBFS_COMPRESS_ZSTD:
+		timestamp_add_now(TS_UZSTD_START);
+		out_size = uzstdn(in, in_size, buffer, buffer_size);
+		timestamp_add_now(TS_UZSTD_END);
+		break;
+	}
+
+	return out_size;
+}
+
 static size_t cbfs_load_and_decompress(const struct region_device *rdev, void *buffer,
 				       size_t buffer_size, uint32_t compression,
 				       const union cbfs_mdata *mdata, bool skip_verification)
@@ -212,53 +415,56 @@ static size_t cbfs_load_and_decompress(const struct region_device *rdev, void *b
 	case CBFS_COMPRESS_NONE:
 		if (buffer_size < in_size)
 			return 0;
-		if (rdev_readat(rdev, buffer, 0, in_size) != in_size)
-			return 0;
-		if (cbfs_file_hash_mismatch(buffer, in_size, mdata, skip_verification))
+		if (!cbfs_read_and_hash(rdev, buffer, in_size, mdata, skip_verification))
 			return 0;
 		return in_size;
 
 	case CBFS_COMPRESS_LZ4:
 		if (!cbfs_lz4_enabled())
 			return 0;
-
-		/* cbfs_prog_stage_load() takes care of in-place LZ4 decompression by
-		   setting up the rdev to be in memory. */
-		map = rdev_mmap_full(rdev);
-		if (map == NULL)
-			return 0;
-
-		if (!cbfs_file_hash_mismatch(map, in_size, mdata, skip_verification)) {
-			timestamp_add_now(TS_ULZ4F_START);
-			out_size = ulz4fn(map, in_size, buffer, buffer_size);
-			timestamp_add_now(TS_ULZ4F_END);
-		}
-
-		rdev_munmap(rdev, map);
-
-		return out_size;
+		break;
 
 	case CBFS_COMPRESS_LZMA:
 		if (!cbfs_lzma_enabled())
 			return 0;
-		map = rdev_mmap_full(rdev);
-		if (map == NULL)
+		break;
+
+	case CBFS_COMPRESS_ZSTD:
+		if (!cbfs_zstd_enabled())
 			return 0;
+		break;
+
+	default:
+		return 0;
+	}
 
-		if (!cbfs_file_hash_mismatch(map, in_size, mdata, skip_verification)) {
-			/* Note: timestamp not useful for memory-mapped media (x86) */
-			timestamp_add_now(TS_ULZMA_START);
-			out_size = ulzman(map, in_size, buffer, buffer_size);
-			timestamp_add_now(TS_ULZMA_END);
+	/*
+	 * Without a memory-mapped boot device, mapping the file means reading it into the
+	 * cbfs_cache anyway. Do that read ourselves so that hashing can be folded into it.
+	 * Preloaded files are already in memory and are mapped in place below.
+	 */
+	if (!CONFIG(BOOT_DEVICE_MEMORY_MAPPED) && cbfs_cache.size &&
+	    rdev_relative_offset(boot_device_ro(), rdev) >= 0) {
+		void *staging = mem_pool_alloc(&cbfs_cache, in_size);
+		if (staging) {
+			if (cbfs_read_and_hash(rdev, staging, in_size, mdata, skip_verification))
+				out_size = cbfs_decompress(staging, in_size, buffer,
+							   buffer_size, compression);
+			mem_pool_free(&cbfs_cache, staging);
+			return out_size;
 		}
+	}
 
-		rdev_munmap(rdev, map);
+	map = rdev_mmap_full(rdev);
+	if (map == NULL)
+		return 0;
 
-		return out_size;
+	if (!cbfs_file_hash_mismatch(map, in_size, mdata, skip_verification))
+		out_size = cbfs_decompress(map, in_size, buffer, buffer_size, compression);
 
-	default:
-		return 0;
-	}
+	rdev_munmap(rdev, map);
+
+	return out_size;
 }
 
 struct cbfs_preload_context {
@@ -488,7 +694,12 @@ void *_cbfs_alloc(const char *name, cbfs_allocator_t allocator, void *arg,
 	if (!force_ro && get_preload_rdev(&rdev, name) == CB_SUCCESS)
 		preload_successful = true;
 
-	void *ret = do_alloc(&mdata, &rdev, allocator, arg, size_out, false);
+	size_t size = 0;
+	int span = trace_span_begin(0, name);
+	void *ret = do_alloc(&mdata, &rdev, allocator, arg, &size, false);
+	trace_span_end(span, ret ? size : 0);
+	if (size_out)
+		*size_out = size;
 
 	/* When using cbfs_preload we need to free the preload buffer after populating the
 	 * destination buffer. We know we must have a mem_rdev here, so extra mmap is fine. */
@@ -575,18 +786,21 @@ enum cb_err cbfs_prog_stage_load(struct prog *pstage)
 			return CB_SUCCESS;
 	}
 
-	/* LZ4 stages can be decompressed in-place to save mapping scratch space. Load the
-	   compressed data to the end of the buffer and point &rdev to that memory location. */
+	size_t fsize;
+
+	/* LZ4 stages can be decompressed in-place to save mapping scratch space. Load (and
+	   verify) the compressed data at the end of the buffer and decompress from there. */
 	if (cbfs_lz4_enabled() && compression == CBFS_COMPRESS_LZ4) {
 		size_t in_size = region_device_sz(&rdev);
 		void *compr_start = prog_start(pstage) + prog_size(pstage) - in_size;
-		if (rdev_readat(&rdev, compr_start, 0, in_size) != in_size)
+		if (!cbfs_read_and_hash(&rdev, compr_start, in_size, &mdata, false))
 			return CB_ERR;
-		rdev_chain_mem(&rdev, compr_start, in_size);
+		fsize = cbfs_decompress(compr_start, in_size, prog_start(pstage),
+					prog_size(pstage), compression);
+	} else {
+		fsize = cbfs_load_and_decompress(&rdev, prog_start(pstage), prog_size(pstage),
+						 compression, &mdata, false);
 	}
-
-	size_t fsize = cbfs_load_and_decompress(&rdev, prog_start(pstage), prog_size(pstage),
-						compression, &mdata, false);
 	if (!fsize)
 		return CB_ERR;
 
@@ -699,7 +913,7 @@ static void mcache_to_cbmem(const struct cbfs_boot_device *cbd, u32 cbmem_id)
 		       cbmem_id, real_size);
 		return;
 	}
-	memcpy(cbmem_mcache, cbd->mcache, real_size);
+	cbfs_mcache_copy(cbmem_mcache, cbd->mcache, cbd->mcache_size);
 }
 
 static void cbfs_mcache_migrate(int unused)
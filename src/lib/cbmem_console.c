@@ -4,6 +4,8 @@
 #include <console/console.h>
 #include <console/uart.h>
 #include <cbmem.h>
+#include <commonlib/helpers.h>
+#include <string.h>
 #include <symbols.h>
 #include <types.h>
 
@@ -97,49 +99,93 @@ void cbmemc_init(void)
 	}
 }
 
-void cbmemc_tx_byte(unsigned char data)
+/*
+ * SMM can interrupt the other stages in the middle of a write and, unlike APs, doesn't take
+ * the console lock, so on x86 the cursor is updated atomically. That way, the data of one
+ * cbmemc_write() call never ends up interleaved with another one.
+ */
+static bool update_cursor(volatile u32 *cursor_p, u32 old, u32 new)
 {
-	if (!current_console || !current_console->size || console_paused)
+	if (ENV_X86)
+		return __sync_bool_compare_and_swap(cursor_p, old, new);
+
+	*cursor_p = new;
+	return true;
+}
+
+/* Advance the cursor by |len| bytes and return the new cursor. */
+static u32 reserve_space(struct cbmem_console *cons, size_t len)
+{
+	volatile u32 *cursor_p = (void *)cons + offsetof(struct cbmem_console, cursor);
+	const u32 size = cons->size;
+	u32 old, new, cursor;
+
+	do {
+		old = *cursor_p;
+		cursor = (old & CURSOR_MASK) + len % size;
+		new = old & ~CURSOR_MASK;
+		if (len >= size || cursor >= size)
+			new |= OVERFLOW;
+		if (cursor >= size)
+			cursor -= size;
+		new |= cursor;
+	} while (!update_cursor(cursor_p, old, new));
+
+	return cursor;
+}
+
+void cbmemc_write(const void *data, size_t len)
+{
+	const u8 *p = data;
+	u32 end, start, size, first;
+
+	if (!current_console || !current_console->size || console_paused || !len)
 		return;
 
-	u32 flags = current_console->cursor & ~CURSOR_MASK;
-	u32 cursor = current_console->cursor & CURSOR_MASK;
+	size = current_console->size;
+	end = reserve_space(current_console, len);
 
-	current_console->body[cursor++] = data;
-	if (cursor >= current_console->size) {
-		cursor = 0;
-		flags |= OVERFLOW;
+	/* Only the last |size| bytes survive, ending at the new cursor. */
+	if (len > size) {
+		p += len - size;
+		len = size;
 	}
+	start = end >= len ? end - len : end + size - len;
+
+	first = MIN(len, size - start);
+	memcpy(&current_console->body[start], p, first);
+	memcpy(current_console->body, p + first, len - first);
+}
 
-	current_console->cursor = flags | cursor;
+void cbmemc_tx_byte(unsigned char data)
+{
+	cbmemc_write(&data, 1);
 }
 
 /*
  * Copy the current console buffer (either from the cache as RAM area or from
  * the static buffer, pointed at by src_cons_p) into the newly initialized CBMEM
- * console. The use of cbmemc_tx_byte() ensures that all special cases for the
+ * console. The use of cbmemc_write() ensures that all special cases for the
  * target console (e.g. overflow) will be handled. If there had been an
  * overflow in the source console, log a message to that effect.
  */
 static void copy_console_buffer(struct cbmem_console *src_cons_p)
 {
-	u32 c;
+	u32 cursor;
 
 	if (!src_cons_p)
 		return;
 
+	cursor = src_cons_p->cursor & CURSOR_MASK;
+
 	if (src_cons_p->cursor & OVERFLOW) {
 		const char overflow_warning[] = "\n*** Pre-CBMEM " ENV_STRING
 			" console overflowed, log truncated! ***\n";
-		for (c = 0; c < sizeof(overflow_warning) - 1; c++)
-			cbmemc_tx_byte(overflow_warning[c]);
-		for (c = src_cons_p->cursor & CURSOR_MASK;
-		     c < src_cons_p->size; c++)
-			cbmemc_tx_byte(src_cons_p->body[c]);
+		cbmemc_write(overflow_warning, sizeof(overflow_warning) - 1);
+		cbmemc_write(&src_cons_p->body[cursor], src_cons_p->size - cursor);
 	}
 
-	for (c = 0; c < (src_cons_p->cursor & CURSOR_MASK); c++)
-		cbmemc_tx_byte(src_cons_p->body[c]);
+	cbmemc_write(src_cons_p->body, cursor);
 
 	/* Invalidate the source console, so it will be reinitialized on the
 	   next reboot. Otherwise, we might copy the same bytes again. */
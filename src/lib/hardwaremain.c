@@ -22,6 +22,7 @@
 #include <thread.h>
 #include <timer.h>
 #include <timestamp.h>
+#include <trace.h>
 #include <types.h>
 
 static boot_state_t bs_pre_device(void *arg);
@@ -320,6 +321,7 @@ static void bs_walk_state_machine(void)
 	while (1) {
 		struct boot_state *state;
 		boot_state_t next_id;
+		int span;
 
 		state = &boot_states[current_phase.state_id];
 
@@ -333,6 +335,8 @@ static void bs_walk_state_machine(void)
 			printk(BIOS_DEBUG, "BS: Entering %s state.\n",
 				state->name);
 
+		span = trace_span_begin(0, state->name);
+
 		bs_run_timers(0);
 
 		bs_sample_time(state);
@@ -359,6 +363,8 @@ static void bs_walk_state_machine(void)
 
 		bs_call_callbacks(state, current_phase.seq);
 
+		trace_span_end(span, 0);
+
 		if (CONFIG(DEBUG_BOOT_STATE))
 			printk(BIOS_DEBUG,
 				"----------------------------------------\n");
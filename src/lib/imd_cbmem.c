@@ -219,6 +219,24 @@ void cbmem_list(void)
 }
 #endif
 
+void cbmem_walk_entries(void (*fn)(u32 id, const void *start, size_t size, void *arg),
+			void *arg)
+{
+	struct imd_cursor cursor;
+	const struct imd_entry *e;
+	uint32_t id;
+
+	if (imd_cursor_init(&imd, &cursor))
+		return;
+
+	while ((e = imd_cursor_next(&cursor))) {
+		id = imd_entry_id(e);
+		if (id == CBMEM_ID_IMD_ROOT || id == CBMEM_ID_IMD_SMALL)
+			continue;
+		fn(id, imd_entry_at(&imd, e), imd_entry_size(e), arg);
+	}
+}
+
 void cbmem_add_records_to_cbtable(struct lb_header *header)
 {
 	struct imd_cursor cursor;
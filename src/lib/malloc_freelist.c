@@ -0,0 +1,324 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+
+/*
+ * Ramstage heap with segregated free lists, used instead of the bump allocator in malloc.c
+ * when CONFIG(HEAP_FREE_LIST) is selected.
+ *
+ * Every block starts with a struct heap_block that records its own size and the size of the
+ * block physically in front of it, so a freed block can be merged with both neighbours in
+ * constant time. Free blocks are kept on doubly linked lists, one per power-of-two size
+ * class, and free neighbours are always merged, so no two free blocks are ever adjacent.
+ * The heap is terminated by a zero-sized block that is permanently in use.
+ */
+
+#include <bootstate.h>
+#include <cbmem.h>
+#include <commonlib/heap_stats_serialized.h>
+#include <console/console.h>
+#include <lib.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if CONFIG(DEBUG_MALLOC)
+#define MALLOCDBG(x...) printk(BIOS_SPEW, x)
+#else
+#define MALLOCDBG(x...)
+#endif
+
+struct heap_block {
+	size_t prev_size;	/* Size of the block in front of this one, 0 for the first */
+	size_t size;		/* Size including this header, ORed with BLOCK_IN_USE */
+};
+
+struct free_block {
+	struct heap_block h;
+	struct free_block *next;
+	struct free_block *prev;
+};
+
+#define BLOCK_IN_USE	((size_t)1)
+
+/* At least sizeof(u64), which is what malloc() has always guaranteed. */
+#define HEAP_ALIGN	sizeof(struct heap_block)
+#define MIN_BLOCK_SIZE	ALIGN_UP(sizeof(struct free_block), HEAP_ALIGN)
+
+extern unsigned char _heap, _eheap;
+
+static struct heap_block *heap_end;	/* Terminating block, NULL until initialized */
+static struct free_block *free_lists[HEAP_STATS_NUM_CLASSES];
+static struct heap_stats stats;
+static struct heap_stats *cbmem_stats;
+
+static size_t block_size(const struct heap_block *b)
+{
+	return b->size & ~BLOCK_IN_USE;
+}
+
+static bool block_in_use(const struct heap_block *b)
+{
+	return b->size & BLOCK_IN_USE;
+}
+
+static struct heap_block *next_block(struct heap_block *b)
+{
+	return (void *)b + block_size(b);
+}
+
+static struct heap_block *prev_block(struct heap_block *b)
+{
+	return b->prev_size ? (void *)b - b->prev_size : NULL;
+}
+
+/* Set the size of |b| and keep the boundary tag of the following block in sync. */
+static void set_block(struct heap_block *b, size_t size, bool in_use)
+{
+	b->size = size | (in_use ? BLOCK_IN_USE : 0);
+	next_block(b)->prev_size = size;
+}
+
+static unsigned int size_class(size_t size)
+{
+	return MIN(log2_64(size / MIN_BLOCK_SIZE), HEAP_STATS_NUM_CLASSES - 1);
+}
+
+static void free_list_insert(struct heap_block *b)
+{
+	struct free_block *fb = (struct free_block *)b;
+	struct free_block **head = &free_lists[size_class(block_size(b))];
+
+	fb->prev = NULL;
+	fb->next = *head;
+	if (*head)
+		(*head)->prev = fb;
+	*head = fb;
+}
+
+static void free_list_remove(struct heap_block *b)
+{
+	struct free_block *fb = (struct free_block *)b;
+
+	if (fb->prev)
+		fb->prev->next = fb->next;
+	else
+		free_lists[size_class(block_size(b))] = fb->next;
+	if (fb->next)
+		fb->next->prev = fb->prev;
+}
+
+static void heap_init(void)
+{
+	struct heap_block *first = (void *)ALIGN_UP((uintptr_t)&_heap, HEAP_ALIGN);
+
+	heap_end = (void *)ALIGN_DOWN((uintptr_t)&_eheap, HEAP_ALIGN) - sizeof(*heap_end);
+	if ((void *)heap_end < (void *)first + MIN_BLOCK_SIZE)
+		die("Error! %s: Heap is too small\n", __func__);
+
+	heap_end->size = BLOCK_IN_USE;
+	first->prev_size = 0;
+	set_block(first, (void *)heap_end - (void *)first, false);
+	free_list_insert(first);
+
+	stats.heap_size = (void *)&_eheap - (void *)&_heap;
+	stats.class_unit = MIN_BLOCK_SIZE;
+}
+
+/* Take the first block that fits from the smallest size class that may hold one. */
+static struct heap_block *find_free_block(size_t size)
+{
+	for (unsigned int class = size_class(size); class < HEAP_STATS_NUM_CLASSES; class++) {
+		for (struct free_block *fb = free_lists[class]; fb; fb = fb->next) {
+			if (block_size(&fb->h) >= size)
+				return &fb->h;
+		}
+	}
+
+	return NULL;
+}
+
+/* Shrink the unlisted block |b| to |size| bytes and put the rest on the free lists. */
+static void split_block(struct heap_block *b, size_t size)
+{
+	const size_t rest = block_size(b) - size;
+	struct heap_block *r;
+
+	if (rest < MIN_BLOCK_SIZE)
+		return;
+
+	set_block(b, size, block_in_use(b));
+	r = next_block(b);
+	set_block(r, rest, false);
+	free_list_insert(r);
+}
+
+/* We don't restrict the boundary. This is firmware,
+ * you are supposed to know what you are doing.
+ */
+void *memalign(size_t boundary, size_t size)
+{
+	struct heap_block *b;
+	size_t align, block, needed;
+
+	MALLOCDBG("%s Enter, boundary %zu, size %zu\n", __func__, boundary, size);
+
+	if (!heap_end)
+		heap_init();
+
+	if (size > stats.heap_size || boundary > stats.heap_size)
+		goto out_of_memory;
+
+	align = boundary <= HEAP_ALIGN ? HEAP_ALIGN : (size_t)1 << log2_ceil(boundary);
+	block = MAX(ALIGN_UP(size + sizeof(*b), HEAP_ALIGN), MIN_BLOCK_SIZE);
+
+	/* Leave room to split off a free block in front of the aligned one. */
+	needed = block;
+	if (align > HEAP_ALIGN)
+		needed += align + MIN_BLOCK_SIZE;
+
+	b = find_free_block(needed);
+	if (!b)
+		goto out_of_memory;
+	free_list_remove(b);
+
+	if (!IS_ALIGNED((uintptr_t)(b + 1), align)) {
+		uintptr_t data = ALIGN_UP((uintptr_t)(b + 1) + MIN_BLOCK_SIZE, align);
+		struct heap_block *aligned = (struct heap_block *)data - 1;
+		const size_t total = block_size(b);
+
+		set_block(b, (void *)aligned - (void *)b, false);
+		set_block(aligned, total - block_size(b), false);
+		free_list_insert(b);
+		b = aligned;
+	}
+
+	split_block(b, block);
+	b->size |= BLOCK_IN_USE;
+
+	stats.allocations++;
+	stats.in_use += block_size(b);
+	stats.peak_in_use = MAX(stats.peak_in_use, stats.in_use);
+
+	MALLOCDBG("%s %p\n", __func__, b + 1);
+
+	return b + 1;
+
+out_of_memory:
+	printk(BIOS_ERR, "%s(boundary=%zu, size=%zu): failed: ", __func__, boundary, size);
+	printk(BIOS_ERR, "%llu of %llu heap bytes in use\n",
+	       (unsigned long long)stats.in_use, (unsigned long long)stats.heap_size);
+	die("Error! %s: Out of memory", __func__);
+	return NULL;
+}
+
+void *malloc(size_t size)
+{
+	return memalign(sizeof(u64), size);
+}
+
+void *calloc(size_t nitems, size_t size)
+{
+	size_t total;
+	void *p;
+
+	if (__builtin_mul_overflow(nitems, size, &total))
+		die("Error! %s: %zu * %zu overflows", __func__, nitems, size);
+
+	p = malloc(total);
+	if (p)
+		memset(p, 0, total);
+
+	return p;
+}
+
+void free(void *ptr)
+{
+	struct heap_block *b, *neighbour;
+	size_t size;
+
+	if (ptr == NULL)
+		return;
+
+	if (!heap_end || ptr < (void *)&_heap || ptr >= (void *)heap_end) {
+		printk(BIOS_WARNING, "Pointer passed to %s is not "
+					"pointing to the heap\n", __func__);
+		return;
+	}
+
+	b = (struct heap_block *)ptr - 1;
+	if (!block_in_use(b)) {
+		printk(BIOS_WARNING, "Pointer passed to %s is already free\n", __func__);
+		return;
+	}
+
+	size = block_size(b);
+	stats.frees++;
+	stats.in_use -= size;
+
+	neighbour = next_block(b);
+	if (!block_in_use(neighbour)) {
+		free_list_remove(neighbour);
+		size += block_size(neighbour);
+	}
+
+	/* The header of b stays behind if it merges into the previous block. */
+	set_block(b, block_size(b), false);
+
+	neighbour = prev_block(b);
+	if (neighbour && !block_in_use(neighbour)) {
+		free_list_remove(neighbour);
+		size += block_size(neighbour);
+		b = neighbour;
+	}
+
+	set_block(b, size, false);
+	free_list_insert(b);
+}
+
+static void heap_stats_snapshot(struct heap_stats *out)
+{
+	stats.free_bytes = 0;
+	stats.largest_free = 0;
+	stats.free_blocks = 0;
+	memset(stats.class_free_blocks, 0, sizeof(stats.class_free_blocks));
+
+	for (unsigned int class = 0; class < HEAP_STATS_NUM_CLASSES; class++) {
+		for (struct free_block *fb = free_lists[class]; fb; fb = fb->next) {
+			const size_t size = block_size(&fb->h);
+
+			stats.free_bytes += size;
+			stats.largest_free = MAX(stats.largest_free, size);
+			stats.free_blocks++;
+			stats.class_free_blocks[class]++;
+		}
+	}
+
+	memcpy(out, &stats, sizeof(*out));
+}
+
+/* The entry has to exist before the coreboot tables are written to be listed in them. */
+static void heap_stats_add_cbmem(void *unused)
+{
+	cbmem_stats = cbmem_add(CBMEM_ID_HEAP_STATS, sizeof(*cbmem_stats));
+	if (!cbmem_stats) {
+		printk(BIOS_ERR, "Unable to add heap statistics to CBMEM\n");
+		return;
+	}
+
+	heap_stats_snapshot(cbmem_stats);
+}
+
+static void heap_stats_finalize(void *unused)
+{
+	struct heap_stats s;
+
+	heap_stats_snapshot(&s);
+	if (cbmem_stats)
+		memcpy(cbmem_stats, &s, sizeof(s));
+
+	printk(BIOS_DEBUG, "Heap: %llu/%llu bytes in use, peak %llu, %u allocations, %u frees, "
+	       "%u free blocks, largest %llu\n", (unsigned long long)s.in_use,
+	       (unsigned long long)s.heap_size, (unsigned long long)s.peak_in_use,
+	       s.allocations, s.frees, s.free_blocks, (unsigned long long)s.largest_free);
+}
+
+BOOT_STATE_INIT_ENTRY(BS_WRITE_TABLES, BS_ON_ENTRY, heap_stats_add_cbmem, NULL);
+BOOT_STATE_INIT_ENTRY(BS_PAYLOAD_BOOT, BS_ON_ENTRY, heap_stats_finalize, NULL);
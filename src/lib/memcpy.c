@@ -1,14 +1,77 @@
 /* SPDX-License-Identifier: GPL-2.0-only */
 
+#include <stdint.h>
 #include <string.h>
+
+#include "memops.h"
+
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define MERGE_WORDS(lo, hi, lshift) (((lo) >> (lshift)) | ((hi) << (WORD_BITS - (lshift))))
+#else
+#define MERGE_WORDS(lo, hi, lshift) (((lo) << (lshift)) | ((hi) >> (WORD_BITS - (lshift))))
+#endif
+
+/* Copy whole words between two word-aligned buffers, four words per iteration. */
+static void copy_words_aligned(mem_word_t *d, const mem_word_t *s, size_t words)
+{
+	for (; words >= 4; words -= 4, d += 4, s += 4) {
+		d[0] = s[0];
+		d[1] = s[1];
+		d[2] = s[2];
+		d[3] = s[3];
+	}
+
+	while (words--)
+		*d++ = *s++;
+}
+
+/*
+ * Copy whole words to an aligned destination from a source that is not word-aligned. Only
+ * aligned loads are issued (some architectures trap on unaligned ones), and each output
+ * word is assembled from two neighbouring source words. The loads never leave the aligned
+ * words that contain source bytes, so they cannot fault.
+ */
+static void copy_words_shifted(mem_word_t *d, const uint8_t *src, size_t words)
+{
+	const unsigned int lshift = ((uintptr_t)src & WORD_MASK) * 8;
+	const mem_word_t *s = (const mem_word_t *)((uintptr_t)src & ~WORD_MASK);
+	mem_word_t lo = *s++;
+
+	while (words--) {
+		mem_word_t hi = *s++;
+		*d++ = MERGE_WORDS(lo, hi, lshift);
+		lo = hi;
+	}
+}
+
 void *memcpy(void *vdest, const void *vsrc, size_t bytes)
 {
-	const char *src = vsrc;
-	char *dest = vdest;
-	int i;
+	const uint8_t *src = vsrc;
+	uint8_t *dest = vdest;
+
+	if (bytes >= 2 * WORD_SIZE) {
+		size_t words;
+
+		/* Byte-copy the head until the destination is word-aligned. */
+		while ((uintptr_t)dest & WORD_MASK) {
+			*dest++ = *src++;
+			bytes--;
+		}
+
+		words = bytes / WORD_SIZE;
+		if ((uintptr_t)src & WORD_MASK)
+			copy_words_shifted((mem_word_t *)dest, src, words);
+		else
+			copy_words_aligned((mem_word_t *)dest, (const mem_word_t *)src, words);
+
+		dest += words * WORD_SIZE;
+		src += words * WORD_SIZE;
+		bytes -= words * WORD_SIZE;
+	}
 
-	for (i = 0; i < (int)bytes; i++)
-		dest[i] = src[i];
+	/* Tail, or the whole copy if it is too short to be worth aligning. */
+	while (bytes--)
+		*dest++ = *src++;
 
 	return vdest;
 }
@@ -1,19 +1,81 @@
 /* SPDX-License-Identifier: GPL-2.0-only */
 
+#include <stdint.h>
 #include <string.h>
-void *memmove(void *vdest, const void *vsrc, size_t count)
+
+#include "memops.h"
+
+/*
+ * Words can only be moved if source and destination share the same alignment. Otherwise
+ * fall back to byte moves, overlapping unaligned moves are rare enough not to matter.
+ */
+static int can_move_words(const uint8_t *dest, const uint8_t *src, size_t count)
+{
+	return count >= 2 * WORD_SIZE && !(((uintptr_t)dest ^ (uintptr_t)src) & WORD_MASK);
+}
+
+static void move_forward(uint8_t *dest, const uint8_t *src, size_t count)
 {
-	const char *src = vsrc;
-	char *dest = vdest;
+	if (can_move_words(dest, src, count)) {
+		mem_word_t *d;
+		const mem_word_t *s;
 
-	if (dest <= src) {
-		while (count--)
+		while ((uintptr_t)dest & WORD_MASK) {
 			*dest++ = *src++;
-	} else {
-		src  += count - 1;
-		dest += count - 1;
-		while (count--)
-			*dest-- = *src--;
+			count--;
+		}
+
+		d = (mem_word_t *)dest;
+		s = (const mem_word_t *)src;
+		for (; count >= WORD_SIZE; count -= WORD_SIZE)
+			*d++ = *s++;
+
+		dest = (uint8_t *)d;
+		src = (const uint8_t *)s;
+	}
+
+	while (count--)
+		*dest++ = *src++;
+}
+
+static void move_backward(uint8_t *dest, const uint8_t *src, size_t count)
+{
+	/* Start one past the end and walk down. */
+	dest += count;
+	src += count;
+
+	if (can_move_words(dest, src, count)) {
+		mem_word_t *d;
+		const mem_word_t *s;
+
+		while ((uintptr_t)dest & WORD_MASK) {
+			*--dest = *--src;
+			count--;
+		}
+
+		d = (mem_word_t *)dest;
+		s = (const mem_word_t *)src;
+		for (; count >= WORD_SIZE; count -= WORD_SIZE)
+			*--d = *--s;
+
+		dest = (uint8_t *)d;
+		src = (const uint8_t *)s;
 	}
+
+	while (count--)
+		*--dest = *--src;
+}
+
+void *memmove(void *vdest, const void *vsrc, size_t count)
+{
+	const uint8_t *src = vsrc;
+	uint8_t *dest = vdest;
+
+	/* A forward move is safe whenever the destination does not start inside the source. */
+	if (dest <= src || dest >= src + count)
+		move_forward(dest, src, count);
+	else
+		move_backward(dest, src, count);
+
 	return vdest;
 }
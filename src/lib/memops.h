@@ -0,0 +1,17 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+
+/* Word-wide helpers shared by the generic memcpy(), memmove() and memset(). */
+
+#ifndef __MEMOPS_H
+#define __MEMOPS_H
+
+#include <stdint.h>
+
+/* Word accesses are used on untyped memory, so they must be allowed to alias anything. */
+typedef unsigned long __attribute__((__may_alias__)) mem_word_t;
+
+#define WORD_SIZE	sizeof(mem_word_t)
+#define WORD_MASK	(WORD_SIZE - 1)
+#define WORD_BITS	(WORD_SIZE * 8)
+
+#endif /* __MEMOPS_H */
@@ -1,14 +1,44 @@
 /* SPDX-License-Identifier: GPL-2.0-only */
 
+#include <stdint.h>
 #include <string.h>
 
+#include "memops.h"
+
 void *memset(void *s, int c, size_t n)
 {
-	int i;
-	char *ss = (char *) s;
+	uint8_t *ss = (uint8_t *)s;
+	const uint8_t byte = c;
+
+	if (n >= 2 * WORD_SIZE) {
+		/* Replicate the fill byte into every byte lane of a word. */
+		const mem_word_t pattern = (mem_word_t)-1 / 0xff * byte;
+		mem_word_t *w;
+		size_t words;
+
+		while ((uintptr_t)ss & WORD_MASK) {
+			*ss++ = byte;
+			n--;
+		}
+
+		w = (mem_word_t *)ss;
+		words = n / WORD_SIZE;
+		n -= words * WORD_SIZE;
+
+		for (; words >= 4; words -= 4, w += 4) {
+			w[0] = pattern;
+			w[1] = pattern;
+			w[2] = pattern;
+			w[3] = pattern;
+		}
+		while (words--)
+			*w++ = pattern;
+
+		ss = (uint8_t *)w;
+	}
 
-	for (i = 0; i < (int)n; i++)
-		ss[i] = c;
+	while (n--)
+		*ss++ = byte;
 
 	return s;
 }
@@ -0,0 +1,227 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+
+#include <acpi/acpi.h>
+#include <bootmem.h>
+#include <bootstate.h>
+#include <cbmem.h>
+#include <commonlib/memtest_serialized.h>
+#include <console/console.h>
+#include <memrange.h>
+#include <ram_split.h>
+#include <security/memory/memory.h>
+#include <string.h>
+#include <timer.h>
+
+struct memtest_work {
+	struct ram_split split;
+	struct memtest_results *results;
+	enum memtest_pattern pattern;	/* Pattern of the current pass */
+	bool clear;			/* Zero the memory instead of testing */
+};
+
+/* State of one pass over a share */
+struct memtest_pass {
+	const struct memtest_work *work;
+	struct memtest_cpu_result *result;
+	uint64_t state;
+	bool verify;
+};
+
+static const char *const pattern_names[MEMTEST_NUM_PATTERNS] = {
+	[MEMTEST_WALKING_ONES]	= "walking ones",
+	[MEMTEST_ADDRESS]	= "address in address",
+	[MEMTEST_RANDOM]	= "random",
+};
+
+static inline uint64_t xorshift64(uint64_t *state)
+{
+	uint64_t x = *state;
+
+	x ^= x << 13;
+	x ^= x >> 7;
+	x ^= x << 17;
+	return *state = x;
+}
+
+static inline uint64_t pattern_value(enum memtest_pattern pattern,
+				     const volatile uint64_t *p, uint64_t *state)
+{
+	switch (pattern) {
+	case MEMTEST_WALKING_ONES:
+		return 1ULL << (((uintptr_t)p / sizeof(*p)) % 64);
+	case MEMTEST_ADDRESS:
+		return (uintptr_t)p;
+	default:
+		return xorshift64(state);
+	}
+}
+
+static void fill_words(volatile uint64_t *p, size_t words,
+		       enum memtest_pattern pattern, uint64_t *state)
+{
+	for (size_t i = 0; i < words; i++)
+		p[i] = pattern_value(pattern, &p[i], state);
+}
+
+static void verify_words(volatile uint64_t *p, size_t words,
+			 enum memtest_pattern pattern, uint64_t *state,
+			 struct memtest_cpu_result *result)
+{
+	for (size_t i = 0; i < words; i++) {
+		const uint64_t expected = pattern_value(pattern, &p[i], state);
+		const uint64_t actual = p[i];
+
+		if (actual == expected)
+			continue;
+		if (!result->errors++) {
+			result->error_addr = (uintptr_t)&p[i];
+			result->expected = expected;
+			result->actual = actual;
+			result->error_pattern = pattern;
+		}
+	}
+}
+
+static void test_piece(uint64_t base, uint64_t size, void *arg)
+{
+	struct memtest_pass *pass = arg;
+	uint64_t *p = (uint64_t *)(uintptr_t)base;
+
+	if (pass->work->clear)
+		memset(p, 0, size);
+	else if (pass->verify)
+		verify_words(p, size / 8, pass->work->pattern, &pass->state, pass->result);
+	else
+		fill_words(p, size / 8, pass->work->pattern, &pass->state);
+}
+
+/* Fills the share with the pattern and verifies it, or zeroes it. */
+static void test_share(const struct ram_share *share, void *arg)
+{
+	const struct memtest_work *work = arg;
+	struct memtest_pass pass = {
+		.work = work,
+		.result = &work->results->cpus[share->index],
+	};
+	const uint64_t seed = work->results->seed ^ share->first;
+
+	for (pass.verify = false; ; pass.verify = true) {
+		/* xorshift64 never leaves the all-zero state */
+		pass.state = seed ? seed : 1;
+		ram_share_for_each_piece(share, test_piece, &pass);
+		if (work->clear || pass.verify)
+			break;
+	}
+
+	if (!work->clear)
+		pass.result->tested = share->last - share->first;
+}
+
+static void run_pattern(struct memtest_work *work)
+{
+	struct memtest_pattern_result *result = &work->results->patterns[work->pattern];
+	struct stopwatch sw;
+
+	stopwatch_init(&sw);
+	ram_split_run(&work->split, test_share, work);
+
+	result->bytes = 2 * work->split.total;
+	result->usecs = stopwatch_duration_usecs(&sw);
+
+	/* Bytes per microsecond are MB/s */
+	const uint64_t mbps = result->usecs ? result->bytes / result->usecs : 0;
+	printk(BIOS_INFO, "memtest: %s: %llu MiB in %llu ms, %llu.%02llu GB/s\n",
+	       pattern_names[work->pattern], work->split.total / MiB, result->usecs / 1000,
+	       mbps / 1000, mbps % 1000 / 10);
+}
+
+/*
+ * Tests all memory regions marked as BM_MEM_RAM, except for CBMEM. On x86,
+ * ramstage is loaded into CBMEM with its stack and heap. Memory
+ * that isn't directly addressable (above 4GiB in a 32-bit ramstage) is
+ * skipped. This runs at the same point as the DRAM clearing, so zero the
+ * memory again if that is requested.
+ */
+static void memtest(void *unused)
+{
+	struct memranges mem;
+	const struct range_entry *r;
+	struct memtest_work work = { 0 };
+	/* Only memory that is directly addressable */
+	const uint64_t limit = sizeof(uintptr_t) < sizeof(uint64_t) ? 4ULL * GiB : UINT64_MAX;
+	uint64_t errors = 0;
+
+	if (acpi_is_wakeup_s3())
+		return;
+
+	ram_split_init(&work.split, &mem, limit, sizeof(uint64_t));
+
+	/* Allocate the results first, so they end up in memory that's skipped. */
+	work.results = cbmem_add(CBMEM_ID_MEMTEST, sizeof(*work.results) +
+				 work.split.shares * sizeof(work.results->cpus[0]));
+	if (!work.results) {
+		printk(BIOS_ERR, "%s: Failed to add CBMEM entry\n", __func__);
+		return;
+	}
+	memset(work.results, 0, sizeof(*work.results) +
+	       work.split.shares * sizeof(work.results->cpus[0]));
+	work.results->seed = CONFIG_RAMSTAGE_MEMTEST_SEED;
+	work.results->num_patterns = MEMTEST_NUM_PATTERNS;
+
+	memranges_init(&mem, IORESOURCE_MEM | IORESOURCE_FIXED |
+			IORESOURCE_STORED | IORESOURCE_ASSIGNED |
+			IORESOURCE_CACHEABLE,
+			IORESOURCE_MEM | IORESOURCE_FIXED |
+			IORESOURCE_STORED | IORESOURCE_ASSIGNED |
+			IORESOURCE_CACHEABLE,
+			BM_MEM_RAM);
+
+	/* Only skip CBMEM, x86 loads ramstage with its stack and heap there. */
+	void *baseptr = NULL;
+	size_t size = 0;
+	cbmem_get_region(&baseptr, &size);
+	memranges_insert(&mem, (uintptr_t)baseptr, size, BM_MEM_TABLE);
+
+	memranges_each_entry(r, &mem) {
+		if (range_entry_tag(r) != BM_MEM_RAM || range_entry_base(r) >= limit)
+			continue;
+		printk(BIOS_DEBUG, "%s: Testing DRAM %016llx-%016llx\n", __func__,
+		       range_entry_base(r), MIN(range_entry_end(r), limit));
+	}
+
+	for (work.pattern = 0; work.pattern < MEMTEST_NUM_PATTERNS; work.pattern++)
+		run_pattern(&work);
+
+	/* Don't leave test patterns behind if DRAM has to be cleared. */
+	if (CONFIG(PLATFORM_HAS_DRAM_CLEAR) && security_clear_dram_request()) {
+		work.clear = true;
+		ram_split_run(&work.split, test_share, &work);
+	}
+
+	memranges_teardown(&mem);
+
+	work.results->tested = work.split.total;
+	work.results->num_cpus = work.split.shares;
+
+	for (unsigned int i = 0; i < work.split.shares; i++) {
+		const struct memtest_cpu_result *result = &work.results->cpus[i];
+
+		if (!result->errors)
+			continue;
+		printk(BIOS_ERR, "memtest: Share %u: %llu errors, first at %llx (%s): "
+		       "expected %016llx, got %016llx\n", i, result->errors,
+		       result->error_addr, pattern_names[result->error_pattern],
+		       result->expected, result->actual);
+		errors += result->errors;
+	}
+
+	if (errors) {
+		post_code(POST_RAM_FAILURE);
+		printk(BIOS_ERR, "memtest: DRAM did _NOT_ verify!\n");
+	} else {
+		printk(BIOS_INFO, "memtest: DRAM verified.\n");
+	}
+}
+
+/* After DEV_INIT as MTRRs needs to be configured on x86 */
+BOOT_STATE_INIT_ENTRY(BS_DEV_INIT, BS_ON_EXIT, memtest, NULL);
@@ -0,0 +1,97 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+
+#include <bootmem.h>
+#include <commonlib/helpers.h>
+#include <cpu/x86/mp.h>
+#include <memrange.h>
+#include <ram_split.h>
+
+/* A share with what it needs to run as queued work. */
+static struct ram_split_item {
+	struct mp_work work;
+	struct ram_share share;
+	void (*func)(const struct ram_share *share, void *arg);
+	void *arg;
+} items[CONFIG_MAX_CPUS];
+
+/* Size of the part of a range below limit */
+static uint64_t size_below(const struct range_entry *r, uint64_t limit)
+{
+	if (range_entry_base(r) >= limit)
+		return 0;
+	return MIN(range_entry_end(r), limit) - range_entry_base(r);
+}
+
+void ram_split_init(struct ram_split *split, const struct memranges *mem, uint64_t limit,
+		    uint64_t align)
+{
+	split->mem = mem;
+	split->limit = limit;
+	split->align = align;
+	split->total = 0;
+	split->shares = 1;
+
+	if (CONFIG(PARALLEL_MP_AP_WORK))
+		split->shares = MIN(mp_get_num_aps() + 1, CONFIG_MAX_CPUS);
+}
+
+void ram_share_for_each_piece(const struct ram_share *share,
+			      void (*func)(uint64_t base, uint64_t size, void *arg), void *arg)
+{
+	const struct ram_split *split = share->split;
+	const struct range_entry *r;
+	uint64_t offset = 0;
+
+	memranges_each_entry(r, split->mem) {
+		if (range_entry_tag(r) != BM_MEM_RAM)
+			continue;
+
+		const uint64_t size = size_below(r, split->limit);
+		const uint64_t s = MAX(share->first, offset);
+		const uint64_t e = MIN(share->last, offset + size);
+
+		if (s < e)
+			func(range_entry_base(r) + s - offset, e - s, arg);
+		offset += size;
+	}
+}
+
+static void run_item(void *arg)
+{
+	struct ram_split_item *item = arg;
+
+	item->func(&item->share, item->arg);
+}
+
+void ram_split_run(struct ram_split *split,
+		   void (*func)(const struct ram_share *share, void *arg), void *arg)
+{
+	const struct range_entry *r;
+	unsigned int i;
+
+	split->total = 0;
+	memranges_each_entry(r, split->mem) {
+		if (range_entry_tag(r) == BM_MEM_RAM)
+			split->total += size_below(r, split->limit);
+	}
+
+	for (i = 0; i < split->shares; i++) {
+		struct ram_share *share = &items[i].share;
+
+		share->split = split;
+		share->index = i;
+		share->first = ALIGN_DOWN(split->total * i / split->shares, split->align);
+		share->last = i + 1 == split->shares ? split->total :
+			ALIGN_DOWN(split->total * (i + 1) / split->shares, split->align);
+		items[i].func = func;
+		items[i].arg = arg;
+	}
+
+	for (i = 1; CONFIG(PARALLEL_MP_AP_WORK) && i < split->shares; i++)
+		mp_queue_work(&items[i].work, run_item, &items[i]);
+
+	run_item(&items[0]);
+
+	for (i = 1; CONFIG(PARALLEL_MP_AP_WORK) && i < split->shares; i++)
+		mp_work_wait(&items[i].work, 0);
+}
@@ -87,6 +87,15 @@ static int load_one_segment(uint8_t *dest,
 			return 0;
 		break;
 	}
+	case CBFS_COMPRESS_ZSTD: {
+		printk(BIOS_DEBUG, "using Zstandard\n");
+		timestamp_add_now(TS_UZSTD_START);
+		len = uzstdn(src, len, dest, memsz);
+		timestamp_add_now(TS_UZSTD_END);
+		if (!len) /* Decompression Error. */
+			return 0;
+		break;
+	}
 	case CBFS_COMPRESS_NONE: {
 		printk(BIOS_DEBUG, "it's not compressed!\n");
 		memcpy(dest, src, len);
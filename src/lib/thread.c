@@ -4,8 +4,11 @@
 #include <bootstate.h>
 #include <console/console.h>
 #include <smp/node.h>
+#include <stdio.h>
 #include <thread.h>
 #include <timer.h>
+#include <timestamp.h>
+#include <trace.h>
 #include <types.h>
 
 static u8 thread_stacks[CONFIG_STACK_SIZE * CONFIG_NUM_THREADS] __aligned(sizeof(uint64_t));
@@ -20,12 +23,25 @@ static void idle_thread_init(void);
 static struct thread all_threads[TOTAL_NUM_THREADS];
 
 /* All runnable (but not running) and free threads are kept on their
- * respective lists. */
-static struct thread *runnable_threads;
+ * respective lists. Runnable threads are queued per priority, in FIFO order.
+ * Threads waiting for a mutex or for another thread to finish are kept on
+ * the wait list of the object they wait for. */
+static struct thread *runnable_threads[THREAD_NUM_PRIORITIES];
 static struct thread *free_threads;
 
 static struct thread *active_thread;
 
+/* Runs whenever nothing else is runnable, it is never on a list. */
+static struct thread *idle;
+
+/* Time of the last thread switch, for the per-thread run time accounting. */
+static struct mono_time last_switch;
+
+/* A runnable thread that has been passed over this many times for threads of a
+ * higher priority runs next, so that a thread which keeps yielding can't starve
+ * the threads of lower priorities. */
+#define THREAD_MAX_PASSED_OVER 8
+
 static inline int thread_can_yield(const struct thread *t)
 {
 	return (t != NULL && t->can_yield > 0);
@@ -66,14 +82,57 @@ static inline void push_thread(struct thread **list, struct thread *t)
 	*list = t;
 }
 
+/* There are only a handful of threads, so walking the list is cheap. */
+static inline void append_thread(struct thread **list, struct thread *t)
+{
+	while (*list != NULL)
+		list = &(*list)->next;
+	t->next = NULL;
+	*list = t;
+}
+
+/* Queue t behind all runnable threads of the same priority. */
 static inline void push_runnable(struct thread *t)
 {
-	push_thread(&runnable_threads, t);
+	if (t != idle)
+		append_thread(&runnable_threads[t->priority], t);
+}
+
+/* Queue t in front of all runnable threads of the same priority. This is used
+ * for threads that didn't give up the CPU voluntarily. */
+static inline void push_runnable_front(struct thread *t)
+{
+	if (t != idle)
+		push_thread(&runnable_threads[t->priority], t);
 }
 
+/* Return the runnable thread with the highest priority, or the idle thread.
+ * The next thread of a lower priority runs instead once it has been passed over
+ * THREAD_MAX_PASSED_OVER times. */
 static inline struct thread *pop_runnable(void)
 {
-	return pop_thread(&runnable_threads);
+	struct thread **list = NULL;
+	struct thread *t;
+	int prio;
+
+	for (prio = THREAD_NUM_PRIORITIES - 1; prio >= 0; prio--) {
+		if (thread_list_empty(&runnable_threads[prio]))
+			continue;
+
+		if (list == NULL) {
+			list = &runnable_threads[prio];
+		} else if (++runnable_threads[prio]->passed_over >= THREAD_MAX_PASSED_OVER) {
+			list = &runnable_threads[prio];
+			break;
+		}
+	}
+
+	if (list == NULL)
+		return idle;
+
+	t = pop_thread(list);
+	t->passed_over = 0;
+	return t;
 }
 
 static inline struct thread *get_free_thread(void)
@@ -99,15 +158,28 @@ static inline void free_thread(struct thread *t)
 	push_thread(&free_threads, t);
 }
 
+static void schedule(struct thread *t);
+
 /* The idle thread is ran whenever there isn't anything else that is runnable.
  * It's sole responsibility is to ensure progress is made by running the timer
- * callbacks. */
+ * callbacks, which make sleeping threads runnable again. */
 __noreturn static enum cb_err idle_thread(void *unused)
 {
 	/* This thread never voluntarily yields. */
 	thread_coop_disable();
-	while (1)
+	while (1) {
 		timers_run();
+		schedule(NULL);
+	}
+}
+
+static void account_run_time(struct thread *t)
+{
+	struct mono_time now;
+
+	timer_monotonic_get(&now);
+	t->run_time_us += mono_time_diff_microseconds(&last_switch, &now);
+	last_switch = now;
 }
 
 static void schedule(struct thread *t)
@@ -116,39 +188,89 @@ static void schedule(struct thread *t)
 
 	/* If t is NULL need to find new runnable thread. */
 	if (t == NULL) {
-		if (thread_list_empty(&runnable_threads))
-			die("Runnable thread list is empty!\n");
 		t = pop_runnable();
 	} else {
 		/* current is still runnable. */
-		push_runnable(current);
+		push_runnable_front(current);
 	}
 
-	if (t->handle)
-		t->handle->state = THREAD_STARTED;
+	/* Nothing else to run, e.g. a yield without other runnable threads. */
+	if (t == current)
+		return;
 
+	account_run_time(current);
 	set_current_thread(t);
 
 	switch_to_thread(t->stack_current, &current->stack_current);
 }
 
+/* Block the current thread until another thread passes the wait list to
+ * wake_one(). */
+static void wait_on(struct thread **wait_list)
+{
+	struct thread *current = current_thread();
+
+	current->waits++;
+	append_thread(wait_list, current);
+	schedule(NULL);
+}
+
+/* Make the thread that has been waiting longest on wait_list runnable again.
+ * Returns that thread, or NULL if the list was empty. */
+static struct thread *wake_one(struct thread **wait_list)
+{
+	struct thread *t;
+
+	if (thread_list_empty(wait_list))
+		return NULL;
+
+	t = pop_thread(wait_list);
+	push_runnable(t);
+	return t;
+}
+
 static void terminate_thread(struct thread *t, enum cb_err error)
 {
+	timestamp_add_now(TS_THREAD_END);
+
 	if (t->handle) {
 		t->handle->error = error;
 		t->handle->state = THREAD_DONE;
+		while (wake_one(&t->handle->waiters))
+			;
 	}
 
 	free_thread(t);
 	schedule(NULL);
 }
 
+static enum cb_err run_entry(struct thread *t)
+{
+	char name[TRACE_SPAN_NAME_LEN];
+	enum cb_err error;
+	int span;
+
+	/* The idle thread never terminates. */
+	if (t == idle)
+		return t->entry(t->entry_arg);
+
+	/* The span covers the lifetime of the thread, its payload is the time the
+	   thread actually ran. */
+	snprintf(name, sizeof(name), "thread %d", t->id);
+	span = trace_span_begin(TS_THREAD_START, name);
+	error = t->entry(t->entry_arg);
+	account_run_time(t);
+	trace_span_end(span, t->run_time_us);
+
+	return error;
+}
+
 static void asmlinkage call_wrapper(void *unused)
 {
 	struct thread *current = current_thread();
 	enum cb_err error;
 
-	error = current->entry(current->entry_arg);
+	error = run_entry(current);
 
 	terminate_thread(current, error);
 }
@@ -166,7 +288,7 @@ static void asmlinkage call_wrapper_block_state(void *arg)
 	enum cb_err error;
 
 	boot_state_block(bbs->state, bbs->seq);
-	error = current->entry(current->entry_arg);
+	error = run_entry(current);
 	boot_state_unblock(bbs->state, bbs->seq);
 	terminate_thread(current, error);
 }
@@ -174,7 +296,7 @@ static void asmlinkage call_wrapper_block_state(void *arg)
 /* Prepare a thread so that it starts by executing thread_entry(thread_arg).
  * Within thread_entry() it will call func(arg). */
 static void prepare_thread(struct thread *t, struct thread_handle *handle,
-			   enum cb_err (*func)(void *), void *arg,
+			   enum thread_priority prio, enum cb_err (*func)(void *), void *arg,
 			   asmlinkage void (*thread_entry)(void *), void *thread_arg)
 {
 	/* Stash the function and argument to run. */
@@ -183,19 +305,49 @@ static void prepare_thread(struct thread *t, struct thread_handle *handle,
 
 	/* All new threads can yield by default. */
 	t->can_yield = 1;
+	t->priority = prio;
+
+	t->run_time_us = 0;
+	t->yields = 0;
+	t->waits = 0;
+	t->passed_over = 0;
 
-	/* Pointer used to publish the state of thread */
+	/* Pointer used to publish the state of thread. The thread counts as
+	 * started from now on, even if it has to wait for its first turn. */
 	t->handle = handle;
+	if (handle) {
+		handle->state = THREAD_STARTED;
+		handle->waiters = NULL;
+	}
 
 	arch_prepare_thread(t, thread_entry, thread_arg);
 }
 
+/* Start a prepared thread right away, unless it has a lower priority than
+ * the current one. Then it has to wait until the current thread blocks. */
+static void start_thread(struct thread *t)
+{
+	timestamp_add_now(TS_THREAD_START);
+
+	if (t->priority >= current_thread()->priority)
+		schedule(t);
+	else
+		push_runnable(t);
+}
+
 static void thread_resume_from_timeout(struct timeout_callback *tocb)
 {
+	struct thread *current = current_thread();
 	struct thread *to;
 
 	to = tocb->priv;
-	schedule(to);
+
+	/* Only switch right away if the current thread may be interrupted.
+	 * Otherwise the thread runs at the next scheduling point. */
+	if (thread_can_yield(current) && to->priority >= current->priority)
+		schedule(to);
+	else
+		push_runnable(to);
 }
 
 static void idle_thread_init(void)
@@ -207,9 +359,9 @@ static void idle_thread_init(void)
 	if (t == NULL)
 		die("No threads available for idle thread!\n");
 
-	/* Queue idle thread to run once all other threads have yielded. */
-	prepare_thread(t, NULL, idle_thread, NULL, call_wrapper, NULL);
-	push_runnable(t);
+	/* The idle thread runs once all other threads have blocked. */
+	prepare_thread(t, NULL, THREAD_PRIORITY_LOW, idle_thread, NULL, call_wrapper, NULL);
+	idle = t;
 }
 
 /* Don't inline this function so the timeout_callback won't have its storage
@@ -229,6 +381,26 @@ thread_yield_timed_callback(struct timeout_callback *tocb,
 	return 0;
 }
 
+/* Let the other runnable threads of the same or higher priority run before
+ * returning to the current thread. */
+static void yield_to_runnable(struct thread *current)
+{
+	int i;
+
+	/* Threads only ever yielding to each other would keep the idle thread
+	 * from running, so make threads whose sleep has expired runnable here,
+	 * too. With cooperation disabled, the timer callbacks just queue them. */
+	thread_coop_disable();
+	for (i = 0; i < TOTAL_NUM_THREADS; i++) {
+		if (!timers_run())
+			break;
+	}
+	thread_coop_enable();
+
+	push_runnable(current);
+	schedule(NULL);
+}
+
 static void *thread_alloc_space(struct thread *t, size_t bytes)
 {
 	/* Allocate the amount of space on the stack keeping the stack
@@ -254,6 +426,8 @@ static void threads_initialize(void)
 	t->stack_orig = (uintptr_t)NULL; /* We never free the main thread */
 	t->id = 0;
 	t->can_yield = 1;
+	t->priority = THREAD_PRIORITY_NORMAL;
+	timer_monotonic_get(&last_switch);
 
 	stack_top = &thread_stacks[CONFIG_STACK_SIZE];
 	for (i = 1; i < TOTAL_NUM_THREADS; i++) {
@@ -270,6 +444,12 @@ static void threads_initialize(void)
 }
 
 int thread_run(struct thread_handle *handle, enum cb_err (*func)(void *), void *arg)
+{
+	return thread_run_prio(handle, THREAD_PRIORITY_NORMAL, func, arg);
+}
+
+int thread_run_prio(struct thread_handle *handle, enum thread_priority prio,
+		    enum cb_err (*func)(void *), void *arg)
 {
 	struct thread *current;
 	struct thread *t;
@@ -291,8 +471,8 @@ int thread_run(struct thread_handle *handle, enum cb_err (*func)(void *), void *
 		return -1;
 	}
 
-	prepare_thread(t, handle, func, arg, call_wrapper, NULL);
-	schedule(t);
+	prepare_thread(t, handle, prio, func, arg, call_wrapper, NULL);
+	start_thread(t);
 
 	return 0;
 }
@@ -328,8 +508,9 @@ int thread_run_until(struct thread_handle *handle, enum cb_err (*func)(void *),
 	bbs = thread_alloc_space(t, sizeof(*bbs));
 	bbs->state = state;
 	bbs->seq = seq;
-	prepare_thread(t, handle, func, arg, call_wrapper_block_state, bbs);
-	schedule(t);
+	prepare_thread(t, handle, THREAD_PRIORITY_NORMAL, func, arg, call_wrapper_block_state,
+		       bbs);
+	start_thread(t);
 
 	return 0;
 }
@@ -349,6 +530,13 @@ int thread_yield_microseconds(unsigned int microsecs)
 	if (!thread_can_yield(current))
 		return -1;
 
+	current->yields++;
+
+	if (microsecs == 0) {
+		yield_to_runnable(current);
+		return 0;
+	}
+
 	if (thread_yield_timed_callback(&tocb, microsecs))
 		return -1;
 
@@ -381,6 +569,13 @@ void thread_coop_disable(void)
 	current->can_yield--;
 }
 
+int thread_current_id(void)
+{
+	struct thread *current = current_thread();
+
+	return current ? current->id : 0;
+}
+
 enum cb_err thread_join(struct thread_handle *handle)
 {
 	struct stopwatch sw;
@@ -397,8 +592,11 @@ enum cb_err thread_join(struct thread_handle *handle)
 
 	stopwatch_init(&sw);
 
-	while (handle->state != THREAD_DONE)
-		assert(thread_yield() == 0);
+	/* terminate_thread() wakes up all threads waiting for the handle. */
+	while (handle->state != THREAD_DONE) {
+		assert(thread_can_yield(current));
+		wait_on(&handle->waiters);
+	}
 
 	printk(BIOS_SPEW, "took %lld us\n", stopwatch_duration_usecs(&sw));
 
@@ -407,13 +605,26 @@ enum cb_err thread_join(struct thread_handle *handle)
 
 void thread_mutex_lock(struct thread_mutex *mutex)
 {
+	struct thread *current = current_thread();
 	struct stopwatch sw;
 
 	stopwatch_init(&sw);
 
-	while (mutex->locked)
-		assert(thread_yield() == 0);
-	mutex->locked = true;
+	if (!mutex->locked) {
+		mutex->locked = true;
+	} else if (thread_can_yield(current)) {
+		/* thread_mutex_unlock() hands the mutex over without unlocking it. */
+		wait_on(&mutex->waiters);
+	} else {
+		/*
+		 * Nothing else runs until this thread yields, so the holder can
+		 * never release the mutex. thread_yield() fails here, and the
+		 * assert catches the deadlock.
+		 */
+		while (mutex->locked)
+			assert(thread_yield() == 0);
+		mutex->locked = true;
+	}
 
 	printk(BIOS_SPEW, "took %lld us to acquire mutex\n", stopwatch_duration_usecs(&sw));
 }
@@ -421,5 +632,24 @@ void thread_mutex_lock(struct thread_mutex *mutex)
 void thread_mutex_unlock(struct thread_mutex *mutex)
 {
 	assert(mutex->locked);
-	mutex->locked = 0;
+
+	/* Pass the mutex on to the thread that has been waiting longest. */
+	if (!wake_one(&mutex->waiters))
+		mutex->locked = false;
+}
+
+#if ENV_RAMSTAGE
+static void thread_report_stats(void *unused)
+{
+	struct thread *t;
+
+	if (!initialized)
+		return;
+
+	t = current_thread();
+	account_run_time(t);
+	printk(BIOS_DEBUG, "Threads: main ran %lld us, %u yields, %u waits, idle %lld us\n",
+	       (long long)t->run_time_us, t->yields, t->waits, (long long)idle->run_time_us);
 }
+BOOT_STATE_INIT_ENTRY(BS_PAYLOAD_BOOT, BS_ON_ENTRY, thread_report_stats, NULL);
+#endif
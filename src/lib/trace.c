@@ -0,0 +1,115 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+
+#include <cbmem.h>
+#include <commonlib/trace_serialized.h>
+#include <smp/node.h>
+#include <smp/spinlock.h>
+#include <string.h>
+#include <thread.h>
+#include <timestamp.h>
+#include <trace.h>
+
+#if ENV_X86
+#include <arch/cpu.h>
+#endif
+
+static struct trace_table *table;
+
+/* Serializes the span updates of all CPUs. */
+DECLARE_SPIN_LOCK(trace_lock)
+
+static uint8_t trace_cpu(void)
+{
+#if ENV_X86
+	return cpu_index();
+#else
+	return 0;
+#endif
+}
+
+static struct trace_table *trace_table_get(void)
+{
+	const size_t max = CONFIG_TRACE_SPANS_MAX_ENTRIES;
+
+	/* Only the BSP sets up the table, and it does so with the first span. */
+	if (table || !boot_cpu() || !cbmem_online())
+		return table;
+
+	table = cbmem_add(CBMEM_ID_TRACE, sizeof(*table) + max * sizeof(table->spans[0]));
+	if (!table)
+		return NULL;
+
+	table->base_time = get_initial_timestamp();
+	table->tick_freq_mhz = timestamp_tick_freq_mhz();
+	table->max_entries = max;
+	table->num_entries = 0;
+
+	return table;
+}
+
+/* Innermost open span of the given CPU and thread, 0 if there is none. */
+static uint16_t open_span(const struct trace_table *t, uint8_t cpu, uint8_t thread)
+{
+	uint32_t i = t->num_entries;
+
+	while (i--) {
+		const struct trace_span *s = &t->spans[i];
+
+		if (!s->end && s->cpu == cpu && s->thread == thread)
+			return i + 1;
+	}
+
+	return 0;
+}
+
+int trace_span_begin(uint32_t id, const char *name)
+{
+	struct trace_table *t;
+	struct trace_span *s;
+	uint64_t now = timestamp_get();
+	int span = -1;
+
+	spin_lock(&trace_lock);
+
+	t = trace_table_get();
+	if (!t || t->num_entries >= t->max_entries || t->num_entries >= UINT16_MAX)
+		goto out;
+
+	span = t->num_entries;
+	s = &t->spans[span];
+	memset(s, 0, sizeof(*s));
+	s->start = now - t->base_time;
+	s->id = id;
+	s->cpu = trace_cpu();
+	s->thread = thread_current_id();
+	strncpy(s->name, name, sizeof(s->name) - 1);
+
+	s->parent = open_span(t, s->cpu, s->thread);
+	if (!s->parent && (s->cpu || s->thread))
+		s->parent = open_span(t, 0, 0);
+
+	t->num_entries++;
+
+out:
+	spin_unlock(&trace_lock);
+
+	return span;
+}
+
+void trace_span_end(int span, uint64_t payload)
+{
+	struct trace_span *s;
+	uint64_t now = timestamp_get();
+
+	if (span < 0 || !table)
+		return;
+
+	spin_lock(&trace_lock);
+
+	s = &table->spans[span];
+	/* Keep the end distinguishable from an open span. */
+	s->end = MAX(now - table->base_time, s->start + 1);
+	s->payload = payload;
+
+	spin_unlock(&trace_lock);
+}
@@ -6,11 +6,11 @@
 #define memset_pae(a, b, c, d, e) 0
 #define MEMSET_PAE_PGTL_ALIGN 0
 #define MEMSET_PAE_PGTL_SIZE 0
-#define MEMSET_PAE_PGTL_SIZE 0
 #define MEMSET_PAE_VMEM_ALIGN 0
 #endif
 
 #include <memrange.h>
+#include <ram_split.h>
 #include <bootmem.h>
 #include <bootstate.h>
 #include <symbols.h>
@@ -20,6 +20,8 @@
 #include <security/memory/memory.h>
 #include <cbmem.h>
 #include <acpi/acpi.h>
+#include <timestamp.h>
+#include <trace.h>
 
 /* Helper to find free space for memset_pae. */
 static uintptr_t get_free_memory_range(struct memranges *mem,
@@ -44,18 +46,110 @@ static uintptr_t get_free_memory_range(struct memranges *mem,
 	return 0;
 }
 
+/* Zero memory with non-temporal stores, there's no point in caching it. */
+static void memset_nt(void *dest, size_t size)
+{
+#if ENV_X86 && CONFIG(SSE2)
+	uintptr_t p = (uintptr_t)dest;
+	const uintptr_t end = p + size;
+	const uintptr_t body = MIN(ALIGN_UP(p, sizeof(unsigned long)), end);
+
+	memset((void *)p, 0, body - p);
+	for (p = body; end - p >= sizeof(unsigned long); p += sizeof(unsigned long))
+		asm volatile ("movnti %1, (%0)" :: "r" (p), "r" (0UL) : "memory");
+	memset((void *)p, 0, end - p);
+
+	/* Needed for movnti */
+	asm volatile ("sfence" ::: "memory");
+#else
+	memset(dest, 0, size);
+#endif
+}
+
 /*
- * Clears all memory regions marked as BM_MEM_RAM.
+ * Clears a piece of DRAM.
  * Uses memset_pae if the memory region can't be accessed by memset and
  * architecture is x86.
- *
- * @return 0 on success, 1 on error
+ */
+static void clear_range(uint64_t base, uint64_t size, uintptr_t pgtbl,
+			uintptr_t vmem_addr)
+{
+	/* Does regular memset work? */
+	if (sizeof(resource_t) == sizeof(void *) ||
+	    !((base + size) >> (sizeof(void *) * 8))) {
+		/* fastpath */
+		memset_nt((void *)(uintptr_t)base, size);
+	}
+	/* Use PAE if available */
+	else if (ENV_X86) {
+		if (memset_pae(base, 0, size, (void *)pgtbl, (void *)vmem_addr))
+			printk(BIOS_ERR, "%s: Failed to memset memory\n",
+			       __func__);
+	} else {
+		printk(BIOS_ERR, "%s: Failed to memset memory\n", __func__);
+	}
+}
+
+struct clear_memory_work {
+	struct ram_split split;
+	uintptr_t pgtbl;	/* MEMSET_PAE_PGTL_SIZE of page tables per share */
+	uintptr_t vmem_addr;
+};
+
+static struct {
+	uint64_t bytes;
+	uint64_t start;
+	uint64_t end;
+} clear_stats[CONFIG_MAX_CPUS];
+
+static void clear_piece(uint64_t base, uint64_t size, void *arg)
+{
+	const struct ram_share *share = arg;
+	const struct clear_memory_work *work =
+		container_of(share->split, struct clear_memory_work, split);
+
+	clear_range(base, size, work->pgtbl + share->index * MEMSET_PAE_PGTL_SIZE,
+		    work->vmem_addr);
+}
+
+static void clear_memory_share(const struct ram_share *share, void *unused)
+{
+	int span;
+
+	/* The trace span records which CPU cleared how much, and when. */
+	span = trace_span_begin(0, "clear DRAM share");
+	clear_stats[share->index].start = timestamp_get();
+
+	ram_share_for_each_piece(share, clear_piece, (void *)share);
+
+	clear_stats[share->index].bytes = share->last - share->first;
+	clear_stats[share->index].end = timestamp_get();
+	trace_span_end(span, share->last - share->first);
+}
+
+static void report_clear_stats(unsigned int shares)
+{
+	const uint64_t mhz = timestamp_tick_freq_mhz();
+
+	for (unsigned int i = 0; i < shares; i++) {
+		const uint64_t us = mhz ? (clear_stats[i].end - clear_stats[i].start) / mhz : 0;
+
+		printk(BIOS_DEBUG, "%s: Share %u: cleared %llu MiB in %llu ms (%llu MiB/s)\n",
+		       __func__, i, clear_stats[i].bytes / MiB, us / 1000,
+		       us ? clear_stats[i].bytes / us * 1000000 / MiB : 0);
+	}
+}
+
+/*
+ * Clears all memory regions marked as BM_MEM_RAM.
+ * The work is split over all CPUs if the APs are waiting for work.
  */
 static void clear_memory(void *unused)
 {
 	const struct range_entry *r;
 	struct memranges mem;
-	uintptr_t pgtbl, vmem_addr;
+	struct clear_memory_work work = { 0 };
+	size_t pgtbl_size = 0;
 
 	if (acpi_is_wakeup_s3())
 		return;
@@ -63,6 +157,8 @@ static void clear_memory(void *unused)
 	if (!security_clear_dram_request())
 		return;
 
+	timestamp_add_now(TS_CLEAR_DRAM_START);
+
 	/* FSP1.0 is marked as MMIO and won't appear here */
 
 	memranges_init(&mem, IORESOURCE_MEM | IORESOURCE_FIXED |
@@ -82,58 +178,49 @@ static void clear_memory(void *unused)
 	cbmem_get_region(&baseptr, &size);
 	memranges_insert(&mem, (uintptr_t)baseptr, size, BM_MEM_TABLE);
 
+	ram_split_init(&work.split, &mem, UINT64_MAX, 1);
+
 	if (ENV_X86) {
-		/* Find space for PAE enabled memset */
-		pgtbl = get_free_memory_range(&mem, MEMSET_PAE_PGTL_ALIGN,
-					MEMSET_PAE_PGTL_SIZE);
+		/* Find space for PAE enabled memset, one set of tables per share. */
+		pgtbl_size = work.split.shares * MEMSET_PAE_PGTL_SIZE;
+		work.pgtbl = get_free_memory_range(&mem, MEMSET_PAE_PGTL_ALIGN,
+					pgtbl_size);
 
 		/* Don't touch page tables while clearing */
-		memranges_insert(&mem, pgtbl, MEMSET_PAE_PGTL_SIZE,
-					BM_MEM_TABLE);
+		memranges_insert(&mem, work.pgtbl, pgtbl_size, BM_MEM_TABLE);
 
-		vmem_addr = get_free_memory_range(&mem, MEMSET_PAE_VMEM_ALIGN,
-						MEMSET_PAE_PGTL_SIZE);
+		/* Every share has its own page tables, so they can share this */
+		work.vmem_addr = get_free_memory_range(&mem,
+					MEMSET_PAE_VMEM_ALIGN,
+					MEMSET_PAE_PGTL_SIZE);
 
 		printk(BIOS_SPEW, "%s: pgtbl at %p, virt memory at %p\n",
-		__func__, (void *)pgtbl, (void *)vmem_addr);
+		__func__, (void *)work.pgtbl, (void *)work.vmem_addr);
 	}
 
-	/* Now clear all usable DRAM */
 	memranges_each_entry(r, &mem) {
 		if (range_entry_tag(r) != BM_MEM_RAM)
 			continue;
 		printk(BIOS_DEBUG, "%s: Clearing DRAM %016llx-%016llx\n",
 		       __func__, range_entry_base(r), range_entry_end(r));
-
-		/* Does regular memset work? */
-		if (sizeof(resource_t) == sizeof(void *) ||
-		    !(range_entry_end(r) >> (sizeof(void *) * 8))) {
-			/* fastpath */
-			memset((void *)(uintptr_t)range_entry_base(r), 0,
-			       range_entry_size(r));
-		}
-		/* Use PAE if available */
-		else if (ENV_X86) {
-			if (memset_pae(range_entry_base(r), 0,
-			    range_entry_size(r), (void *)pgtbl,
-			    (void *)vmem_addr))
-				printk(BIOS_ERR, "%s: Failed to memset "
-				       "memory\n", __func__);
-		} else {
-			printk(BIOS_ERR, "%s: Failed to memset memory\n",
-			       __func__);
-		}
 	}
 
+	/* Now clear all usable DRAM, on all CPUs as long as it takes. */
+	ram_split_run(&work.split, clear_memory_share, NULL);
+
 	if (ENV_X86) {
 		/* Clear previously skipped memory reserved for pagetables */
 		printk(BIOS_DEBUG, "%s: Clearing DRAM %016lx-%016lx\n",
-		__func__, pgtbl, pgtbl + MEMSET_PAE_PGTL_SIZE);
+		__func__, work.pgtbl, work.pgtbl + pgtbl_size);
 
-		memset((void *)pgtbl, 0, MEMSET_PAE_PGTL_SIZE);
+		memset((void *)work.pgtbl, 0, pgtbl_size);
 	}
 
 	memranges_teardown(&mem);
+
+	if (CONFIG(COLLECT_TIMESTAMPS))
+		report_clear_stats(work.split.shares);
+	timestamp_add_now(TS_CLEAR_DRAM_END);
 }
 
 /* After DEV_INIT as MTRRs needs to be configured on x86 */
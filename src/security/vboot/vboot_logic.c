@@ -11,6 +11,7 @@
 #include <security/vboot/vbnv.h>
 #include <security/vboot/tpm_common.h>
 #include <string.h>
+#include <thread.h>
 #include <timestamp.h>
 #include <vb2_api.h>
 #include <boot_device.h>
@@ -117,6 +118,98 @@ static vb2_error_t handle_digest_result(void *slot_hash, size_t slot_hash_sz)
 	return VB2_SUCCESS;
 }
 
+/*
+ * State shared between hash_body_pipelined() and its reader thread. Two block buffers are
+ * used alternately: while one is being hashed, the reader fills the other one.
+ */
+struct hash_body_pipeline {
+	const struct region_device *fw_body;
+	uint8_t block[2][CONFIG_VBOOT_HASH_BLOCK_SIZE];
+	size_t block_size[2];
+	bool filled[2];
+	bool abort;
+	uint64_t load_end_ts;
+};
+
+static enum cb_err hash_body_reader(void *arg)
+{
+	struct hash_body_pipeline *pipe = arg;
+	size_t remaining = region_device_sz(pipe->fw_body);
+	size_t offset = 0;
+	int i = 0;
+
+	while (remaining) {
+		size_t block_size = MIN(remaining, sizeof(pipe->block[i]));
+
+		/* Wait until the hashing side is done with this buffer. */
+		while (pipe->filled[i] && !pipe->abort)
+			thread_yield();
+		if (pipe->abort)
+			return CB_ERR;
+
+		/* The read yields while the boot device transfers, if it supports DMA. */
+		if (rdev_readat(pipe->fw_body, pipe->block[i], offset, block_size) < 0)
+			return CB_ERR;
+
+		pipe->block_size[i] = block_size;
+		pipe->filled[i] = true;
+		remaining -= block_size;
+		offset += block_size;
+		i ^= 1;
+	}
+
+	pipe->load_end_ts = timestamp_get();
+
+	return CB_SUCCESS;
+}
+
+/*
+ * Hash the firmware body while a separate thread reads it, so that reading the next block
+ * overlaps with hashing the current one. Returns VB2_ERROR_UNKNOWN without touching the
+ * hash state if no thread could be started.
+ */
+static vb2_error_t hash_body_pipelined(struct vb2_context *ctx,
+				       const struct region_device *fw_body,
+				       uint64_t *load_end_ts, bool *started)
+{
+	struct hash_body_pipeline pipe = { .fw_body = fw_body };
+	struct thread_handle handle = { 0 };
+	size_t remaining = region_device_sz(fw_body);
+	vb2_error_t rv = VB2_SUCCESS;
+	int i = 0;
+
+	*started = false;
+	if (thread_run(&handle, hash_body_reader, &pipe))
+		return VB2_ERROR_UNKNOWN;
+	*started = true;
+
+	while (remaining) {
+		while (!pipe.filled[i] && handle.state != THREAD_DONE)
+			thread_yield();
+		if (!pipe.filled[i]) {
+			rv = VB2_ERROR_UNKNOWN;
+			break;
+		}
+
+		rv = vb2api_extend_hash(ctx, pipe.block[i], pipe.block_size[i]);
+		if (rv)
+			break;
+
+		remaining -= pipe.block_size[i];
+		pipe.filled[i] = false;
+		i ^= 1;
+	}
+
+	/* The reader writes into our stack frame, make sure it is gone before returning. */
+	pipe.abort = true;
+	if (thread_join(&handle) != CB_SUCCESS && !rv)
+		rv = VB2_ERROR_UNKNOWN;
+
+	*load_end_ts = pipe.load_end_ts;
+
+	return rv;
+}
+
 static vb2_error_t hash_body(struct vb2_context *ctx,
 			     struct region_device *fw_body)
 {
@@ -138,6 +231,9 @@ static vb2_error_t hash_body(struct vb2_context *ctx,
 	 * we use this little trick to measure them separately and pretend it
 	 * was first loaded and then hashed in one piece with the timestamps.
 	 * (This split won't make sense with memory-mapped media like on x86.)
+	 * When loading runs in a separate thread, TS_LOADING_END instead marks
+	 * the real end of loading, which lies before TS_HASHING_END by however
+	 * much hashing of the last block trails behind.
 	 */
 	load_ts = timestamp_get();
 	timestamp_add(TS_HASH_BODY_START, load_ts);
@@ -150,6 +246,19 @@ static vb2_error_t hash_body(struct vb2_context *ctx,
 	if (rv)
 		return rv;
 
+	if (CONFIG(VBOOT_HASH_BODY_PIPELINED) && ENV_SUPPORTS_COOP) {
+		bool started;
+
+		rv = hash_body_pipelined(ctx, fw_body, &load_ts, &started);
+		if (started) {
+			if (rv)
+				return rv;
+			remaining = 0;
+		} else {
+			printk(BIOS_WARNING, "VBOOT: Hashing body without read-ahead thread\n");
+		}
+	}
+
 	/* Extend over the body */
 	while (remaining) {
 		uint64_t temp_ts;
@@ -17,7 +17,9 @@ struct device_operations hda_ops = {
 	.enable_resources	= pci_dev_enable_resources,
 	.init			= hda_init,
 	.ops_pci		= &pci_dev_ops_pci,
-	.scan_bus		= scan_static_bus
+	.scan_bus		= scan_static_bus,
+	/* Codec detection and verb loading only touch the controller's MMIO. */
+	.ap_safe_init		= !CONFIG(AZALIA_RUNTIME_VERBS_BSP_ONLY),
 };
 
 static const unsigned short pci_device_ids[] = {
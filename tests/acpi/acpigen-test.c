@@ -4,6 +4,7 @@
 #include <types.h>
 #include <tests/test.h>
 #include <acpi/acpigen.h>
+#include <acpi/acpigen_pci.h>
 
 #define ACPIGEN_TEST_BUFFER_SZ (16 * KiB)
 
@@ -200,6 +201,40 @@ static void test_acpigen_scope_with_contents(void **state)
 	assert_int_equal(package_length, block_length);
 }
 
+static void test_acpigen_write_pci_device(void **state)
+{
+	char *acpigen_buf = *state;
+	char *expected = acpigen_buf + ACPIGEN_TEST_BUFFER_SZ / 2;
+	const struct {
+		const char *name;
+		pci_devfn_t devfn;
+		uint8_t status;
+	} devs[] = {
+		{ "SATA", PCI_DEVFN(0x11, 0), 0xf },
+		{ "GFX0", PCI_DEVFN(0x1f, 7), 0 },
+		{ "PEG", PCI_DEVFN(0x1, 1), 0xf },
+		{ "^SB0.HDA0", PCI_DEVFN(0x8, 2), 0xb },
+	};
+
+	for (int i = 0; i < ARRAY_SIZE(devs); ++i) {
+		/* The generic encoding the template has to match */
+		acpigen_set_current(expected);
+		acpigen_write_device(devs[i].name);
+		acpigen_write_ADR_pci_devfn(devs[i].devfn);
+		acpigen_write_STA(devs[i].status);
+		acpigen_pop_len();
+		const size_t len = acpigen_get_current() - expected;
+
+		acpigen_set_current(acpigen_buf);
+		acpigen_write_pci_device(devs[i].name, devs[i].devfn, devs[i].status);
+
+		assert_int_equal(acpigen_get_current() - acpigen_buf, len);
+		assert_memory_equal(acpigen_buf, expected, len);
+		assert_int_equal(decode_package_length(acpigen_buf),
+				 get_current_block_length(acpigen_buf));
+	}
+}
+
 int main(void)
 {
 	const struct CMUnitTest tests[] = {
@@ -211,6 +246,8 @@ int main(void)
 						teardown_acpigen),
 		cmocka_unit_test_setup_teardown(test_acpigen_scope_with_contents, setup_acpigen,
 						teardown_acpigen),
+		cmocka_unit_test_setup_teardown(test_acpigen_write_pci_device, setup_acpigen,
+						teardown_acpigen),
 	};
 
 	return cb_run_group_tests(tests, NULL, NULL);
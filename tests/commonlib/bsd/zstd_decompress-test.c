@@ -0,0 +1,229 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+
+#include <commonlib/bsd/compression.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <tests/test.h>
+#include <unistd.h>
+
+struct zstd_test_state {
+	uint8_t *raw;
+	size_t raw_sz;
+	uint8_t *comp;
+	size_t comp_sz;
+};
+
+/* "coreboot", stored in a raw block. */
+static const uint8_t raw_frame[] = {
+	0x28, 0xb5, 0x2f, 0xfd, 0x00, 0x58, 0x41, 0x00, 0x00, 0x63, 0x6f, 0x72,
+	0x65, 0x62, 0x6f, 0x6f, 0x74,
+};
+
+/* 300 times 'z', one literal and a match with the repeated offset. */
+static const uint8_t match_frame[] = {
+	0x28, 0xb5, 0x2f, 0xfd, 0x00, 0x68, 0x45, 0x00, 0x00, 0x08, 0x7a, 0x01,
+	0x00, 0x28, 0x2a, 0x10, 0x02,
+};
+
+static uint8_t *read_file(const char *fname, size_t *sz)
+{
+	int f = open(fname, O_RDONLY);
+	uint8_t *buf = NULL;
+	struct stat st;
+
+	if (f == -1)
+		return NULL;
+	if (fstat(f, &st) == 0 && st.st_size > 0) {
+		buf = test_malloc(st.st_size);
+		if (read(f, buf, st.st_size) == st.st_size) {
+			*sz = st.st_size;
+		} else {
+			test_free(buf);
+			buf = NULL;
+		}
+	}
+	close(f);
+
+	return buf;
+}
+
+static int teardown_uzstdn_file(void **state)
+{
+	struct zstd_test_state *s = *state;
+
+	test_free(s->raw);
+	test_free(s->comp);
+	test_free(s);
+
+	return 0;
+}
+
+/* The initial state is the file name prefix, see main(). */
+static int setup_uzstdn_file(void **state)
+{
+	const char *fname_base = *state;
+	struct zstd_test_state *s = test_calloc(1, sizeof(*s));
+	char path[256];
+
+	if (!s)
+		return 1;
+
+	snprintf(path, sizeof(path), __TEST_DATA_DIR__ "/commonlib/bsd/zstd-test/%s.bin",
+		 fname_base);
+	s->raw = read_file(path, &s->raw_sz);
+	snprintf(path, sizeof(path), __TEST_DATA_DIR__ "/commonlib/bsd/zstd-test/%s.zst.bin",
+		 fname_base);
+	s->comp = read_file(path, &s->comp_sz);
+
+	*state = s;
+	if (!s->raw || !s->comp) {
+		print_error("Unable to read test data %s\n", fname_base);
+		teardown_uzstdn_file(state);
+		return 2;
+	}
+
+	return 0;
+}
+
+static void test_uzstdn_correct_file(void **state)
+{
+	struct zstd_test_state *s = *state;
+	uint8_t *out = test_malloc(s->raw_sz);
+
+	assert_int_equal(s->raw_sz, uzstdn(s->comp, s->comp_sz, out, s->raw_sz));
+	assert_memory_equal(s->raw, out, s->raw_sz);
+
+	test_free(out);
+}
+
+static void test_uzstdn_output_too_small(void **state)
+{
+	struct zstd_test_state *s = *state;
+	uint8_t *out = test_malloc(s->raw_sz);
+
+	assert_int_equal(0, uzstdn(s->comp, s->comp_sz, out, s->raw_sz - 1));
+
+	test_free(out);
+}
+
+static void test_uzstdn_input_truncated(void **state)
+{
+	struct zstd_test_state *s = *state;
+	uint8_t *out = test_malloc(s->raw_sz);
+
+	assert_int_equal(0, uzstdn(s->comp, s->comp_sz - 1, out, s->raw_sz));
+	assert_int_equal(0, uzstdn(s->comp, s->comp_sz / 2, out, s->raw_sz));
+
+	test_free(out);
+}
+
+/* Every proper prefix of a single frame has to be rejected without reading past it. */
+static void check_all_truncations(const uint8_t *frame, size_t size, size_t out_size)
+{
+	uint8_t *out = test_malloc(out_size);
+	uint8_t *in;
+	size_t len;
+
+	for (len = 0; len < size; len++) {
+		in = test_malloc(len ? len : 1);
+		memcpy(in, frame, len);
+		assert_int_equal(0, uzstdn(in, len, out, out_size));
+		test_free(in);
+	}
+
+	test_free(out);
+}
+
+static void test_uzstdn_every_truncation(void **state)
+{
+	struct zstd_test_state *s = *state;
+
+	check_all_truncations(s->comp, s->comp_sz, s->raw_sz);
+	check_all_truncations(raw_frame, sizeof(raw_frame), 8);
+	check_all_truncations(match_frame, sizeof(match_frame), 300);
+}
+
+static void test_uzstdn_small_frames(void **state)
+{
+	uint8_t out[300];
+	size_t i;
+
+	assert_int_equal(8, uzstdn(raw_frame, sizeof(raw_frame), out, sizeof(out)));
+	assert_memory_equal("coreboot", out, 8);
+
+	assert_int_equal(300, uzstdn(match_frame, sizeof(match_frame), out, sizeof(out)));
+	for (i = 0; i < 300; i++)
+		assert_int_equal('z', out[i]);
+	assert_int_equal(0, uzstdn(match_frame, sizeof(match_frame), out, 299));
+}
+
+static void test_uzstdn_bad_input(void **state)
+{
+	uint8_t in[sizeof(raw_frame)];
+	uint8_t out[16];
+
+	/* Wrong magic */
+	memcpy(in, raw_frame, sizeof(in));
+	in[0] ^= 1;
+	assert_int_equal(0, uzstdn(in, sizeof(in), out, sizeof(out)));
+
+	/* Reserved bit in the frame header */
+	memcpy(in, raw_frame, sizeof(in));
+	in[4] |= 1 << 3;
+	assert_int_equal(0, uzstdn(in, sizeof(in), out, sizeof(out)));
+
+	/* Dictionary ID */
+	memcpy(in, raw_frame, sizeof(in));
+	in[4] |= 1;
+	assert_int_equal(0, uzstdn(in, sizeof(in), out, sizeof(out)));
+
+	/* Frame header without the window descriptor */
+	static const uint8_t no_window[] = { 0x28, 0xb5, 0x2f, 0xfd, 0xc3 };
+	assert_int_equal(0, uzstdn(no_window, sizeof(no_window), out, sizeof(out)));
+
+	/* Compressed block that ends after a 3-byte literals section header */
+	static const uint8_t short_literals[] = {
+		0x28, 0xb5, 0x2f, 0xfd, 0x20, 0x10, 0x1d, 0x00, 0x00, 0x02, 0x00, 0x00,
+	};
+	assert_int_equal(0, uzstdn(short_literals, sizeof(short_literals), out, sizeof(out)));
+
+	memset(in, 0, sizeof(in));
+	assert_int_equal(0, uzstdn(in, sizeof(in), out, sizeof(out)));
+	assert_int_equal(0, uzstdn(raw_frame, 0, out, sizeof(out)));
+}
+
+#define UZSTDN_FILE_TEST(_func, _file_prefix)                                                  \
+	{                                                                                      \
+		.name = #_func "(" _file_prefix ")", .test_func = _func,                       \
+		.setup_func = setup_uzstdn_file, .teardown_func = teardown_uzstdn_file,        \
+		.initial_state = (_file_prefix)                                                \
+	}
+
+int main(void)
+{
+	const struct CMUnitTest tests[] = {
+		/* "data.N" refers to __TEST_DATA_DIR__/commonlib/bsd/zstd-test/data.N.bin and
+		   its compressed form data.N.zst.bin:
+		   - data.1: tests/lib/imd-test.c, compressed with zstd -19.
+		   - data.2: src/commonlib/bsd/zstd_decompress.c and lz4_wrapper.c, followed by
+		     4096 little endian words that grow by random steps below 256, like an
+		     address table. Compressed by util/cbfs-compression-tool.
+		   - data.3: README.md, split into two zstd -3 frames with a skippable frame
+		     in between. */
+		UZSTDN_FILE_TEST(test_uzstdn_correct_file, "data.1"),
+		UZSTDN_FILE_TEST(test_uzstdn_correct_file, "data.2"),
+		UZSTDN_FILE_TEST(test_uzstdn_correct_file, "data.3"),
+		UZSTDN_FILE_TEST(test_uzstdn_output_too_small, "data.1"),
+		UZSTDN_FILE_TEST(test_uzstdn_output_too_small, "data.2"),
+		UZSTDN_FILE_TEST(test_uzstdn_input_truncated, "data.1"),
+		UZSTDN_FILE_TEST(test_uzstdn_input_truncated, "data.3"),
+		UZSTDN_FILE_TEST(test_uzstdn_every_truncation, "data.1"),
+		cmocka_unit_test(test_uzstdn_small_frames),
+		cmocka_unit_test(test_uzstdn_bad_input),
+	};
+
+	return cb_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,223 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+
+#include <commonlib/helpers.h>
+#include <commonlib/mem_pool.h>
+#include <string.h>
+#include <tests/test.h>
+
+#define POOL_SZ 1024
+#define POOL_ALIGN 16
+
+static uint8_t pool_buf[POOL_SZ] __aligned(POOL_ALIGN);
+
+static int setup_stack_pool(void **state)
+{
+	static struct mem_pool mp;
+
+	mem_pool_init(&mp, pool_buf, POOL_SZ, POOL_ALIGN);
+	*state = &mp;
+
+	return 0;
+}
+
+static int setup_any_order_pool(void **state)
+{
+	static struct mem_pool mp;
+
+	mem_pool_init_any_order(&mp, pool_buf, POOL_SZ, POOL_ALIGN);
+	*state = &mp;
+
+	return 0;
+}
+
+static void test_stack_free_reverse_order(void **state)
+{
+	struct mem_pool *mp = *state;
+	void *a = mem_pool_alloc(mp, 100);
+	void *b = mem_pool_alloc(mp, 100);
+
+	assert_ptr_equal(pool_buf, a);
+	assert_true(IS_ALIGNED((uintptr_t)b, POOL_ALIGN));
+
+	mem_pool_free(mp, b);
+	mem_pool_free(mp, a);
+	assert_ptr_equal(a, mem_pool_alloc(mp, 200));
+}
+
+static void test_stack_free_wrong_order_leaks(void **state)
+{
+	struct mem_pool *mp = *state;
+	void *a = mem_pool_alloc(mp, 100);
+	void *b = mem_pool_alloc(mp, 100);
+
+	/* Only the most recent allocation can be freed in stack mode. */
+	mem_pool_free(mp, a);
+	mem_pool_free(mp, b);
+	assert_ptr_not_equal(a, mem_pool_alloc(mp, 16));
+}
+
+static void test_any_order_free(void **state)
+{
+	struct mem_pool *mp = *state;
+	void *a = mem_pool_alloc(mp, 100);
+	void *b = mem_pool_alloc(mp, 100);
+	void *c = mem_pool_alloc(mp, 100);
+
+	assert_non_null(c);
+	assert_true(IS_ALIGNED((uintptr_t)a, POOL_ALIGN));
+	assert_true(IS_ALIGNED((uintptr_t)b, POOL_ALIGN));
+	assert_true(IS_ALIGNED((uintptr_t)c, POOL_ALIGN));
+
+	/* A hole below the top is reused by an allocation that fits. */
+	mem_pool_free(mp, a);
+	assert_ptr_equal(a, mem_pool_alloc(mp, 64));
+
+	/* Freed neighbours are merged and the top is returned to the pool. */
+	mem_pool_free(mp, b);
+	mem_pool_free(mp, a);
+	assert_ptr_equal(a, mem_pool_alloc(mp, 200));
+	mem_pool_free(mp, c);
+	mem_pool_free(mp, a);
+	assert_int_equal(0, mp->free_offset);
+}
+
+static void test_any_order_fill_and_drain(void **state)
+{
+	struct mem_pool *mp = *state;
+	void *ptrs[POOL_SZ / 64];
+	size_t n = 0;
+
+	/* Fill the pool, then free in an interleaved order and refill it. */
+	for (int round = 0; round < 3; ++round) {
+		while (n < ARRAY_SIZE(ptrs) && (ptrs[n] = mem_pool_alloc(mp, 40)))
+			memset(ptrs[n++], 0xA5, 40);
+		assert_true(n > POOL_SZ / 128);
+
+		for (size_t i = 0; i < n; i += 2)
+			mem_pool_free(mp, ptrs[i]);
+		for (size_t i = 1; i < n; i += 2)
+			mem_pool_free(mp, ptrs[i]);
+		assert_int_equal(0, mp->free_offset);
+		n = 0;
+	}
+}
+
+static void test_free_foreign_pointers(void **state)
+{
+	struct mem_pool *mp = *state;
+	uint8_t not_in_pool;
+	uint8_t *a = mem_pool_alloc(mp, 32);
+	const size_t used = mp->free_offset;
+
+	mem_pool_free(mp, NULL);
+	mem_pool_free(mp, &not_in_pool);
+	mem_pool_free(mp, a + 1);
+	assert_int_equal(used, mp->free_offset);
+
+	mem_pool_free(mp, a);
+	mem_pool_free(mp, a);
+	assert_int_equal(0, mp->free_offset);
+}
+
+static void test_out_of_space(void **state)
+{
+	struct mem_pool *mp = *state;
+
+	assert_null(mem_pool_alloc(mp, POOL_SZ + 1));
+	assert_null(mem_pool_alloc(mp, ~(size_t)0 - POOL_ALIGN));
+	assert_non_null(mem_pool_alloc(mp, POOL_SZ / 2));
+	assert_null(mem_pool_alloc(mp, POOL_SZ / 2 + 1));
+}
+
+static void test_release_to_mark(void **state)
+{
+	struct mem_pool *mp = *state;
+	void *a = mem_pool_alloc(mp, 100);
+	struct mem_pool_mark mark = mem_pool_get_mark(mp);
+	void *b = mem_pool_alloc(mp, 100);
+
+	assert_non_null(b);
+	assert_non_null(mem_pool_alloc(mp, 100));
+	assert_non_null(mem_pool_alloc(mp, 100));
+
+	mem_pool_release_to_mark(mp, mark);
+	assert_ptr_equal(b, mem_pool_alloc(mp, 100));
+
+	/* Releasing twice, or to a mark above the current state, changes nothing. */
+	mem_pool_release_to_mark(mp, mark);
+	mem_pool_release_to_mark(mp, mark);
+	assert_ptr_equal(b, mem_pool_alloc(mp, 100));
+
+	/* Allocations from before the mark are still intact. */
+	mem_pool_release_to_mark(mp, mark);
+	memset(a, 0x5A, 100);
+	mem_pool_release_to_mark(mp, mem_pool_get_mark(mp));
+	for (int i = 0; i < 100; ++i)
+		assert_int_equal(0x5A, ((uint8_t *)a)[i]);
+}
+
+static void test_release_to_mark_reused_hole(void **state)
+{
+	struct mem_pool *mp = *state;
+	void *a = mem_pool_alloc(mp, 100);
+	void *b = mem_pool_alloc(mp, 100);
+	struct mem_pool_mark mark;
+	void *c;
+
+	mem_pool_free(mp, a);
+	mark = mem_pool_get_mark(mp);
+
+	/* This allocation lands in the hole below the mark, but is still released. */
+	c = mem_pool_alloc(mp, 50);
+	assert_ptr_equal(a, c);
+	assert_non_null(mem_pool_alloc(mp, 100));
+	mem_pool_release_to_mark(mp, mark);
+
+	/* Only b is left, so freeing it empties the pool. */
+	mem_pool_free(mp, b);
+	assert_int_equal(0, mp->free_offset);
+}
+
+static void test_high_water(void **state)
+{
+	struct mem_pool *mp = *state;
+	void *a, *b;
+
+	assert_int_equal(0, mem_pool_high_water(mp));
+
+	a = mem_pool_alloc(mp, 200);
+	b = mem_pool_alloc(mp, 300);
+	const size_t peak = mem_pool_high_water(mp);
+	assert_true(peak >= 500);
+	assert_true(peak <= POOL_SZ);
+
+	mem_pool_free(mp, b);
+	mem_pool_free(mp, a);
+	assert_int_equal(0, mp->free_offset);
+	assert_int_equal(peak, mem_pool_high_water(mp));
+
+	/* Smaller allocations after the peak don't change it, neither does a reset. */
+	mem_pool_free(mp, mem_pool_alloc(mp, 16));
+	mem_pool_reset(mp);
+	assert_int_equal(peak, mem_pool_high_water(mp));
+}
+
+int main(void)
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test_setup(test_stack_free_reverse_order, setup_stack_pool),
+		cmocka_unit_test_setup(test_stack_free_wrong_order_leaks, setup_stack_pool),
+		cmocka_unit_test_setup(test_any_order_free, setup_any_order_pool),
+		cmocka_unit_test_setup(test_any_order_fill_and_drain, setup_any_order_pool),
+		cmocka_unit_test_setup(test_free_foreign_pointers, setup_any_order_pool),
+		cmocka_unit_test_setup(test_out_of_space, setup_stack_pool),
+		cmocka_unit_test_setup(test_out_of_space, setup_any_order_pool),
+		cmocka_unit_test_setup(test_release_to_mark, setup_stack_pool),
+		cmocka_unit_test_setup(test_release_to_mark, setup_any_order_pool),
+		cmocka_unit_test_setup(test_release_to_mark_reused_hole, setup_any_order_pool),
+		cmocka_unit_test_setup(test_high_water, setup_stack_pool),
+		cmocka_unit_test_setup(test_high_water, setup_any_order_pool),
+	};
+
+	return cb_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,177 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+
+#include <cpu/x86/mp.h>
+#include <string.h>
+#include <tests/test.h>
+#include <timer.h>
+
+/*
+ * There are no real APs. The tests call mp_work_run_queued() where an idle AP would, and
+ * mp_get_num_aps() decides whether mp_queue_work() queues at all.
+ */
+static int num_aps;
+static uint64_t fake_time_us;
+
+int mp_get_num_aps(void)
+{
+	return num_aps;
+}
+
+/* Every reading of the clock advances it, so that timeouts expire. */
+void timer_monotonic_get(struct mono_time *mt)
+{
+	mt->microseconds = fake_time_us++;
+}
+
+/* Order in which the work ran. */
+static char run_order[16];
+static size_t run_count;
+
+static void record_run(void *arg)
+{
+	assert_true(run_count < sizeof(run_order) - 1);
+	run_order[run_count++] = *(const char *)arg;
+}
+
+static int setup_test(void **state)
+{
+	memset(run_order, 0, sizeof(run_order));
+	run_count = 0;
+	num_aps = 3;
+	return 0;
+}
+
+static void test_mp_queue_work_without_aps(void **state)
+{
+	struct mp_work work;
+
+	num_aps = 0;
+	mp_queue_work(&work, record_run, "a");
+
+	/* Nobody would pick it up, so it ran right away. */
+	assert_true(mp_work_done(&work));
+	assert_false(mp_work_queued());
+	assert_string_equal("a", run_order);
+	assert_int_equal(CB_SUCCESS, mp_work_wait(&work, 0));
+}
+
+static void test_mp_queue_work_fifo(void **state)
+{
+	struct mp_work work[3];
+
+	mp_queue_work(&work[0], record_run, "a");
+	mp_queue_work(&work[1], record_run, "b");
+	mp_queue_work(&work[2], record_run, "c");
+
+	assert_true(mp_work_queued());
+	assert_int_equal(0, run_count);
+	assert_false(mp_work_done(&work[0]));
+
+	/* An AP takes the oldest item. */
+	assert_true(mp_work_run_queued());
+	assert_string_equal("a", run_order);
+	assert_true(mp_work_done(&work[0]));
+	assert_false(mp_work_done(&work[1]));
+
+	/* Waiting for the last item runs the rest in order. */
+	assert_int_equal(CB_SUCCESS, mp_work_wait(&work[2], 0));
+	assert_string_equal("abc", run_order);
+	assert_true(mp_work_done(&work[1]));
+
+	assert_false(mp_work_queued());
+	assert_false(mp_work_run_queued());
+}
+
+static void test_mp_work_wait_only_runs_what_it_needs(void **state)
+{
+	struct mp_work work[3];
+
+	mp_queue_work(&work[0], record_run, "a");
+	mp_queue_work(&work[1], record_run, "b");
+	mp_queue_work(&work[2], record_run, "c");
+
+	assert_int_equal(CB_SUCCESS, mp_work_wait(&work[1], 0));
+	assert_string_equal("ab", run_order);
+	assert_false(mp_work_done(&work[2]));
+
+	mp_work_finish_all();
+	assert_string_equal("abc", run_order);
+}
+
+static struct mp_work stuck_work, helped_work;
+static enum cb_err stuck_wait_result;
+
+/* Waits for itself, like the BSP would for an item that an AP doesn't finish. */
+static void wait_for_self(void *arg)
+{
+	record_run(arg);
+	stuck_wait_result = mp_work_wait(&stuck_work, 100);
+}
+
+static void test_mp_work_wait_timeout(void **state)
+{
+	mp_queue_work(&stuck_work, wait_for_self, "s");
+	mp_queue_work(&helped_work, record_run, "h");
+
+	assert_true(mp_work_run_queued());
+
+	/* While waiting, the other item was run, and the wait still expired. */
+	assert_int_equal(CB_ERR, stuck_wait_result);
+	assert_string_equal("sh", run_order);
+	assert_true(mp_work_done(&helped_work));
+	assert_true(mp_work_done(&stuck_work));
+}
+
+static struct mp_work chained_work[4];
+
+/* Queues the next link of the chain from queued work. */
+static void queue_next(void *arg)
+{
+	const size_t i = (const struct mp_work *)arg - chained_work;
+
+	record_run(i % 2 ? "o" : "e");
+	if (i + 1 < ARRAY_SIZE(chained_work))
+		mp_queue_work(&chained_work[i + 1], queue_next, &chained_work[i + 1]);
+}
+
+static void test_mp_work_finish_all(void **state)
+{
+	mp_queue_work(&chained_work[0], queue_next, &chained_work[0]);
+
+	/* Also finishes the work that was queued while finishing. */
+	mp_work_finish_all();
+	assert_string_equal("eoeo", run_order);
+	for (size_t i = 0; i < ARRAY_SIZE(chained_work); i++)
+		assert_true(mp_work_done(&chained_work[i]));
+	assert_false(mp_work_queued());
+}
+
+/* Has to run last, the queue can't be restarted. */
+static void test_mp_work_stop(void **state)
+{
+	struct mp_work work[2];
+
+	mp_queue_work(&work[0], record_run, "a");
+	mp_work_stop();
+	assert_string_equal("a", run_order);
+
+	/* Parked APs don't take work any more, so it runs right away. */
+	mp_queue_work(&work[1], record_run, "b");
+	assert_true(mp_work_done(&work[1]));
+	assert_string_equal("ab", run_order);
+	assert_false(mp_work_queued());
+}
+
+int main(void)
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test_setup(test_mp_queue_work_without_aps, setup_test),
+		cmocka_unit_test_setup(test_mp_queue_work_fifo, setup_test),
+		cmocka_unit_test_setup(test_mp_work_wait_only_runs_what_it_needs, setup_test),
+		cmocka_unit_test_setup(test_mp_work_wait_timeout, setup_test),
+		cmocka_unit_test_setup(test_mp_work_finish_all, setup_test),
+		cmocka_unit_test_setup(test_mp_work_stop, setup_test),
+	};
+
+	return cb_run_group_tests(tests, NULL, NULL);
+}
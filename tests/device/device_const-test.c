@@ -0,0 +1,79 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+
+#include <device/device.h>
+#include <device/path.h>
+#include <device/pci_def.h>
+#include <tests/test.h>
+
+/*
+ * The devicetree comes from running sconfig on device_const-test.cb, so this checks the
+ * index of the PCI root bus that sconfig generates against a walk over the children.
+ */
+
+static DEVTREE_CONST struct device *walk_root_bus(pci_devfn_t devfn)
+{
+	DEVTREE_CONST struct device *dev;
+
+	for (dev = pci_root_bus()->children; dev; dev = dev->sibling) {
+		if (dev->path.type == DEVICE_PATH_PCI && dev->path.pci.devfn == devfn)
+			return dev;
+	}
+	return NULL;
+}
+
+static void test_pci_root_index_sorted(void **state)
+{
+	DEVTREE_CONST struct device *dev;
+	size_t count = 0;
+
+	assert_ptr_equal(pci_root_bus(), pci_root_index_bus);
+
+	for (size_t i = 0; i < pci_root_index_count; i++) {
+		if (i > 0)
+			assert_true(pci_root_index[i - 1].devfn < pci_root_index[i].devfn);
+		assert_ptr_equal(pci_root_index[i].dev->bus, pci_root_index_bus);
+		assert_int_equal(pci_root_index[i].devfn, pci_root_index[i].dev->path.pci.devfn);
+	}
+
+	/* Every PCI device on the root bus is in there. */
+	for (dev = pci_root_bus()->children; dev; dev = dev->sibling) {
+		if (dev->path.type == DEVICE_PATH_PCI)
+			count++;
+	}
+	assert_int_equal(count, pci_root_index_count);
+	assert_int_equal(9, count);
+}
+
+static void test_pci_root_index_lookup(void **state)
+{
+	size_t found = 0;
+
+	for (unsigned int devfn = 0; devfn <= 0xff; devfn++) {
+		DEVTREE_CONST struct device *dev = walk_root_bus(devfn);
+
+		assert_ptr_equal(dev, pcidev_path_on_root(devfn));
+		assert_ptr_equal(dev, pcidev_on_root(PCI_SLOT(devfn), PCI_FUNC(devfn)));
+		assert_int_equal(dev && dev->enabled, is_devfn_enabled(devfn));
+		if (dev)
+			found++;
+	}
+	assert_int_equal(pci_root_index_count, found);
+
+	/* Devices behind bridges are not on the root bus. */
+	assert_non_null(pcidev_on_root(0x1c, 0));
+	assert_non_null(pcidev_path_behind(pcidev_on_root(0x1c, 0)->link_list, PCI_DEVFN(0, 0)));
+	assert_ptr_not_equal(pcidev_on_root(0, 0),
+			     pcidev_path_behind(pcidev_on_root(0x1c, 0)->link_list, 0));
+	assert_false(is_devfn_enabled(PCI_DEVFN(0x14, 3)));
+	assert_true(is_devfn_enabled(PCI_DEVFN(0x1f, 5)));
+}
+
+int main(void)
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(test_pci_root_index_sorted),
+		cmocka_unit_test(test_pci_root_index_lookup),
+	};
+
+	return cb_run_group_tests(tests, NULL, NULL);
+}
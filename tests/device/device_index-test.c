@@ -0,0 +1,234 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+
+/* Include the sources to call dev_find_slot() and to enable the index like the boot state
+   hook does. main() is renamed, because bootstate.h declares the ramstage one. */
+#define main ramstage_main
+#include "../../src/device/device_const.c"
+#include "../../src/device/device_index.c"
+#undef main
+
+#include <device/pci_def.h>
+#include <device/pci_ids.h>
+#include <string.h>
+#include <tests/test.h>
+
+/* No index of the PCI root bus from sconfig, it isn't used in ramstage. */
+DEVTREE_CONST struct bus *const pci_root_index_bus = NULL;
+const struct pci_root_index_entry pci_root_index[] = {};
+const size_t pci_root_index_count = 0;
+
+#define MAX_DEVICES 256
+#define MAX_BUSES 8
+
+static struct device devices[MAX_DEVICES];
+static size_t num_devices;
+static struct bus buses[MAX_BUSES];
+static size_t num_buses;
+static struct device *last;
+
+struct device dev_root = {
+	.path = { .type = DEVICE_PATH_ROOT },
+	.bus = &buses[0],
+	.link_list = &buses[0],
+	.enabled = 1,
+};
+
+/* Few distinct values, so that many devices share a key. */
+static const u16 vendors[] = { 0x8086, 0x1022, 0x10ec };
+static const u16 device_ids[] = { 0x1234, 0x5678, 0xffff };
+static const unsigned int classes[] = {
+	PCI_CLASS_DISPLAY_VGA << 8, PCI_CLASS_BRIDGE_PCI << 8,
+	(PCI_CLASS_BRIDGE_PCI << 8) | 0x01, PCI_CLASS_STORAGE_SATA << 8,
+};
+
+static uint32_t rand_state;
+
+static uint32_t next_rand(void)
+{
+	rand_state = rand_state * 1103515245 + 12345;
+	return rand_state >> 16;
+}
+
+/* Append a device to all_devices like alloc_dev() does, on a random bus. */
+static struct device *add_device(void)
+{
+	struct device *dev;
+
+	assert_true(num_devices < MAX_DEVICES);
+	dev = &devices[num_devices++];
+	memset(dev, 0, sizeof(*dev));
+
+	dev->bus = &buses[next_rand() % num_buses];
+	dev->vendor = vendors[next_rand() % ARRAY_SIZE(vendors)];
+	dev->device = device_ids[next_rand() % ARRAY_SIZE(device_ids)];
+	dev->class = classes[next_rand() % ARRAY_SIZE(classes)] | (next_rand() & 0xff);
+	dev->enabled = 1;
+
+	if (next_rand() % 8) {
+		dev->path.type = DEVICE_PATH_PCI;
+		/* Only a few slots, so that some exist more than once. */
+		dev->path.pci.devfn = PCI_DEVFN(next_rand() % 4, next_rand() % 2);
+	} else {
+		dev->path.type = DEVICE_PATH_PNP;
+		dev->path.pnp.port = 0x2e;
+	}
+
+	last->next = dev;
+	last = dev;
+	dev_index_invalidate();
+
+	return dev;
+}
+
+static int setup_tree(void **state)
+{
+	rand_state = 1;
+	num_devices = 0;
+	memset(buses, 0, sizeof(buses));
+	for (num_buses = 0; num_buses < MAX_BUSES; num_buses++)
+		buses[num_buses].secondary = num_buses;
+	buses[0].dev = &dev_root;
+
+	dev_root.next = NULL;
+	last = &dev_root;
+	all_devices = &dev_root;
+
+	dev_index_enabled = false;
+	dev_index_invalidate();
+	for (int i = 0; i < 100; i++)
+		add_device();
+
+	return 0;
+}
+
+/* The linear walks that the lookups did before they had an index. */
+static struct device *walk_find_device(u16 vendor, u16 device, struct device *from)
+{
+	for (from = from ? from->next : all_devices; from; from = from->next) {
+		if (from->vendor == vendor && from->device == device)
+			return from;
+	}
+	return NULL;
+}
+
+static struct device *walk_find_class(unsigned int class, struct device *from)
+{
+	for (from = from ? from->next : all_devices; from; from = from->next) {
+		if ((from->class & 0xffffff00) == class)
+			return from;
+	}
+	return NULL;
+}
+
+static struct device *walk_find_slot(unsigned int bus, unsigned int devfn)
+{
+	struct device *dev;
+
+	for (dev = all_devices; dev; dev = dev->next) {
+		if (dev->path.type == DEVICE_PATH_PCI && dev->bus->secondary == bus &&
+		    dev->path.pci.devfn == devfn)
+			return dev;
+	}
+	return NULL;
+}
+
+static void check_lookups(void)
+{
+	struct device *dev, *expected;
+	size_t i, j;
+
+	/* Every match in order, starting with nothing and then with the previous match */
+	for (i = 0; i < ARRAY_SIZE(vendors); i++) {
+		for (j = 0; j < ARRAY_SIZE(device_ids); j++) {
+			dev = NULL;
+			do {
+				expected = walk_find_device(vendors[i], device_ids[j], dev);
+				dev = dev_find_device(vendors[i], device_ids[j], dev);
+				assert_ptr_equal(expected, dev);
+			} while (dev);
+		}
+	}
+	assert_null(dev_find_device(0x1234, 0x1234, NULL));
+
+	for (i = 0; i < ARRAY_SIZE(classes); i++) {
+		dev = NULL;
+		do {
+			expected = walk_find_class(classes[i], dev);
+			dev = dev_find_class(classes[i], dev);
+			assert_ptr_equal(expected, dev);
+		} while (dev);
+	}
+
+	/* Starting at a device that doesn't match, or at the last device */
+	for (i = 0; i < num_devices; i++) {
+		dev = &devices[i];
+		assert_ptr_equal(walk_find_device(0x8086, 0x1234, dev),
+				 dev_find_device(0x8086, 0x1234, dev));
+		assert_ptr_equal(walk_find_class(PCI_CLASS_DISPLAY_VGA << 8, dev),
+				 dev_find_class(PCI_CLASS_DISPLAY_VGA << 8, dev));
+	}
+
+	for (i = 0; i < MAX_BUSES + 1; i++) {
+		for (j = 0; j < 256; j++)
+			assert_ptr_equal(walk_find_slot(i, j), dev_find_slot(i, j));
+	}
+}
+
+static void test_dev_index_before_enumeration(void **state)
+{
+	/* Before enumeration, the lookups walk the list. */
+	check_lookups();
+	assert_false(dev_index_valid);
+	assert_int_equal(0, indices[DEV_INDEX_ID].count);
+}
+
+static void test_dev_index_after_enumeration(void **state)
+{
+	dev_index_enable(NULL);
+	check_lookups();
+
+	/* The lookups used the index, and found something. */
+	assert_true(dev_index_valid);
+	assert_non_null(dev_find_device(0x8086, 0x1234, NULL));
+	assert_non_null(dev_find_slot(devices[0].bus->secondary, devices[0].path.pci.devfn));
+	assert_int_equal(num_devices + 1, indices[DEV_INDEX_ID].count);
+	assert_int_equal(num_devices + 1, indices[DEV_INDEX_CLASS].count);
+}
+
+static void test_dev_index_add_devices(void **state)
+{
+	dev_index_enable(NULL);
+	check_lookups();
+
+	/* Like the CPU devices that are added after enumeration */
+	for (int i = 0; i < 100; i++) {
+		add_device();
+		assert_false(dev_index_valid);
+		if (i % 10 == 0)
+			check_lookups();
+	}
+	check_lookups();
+}
+
+static void test_dev_index_empty(void **state)
+{
+	/* Only the root device */
+	dev_root.next = NULL;
+	num_devices = 0;
+	dev_index_enable(NULL);
+	check_lookups();
+	assert_ptr_equal(&dev_root, dev_find_device(0, 0, NULL));
+	assert_null(dev_find_device(0, 0, &dev_root));
+}
+
+int main(void)
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test_setup(test_dev_index_before_enumeration, setup_tree),
+		cmocka_unit_test_setup(test_dev_index_after_enumeration, setup_tree),
+		cmocka_unit_test_setup(test_dev_index_add_devices, setup_tree),
+		cmocka_unit_test_setup(test_dev_index_empty, setup_tree),
+	};
+
+	return cb_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,242 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+
+/* Include the source to reset its state between simulated boots and to run its boot state
+   callback directly. main() is renamed, because bootstate.h declares the ramstage one. */
+#define main ramstage_main
+#include "../../src/drivers/table_cache/table_cache.c"
+#undef main
+
+#include <cbmem.h>
+#include <commonlib/region.h>
+#include <device/device.h>
+#include <fmap.h>
+#include <string.h>
+#include <tests/test.h>
+#include <version.h>
+
+#define FLASH_SIZE	(64 * KiB)
+#define BLOB_OFFSET	64
+#define BLOB_SIZE	200
+
+const char coreboot_version[] = "4.20-test";
+const char coreboot_extra_version[] = "";
+const char coreboot_build[] = "test build";
+const char coreboot_compile_time[] = "00:00:00";
+
+DEVTREE_CONST struct device *DEVTREE_CONST all_devices;
+
+static uint8_t flash[FLASH_SIZE];
+
+/* The CBMEM_ID_ACPI entry, and a second entry that tests can move around. */
+static uint8_t acpi_area[1 * KiB];
+static size_t acpi_area_size;
+static uintptr_t other_entry_start;
+
+int fmap_locate_area_as_rdev(const char *name, struct region_device *area)
+{
+	assert_string_equal(TABLE_CACHE_REGION, name);
+	rdev_chain_mem(area, flash, sizeof(flash));
+	return 0;
+}
+
+int fmap_locate_area_as_rdev_rw(const char *name, struct region_device *area)
+{
+	assert_string_equal(TABLE_CACHE_REGION, name);
+	rdev_chain_mem_rw(area, flash, sizeof(flash));
+	return 0;
+}
+
+void *cbmem_find(u32 id)
+{
+	return NULL;
+}
+
+const struct cbmem_entry *cbmem_entry_find(u32 id)
+{
+	return id == CBMEM_ID_ACPI ? (const struct cbmem_entry *)acpi_area : NULL;
+}
+
+void *cbmem_entry_start(const struct cbmem_entry *entry)
+{
+	return acpi_area;
+}
+
+u64 cbmem_entry_size(const struct cbmem_entry *entry)
+{
+	return acpi_area_size;
+}
+
+void cbmem_walk_entries(void (*fn)(u32 id, const void *start, size_t size, void *arg),
+			void *arg)
+{
+	fn(CBMEM_ID_ACPI, acpi_area, sizeof(acpi_area), arg);
+	fn(CBMEM_ID_CBTABLE, (const void *)other_entry_start, 4 * KiB, arg);
+}
+
+static uint8_t *ssdt(void)
+{
+	return acpi_area + BLOB_OFFSET;
+}
+
+static void generate_ssdt(void)
+{
+	for (size_t i = 0; i < BLOB_SIZE; i++)
+		ssdt()[i] = i * 3 + 1;
+}
+
+static bool ssdt_is_generated(void)
+{
+	for (size_t i = 0; i < BLOB_SIZE; i++) {
+		if (ssdt()[i] != (uint8_t)(i * 3 + 1))
+			return false;
+	}
+	return true;
+}
+
+/* Forget everything but the flash contents, like a reboot does. */
+static void reboot(void)
+{
+	memset(&cache, 0, sizeof(cache));
+	memset(acpi_area, 0, sizeof(acpi_area));
+}
+
+/* One pass through acpi.c and BS_WRITE_TABLES. Returns the size table_cache_load() found. */
+static size_t boot(void)
+{
+	size_t size;
+
+	reboot();
+	size = table_cache_load(TABLE_CACHE_SSDT, ssdt());
+	if (!size) {
+		generate_ssdt();
+		table_cache_store(TABLE_CACHE_SSDT, ssdt(), BLOB_SIZE);
+	}
+	table_cache_update(NULL);
+
+	return size;
+}
+
+/* The cached SSDT file data in flash. */
+static uint8_t *cached_blob(void)
+{
+	struct region_device rdev, data;
+	struct region_file file;
+
+	fmap_locate_area_as_rdev(TABLE_CACHE_REGION, &rdev);
+	assert_int_equal(0, region_file_init(&file, &rdev));
+	assert_int_equal(0, region_file_data(&file, &data));
+	assert_true(region_device_sz(&data) >= sizeof(struct table_cache_header) + BLOB_SIZE);
+
+	return (uint8_t *)rdev_mmap_full(&data) + sizeof(struct table_cache_header);
+}
+
+static int setup_test(void **state)
+{
+	memset(flash, 0xff, sizeof(flash));
+	acpi_area_size = sizeof(acpi_area);
+	other_entry_start = 0x7f000000;
+
+	/* First boot fills the cache. */
+	assert_int_equal(0, boot());
+	assert_true(ssdt_is_generated());
+
+	return 0;
+}
+
+static void test_table_cache_hit(void **state)
+{
+	uint8_t before[FLASH_SIZE];
+
+	memcpy(before, flash, sizeof(flash));
+
+	assert_int_equal(BLOB_SIZE, boot());
+	assert_true(ssdt_is_generated());
+
+	/* A hit doesn't write the cache again. */
+	assert_memory_equal(before, flash, sizeof(flash));
+}
+
+static void test_table_cache_miss_on_fingerprint(void **state)
+{
+	/* A CBMEM entry the AML might point to moved. */
+	other_entry_start += 4 * KiB;
+	assert_int_equal(0, boot());
+	assert_true(ssdt_is_generated());
+
+	/* The cache was updated for the new layout. */
+	assert_int_equal(BLOB_SIZE, boot());
+}
+
+static void test_table_cache_miss_on_address(void **state)
+{
+	reboot();
+	assert_int_equal(0, table_cache_load(TABLE_CACHE_SSDT, ssdt() + 16));
+}
+
+static void test_table_cache_size_mismatch(void **state)
+{
+	uint8_t data[sizeof(struct table_cache_header) + BLOB_SIZE];
+	struct table_cache_header *header = (void *)data;
+	struct region_device rdev;
+	struct region_file file;
+
+	/* A valid header that claims more data than the file holds */
+	memcpy(data, cached_blob() - sizeof(*header), sizeof(data));
+	header->blobs[TABLE_CACHE_SSDT].size += 64;
+	header->header_hash = xxh64(header, offsetof(typeof(*header), header_hash), 0);
+
+	fmap_locate_area_as_rdev_rw(TABLE_CACHE_REGION, &rdev);
+	assert_int_equal(0, region_file_init(&file, &rdev));
+	assert_int_equal(0, region_file_update_data(&file, data, sizeof(data)));
+
+	reboot();
+	assert_int_equal(0, table_cache_load(TABLE_CACHE_SSDT, ssdt()));
+	assert_false(ssdt_is_generated());
+}
+
+static void test_table_cache_does_not_fit(void **state)
+{
+	/* The blob doesn't fit in the CBMEM entry any more. */
+	acpi_area_size = BLOB_OFFSET + BLOB_SIZE - 1;
+	reboot();
+	assert_int_equal(0, table_cache_load(TABLE_CACHE_SSDT, ssdt()));
+	assert_false(ssdt_is_generated());
+}
+
+static void test_table_cache_corrupted(void **state)
+{
+	cached_blob()[BLOB_SIZE / 2] ^= 0x80;
+
+	reboot();
+	assert_int_equal(0, table_cache_load(TABLE_CACHE_SSDT, ssdt()));
+
+	/* Nothing of the corrupted blob is left behind. */
+	for (size_t i = 0; i < BLOB_SIZE; i++)
+		assert_int_equal(0, ssdt()[i]);
+
+	/* The next boot writes a good copy. */
+	assert_int_equal(0, boot());
+	assert_int_equal(BLOB_SIZE, boot());
+}
+
+static void test_table_cache_empty_flash(void **state)
+{
+	memset(flash, 0xff, sizeof(flash));
+	reboot();
+	assert_int_equal(0, table_cache_load(TABLE_CACHE_SSDT, ssdt()));
+}
+
+int main(void)
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test_setup(test_table_cache_hit, setup_test),
+		cmocka_unit_test_setup(test_table_cache_miss_on_fingerprint, setup_test),
+		cmocka_unit_test_setup(test_table_cache_miss_on_address, setup_test),
+		cmocka_unit_test_setup(test_table_cache_size_mismatch, setup_test),
+		cmocka_unit_test_setup(test_table_cache_does_not_fit, setup_test),
+		cmocka_unit_test_setup(test_table_cache_corrupted, setup_test),
+		cmocka_unit_test_setup(test_table_cache_empty_flash, setup_test),
+	};
+
+	return cb_run_group_tests(tests, NULL, NULL);
+}
@@ -5,9 +5,12 @@
 #include <commonlib/bsd/cbfs_mdata.h>
 #include <commonlib/bsd/cbfs_private.h>
 #include <commonlib/region.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <tests/lib/cbfs_util.h>
 #include <tests/test.h>
+#include <time.h>
 
 
 static struct cbfs_boot_device cbd;
@@ -70,6 +73,14 @@ size_t ulz4fn(const void *src, size_t srcn, void *dst, size_t dstn)
 	return dstn;
 }
 
+size_t uzstdn(const void *src, size_t srcn, void *dst, size_t dstn)
+{
+	check_expected(srcn);
+	check_expected(dstn);
+	memcpy(dst, src, dstn);
+	return dstn;
+}
+
 extern enum cb_err __real_cbfs_lookup(cbfs_dev_t dev, const char *name,
 				      union cbfs_mdata *mdata_out, size_t *data_offset_out,
 				      struct vb2_hash *metadata_hash);
@@ -973,6 +984,93 @@ static void test_cbfs_attributes_offset_uint32_max(void **state)
 					       .file_length = (file_len),                      \
 				       }))
 
+/*
+ * Lookup latency on a CBFS with many files, with and without the mcache name index. Results
+ * are reported through print_message(), every lookup is also checked for the right offset.
+ */
+#define BENCH_NUM_FILES 512
+#define BENCH_ROUNDS 64
+
+static uint64_t bench_lookups(const void *mcache, size_t mcache_size,
+			      const char names[][FILENAME_SIZE], const size_t *offsets)
+{
+	union cbfs_mdata mdata;
+	size_t data_offset;
+	struct timespec start, end;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (size_t round = 0; round < BENCH_ROUNDS; round++) {
+		for (size_t i = 0; i < BENCH_NUM_FILES; i++) {
+			assert_int_equal(CB_SUCCESS,
+					 __real_cbfs_mcache_lookup(mcache, mcache_size, names[i],
+								   &mdata, &data_offset));
+			assert_int_equal(offsets[i], data_offset);
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	assert_int_equal(CB_CBFS_NOT_FOUND,
+			 __real_cbfs_mcache_lookup(mcache, mcache_size, "bench/missing", &mdata,
+						   &data_offset));
+
+	return ((uint64_t)(end.tv_sec - start.tv_sec) * 1000000000ULL + end.tv_nsec
+		- start.tv_nsec)
+	       / (BENCH_ROUNDS * BENCH_NUM_FILES);
+}
+
+static void test_cbfs_mcache_lookup_latency(void **state)
+{
+	const size_t file_size = ALIGN_UP(sizeof(struct cbfs_file) + FILENAME_SIZE + sizeof(u32),
+					  CBFS_ALIGNMENT);
+	const size_t cbfs_size = file_size * (BENCH_NUM_FILES + 1);
+	static char names[BENCH_NUM_FILES][FILENAME_SIZE];
+	static size_t offsets[BENCH_NUM_FILES];
+	struct region_device rdev;
+	u8 *cbfs_buf = calloc(1, cbfs_size);
+	u8 *indexed, *linear;
+	size_t indexed_size, linear_size;
+
+	assert_non_null(cbfs_buf);
+
+	for (size_t i = 0; i < BENCH_NUM_FILES; i++) {
+		struct cbfs_file *file = (struct cbfs_file *)&cbfs_buf[i * file_size];
+
+		*file = (struct cbfs_file)HEADER_INITIALIZER(CBFS_TYPE_RAW, 0, sizeof(u32));
+		snprintf(names[i], FILENAME_SIZE, "bench/%04zu", i);
+		strcpy(file->filename, names[i]);
+		offsets[i] = i * file_size + sizeof(struct cbfs_file) + FILENAME_SIZE;
+	}
+	rdev_chain_mem(&rdev, cbfs_buf, cbfs_size);
+
+	assert_int_equal(CB_SUCCESS, cbfs_mcache_build(&rdev, cbfs_mcache, TEST_MCACHE_SIZE,
+						       NULL));
+	indexed_size = cbfs_mcache_real_size(cbfs_mcache, TEST_MCACHE_SIZE);
+	indexed = malloc(indexed_size);
+	assert_non_null(indexed);
+	cbfs_mcache_copy(indexed, cbfs_mcache, TEST_MCACHE_SIZE);
+
+	/* A cache one word too small for the index holds the same entries without it. */
+	linear = malloc(indexed_size);
+	assert_non_null(linear);
+	linear_size = indexed_size;
+	if (CONFIG(CBFS_MCACHE_INDEX)) {
+		linear_size -= sizeof(u32);
+		assert_int_equal(CB_SUCCESS, cbfs_mcache_build(&rdev, linear, linear_size, NULL));
+		assert_true(cbfs_mcache_real_size(linear, linear_size) < indexed_size);
+	} else {
+		memcpy(linear, indexed, indexed_size);
+	}
+
+	print_message("mcache lookup, %d files: %llu ns indexed, %llu ns linear\n",
+		      BENCH_NUM_FILES,
+		      (unsigned long long)bench_lookups(indexed, indexed_size, names, offsets),
+		      (unsigned long long)bench_lookups(linear, linear_size, names, offsets));
+
+	free(linear);
+	free(indexed);
+	free(cbfs_buf);
+}
+
 int main(void)
 {
 	const struct CMUnitTest cbfs_lookup_aligned_and_unaligned_tests[] = {
@@ -1059,6 +1157,8 @@ int main(void)
 			UINT32_MAX - offsetof(struct cbfs_test_file, attrs_and_data) + 1),
 
 		CBFS_LOOKUP_TEST(test_cbfs_attributes_offset_uint32_max),
+
+		cmocka_unit_test(test_cbfs_mcache_lookup_latency),
 	};
 
 	return cb_run_group_tests(cbfs_lookup_aligned_and_unaligned_tests, NULL, NULL);
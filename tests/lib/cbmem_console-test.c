@@ -115,6 +115,74 @@ void test_cbmemc_tx_byte_overflow(void **state)
 	free(check_buffer);
 }
 
+void test_cbmemc_write(void **state)
+{
+	const char data[] = "First line\nSecond line\n";
+
+	cbmemc_write(data, 11);
+	cbmemc_write(&data[11], sizeof(data) - 11);
+
+	assert_int_equal(sizeof(data), current_console->cursor);
+	assert_memory_equal(data, current_console->body, sizeof(data));
+
+	/* Empty writes don't change anything. */
+	cbmemc_write(data, 0);
+	assert_int_equal(sizeof(data), current_console->cursor);
+}
+
+void test_cbmemc_write_wraparound(void **state)
+{
+	const uint32_t console_size = current_console->size;
+	const char data[] = "0123456789abcdef";
+	const size_t split = 6;
+	int i;
+
+	/* Move the cursor close to the end of the buffer. */
+	for (i = 0; i < console_size - split; ++i)
+		cbmemc_tx_byte('x');
+	assert_int_equal(0, current_console->cursor & OVERFLOW);
+
+	cbmemc_write(data, sizeof(data) - 1);
+
+	/* The data is split between the end and the start of the buffer. */
+	assert_int_equal(OVERFLOW | (sizeof(data) - 1 - split), current_console->cursor);
+	assert_memory_equal(&current_console->body[console_size - split], data, split);
+	assert_memory_equal(current_console->body, &data[split], sizeof(data) - 1 - split);
+	assert_int_equal('x', current_console->body[sizeof(data) - 1 - split]);
+}
+
+void test_cbmemc_write_matches_tx_byte(void **state)
+{
+	const uint32_t console_size = current_console->size;
+	const size_t data_size = console_size * 2 + 7;
+	unsigned char *data = malloc(data_size);
+	unsigned char *check_buffer = malloc(console_size);
+	u32 check_cursor;
+	size_t i;
+
+	for (i = 0; i < data_size; ++i)
+		data[i] = 'a' + i % 23;
+
+	/* Byte by byte as the reference. */
+	cbmemc_tx_byte('-');
+	for (i = 0; i < data_size; ++i)
+		cbmemc_tx_byte(data[i]);
+	memcpy(check_buffer, current_console->body, console_size);
+	check_cursor = current_console->cursor;
+
+	/* Start over and write everything at once, more than fits into the buffer. */
+	current_console->cursor = 0;
+	memset(current_console->body, 0, console_size);
+	cbmemc_tx_byte('-');
+	cbmemc_write(data, data_size);
+
+	assert_int_equal(check_cursor, current_console->cursor);
+	assert_memory_equal(check_buffer, current_console->body, console_size);
+
+	free(data);
+	free(check_buffer);
+}
+
 int main(void)
 {
 	const struct CMUnitTest tests[] = {
@@ -123,6 +191,11 @@ int main(void)
 						teardown_cbmemc),
 		cmocka_unit_test_setup_teardown(test_cbmemc_tx_byte_overflow, setup_cbmemc,
 						teardown_cbmemc),
+		cmocka_unit_test_setup_teardown(test_cbmemc_write, setup_cbmemc, teardown_cbmemc),
+		cmocka_unit_test_setup_teardown(test_cbmemc_write_wraparound, setup_cbmemc,
+						teardown_cbmemc),
+		cmocka_unit_test_setup_teardown(test_cbmemc_write_matches_tx_byte, setup_cbmemc,
+						teardown_cbmemc),
 	};
 
 	return cb_run_group_tests(tests, NULL, NULL);
@@ -446,6 +446,27 @@ static void test_cbmem_entry_start(void **state)
 	assert_ptr_equal(cbmem_find(id2), cbmem_entry_start(cbmem_entry_find(id2)));
 }
 
+static void walk_entry(u32 id, const void *start, size_t size, void *arg)
+{
+	int *count = arg;
+
+	assert_true(id != CBMEM_ID_IMD_ROOT && id != CBMEM_ID_IMD_SMALL);
+	assert_ptr_equal(cbmem_find(id), start);
+	assert_int_equal(cbmem_entry_size(cbmem_entry_find(id)), size);
+	(*count)++;
+}
+
+static void test_cbmem_walk_entries(void **state)
+{
+	int count = 0;
+
+	prepare_simple_cbmem();
+	cbmem_walk_entries(walk_entry, &count);
+
+	/* Both large and small entries, without the IMD metadata */
+	assert_int_equal(4, count);
+}
+
 /* Reimplementation for testing purposes */
 void bootmem_add_range(uint64_t start, uint64_t size, const enum bootmem_type tag)
 {
@@ -614,6 +635,9 @@ int main(void)
 		cmocka_unit_test_setup_teardown(test_cbmem_entry_start,
 				setup_teardown_test_imd_cbmem,
 				setup_teardown_test_imd_cbmem),
+		cmocka_unit_test_setup_teardown(test_cbmem_walk_entries,
+				setup_teardown_test_imd_cbmem,
+				setup_teardown_test_imd_cbmem),
 		cmocka_unit_test_setup_teardown(test_cbmem_add_bootmem,
 				setup_teardown_test_imd_cbmem,
 				setup_teardown_test_imd_cbmem),
@@ -0,0 +1,346 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+
+/* Include the free list allocator source code and alter its function names to indicate their
+   source origin. main() is renamed as well, because bootstate.h declares the ramstage one. */
+#define main ramstage_main
+#define calloc cb_calloc
+#define malloc cb_malloc
+#define free cb_free
+#define memalign cb_memalign
+#undef __noreturn
+#define __noreturn
+
+#include "../lib/malloc_freelist.c"
+
+#undef main
+#undef calloc
+#undef malloc
+#undef free
+#undef memalign
+#undef __noreturn
+#define __noreturn __attribute__((noreturn))
+
+#include <stdlib.h>
+#include <tests/test.h>
+#include <commonlib/helpers.h>
+#include <types.h>
+#include <symbols.h>
+
+/* 1 MiB */
+#define TEST_HEAP_SZ 0x100000
+
+/* Heap region setup */
+__weak extern uint8_t _test_heap[];
+__weak extern uint8_t _etest_heap[];
+TEST_REGION(test_heap, TEST_HEAP_SZ);
+TEST_SYMBOL(_heap, _test_heap);
+TEST_SYMBOL(_eheap, _etest_heap);
+
+static struct heap_stats test_cbmem_stats;
+
+void die(const char *msg, ...)
+{
+	function_called();
+}
+
+void *cbmem_add(u32 id, u64 size)
+{
+	assert_int_equal(CBMEM_ID_HEAP_STATS, id);
+	assert_int_equal(sizeof(test_cbmem_stats), size);
+	return &test_cbmem_stats;
+}
+
+static int setup_test(void **state)
+{
+	heap_end = NULL;
+	cbmem_stats = NULL;
+	memset(free_lists, 0, sizeof(free_lists));
+	memset(&stats, 0, sizeof(stats));
+	memset(&test_cbmem_stats, 0, sizeof(test_cbmem_stats));
+	memset(_test_heap, 0xFF, TEST_HEAP_SZ);
+
+	return 0;
+}
+
+/* Walk all blocks and check the boundary tags and the free lists against each other. */
+static void assert_heap_consistent(void)
+{
+	struct heap_block *b = (void *)ALIGN_UP((uintptr_t)&_heap, HEAP_ALIGN);
+	size_t prev_size = 0, free_blocks = 0, listed = 0;
+	bool prev_free = false;
+
+	while (b != heap_end) {
+		assert_true(b < heap_end);
+		assert_int_equal(prev_size, b->prev_size);
+		assert_true(block_size(b) >= MIN_BLOCK_SIZE);
+		assert_true(IS_ALIGNED(block_size(b), HEAP_ALIGN));
+		if (!block_in_use(b)) {
+			assert_false(prev_free);
+			free_blocks++;
+		}
+		prev_free = !block_in_use(b);
+		prev_size = block_size(b);
+		b = next_block(b);
+	}
+	assert_int_equal(prev_size, heap_end->prev_size);
+
+	for (unsigned int class = 0; class < HEAP_STATS_NUM_CLASSES; class++) {
+		for (struct free_block *fb = free_lists[class]; fb; fb = fb->next) {
+			assert_false(block_in_use(&fb->h));
+			assert_int_equal(class, size_class(block_size(&fb->h)));
+			if (fb->next)
+				assert_ptr_equal(fb, fb->next->prev);
+			listed++;
+		}
+	}
+	assert_int_equal(free_blocks, listed);
+}
+
+static void assert_heap_empty(void)
+{
+	struct heap_stats s;
+
+	assert_heap_consistent();
+	heap_stats_snapshot(&s);
+	assert_int_equal(0, s.in_use);
+	assert_int_equal(1, s.free_blocks);
+	assert_int_equal(s.free_bytes, s.largest_free);
+}
+
+static void test_malloc_free_reuses_memory(void **state)
+{
+	void *first = cb_malloc(1 * KiB);
+
+	assert_non_null(first);
+	cb_free(first);
+
+	/* A bump allocator would run out of memory long before this. */
+	for (int i = 0; i < 10000; ++i) {
+		void *p = cb_malloc(1 * KiB);
+		assert_ptr_equal(first, p);
+		memset(p, 0xAA, 1 * KiB);
+		cb_free(p);
+	}
+
+	assert_heap_empty();
+}
+
+static void test_free_coalesces_neighbours(void **state)
+{
+	void *a = cb_malloc(100);
+	void *b = cb_malloc(200);
+	void *c = cb_malloc(300);
+	void *d = cb_malloc(400);
+
+	assert_true(a < b && b < c && c < d);
+
+	/* Free outer blocks first, so the middle one has to merge in both directions. */
+	cb_free(a);
+	cb_free(c);
+	assert_heap_consistent();
+	cb_free(b);
+	assert_heap_consistent();
+
+	/* The merged hole fits an allocation as big as the three blocks together. */
+	assert_ptr_equal(a, cb_malloc(600));
+	cb_free(a);
+	cb_free(d);
+
+	assert_heap_empty();
+}
+
+static void test_malloc_alignment(void **state)
+{
+	for (int i = 0; i < 100; ++i) {
+		void *p = cb_malloc(i);
+		assert_true(IS_ALIGNED((uintptr_t)p, sizeof(u64)));
+	}
+	assert_heap_consistent();
+}
+
+static void test_memalign_different_alignments(void **state)
+{
+	void *ptrs[13];
+
+	for (size_t i = 0; i < ARRAY_SIZE(ptrs); ++i) {
+		const size_t boundary = (size_t)1 << i;
+
+		/* Keep a small allocation in between so that neighbours are not all merged. */
+		cb_malloc(8);
+		ptrs[i] = cb_memalign(boundary, 3 * i + 1);
+		assert_true(IS_ALIGNED((uintptr_t)ptrs[i], boundary));
+		memset(ptrs[i], i, 3 * i + 1);
+	}
+	assert_heap_consistent();
+
+	for (size_t i = 0; i < ARRAY_SIZE(ptrs); ++i) {
+		for (size_t j = 0; j < 3 * i + 1; ++j)
+			assert_int_equal(i, ((u8 *)ptrs[i])[j]);
+		cb_free(ptrs[i]);
+	}
+	assert_heap_consistent();
+}
+
+static void test_memalign_non_power_of_two(void **state)
+{
+	void *p = cb_memalign(24, 10);
+
+	/* Boundaries are rounded up to the next power of two. */
+	assert_true(IS_ALIGNED((uintptr_t)p, 32));
+	cb_free(p);
+	assert_heap_empty();
+}
+
+static void test_calloc_memory_is_zeroed(void **state)
+{
+	const size_t nitems = 42;
+	const size_t size = sizeof(uint32_t);
+	uint32_t *ptr = cb_malloc(nitems * size);
+
+	/* Make sure calloc() gets recycled, dirty memory. */
+	memset(ptr, 0xFF, nitems * size);
+	cb_free(ptr);
+	ptr = cb_calloc(nitems, size);
+	assert_non_null(ptr);
+
+	for (size_t i = 0; i < nitems; i++)
+		assert_int_equal(ptr[i], 0);
+}
+
+static void test_malloc_out_of_memory(void **state)
+{
+	/* Expect die() call if out of memory */
+	expect_function_call(die);
+	cb_malloc(TEST_HEAP_SZ);
+}
+
+static void test_malloc_out_of_memory_fragmented(void **state)
+{
+	void *ptrs[8];
+	struct heap_stats s;
+
+	/* Fill the heap with blocks of 1/8 of its size and free every other one. */
+	for (size_t i = 0; i < ARRAY_SIZE(ptrs); ++i)
+		ptrs[i] = cb_malloc(TEST_HEAP_SZ / ARRAY_SIZE(ptrs) - 2 * MIN_BLOCK_SIZE);
+	for (size_t i = 0; i < ARRAY_SIZE(ptrs); i += 2)
+		cb_free(ptrs[i]);
+
+	heap_stats_snapshot(&s);
+	assert_true(s.free_bytes > TEST_HEAP_SZ / 2);
+	assert_true(s.largest_free < TEST_HEAP_SZ / 4);
+
+	expect_function_call(die);
+	cb_malloc(TEST_HEAP_SZ / 4);
+}
+
+static void test_free_invalid_pointers(void **state)
+{
+	int not_on_heap;
+	void *p = cb_malloc(16);
+	struct heap_stats before, after;
+
+	cb_free(NULL);
+	cb_free(&not_on_heap);
+	cb_free(p);
+
+	/* Double free must not corrupt the heap or the statistics. */
+	heap_stats_snapshot(&before);
+	cb_free(p);
+	heap_stats_snapshot(&after);
+	assert_memory_equal(&before, &after, sizeof(before));
+
+	/* Also not after the block was merged into its free predecessor. */
+	void *a = cb_malloc(16), *b = cb_malloc(16), *c = cb_malloc(16);
+	cb_free(a);
+	cb_free(b);
+	heap_stats_snapshot(&before);
+	cb_free(b);
+	heap_stats_snapshot(&after);
+	assert_memory_equal(&before, &after, sizeof(before));
+	cb_free(c);
+
+	assert_heap_empty();
+}
+
+static void test_random_allocations(void **state)
+{
+	struct {
+		u8 *p;
+		size_t size;
+	} allocs[256] = { 0 };
+	unsigned int seed = 0x12345678;
+
+	for (int i = 0; i < 20000; ++i) {
+		const size_t slot = (seed = seed * 1103515245 + 12345) >> 16 & 0xff;
+
+		if (allocs[slot].p) {
+			for (size_t j = 0; j < allocs[slot].size; ++j)
+				assert_int_equal(slot, allocs[slot].p[j]);
+			cb_free(allocs[slot].p);
+			allocs[slot].p = NULL;
+		} else {
+			seed = seed * 1103515245 + 12345;
+			allocs[slot].size = (seed >> 16) % 2048;
+			if (seed & 0x1000)
+				allocs[slot].p = cb_memalign(64, allocs[slot].size);
+			else
+				allocs[slot].p = cb_malloc(allocs[slot].size);
+			memset(allocs[slot].p, slot, allocs[slot].size);
+		}
+	}
+	assert_heap_consistent();
+
+	for (size_t slot = 0; slot < ARRAY_SIZE(allocs); ++slot)
+		cb_free(allocs[slot].p);
+
+	assert_heap_empty();
+}
+
+static void test_heap_stats_in_cbmem(void **state)
+{
+	void *a = cb_malloc(1000);
+	void *b = cb_malloc(2000);
+	void *c = cb_malloc(3000);
+	uint32_t class_sum = 0;
+
+	cb_free(b);
+	heap_stats_add_cbmem(NULL);
+
+	assert_int_equal(TEST_HEAP_SZ, test_cbmem_stats.heap_size);
+	assert_int_equal(MIN_BLOCK_SIZE, test_cbmem_stats.class_unit);
+	assert_int_equal(3, test_cbmem_stats.allocations);
+	assert_int_equal(1, test_cbmem_stats.frees);
+	assert_true(test_cbmem_stats.peak_in_use >= 6000);
+	assert_true(test_cbmem_stats.in_use < test_cbmem_stats.peak_in_use);
+	assert_int_equal(2, test_cbmem_stats.free_blocks);
+	for (size_t i = 0; i < HEAP_STATS_NUM_CLASSES; ++i)
+		class_sum += test_cbmem_stats.class_free_blocks[i];
+	assert_int_equal(test_cbmem_stats.free_blocks, class_sum);
+
+	/* The CBMEM copy is refreshed when the payload is started. */
+	cb_free(a);
+	cb_free(c);
+	heap_stats_finalize(NULL);
+	assert_int_equal(0, test_cbmem_stats.in_use);
+	assert_int_equal(3, test_cbmem_stats.frees);
+	assert_int_equal(1, test_cbmem_stats.free_blocks);
+}
+
+int main(void)
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test_setup(test_malloc_free_reuses_memory, setup_test),
+		cmocka_unit_test_setup(test_free_coalesces_neighbours, setup_test),
+		cmocka_unit_test_setup(test_malloc_alignment, setup_test),
+		cmocka_unit_test_setup(test_memalign_different_alignments, setup_test),
+		cmocka_unit_test_setup(test_memalign_non_power_of_two, setup_test),
+		cmocka_unit_test_setup(test_calloc_memory_is_zeroed, setup_test),
+		cmocka_unit_test_setup(test_malloc_out_of_memory, setup_test),
+		cmocka_unit_test_setup(test_malloc_out_of_memory_fragmented, setup_test),
+		cmocka_unit_test_setup(test_free_invalid_pointers, setup_test),
+		cmocka_unit_test_setup(test_random_allocations, setup_test),
+		cmocka_unit_test_setup(test_heap_stats_in_cbmem, setup_test),
+	};
+
+	return cb_run_group_tests(tests, NULL, NULL);
+}
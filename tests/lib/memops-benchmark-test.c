@@ -0,0 +1,223 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+
+/*
+ * Throughput benchmark for the architecture-independent memcpy(), memmove() and memset()
+ * from src/lib. Every measured call is also checked against the host libc result, so this
+ * doubles as a sweep over sizes and alignments that the functional tests do not cover.
+ *
+ * Results are reported in MB/s through print_message(). Compare them between revisions
+ * to spot regressions, absolute numbers depend on the host.
+ */
+
+#define memcpy cb_memcpy
+#include "../lib/memcpy.c"
+#undef memcpy
+
+#define memmove cb_memmove
+#include "../lib/memmove.c"
+#undef memmove
+
+#define memset cb_memset
+#include "../lib/memset.c"
+#undef memset
+
+#include <stdlib.h>
+#include <time.h>
+#include <tests/test.h>
+#include <commonlib/helpers.h>
+#include <types.h>
+
+/* Prototypes from string.h were renamed above. They have to be declared again. */
+void *memcpy(void *dest, const void *src, size_t n);
+void *memmove(void *dest, const void *src, size_t n);
+void *memset(void *s, int c, size_t n);
+
+/* Leave room for the largest size plus the largest misalignment. */
+#define BENCH_BUFFER_SZ (1 * MiB + 64)
+
+/* Amount of data moved per measurement. Keeps each run short but above timer noise. */
+#define BENCH_BYTES_PER_RUN (64 * MiB)
+
+static const size_t bench_sizes[] = { 8, 31, 64, 256, 1 * KiB, 4 * KiB, 64 * KiB, 1 * MiB };
+
+/* Destination and source offsets from a 64-byte aligned base. */
+static const struct {
+	size_t dst;
+	size_t src;
+} bench_alignments[] = {
+	{ 0, 0 },
+	{ 3, 3 },
+	{ 0, 1 },
+	{ 1, 0 },
+	{ 5, 7 },
+};
+
+struct bench_state {
+	u8 *src;
+	u8 *dst;
+	u8 *ref;
+};
+
+static int setup_bench(void **state)
+{
+	struct bench_state *s = malloc(sizeof(*s));
+
+	if (!s)
+		return -1;
+
+	s->src = memalign(64, BENCH_BUFFER_SZ);
+	s->dst = memalign(64, BENCH_BUFFER_SZ);
+	s->ref = memalign(64, BENCH_BUFFER_SZ);
+
+	if (!s->src || !s->dst || !s->ref) {
+		free(s->src);
+		free(s->dst);
+		free(s->ref);
+		free(s);
+		return -1;
+	}
+
+	for (size_t i = 0; i < BENCH_BUFFER_SZ; i++)
+		s->src[i] = (i * 7 + 13) & 0xff;
+
+	*state = s;
+
+	return 0;
+}
+
+static int teardown_bench(void **state)
+{
+	struct bench_state *s = *state;
+
+	free(s->src);
+	free(s->dst);
+	free(s->ref);
+	free(s);
+
+	return 0;
+}
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static size_t bench_iterations(size_t size)
+{
+	return MAX(BENCH_BYTES_PER_RUN / size, (size_t)1);
+}
+
+static void report(const char *func, size_t size, size_t dst_off, size_t src_off,
+		   size_t iterations, uint64_t elapsed_ns)
+{
+	/* bytes / ns * 1000 = MB/s (decimal megabytes). */
+	const uint64_t mbps = elapsed_ns ? (uint64_t)size * iterations * 1000 / elapsed_ns : 0;
+
+	print_message("%-8s size %8zu dst+%zu src+%zu: %6llu MB/s\n", func, size, dst_off,
+		      src_off, (unsigned long long)mbps);
+}
+
+static void bench_memcpy(void **state)
+{
+	struct bench_state *s = *state;
+
+	for (size_t a = 0; a < ARRAY_SIZE(bench_alignments); a++) {
+		const size_t dst_off = bench_alignments[a].dst;
+		const size_t src_off = bench_alignments[a].src;
+
+		for (size_t i = 0; i < ARRAY_SIZE(bench_sizes); i++) {
+			const size_t size = bench_sizes[i];
+			const size_t iterations = bench_iterations(size);
+			uint64_t start;
+
+			memset(s->dst, 0xEE, BENCH_BUFFER_SZ);
+			memset(s->ref, 0xEE, BENCH_BUFFER_SZ);
+			memcpy(s->ref + dst_off, s->src + src_off, size);
+			assert_ptr_equal(s->dst + dst_off,
+					 cb_memcpy(s->dst + dst_off, s->src + src_off, size));
+			assert_memory_equal(s->dst, s->ref, BENCH_BUFFER_SZ);
+
+			start = now_ns();
+			for (size_t n = 0; n < iterations; n++)
+				cb_memcpy(s->dst + dst_off, s->src + src_off, size);
+			report("memcpy", size, dst_off, src_off, iterations, now_ns() - start);
+		}
+	}
+}
+
+static void bench_memmove(void **state)
+{
+	struct bench_state *s = *state;
+
+	/* Overlapping moves in both directions within one buffer. */
+	for (size_t a = 0; a < ARRAY_SIZE(bench_alignments); a++) {
+		const size_t lo = MIN(bench_alignments[a].dst, bench_alignments[a].src);
+		const size_t hi = MAX(bench_alignments[a].dst, bench_alignments[a].src) + 8;
+
+		for (size_t i = 0; i < ARRAY_SIZE(bench_sizes); i++) {
+			const size_t size = MIN(bench_sizes[i], BENCH_BUFFER_SZ - hi);
+			const size_t iterations = bench_iterations(size);
+			uint64_t start;
+
+			memcpy(s->dst, s->src, BENCH_BUFFER_SZ);
+			memcpy(s->ref, s->src, BENCH_BUFFER_SZ);
+			memmove(s->ref + lo, s->ref + hi, size);
+			cb_memmove(s->dst + lo, s->dst + hi, size);
+			assert_memory_equal(s->dst, s->ref, BENCH_BUFFER_SZ);
+
+			memmove(s->ref + hi, s->ref + lo, size);
+			cb_memmove(s->dst + hi, s->dst + lo, size);
+			assert_memory_equal(s->dst, s->ref, BENCH_BUFFER_SZ);
+
+			start = now_ns();
+			for (size_t n = 0; n < iterations; n++)
+				cb_memmove(s->dst + lo, s->dst + hi, size);
+			report("memmove<", size, lo, hi, iterations, now_ns() - start);
+
+			start = now_ns();
+			for (size_t n = 0; n < iterations; n++)
+				cb_memmove(s->dst + hi, s->dst + lo, size);
+			report("memmove>", size, hi, lo, iterations, now_ns() - start);
+		}
+	}
+}
+
+static void bench_memset(void **state)
+{
+	struct bench_state *s = *state;
+
+	for (size_t a = 0; a < ARRAY_SIZE(bench_alignments); a++) {
+		const size_t dst_off = bench_alignments[a].dst;
+
+		for (size_t i = 0; i < ARRAY_SIZE(bench_sizes); i++) {
+			const size_t size = bench_sizes[i];
+			const size_t iterations = bench_iterations(size);
+			uint64_t start;
+
+			memset(s->dst, 0xEE, BENCH_BUFFER_SZ);
+			memset(s->ref, 0xEE, BENCH_BUFFER_SZ);
+			memset(s->ref + dst_off, 0x5A, size);
+			assert_ptr_equal(s->dst + dst_off, cb_memset(s->dst + dst_off, 0x5A, size));
+			assert_memory_equal(s->dst, s->ref, BENCH_BUFFER_SZ);
+
+			start = now_ns();
+			for (size_t n = 0; n < iterations; n++)
+				cb_memset(s->dst + dst_off, n & 0xff, size);
+			report("memset", size, dst_off, 0, iterations, now_ns() - start);
+		}
+	}
+}
+
+int main(void)
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test_setup_teardown(bench_memcpy, setup_bench, teardown_bench),
+		cmocka_unit_test_setup_teardown(bench_memmove, setup_bench, teardown_bench),
+		cmocka_unit_test_setup_teardown(bench_memset, setup_bench, teardown_bench),
+	};
+
+	return cb_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,228 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+
+#include <bootmem.h>
+#include <commonlib/helpers.h>
+#include <cpu/x86/mp.h>
+#include <memrange.h>
+#include <ram_split.h>
+#include <string.h>
+#include <tests/test.h>
+
+/*
+ * The AP work queue is emulated. Queued shares only run once the caller waits for the first
+ * of them, and then in reverse order, so the test sees if anything depends on the order.
+ */
+static int num_aps;
+static struct mp_work *queued[CONFIG_MAX_CPUS];
+static size_t num_queued;
+static bool bsp_share_done;
+
+int mp_get_num_aps(void)
+{
+	return num_aps;
+}
+
+void mp_queue_work(struct mp_work *work, void (*func)(void *), void *arg)
+{
+	assert_true(num_queued < ARRAY_SIZE(queued));
+	work->func = func;
+	work->arg = arg;
+	queued[num_queued++] = work;
+}
+
+enum cb_err mp_work_wait(struct mp_work *work, long expire_us)
+{
+	assert_int_equal(0, expire_us);
+
+	/* Share 0 runs on the caller, before it waits for the APs. */
+	assert_true(bsp_share_done);
+
+	while (num_queued) {
+		struct mp_work *w = queued[--num_queued];
+		w->func(w->arg);
+	}
+
+	return CB_SUCCESS;
+}
+
+struct piece {
+	unsigned int share;
+	uint64_t base;
+	uint64_t size;
+};
+
+static struct piece pieces[256];
+static size_t num_pieces;
+static uint64_t share_bytes[CONFIG_MAX_CPUS];
+static unsigned int share_runs[CONFIG_MAX_CPUS];
+
+static void record_piece(uint64_t base, uint64_t size, void *arg)
+{
+	const struct ram_share *share = arg;
+
+	assert_true(num_pieces < ARRAY_SIZE(pieces));
+	assert_true(size > 0);
+	pieces[num_pieces++] = (struct piece){ share->index, base, size };
+	share_bytes[share->index] += size;
+}
+
+static void record_share(const struct ram_share *share, void *arg)
+{
+	assert_ptr_equal(arg, &pieces);
+	assert_true(share->index < share->split->shares);
+	share_runs[share->index]++;
+	if (share->index == 0)
+		bsp_share_done = true;
+
+	ram_share_for_each_piece(share, record_piece, (void *)share);
+}
+
+static void sort_pieces(void)
+{
+	for (size_t i = 1; i < num_pieces; i++) {
+		const struct piece p = pieces[i];
+		size_t j = i;
+
+		for (; j > 0 && pieces[j - 1].base > p.base; j--)
+			pieces[j] = pieces[j - 1];
+		pieces[j] = p;
+	}
+}
+
+/*
+ * RAM with a CBMEM hole, a reserved range, and RAM on both sides of 4GiB. The sizes are
+ * multiples of 4KiB, like the granularity of memranges.
+ */
+static void init_ranges(struct memranges *mem, struct range_entry *free, size_t num_free)
+{
+	memranges_init_empty(mem, free, num_free);
+	memranges_insert(mem, 0x0, 0xa0000, BM_MEM_RAM);
+	memranges_insert(mem, 0x100000, 0x7ff00000, BM_MEM_RAM);
+	memranges_insert(mem, 0x7f000000, 0x800000, BM_MEM_TABLE);
+	memranges_insert(mem, 0xfe000000, 0x1000000, BM_MEM_RESERVED);
+	memranges_insert(mem, 0xff000000, 0x3000, BM_MEM_RAM);
+	memranges_insert(mem, 4ULL * GiB, 3ULL * GiB + 0x5000, BM_MEM_RAM);
+}
+
+/* Check that the pieces cover the BM_MEM_RAM below limit exactly once. */
+static void check_coverage(const struct memranges *mem, uint64_t limit, uint64_t total)
+{
+	const struct range_entry *r;
+	uint64_t expected_total = 0;
+	size_t i = 0;
+
+	sort_pieces();
+
+	memranges_each_entry(r, mem) {
+		if (range_entry_tag(r) != BM_MEM_RAM || range_entry_base(r) >= limit)
+			continue;
+
+		const uint64_t end = MIN(range_entry_end(r), limit);
+		uint64_t addr = range_entry_base(r);
+
+		while (addr < end) {
+			assert_true(i < num_pieces);
+			assert_int_equal(addr, pieces[i].base);
+			/* Every share is one contiguous part of the memory. */
+			if (i > 0)
+				assert_true(pieces[i - 1].share <= pieces[i].share);
+			addr += pieces[i].size;
+			i++;
+		}
+		assert_int_equal(end, addr);
+		expected_total += end - range_entry_base(r);
+	}
+
+	/* Nothing else was touched. */
+	assert_int_equal(num_pieces, i);
+	assert_int_equal(expected_total, total);
+}
+
+static void run_split(int aps, uint64_t limit, uint64_t align)
+{
+	struct range_entry free[16];
+	struct memranges mem;
+	struct ram_split split;
+	uint64_t sum = 0;
+
+	num_aps = aps;
+	num_queued = 0;
+	num_pieces = 0;
+	bsp_share_done = false;
+	memset(share_bytes, 0, sizeof(share_bytes));
+	memset(share_runs, 0, sizeof(share_runs));
+
+	init_ranges(&mem, free, ARRAY_SIZE(free));
+	ram_split_init(&split, &mem, limit, align);
+	assert_int_equal(MIN(aps + 1, CONFIG_MAX_CPUS), split.shares);
+
+	ram_split_run(&split, record_share, &pieces);
+	assert_int_equal(0, num_queued);
+
+	check_coverage(&mem, limit, split.total);
+
+	for (unsigned int i = 0; i < split.shares; i++) {
+		assert_int_equal(1, share_runs[i]);
+		sum += share_bytes[i];
+
+		/* Only the last share may end on a partial multiple of align. */
+		if (i + 1 < split.shares)
+			assert_int_equal(0, share_bytes[i] % align);
+
+		/* The shares are about equal. */
+		assert_true(share_bytes[i] + align >= split.total / split.shares);
+		assert_true(share_bytes[i] <= split.total / split.shares + 2 * align);
+	}
+	assert_int_equal(split.total, sum);
+
+	memranges_teardown(&mem);
+}
+
+static void test_ram_split_bsp_only(void **state)
+{
+	run_split(0, UINT64_MAX, 1);
+}
+
+static void test_ram_split_all_cpus(void **state)
+{
+	for (int aps = 1; aps < 8; aps++) {
+		run_split(aps, UINT64_MAX, 1);
+		run_split(aps, UINT64_MAX, sizeof(uint64_t));
+		run_split(aps, UINT64_MAX, 4 * KiB);
+	}
+}
+
+static void test_ram_split_limit(void **state)
+{
+	/* Below 4GiB, like a 32-bit ramstage */
+	run_split(3, 4ULL * GiB, sizeof(uint64_t));
+	/* In the middle of a range */
+	run_split(3, 0x40000000, sizeof(uint64_t));
+	/* Inside the first range only */
+	run_split(5, 0x3000, sizeof(uint64_t));
+}
+
+static void test_ram_split_more_cpus_than_shares(void **state)
+{
+	/* One share per CPU, up to CONFIG_MAX_CPUS */
+	run_split(CONFIG_MAX_CPUS + 4, UINT64_MAX, sizeof(uint64_t));
+}
+
+static void test_ram_split_more_cpus_than_bytes(void **state)
+{
+	/* Shares can be empty, they still run once. */
+	run_split(CONFIG_MAX_CPUS - 1, 0x1000, 4 * KiB);
+}
+
+int main(void)
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(test_ram_split_bsp_only),
+		cmocka_unit_test(test_ram_split_all_cpus),
+		cmocka_unit_test(test_ram_split_limit),
+		cmocka_unit_test(test_ram_split_more_cpus_than_shares),
+		cmocka_unit_test(test_ram_split_more_cpus_than_bytes),
+	};
+
+	return cb_run_group_tests(tests, NULL, NULL);
+}
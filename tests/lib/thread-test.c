@@ -0,0 +1,293 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+
+/* Include the scheduler source code to check its accounting. main() is renamed, because
+   bootstate.h declares the ramstage one. */
+#define main ramstage_main
+#include "../lib/thread.c"
+#undef main
+
+#include <stdlib.h>
+#include <tests/test.h>
+#include <ucontext.h>
+
+/*
+ * The architecture specific part is emulated with ucontext. Instead of a stack pointer,
+ * struct thread.stack_current holds a pointer to the context of the thread.
+ */
+#define TEST_STACK_SZ (64 * KiB)
+
+static ucontext_t contexts[TOTAL_NUM_THREADS];
+static u8 *host_stacks[TOTAL_NUM_THREADS];
+static void (*entries[TOTAL_NUM_THREADS])(void *);
+static void *entry_args[TOTAL_NUM_THREADS];
+
+static uint64_t fake_time_us;
+
+static void context_entry(int id)
+{
+	entries[id](entry_args[id]);
+}
+
+void arch_prepare_thread(struct thread *t, asmlinkage void (*thread_entry)(void *), void *arg)
+{
+	ucontext_t *ctx = &contexts[t->id];
+
+	if (!host_stacks[t->id])
+		host_stacks[t->id] = malloc(TEST_STACK_SZ);
+
+	entries[t->id] = thread_entry;
+	entry_args[t->id] = arg;
+
+	getcontext(ctx);
+	ctx->uc_stack.ss_sp = host_stacks[t->id];
+	ctx->uc_stack.ss_size = TEST_STACK_SZ;
+	ctx->uc_link = NULL;
+	makecontext(ctx, (void (*)(void))context_entry, 1, t->id);
+
+	t->stack_current = (uintptr_t)ctx;
+}
+
+void switch_to_thread(uintptr_t new_stack, uintptr_t *saved_stack)
+{
+	struct thread *current = container_of(saved_stack, struct thread, stack_current);
+
+	*saved_stack = (uintptr_t)&contexts[current->id];
+	swapcontext(&contexts[current->id], (ucontext_t *)new_stack);
+}
+
+/* Every reading of the clock advances it, so that sleeping threads eventually wake up. */
+void timer_monotonic_get(struct mono_time *mt)
+{
+	mt->microseconds = fake_time_us++;
+}
+
+int boot_state_block(boot_state_t state, boot_state_sequence_t seq)
+{
+	return 0;
+}
+
+int boot_state_unblock(boot_state_t state, boot_state_sequence_t seq)
+{
+	return 0;
+}
+
+/* Order in which the threads of a test ran. */
+static char run_order[16];
+static size_t run_count;
+
+static void record_run(char c)
+{
+	assert_true(run_count < sizeof(run_order) - 1);
+	run_order[run_count++] = c;
+}
+
+static int setup_test(void **state)
+{
+	memset(run_order, 0, sizeof(run_order));
+	run_count = 0;
+
+	threads_initialize();
+
+	return 0;
+}
+
+static struct thread *main_thread(void)
+{
+	return &all_threads[0];
+}
+
+static enum cb_err record_thread(void *arg)
+{
+	record_run(*(const char *)arg);
+	return CB_SUCCESS;
+}
+
+static enum cb_err sleeping_thread(void *arg)
+{
+	record_run('s');
+	assert_int_equal(0, thread_yield_microseconds(100));
+	record_run('S');
+	return CB_ERR;
+}
+
+static void test_run_and_join(void **state)
+{
+	struct thread_handle handle = { 0 };
+	const unsigned int waits = main_thread()->waits;
+	const unsigned int yields = main_thread()->yields;
+
+	assert_int_equal(CB_ERR_ARG, thread_join(&handle));
+
+	assert_int_equal(0, thread_run(&handle, sleeping_thread, NULL));
+	assert_int_equal(THREAD_STARTED, handle.state);
+
+	/* The thread started right away and is now sleeping, the join has to block. */
+	assert_string_equal("s", run_order);
+	assert_int_equal(CB_ERR, thread_join(&handle));
+	assert_string_equal("sS", run_order);
+
+	/* The main thread was not woken up before the other thread was done. */
+	assert_int_equal(waits + 1, main_thread()->waits);
+	assert_int_equal(yields, main_thread()->yields);
+
+	/* Joining a finished thread doesn't block. */
+	assert_int_equal(CB_ERR, thread_join(&handle));
+	assert_int_equal(waits + 1, main_thread()->waits);
+}
+
+static void test_priorities(void **state)
+{
+	struct thread_handle low1 = { 0 }, low2 = { 0 }, high = { 0 };
+
+	/* Lower priority threads don't run until the main thread blocks. */
+	assert_int_equal(0, thread_run_prio(&low1, THREAD_PRIORITY_LOW, record_thread, "1"));
+	assert_int_equal(0, thread_run_prio(&low2, THREAD_PRIORITY_LOW, record_thread, "2"));
+	assert_int_equal(THREAD_STARTED, low1.state);
+	assert_string_equal("", run_order);
+
+	/* A higher priority thread runs right away. */
+	assert_int_equal(0, thread_run_prio(&high, THREAD_PRIORITY_HIGH, record_thread, "H"));
+	assert_string_equal("H", run_order);
+
+	/* Once low1 is done, the main thread gets to run before low2. */
+	assert_int_equal(CB_SUCCESS, thread_join(&low1));
+	assert_string_equal("H1", run_order);
+	assert_int_equal(THREAD_STARTED, low2.state);
+
+	assert_int_equal(CB_SUCCESS, thread_join(&low2));
+	assert_int_equal(CB_SUCCESS, thread_join(&high));
+	assert_string_equal("H12", run_order);
+}
+
+static struct thread_mutex test_mutex;
+
+static enum cb_err mutex_thread(void *arg)
+{
+	const char c = *(const char *)arg;
+
+	thread_mutex_lock(&test_mutex);
+	record_run(c);
+	/* Give the other threads a chance to contend for the mutex. */
+	assert_int_equal(0, thread_yield_microseconds(10));
+	record_run(c);
+	thread_mutex_unlock(&test_mutex);
+
+	return CB_SUCCESS;
+}
+
+static void test_mutex_blocks_waiters(void **state)
+{
+	struct thread_handle a = { 0 }, b = { 0 }, c = { 0 };
+
+	assert_int_equal(0, thread_run(&a, mutex_thread, "a"));
+	assert_int_equal(0, thread_run(&b, mutex_thread, "b"));
+	assert_int_equal(0, thread_run(&c, mutex_thread, "c"));
+
+	assert_int_equal(CB_SUCCESS, thread_join(&a));
+	assert_int_equal(CB_SUCCESS, thread_join(&b));
+	assert_int_equal(CB_SUCCESS, thread_join(&c));
+
+	/* Critical sections don't interleave and the mutex is passed on in order. */
+	assert_string_equal("aabbcc", run_order);
+	assert_false(test_mutex.locked);
+	assert_null(test_mutex.waiters);
+}
+
+static void test_mutex_without_threads(void **state)
+{
+	struct thread_mutex mutex = { 0 };
+
+	thread_mutex_lock(&mutex);
+	assert_true(mutex.locked);
+	thread_mutex_unlock(&mutex);
+	assert_false(mutex.locked);
+}
+
+static void test_yield_wakes_sleeping_threads(void **state)
+{
+	struct thread_handle handle = { 0 };
+	const unsigned int yields = main_thread()->yields;
+	unsigned int n = 0;
+
+	assert_int_equal(0, thread_run(&handle, sleeping_thread, NULL));
+
+	/* The idle thread never runs while the main thread keeps yielding, so expired
+	   sleeps have to be handled when yielding, too. */
+	while (handle.state != THREAD_DONE) {
+		assert_int_equal(0, thread_yield());
+		assert_true(++n < 1000);
+	}
+	assert_string_equal("sS", run_order);
+	assert_int_equal(yields + n, main_thread()->yields);
+}
+
+static bool low_thread_ran;
+
+static enum cb_err low_flag_thread(void *arg)
+{
+	low_thread_ran = true;
+	return CB_SUCCESS;
+}
+
+static enum cb_err spinning_thread(void *arg)
+{
+	unsigned int n = 0;
+
+	/* Only yields until the lower priority thread ran, it never blocks. */
+	while (!low_thread_ran) {
+		assert_int_equal(0, thread_yield());
+		assert_true(++n <= THREAD_MAX_PASSED_OVER);
+	}
+	record_run('H');
+	return CB_SUCCESS;
+}
+
+static void test_yielding_thread_doesnt_starve(void **state)
+{
+	struct thread_handle low = { 0 }, high = { 0 };
+
+	low_thread_ran = false;
+	assert_int_equal(0, thread_run_prio(&low, THREAD_PRIORITY_LOW, low_flag_thread, NULL));
+	assert_int_equal(0, thread_run_prio(&high, THREAD_PRIORITY_HIGH, spinning_thread, NULL));
+
+	assert_int_equal(CB_SUCCESS, thread_join(&high));
+	assert_int_equal(CB_SUCCESS, thread_join(&low));
+	assert_true(low_thread_ran);
+	assert_string_equal("H", run_order);
+}
+
+static enum cb_err nested_run_thread(void *arg)
+{
+	struct thread_handle handle = { 0 };
+
+	thread_coop_disable();
+	assert_int_equal(-1, thread_run(&handle, record_thread, "x"));
+	assert_int_equal(-1, thread_yield());
+	thread_coop_enable();
+
+	return CB_SUCCESS;
+}
+
+static void test_non_yielding_context(void **state)
+{
+	struct thread_handle handle = { 0 };
+
+	assert_int_equal(0, thread_run(&handle, nested_run_thread, NULL));
+	assert_int_equal(CB_SUCCESS, thread_join(&handle));
+	assert_string_equal("", run_order);
+}
+
+int main(void)
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test_setup(test_mutex_without_threads, NULL),
+		cmocka_unit_test_setup(test_run_and_join, setup_test),
+		cmocka_unit_test_setup(test_priorities, setup_test),
+		cmocka_unit_test_setup(test_mutex_blocks_waiters, setup_test),
+		cmocka_unit_test_setup(test_yield_wakes_sleeping_threads, setup_test),
+		cmocka_unit_test_setup(test_yielding_thread_doesnt_starve, setup_test),
+		cmocka_unit_test_setup(test_non_yielding_context, setup_test),
+	};
+
+	return cb_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,181 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+
+/* Include the trace source code to reset its state between the tests. main() is renamed,
+   because bootstate.h declares the ramstage one, and the thread id is replaced by a mock. */
+#define main ramstage_main
+#include <thread.h>
+static int test_thread_id(void);
+#define thread_current_id test_thread_id
+#include "../lib/trace.c"
+#undef thread_current_id
+#undef main
+
+#include <tests/test.h>
+
+#define TEST_BASE_TIME 1000
+
+static struct {
+	struct trace_table table;
+	struct trace_span spans[CONFIG_TRACE_SPANS_MAX_ENTRIES];
+} test_cbmem_table;
+
+int cbmem_initialized;
+
+int boot_cpu(void)
+{
+	return 1;
+}
+
+static uint64_t fake_time;
+static int fake_thread;
+
+void *cbmem_add(u32 id, u64 size)
+{
+	assert_int_equal(CBMEM_ID_TRACE, id);
+	assert_int_equal(sizeof(test_cbmem_table), size);
+	return &test_cbmem_table;
+}
+
+/* Every reading of the clock advances it, so that all spans have a duration. */
+uint64_t timestamp_get(void)
+{
+	return fake_time++;
+}
+
+uint64_t get_initial_timestamp(void)
+{
+	return TEST_BASE_TIME;
+}
+
+int timestamp_tick_freq_mhz(void)
+{
+	return 100;
+}
+
+static int test_thread_id(void)
+{
+	return fake_thread;
+}
+
+static int setup_test(void **state)
+{
+	table = NULL;
+	cbmem_initialized = 1;
+	fake_time = TEST_BASE_TIME;
+	fake_thread = 0;
+	memset(&test_cbmem_table, 0xff, sizeof(test_cbmem_table));
+
+	return 0;
+}
+
+static const struct trace_span *span(int i)
+{
+	return &test_cbmem_table.table.spans[i];
+}
+
+static void test_trace_before_cbmem(void **state)
+{
+	cbmem_initialized = 0;
+
+	int s = trace_span_begin(0, "early");
+	assert_true(s < 0);
+	trace_span_end(s, 0);
+	assert_null(table);
+
+	/* The table is set up with the first span once CBMEM is there. */
+	cbmem_initialized = 1;
+	assert_int_equal(0, trace_span_begin(0, "late"));
+	assert_int_equal(TEST_BASE_TIME, test_cbmem_table.table.base_time);
+	assert_int_equal(100, test_cbmem_table.table.tick_freq_mhz);
+	assert_int_equal(CONFIG_TRACE_SPANS_MAX_ENTRIES, test_cbmem_table.table.max_entries);
+	assert_int_equal(1, test_cbmem_table.table.num_entries);
+}
+
+static void test_trace_nesting(void **state)
+{
+	int outer = trace_span_begin(0, "outer");
+	int first = trace_span_begin(TS_DEVICE_INITIALIZE, "first");
+	int nested = trace_span_begin(0, "nested");
+
+	trace_span_end(nested, 0);
+	trace_span_end(first, 42);
+
+	int second = trace_span_begin(0, "second");
+	trace_span_end(second, 0);
+	trace_span_end(outer, 0);
+
+	assert_int_equal(4, test_cbmem_table.table.num_entries);
+	assert_int_equal(0, span(outer)->parent);
+	assert_int_equal(outer + 1, span(first)->parent);
+	assert_int_equal(first + 1, span(nested)->parent);
+	assert_int_equal(outer + 1, span(second)->parent);
+
+	assert_int_equal(TS_DEVICE_INITIALIZE, span(first)->id);
+	assert_int_equal(42, span(first)->payload);
+	assert_string_equal("nested", span(nested)->name);
+
+	/* Times are relative to the base and children lie within their parents. */
+	assert_int_equal(0, span(outer)->start);
+	assert_true(span(first)->start > span(outer)->start);
+	assert_true(span(nested)->end < span(first)->end);
+	assert_true(span(first)->end < span(second)->start);
+	assert_true(span(second)->end < span(outer)->end);
+}
+
+static void test_trace_threads(void **state)
+{
+	int main_span = trace_span_begin(0, "main");
+
+	/* The first span of a thread becomes a child of the main thread's open span. */
+	fake_thread = 2;
+	int thread_span = trace_span_begin(TS_THREAD_START, "thread 2");
+	fake_thread = 0;
+	int main_child = trace_span_begin(0, "main child");
+	fake_thread = 2;
+	int thread_child = trace_span_begin(0, "thread child");
+
+	assert_int_equal(main_span + 1, span(thread_span)->parent);
+	assert_int_equal(2, span(thread_span)->thread);
+	assert_int_equal(main_span + 1, span(main_child)->parent);
+	assert_int_equal(thread_span + 1, span(thread_child)->parent);
+
+	/* Spans that are still open have no end. */
+	trace_span_end(thread_child, 0);
+	assert_int_equal(0, span(thread_span)->end);
+	assert_true(span(thread_child)->end > span(thread_child)->start);
+}
+
+static void test_trace_long_name(void **state)
+{
+	char name[TRACE_SPAN_NAME_LEN * 2];
+
+	memset(name, 'a', sizeof(name) - 1);
+	name[sizeof(name) - 1] = '\0';
+
+	int s = trace_span_begin(0, name);
+	assert_int_equal(TRACE_SPAN_NAME_LEN - 1, strlen(span(s)->name));
+}
+
+static void test_trace_table_full(void **state)
+{
+	for (int i = 0; i < CONFIG_TRACE_SPANS_MAX_ENTRIES; i++)
+		trace_span_end(trace_span_begin(0, "span"), i);
+
+	int s = trace_span_begin(0, "dropped");
+	assert_true(s < 0);
+	trace_span_end(s, 0);
+	assert_int_equal(CONFIG_TRACE_SPANS_MAX_ENTRIES, test_cbmem_table.table.num_entries);
+}
+
+int main(void)
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test_setup(test_trace_before_cbmem, setup_test),
+		cmocka_unit_test_setup(test_trace_nesting, setup_test),
+		cmocka_unit_test_setup(test_trace_threads, setup_test),
+		cmocka_unit_test_setup(test_trace_long_name, setup_test),
+		cmocka_unit_test_setup(test_trace_table_full, setup_test),
+	};
+
+	return cb_run_group_tests(tests, NULL, NULL);
+}
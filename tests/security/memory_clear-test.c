@@ -0,0 +1,153 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+
+/* Include the source to run the clear directly and check its statistics. main() is renamed,
+   because bootstate.h declares the ramstage one. */
+#define main ramstage_main
+#include "../../src/security/memory/memory_clear.c"
+#undef main
+
+#include <cpu/x86/mp.h>
+#include <device/device.h>
+#include <device/resource.h>
+#include <tests/test.h>
+#include <timer.h>
+
+/*
+ * The DRAM is two buffers in the test's own memory, passed as RAM resources of a fake
+ * device. CBMEM is a hole in the larger one. Both sizes are multiples of 4KiB, the
+ * granularity of memranges.
+ */
+static uint8_t dram_low[64 * KiB] __aligned(4 * KiB);
+static uint8_t dram_high[1 * MiB + 12 * KiB] __aligned(4 * KiB);
+
+#define CBMEM_OFFSET	(256 * KiB)
+#define CBMEM_SIZE	(128 * KiB)
+
+#define DRAM_FLAGS	(IORESOURCE_MEM | IORESOURCE_FIXED | IORESOURCE_STORED | \
+			 IORESOURCE_ASSIGNED | IORESOURCE_CACHEABLE)
+
+static struct resource dram_res[2];
+static struct device mock_device = {.enabled = 1};
+struct device *all_devices = &mock_device;
+
+static int num_aps;
+static bool clear_requested;
+static uint64_t fake_time_us;
+
+int mp_get_num_aps(void)
+{
+	return num_aps;
+}
+
+bool security_clear_dram_request(void)
+{
+	return clear_requested;
+}
+
+void cbmem_get_region(void **baseptr, size_t *size)
+{
+	*baseptr = dram_high + CBMEM_OFFSET;
+	*size = CBMEM_SIZE;
+}
+
+void timestamp_add_now(enum timestamp_id id)
+{
+}
+
+void timer_monotonic_get(struct mono_time *mt)
+{
+	mt->microseconds = fake_time_us++;
+}
+
+static int setup_dram(void **state)
+{
+	memset(dram_low, 0xaa, sizeof(dram_low));
+	memset(dram_high, 0xaa, sizeof(dram_high));
+	memset(clear_stats, 0, sizeof(clear_stats));
+
+	dram_res[0] = (struct resource){
+		.base = (uintptr_t)dram_low,
+		.size = sizeof(dram_low),
+		.next = &dram_res[1],
+		.flags = DRAM_FLAGS,
+	};
+	dram_res[1] = (struct resource){
+		.base = (uintptr_t)dram_high,
+		.size = sizeof(dram_high),
+		.flags = DRAM_FLAGS,
+	};
+	mock_device.resource_list = &dram_res[0];
+
+	clear_requested = true;
+	return 0;
+}
+
+static bool all_bytes_are(const uint8_t *p, size_t size, uint8_t value)
+{
+	for (size_t i = 0; i < size; i++) {
+		if (p[i] != value)
+			return false;
+	}
+	return true;
+}
+
+static void run_clear(int aps)
+{
+	const unsigned int shares = aps + 1;
+	uint64_t cleared = 0;
+
+	num_aps = aps;
+	clear_memory(NULL);
+
+	/* Every byte of DRAM is zero, except for CBMEM. */
+	assert_true(all_bytes_are(dram_low, sizeof(dram_low), 0));
+	assert_true(all_bytes_are(dram_high, CBMEM_OFFSET, 0));
+	assert_true(all_bytes_are(dram_high + CBMEM_OFFSET, CBMEM_SIZE, 0xaa));
+	assert_true(all_bytes_are(dram_high + CBMEM_OFFSET + CBMEM_SIZE,
+				  sizeof(dram_high) - CBMEM_OFFSET - CBMEM_SIZE, 0));
+
+	/* Every CPU cleared its share, and the queue is empty again. */
+	for (unsigned int i = 0; i < shares; i++) {
+		assert_true(clear_stats[i].bytes > 0);
+		cleared += clear_stats[i].bytes;
+	}
+	assert_int_equal(sizeof(dram_low) + sizeof(dram_high) - CBMEM_SIZE, cleared);
+	assert_false(mp_work_queued());
+}
+
+static void test_clear_memory_bsp_only(void **state)
+{
+	run_clear(0);
+}
+
+static void test_clear_memory_all_cpus(void **state)
+{
+	run_clear(3);
+}
+
+static void test_clear_memory_max_cpus(void **state)
+{
+	run_clear(CONFIG_MAX_CPUS - 1);
+}
+
+static void test_clear_memory_not_requested(void **state)
+{
+	clear_requested = false;
+	num_aps = 3;
+	clear_memory(NULL);
+
+	assert_true(all_bytes_are(dram_low, sizeof(dram_low), 0xaa));
+	assert_true(all_bytes_are(dram_high, sizeof(dram_high), 0xaa));
+}
+
+int main(void)
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test_setup(test_clear_memory_bsp_only, setup_dram),
+		cmocka_unit_test_setup(test_clear_memory_all_cpus, setup_dram),
+		cmocka_unit_test_setup(test_clear_memory_max_cpus, setup_dram),
+		cmocka_unit_test_setup(test_clear_memory_not_requested, setup_dram),
+	};
+
+	return cb_run_group_tests(tests, NULL, NULL);
+}
@@ -7,6 +7,7 @@
 
 #define CBFS_ENABLE_HASHING 1
 #define CBFS_HASH_HWCRYPTO 0
+#define CBFS_MCACHE_INDEX 0
 
 typedef const struct cbfs_image *cbfs_dev_t;
 
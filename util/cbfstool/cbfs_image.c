@@ -335,6 +335,7 @@ int cbfs_image_from_buffer(struct cbfs_image *out, struct buffer *in,
 
 	buffer_clone(&out->buffer, in);
 	out->has_header = false;
+	out->placement = CBFS_PLACEMENT_FIRST_FIT;
 
 	if (cbfs_is_valid_cbfs(out)) {
 		return 0;
@@ -612,6 +613,122 @@ int cbfs_image_delete(struct cbfs_image *image)
 	return 0;
 }
 
+/*
+ * The free extent index lists the empty entries of an image in address order.
+ * Building it merges adjacent empty entries once, so that a sequence of
+ * placements doesn't have to walk the whole image again for every file.
+ */
+struct cbfs_free_extent {
+	uint32_t addr;	/* of the empty entry */
+	uint32_t end;	/* address of the entry following it */
+};
+
+struct cbfs_free_index {
+	struct cbfs_free_extent *extents;
+	size_t count;
+};
+
+static uint32_t cbfs_free_extent_size(const struct cbfs_free_extent *ext)
+{
+	return ext->end - ext->addr;
+}
+
+static int cbfs_free_index_insert(struct cbfs_free_index *index, size_t pos,
+				  uint32_t addr, uint32_t end)
+{
+	struct cbfs_free_extent *extents = realloc(index->extents,
+			(index->count + 1) * sizeof(*extents));
+	if (!extents) {
+		ERROR("Out of memory for the free space index.\n");
+		return -1;
+	}
+
+	memmove(&extents[pos + 1], &extents[pos],
+		(index->count - pos) * sizeof(*extents));
+	extents[pos].addr = addr;
+	extents[pos].end = end;
+	index->extents = extents;
+	index->count++;
+	return 0;
+}
+
+static void cbfs_free_index_release(struct cbfs_free_index *index)
+{
+	free(index->extents);
+	index->extents = NULL;
+	index->count = 0;
+}
+
+static int cbfs_free_index_build(struct cbfs_image *image,
+				 struct cbfs_free_index *index)
+{
+	struct cbfs_file *entry;
+
+	index->extents = NULL;
+	index->count = 0;
+
+	DEBUG("(trying to merge empty entries...)\n");
+	for (entry = cbfs_find_first_entry(image);
+	     entry && cbfs_is_valid_entry(image, entry);
+	     entry = cbfs_find_next_entry(image, entry)) {
+		uint32_t type = be32toh(entry->type);
+
+		if (type != CBFS_TYPE_NULL && type != CBFS_TYPE_DELETED)
+			continue;
+
+		cbfs_merge_empty_entry(image, entry, NULL);
+		if (be32toh(entry->type) != CBFS_TYPE_NULL)
+			continue;
+
+		if (cbfs_free_index_insert(index, index->count,
+				cbfs_get_entry_addr(image, entry),
+				cbfs_get_entry_addr(image,
+					cbfs_find_next_entry(image, entry)))) {
+			cbfs_free_index_release(index);
+			return -1;
+		}
+	}
+	return 0;
+}
+
+/* Replaces extent i with the empty entries left in it after a file was
+ * placed there. */
+static int cbfs_free_index_refresh(struct cbfs_image *image,
+				   struct cbfs_free_index *index, size_t i)
+{
+	const uint32_t end = index->extents[i].end;
+	struct cbfs_file *entry = (struct cbfs_file *)
+			(image->buffer.data + index->extents[i].addr);
+	size_t pos = i;
+
+	memmove(&index->extents[i], &index->extents[i + 1],
+		(index->count - i - 1) * sizeof(*index->extents));
+	index->count--;
+
+	while (cbfs_get_entry_addr(image, entry) < end &&
+	       cbfs_is_valid_entry(image, entry)) {
+		struct cbfs_file *next = cbfs_find_next_entry(image, entry);
+
+		if (be32toh(entry->type) == CBFS_TYPE_NULL &&
+		    cbfs_free_index_insert(index, pos++,
+				cbfs_get_entry_addr(image, entry),
+				cbfs_get_entry_addr(image, next)))
+			return -1;
+		entry = next;
+	}
+	return 0;
+}
+
+static uint32_t cbfs_free_index_largest(const struct cbfs_free_index *index)
+{
+	uint32_t largest = 0;
+	size_t i;
+
+	for (i = 0; i < index->count; i++)
+		largest = MAX(largest, cbfs_free_extent_size(&index->extents[i]));
+	return largest;
+}
+
 /* Tries to add an entry with its data (CBFS_SUBHEADER) at given offset. */
 static int cbfs_add_entry_at(struct cbfs_image *image,
 			     struct cbfs_file *entry,
@@ -718,93 +835,80 @@ static int cbfs_add_entry_at(struct cbfs_image *image,
 	return 0;
 }
 
-int cbfs_add_entry(struct cbfs_image *image, struct buffer *buffer,
-		   uint32_t content_offset,
-		   struct cbfs_file *header,
-		   const size_t len_align)
+/* cbfs_add_entry() on a free extent index that is kept up to date. */
+static int cbfs_add_entry_indexed(struct cbfs_image *image,
+				  struct cbfs_free_index *index,
+				  struct buffer *buffer,
+				  uint32_t content_offset,
+				  struct cbfs_file *header,
+				  const size_t len_align)
 {
-	assert(image);
-	assert(buffer);
-	assert(buffer->data);
-	assert(!IS_HOST_SPACE_ADDRESS(content_offset));
-
 	const char *name = header->filename;
-
-	/* This is so special rows in cbfstool print -k -v output stay unambiguous. */
-	if (name[0] == '[') {
-		ERROR("CBFS file name `%s` must not start with `[`\n", name);
-		return -1;
-	}
-
-	uint32_t entry_type;
-	uint32_t addr, addr_next;
-	struct cbfs_file *entry, *next;
+	const struct cbfs_free_extent *ext;
 	uint32_t need_size;
 	uint32_t header_size = be32toh(header->offset);
+	size_t i, found = index->count;
 
 	need_size = header_size + buffer->size;
 	DEBUG("cbfs_add_entry('%s'@0x%x) => need_size = %u+%zu=%u\n",
 	      name, content_offset, header_size, buffer->size, need_size);
 
-	// Merge empty entries.
-	DEBUG("(trying to merge empty entries...)\n");
-	cbfs_legacy_walk(image, cbfs_merge_empty_entry, NULL);
-
-	for (entry = cbfs_find_first_entry(image);
-	     entry && cbfs_is_valid_entry(image, entry);
-	     entry = cbfs_find_next_entry(image, entry)) {
-
-		entry_type = be32toh(entry->type);
-		if (entry_type != CBFS_TYPE_NULL)
-			continue;
-
-		addr = cbfs_get_entry_addr(image, entry);
-		next = cbfs_find_next_entry(image, entry);
-		addr_next = cbfs_get_entry_addr(image, next);
+	for (i = 0; i < index->count; i++) {
+		ext = &index->extents[i];
 
 		DEBUG("cbfs_add_entry: space at 0x%x+0x%x(%d) bytes\n",
-		      addr, addr_next - addr, addr_next - addr);
+		      ext->addr, cbfs_free_extent_size(ext),
+		      cbfs_free_extent_size(ext));
 
 		/* Will the file fit? Don't yet worry if we have space for a new
 		 * "empty" entry. We take care of that later.
 		 */
-		if (addr + need_size > addr_next)
+		if (ext->addr + need_size > ext->end)
 			continue;
 
 		// Test for complicated cases
 		if (content_offset > 0) {
-			if (addr_next < content_offset) {
+			if (ext->end < content_offset) {
 				DEBUG("Not for specified offset yet");
 				continue;
-			} else if (addr > content_offset) {
+			} else if (ext->addr > content_offset) {
 				DEBUG("Exceed specified content_offset.");
-				break;
-			} else if (addr + header_size > content_offset) {
+			} else if (ext->addr + header_size > content_offset) {
 				ERROR("Not enough space for header.\n");
-				break;
-			} else if (content_offset + buffer->size > addr_next) {
+			} else if (content_offset + buffer->size > ext->end) {
 				ERROR("Not enough space for content.\n");
-				break;
+			} else {
+				found = i;
 			}
+			break;
 		}
 
 		// TODO there are more few tricky cases that we may
 		// want to fit by altering offset.
 
+		if (found == index->count || cbfs_free_extent_size(ext) <
+		    cbfs_free_extent_size(&index->extents[found]))
+			found = i;
+		if (image->placement == CBFS_PLACEMENT_FIRST_FIT)
+			break;
+	}
+
+	if (found < index->count) {
+		ext = &index->extents[found];
 		if (content_offset == 0) {
 			// we tested every condition earlier under which
 			// placing the file there might fail
-			content_offset = addr + header_size;
+			content_offset = ext->addr + header_size;
 		}
 
 		DEBUG("section 0x%x+0x%x for content_offset 0x%x.\n",
-		      addr, addr_next - addr, content_offset);
+		      ext->addr, cbfs_free_extent_size(ext), content_offset);
 
-		if (cbfs_add_entry_at(image, entry, buffer->data,
-				      content_offset, header, len_align) == 0) {
-			return 0;
-		}
-		break;
+		if (cbfs_add_entry_at(image, (struct cbfs_file *)
+				      (image->buffer.data + ext->addr),
+				      buffer->data, content_offset, header,
+				      len_align) == 0)
+			return cbfs_free_index_refresh(image, index, found);
 	}
 
 	ERROR("Could not add [%s, %zd bytes (%zd KB)@0x%x]; too big?\n",
@@ -812,6 +916,34 @@ int cbfs_add_entry(struct cbfs_image *image, struct buffer *buffer,
 	return -1;
 }
 
+int cbfs_add_entry(struct cbfs_image *image, struct buffer *buffer,
+		   uint32_t content_offset,
+		   struct cbfs_file *header,
+		   const size_t len_align)
+{
+	assert(image);
+	assert(buffer);
+	assert(buffer->data);
+	assert(!IS_HOST_SPACE_ADDRESS(content_offset));
+
+	const char *name = header->filename;
+	struct cbfs_free_index index;
+	int ret;
+
+	/* This is so special rows in cbfstool print -k -v output stay unambiguous. */
+	if (name[0] == '[') {
+		ERROR("CBFS file name `%s` must not start with `[`\n", name);
+		return -1;
+	}
+
+	if (cbfs_free_index_build(image, &index))
+		return -1;
+	ret = cbfs_add_entry_indexed(image, &index, buffer, content_offset,
+				     header, len_align);
+	cbfs_free_index_release(&index);
+	return ret;
+}
+
 struct cbfs_file *cbfs_get_entry(struct cbfs_image *image, const char *name)
 {
 	struct cbfs_file *entry;
@@ -1797,13 +1929,28 @@ struct cbfs_file *cbfs_create_file_header(int type,
 	return entry;
 }
 
+/*
+ * Set len bytes to CBFS_CONTENT_DEFAULT_VALUE. Bytes that already have that
+ * value aren't written, so that the pages of a mapped image stay clean unless
+ * they actually change (see partitioned_file.c).
+ */
+static void fill_default_value(uint8_t *data, size_t len)
+{
+	const uint8_t value = CBFS_CONTENT_DEFAULT_VALUE;
+
+	for (size_t i = 0; i < len; i++) {
+		if (data[i] != value)
+			data[i] = value;
+	}
+}
+
 int cbfs_create_empty_entry(struct cbfs_file *entry, int type,
 			    size_t len, const char *name)
 {
 	struct cbfs_file *tmp = cbfs_create_file_header(type, len, name);
 	memcpy(entry, tmp, be32toh(tmp->offset));
 	free(tmp);
-	memset(CBFS_SUBHEADER(entry), CBFS_CONTENT_DEFAULT_VALUE, len);
+	fill_default_value((uint8_t *)CBFS_SUBHEADER(entry), len);
 	return 0;
 }
 
@@ -1939,34 +2086,18 @@ static size_t absolute_align(const struct cbfs_image *image, size_t val,
 
 }
 
-int32_t cbfs_locate_entry(struct cbfs_image *image, size_t size,
-			  size_t page_size, size_t align, size_t metadata_size)
+/* Returns the content offset for a file in the extent, or -1 if it doesn't
+ * fit there. */
+static int32_t cbfs_locate_in_extent(const struct cbfs_image *image,
+				     const struct cbfs_free_extent *ext,
+				     size_t size, size_t page_size,
+				     size_t align, size_t metadata_size)
 {
-	struct cbfs_file *entry;
-	size_t need_len;
-	size_t addr, addr_next, addr2, addr3, offset;
-
-	/* Default values: allow fitting anywhere in ROM. */
-	if (!page_size)
-		page_size = image->has_header ? image->header.romsize :
-							image->buffer.size;
-	if (!align)
-		align = 1;
-
-	if (size > page_size)
-		ERROR("Input file size (%zd) greater than page size (%zd).\n",
-		      size, page_size);
-
-	size_t image_align = image->has_header ? image->header.align :
-							CBFS_ALIGNMENT;
-	if (page_size % image_align)
-		WARN("%s: Page size (%#zx) not aligned with CBFS image (%#zx).\n",
-		     __func__, page_size, image_align);
-
-	need_len = metadata_size + size;
+	size_t addr = ext->addr, addr_next = ext->end;
+	size_t addr2, addr3, offset;
 
-	// Merge empty entries to build get max available space.
-	cbfs_legacy_walk(image, cbfs_merge_empty_entry, NULL);
+	if (addr_next - addr < metadata_size + size)
+		return -1;
 
 	/* Three cases of content location on memory page:
 	 * case 1.
@@ -1989,43 +2120,273 @@ int32_t cbfs_locate_entry(struct cbfs_image *image, size_t size,
 	 * For stage targets, the address is also used to re-link stage before
 	 * being added into CBFS.
 	 */
+	offset = absolute_align(image, addr + metadata_size, align);
+	if (is_in_same_page(offset, size, page_size) &&
+	    is_in_range(addr, addr_next, metadata_size, offset, size)) {
+		DEBUG("cbfs_locate_entry: FIT (PAGE1).");
+		return offset;
+	}
+
+	addr2 = align_up(addr, page_size);
+	offset = absolute_align(image, addr2, align);
+	if (is_in_range(addr, addr_next, metadata_size, offset, size)) {
+		DEBUG("cbfs_locate_entry: OVERLAP (PAGE2).");
+		return offset;
+	}
+
+	/* Assume page_size >= metadata_size so adding one page will
+	 * definitely provide the space for header. */
+	assert(page_size >= metadata_size);
+	addr3 = addr2 + page_size;
+	offset = absolute_align(image, addr3, align);
+	if (is_in_range(addr, addr_next, metadata_size, offset, size)) {
+		DEBUG("cbfs_locate_entry: OVERLAP+ (PAGE3).");
+		return offset;
+	}
+	return -1;
+}
+
+/* cbfs_locate_entry() on a free extent index. */
+static int32_t cbfs_locate_entry_indexed(struct cbfs_image *image,
+					 const struct cbfs_free_index *index,
+					 size_t size, size_t page_size,
+					 size_t align, size_t metadata_size)
+{
+	int32_t offset, found = -1;
+	size_t i, found_size = 0;
+
+	/* Default values: allow fitting anywhere in ROM. */
+	if (!page_size)
+		page_size = image->has_header ? image->header.romsize :
+							image->buffer.size;
+	if (!align)
+		align = 1;
+
+	if (size > page_size)
+		ERROR("Input file size (%zd) greater than page size (%zd).\n",
+		      size, page_size);
+
+	size_t image_align = image->has_header ? image->header.align :
+							CBFS_ALIGNMENT;
+	if (page_size % image_align)
+		WARN("%s: Page size (%#zx) not aligned with CBFS image (%#zx).\n",
+		     __func__, page_size, image_align);
+
+	for (i = 0; i < index->count; i++) {
+		const struct cbfs_free_extent *ext = &index->extents[i];
+
+		offset = cbfs_locate_in_extent(image, ext, size, page_size,
+					       align, metadata_size);
+		if (offset < 0)
+			continue;
+		if (image->placement == CBFS_PLACEMENT_FIRST_FIT)
+			return offset;
+		if (found < 0 || cbfs_free_extent_size(ext) < found_size) {
+			found = offset;
+			found_size = cbfs_free_extent_size(ext);
+		}
+	}
+	return found;
+}
+
+int32_t cbfs_locate_entry(struct cbfs_image *image, size_t size,
+			  size_t page_size, size_t align, size_t metadata_size)
+{
+	struct cbfs_free_index index;
+	int32_t offset;
+
+	// Merge empty entries to build get max available space.
+	if (cbfs_free_index_build(image, &index))
+		return -1;
+	offset = cbfs_locate_entry_indexed(image, &index, size, page_size,
+					   align, metadata_size);
+	cbfs_free_index_release(&index);
+	return offset;
+}
+
+struct cbfs_pack_file {
+	struct cbfs_file *entry;	/* copy of metadata and data */
+	uint32_t addr;
+	uint32_t size;
+	uint32_t alignment;
+};
+
+static int cbfs_pack_file_compare(const void *a, const void *b)
+{
+	const struct cbfs_pack_file *fa = a, *fb = b;
+
+	if (fa->alignment != fb->alignment)
+		return fa->alignment > fb->alignment ? -1 : 1;
+	if (fa->size != fb->size)
+		return fa->size > fb->size ? -1 : 1;
+	return fa->addr < fb->addr ? -1 : 1;
+}
+
+/*
+ * Files that are referenced by their address have to stay where they are. This
+ * includes stages that run from memory mapped flash, like XIP romstage and
+ * verstage. They are linked to their address, but don't always carry a
+ * position attribute.
+ */
+static bool cbfs_pack_file_is_movable(struct cbfs_file *entry,
+				      bool (*is_mapped)(uint64_t addr),
+				      uint32_t *alignment)
+{
+	switch (be32toh(entry->type)) {
+	case CBFS_TYPE_NULL:
+	case CBFS_TYPE_DELETED:
+	case CBFS_TYPE_BOOTBLOCK:
+	case CBFS_TYPE_CBFSHEADER:
+	case CBFS_TYPE_MICROCODE:
+	case CBFS_TYPE_INTEL_FIT:
+	case CBFS_TYPE_FSP:
+	case CBFS_TYPE_AMDFW:
+		return false;
+	}
+
+	*alignment = 0;
+	for (struct cbfs_file_attribute *attr = cbfs_file_first_attr(entry);
+	     attr != NULL; attr = cbfs_file_next_attr(entry, attr)) {
+		switch (be32toh(attr->tag)) {
+		case CBFS_FILE_ATTR_TAG_POSITION:
+		case CBFS_FILE_ATTR_TAG_IBB:
+			return false;
+		case CBFS_FILE_ATTR_TAG_STAGEHEADER:
+			if (is_mapped(be64toh(((struct cbfs_file_attr_stageheader *)
+					       attr)->loadaddr)))
+				return false;
+			break;
+		case CBFS_FILE_ATTR_TAG_ALIGNMENT:
+			*alignment = be32toh(((struct cbfs_file_attr_align *)
+					      attr)->alignment);
+			break;
+		}
+	}
+	return true;
+}
+
+int cbfs_pack_instance(struct cbfs_image *image, bool (*is_mapped)(uint64_t addr))
+{
+	assert(image);
+
+	const enum cbfs_placement placement = image->placement;
+	struct cbfs_free_index index;
+	struct cbfs_pack_file *files = NULL;
+	struct cbfs_file *entry;
+	size_t count = 0, i;
+	uint32_t largest, alignment;
+	void *backup = NULL;
+	int ret = 1;
+
+	if (image->has_header) {
+		ERROR("Packing a legacy CBFS is not supported.\n");
+		return 1;
+	}
+
+	if (cbfs_free_index_build(image, &index))
+		return 1;
+	largest = cbfs_free_index_largest(&index);
+	cbfs_free_index_release(&index);
+
+	backup = malloc(image->buffer.size);
+	if (!backup) {
+		ERROR("Out of memory for a copy of the CBFS.\n");
+		return 1;
+	}
+	memcpy(backup, image->buffer.data, image->buffer.size);
+
 	for (entry = cbfs_find_first_entry(image);
 	     entry && cbfs_is_valid_entry(image, entry);
-	     entry = cbfs_find_next_entry(image, entry)) {
+	     entry = cbfs_find_next_entry(image, entry))
+		count += cbfs_pack_file_is_movable(entry, is_mapped, &alignment);
 
-		uint32_t type = be32toh(entry->type);
-		if (type != CBFS_TYPE_NULL)
-			continue;
+	files = calloc(count, sizeof(*files));
+	if (count && !files) {
+		ERROR("Out of memory for the files to pack.\n");
+		goto out;
+	}
 
-		addr = cbfs_get_entry_addr(image, entry);
-		addr_next = cbfs_get_entry_addr(image, cbfs_find_next_entry(
-				image, entry));
-		if (addr_next - addr < need_len)
+	/* Take out all files that may be moved... */
+	count = 0;
+	for (entry = cbfs_find_first_entry(image);
+	     entry && cbfs_is_valid_entry(image, entry);
+	     entry = cbfs_find_next_entry(image, entry)) {
+		struct cbfs_pack_file *f = &files[count];
+
+		if (!cbfs_pack_file_is_movable(entry, is_mapped, &alignment))
 			continue;
 
-		offset = absolute_align(image, addr + metadata_size, align);
-		if (is_in_same_page(offset, size, page_size) &&
-		    is_in_range(addr, addr_next, metadata_size, offset, size)) {
-			DEBUG("cbfs_locate_entry: FIT (PAGE1).");
-			return offset;
+		f->alignment = alignment;
+		f->addr = cbfs_get_entry_addr(image, entry);
+		f->size = cbfs_file_entry_size(entry);
+		f->entry = malloc(f->size);
+		if (!f->entry) {
+			ERROR("Out of memory for '%s'.\n", entry->filename);
+			goto out;
 		}
+		memcpy(f->entry, entry, f->size);
+		count++;
+		entry->type = htobe32(CBFS_TYPE_DELETED);
+	}
 
-		addr2 = align_up(addr, page_size);
-		offset = absolute_align(image, addr2, align);
-		if (is_in_range(addr, addr_next, metadata_size, offset, size)) {
-			DEBUG("cbfs_locate_entry: OVERLAP (PAGE2).");
-			return offset;
-		}
+	/* ...and put them back, the most constrained ones first. */
+	qsort(files, count, sizeof(*files), cbfs_pack_file_compare);
 
-		/* Assume page_size >= metadata_size so adding one page will
-		 * definitely provide the space for header. */
-		assert(page_size >= metadata_size);
-		addr3 = addr2 + page_size;
-		offset = absolute_align(image, addr3, align);
-		if (is_in_range(addr, addr_next, metadata_size, offset, size)) {
-			DEBUG("cbfs_locate_entry: OVERLAP+ (PAGE3).");
-			return offset;
+	if (cbfs_free_index_build(image, &index))
+		goto out;
+	image->placement = CBFS_PLACEMENT_BEST_FIT;
+	for (i = 0; i < count; i++) {
+		struct cbfs_file *header = files[i].entry;
+		struct buffer data;
+		int32_t content_offset = 0;
+
+		buffer_init(&data, header->filename,
+			    (char *)header + be32toh(header->offset),
+			    be32toh(header->len));
+
+		if (files[i].alignment) {
+			content_offset = cbfs_locate_entry_indexed(image,
+					&index, buffer_size(&data), 0,
+					files[i].alignment,
+					be32toh(header->offset));
+			if (content_offset < 0) {
+				ERROR("No space left to align '%s'.\n",
+				      header->filename);
+				break;
+			}
 		}
+
+		DEBUG("Packing '%s' (0x%x bytes) from 0x%x\n", header->filename,
+		      files[i].size, files[i].addr);
+		if (cbfs_add_entry_indexed(image, &index, &data,
+					   content_offset, header, 0))
+			break;
 	}
-	return -1;
+	image->placement = placement;
+
+	if (i < count) {
+		ERROR("Unable to pack the CBFS.\n");
+	} else if (cbfs_free_index_largest(&index) <= largest) {
+		INFO("Packing doesn't grow the largest empty entry (0x%x bytes).\n",
+		     largest);
+		ret = 0;
+	} else {
+		INFO("Largest empty entry grew from 0x%x to 0x%x bytes.\n",
+		     largest, cbfs_free_index_largest(&index));
+		ret = 0;
+		free(backup);
+		backup = NULL;
+	}
+	cbfs_free_index_release(&index);
+
+out:
+	if (backup) {
+		/* Leave the image as it was. */
+		memcpy(image->buffer.data, backup, image->buffer.size);
+		free(backup);
+	}
+	for (i = 0; i < count; i++)
+		free(files[i].entry);
+	free(files);
+	return ret;
 }
@@ -11,12 +11,22 @@
 
 /* CBFS image processing */
 
+/* How to choose among the empty entries that can hold a new file. */
+enum cbfs_placement {
+	/* The one at the lowest address, which is what cbfstool always did. */
+	CBFS_PLACEMENT_FIRST_FIT,
+	/* The smallest one, to keep large empty entries for large files. */
+	CBFS_PLACEMENT_BEST_FIT,
+};
+
 struct cbfs_image {
 	struct buffer buffer;
 	/* An image has a header iff it's a legacy CBFS. */
 	bool has_header;
 	/* Only meaningful if has_header is selected. */
 	struct cbfs_header header;
+	/* Used by cbfs_add_entry() and cbfs_locate_entry(). */
+	enum cbfs_placement placement;
 };
 
 /* Given the string name of a compression algorithm, return the corresponding
@@ -71,6 +81,18 @@ int cbfs_copy_instance(struct cbfs_image *image, struct buffer *dst);
  * beginning of the image. Returns 0 on success, otherwise non-zero.  */
 int cbfs_compact_instance(struct cbfs_image *image);
 
+/* Pack a fragmented CBFS image to make the largest empty entry as large as
+ * possible. Unlike cbfs_compact_instance(), this keeps files with a position
+ * or IBB attribute and files that are referenced by address (like the
+ * bootblock and microcode) in place, and keeps files with an alignment
+ * attribute aligned. Stages whose load address is_mapped() tells to be in
+ * memory mapped flash are executed in place and stay where they are too.
+ * The other files are placed best-fit, the most aligned and then the largest
+ * ones first. The image is left unmodified if that doesn't help. Not
+ * supported on legacy images.
+ * Returns 0 on success, otherwise non-zero. */
+int cbfs_pack_instance(struct cbfs_image *image, bool (*is_mapped)(uint64_t addr));
+
 /* Expand a CBFS image inside an fmap region to the entire region's space.
    Returns 0 on success, otherwise non-zero. */
 int cbfs_expand_to_region(struct buffer *region);
@@ -94,6 +116,7 @@ int cbfs_export_entry(struct cbfs_image *image, const char *entry_name,
 
 /* Adds an entry to CBFS image by given name and type. If content_offset is
  * non-zero, try to align "content" (CBFS_SUBHEADER(p)) at content_offset.
+ * Otherwise, image->placement picks the empty entry to use.
  * Never pass this function a top-aligned address: convert it to an offset.
  * Returns 0 on success, otherwise non-zero. */
 int cbfs_add_entry(struct cbfs_image *image, struct buffer *buffer,
@@ -116,6 +139,7 @@ int cbfs_create_empty_entry(struct cbfs_file *entry, int type,
 /* Finds a location to put given content by specified criteria:
  *  "page_size" limits the content to fit on same memory page, and
  *  "align" specifies starting address alignment.
+ * If several empty entries qualify, image->placement picks one.
  * Returns a valid offset, or -1 on failure. */
 int32_t cbfs_locate_entry(struct cbfs_image *image, size_t size,
 			  size_t page_size, size_t align, size_t metadata_size);
@@ -10,6 +10,9 @@
 #include "cbfs.h"
 #include "common.h"
 
+/* Used by the console macros in compress.c, which is shared with cbfstool. */
+int verbose;
+
 const char *usage_text = "cbfs-compression-tool benchmark\n"
 	"  runs benchmarks for all implemented algorithms\n"
 	"cbfs-compression-tool compress inFile outFile algo\n"
@@ -18,7 +21,10 @@ const char *usage_text = "cbfs-compression-tool benchmark\n"
 	"'compress' file format:\n"
 	" 4 bytes little endian: algorithm ID (as used in CBFS)\n"
 	" 4 bytes little endian: uncompressed size\n"
-	" ...: compressed data stream\n";
+	" ...: compressed data stream\n"
+	"\n"
+	"If the environment variable " COMPRESSION_CACHE_ENV " names a\n"
+	"directory, compressed data is cached there.\n";
 
 static void usage(void)
 {
@@ -182,6 +188,8 @@ int main(int argc, char **argv)
 {
 	if ((argc == 2) && (strcmp(argv[1], "benchmark") == 0))
 		return benchmark();
+	compression_set_cache_dir(getenv(COMPRESSION_CACHE_ENV));
+
 	if ((argc == 5) && (strcmp(argv[1], "compress") == 0))
 		return compress(argv[2], argv[3], argv[4], 1);
 	if ((argc == 5) && (strcmp(argv[1], "rawcompress") == 0))
@@ -6,8 +6,12 @@
 #include <string.h>
 #include <strings.h>
 #include <ctype.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <limits.h>
 #include <unistd.h>
 #include <getopt.h>
+#include <sys/wait.h>
 #include "common.h"
 #include "cbfs.h"
 #include "cbfs_image.h"
@@ -79,6 +83,8 @@ static struct param {
 	uint32_t arch;
 	uint32_t padding;
 	uint32_t topswap_size;
+	/* Number of worker processes of a batch, 0 for one per CPU */
+	long jobs;
 	bool u64val_assigned;
 	bool fill_partial_upward;
 	bool fill_partial_downward;
@@ -89,6 +95,7 @@ static struct param {
 	bool machine_parseable;
 	bool unprocessed;
 	bool ibb;
+	enum cbfs_placement placement;
 	enum cbfs_compression compression;
 	int precompression;
 	enum vb2_hash_algorithm hash;
@@ -108,7 +115,9 @@ static struct param {
 	 */
 	uint32_t ext_win_base;
 	uint32_t ext_win_size;
-} param = {
+} param;
+
+static const struct param param_defaults = {
 	/* All variables not listed are initialized as zero. */
 	.arch = CBFS_ARCHITECTURE_UNKNOWN,
 	.compression = CBFS_COMPRESS_NONE,
@@ -135,14 +144,19 @@ struct mh_cache {
 	bool initialized;
 };
 
+/* Set to make the next get_mh_cache() call search the image again. */
+static bool mh_cache_outdated;
+
 static struct mh_cache *get_mh_cache(void)
 {
 	static struct mh_cache mhc;
 
-	if (mhc.initialized)
+	if (mhc.initialized && !mh_cache_outdated)
 		return &mhc;
 
+	memset(&mhc, 0, sizeof(mhc));
 	mhc.initialized = true;
+	mh_cache_outdated = false;
 
 	const struct fmap *fmap = partitioned_file_get_fmap(param.image_file);
 	if (!fmap)
@@ -384,12 +398,12 @@ static int decode_mmap_arg(char *arg)
 #define DEFAULT_DECODE_WINDOW_TOP	(4ULL * GiB)
 #define DEFAULT_DECODE_WINDOW_MAX_SIZE	(16 * MiB)
 
+static bool mmap_windows_done;
+
 static bool create_mmap_windows(void)
 {
-	static bool done;
-
-	if (done)
-		return done;
+	if (mmap_windows_done)
+		return mmap_windows_done;
 
 	// No memory map provided, use a default one
 	if (mmap_window_table_size == 0) {
@@ -433,8 +447,8 @@ static bool create_mmap_windows(void)
 		}
 	}
 
-	done = true;
-	return done;
+	mmap_windows_done = true;
+	return mmap_windows_done;
 }
 
 static unsigned int convert_address(const struct region *to, const struct region *from,
@@ -567,6 +581,7 @@ static int do_cbfs_locate(uint32_t *cbfs_addr, size_t data_size)
 	if (cbfs_image_from_buffer(&image, param.image_region,
 							param.headeroffset))
 		return 1;
+	image.placement = param.placement;
 
 	if (cbfs_get_entry(&image, param.name))
 		WARN("'%s' already in CBFS.\n", param.name);
@@ -642,6 +657,7 @@ static int cbfs_add_integer_component(const char *name,
 		ERROR("Selected image region is not a CBFS.\n");
 		goto done;
 	}
+	image.placement = param.placement;
 
 	if (cbfs_get_entry(&image, name)) {
 		ERROR("'%s' already in ROM image.\n", name);
@@ -738,6 +754,7 @@ static int cbfs_add_master_header(void)
 		ERROR("Selected image region is not a CBFS.\n");
 		return 1;
 	}
+	image.placement = param.placement;
 
 	if (cbfs_get_entry(&image, name)) {
 		ERROR("'%s' already in ROM image.\n", name);
@@ -901,6 +918,7 @@ static int cbfs_add_component(const char *filename,
 	struct cbfs_image image;
 	if (cbfs_image_from_buffer(&image, param.image_region, headeroffset))
 		return 1;
+	image.placement = param.placement;
 
 	if (cbfs_get_entry(&image, name)) {
 		ERROR("'%s' already in ROM image.\n", name);
@@ -1746,6 +1764,25 @@ static int cbfs_compact(void)
 	return cbfs_compact_instance(&image);
 }
 
+/* Whether addr is where the host sees the flash, i.e. code there is XIP. */
+static bool is_mmap_host_address(uint64_t addr)
+{
+	assert(create_mmap_windows());
+	return addr <= UINT32_MAX && find_mmap_window(HOST_SPACE_ADDR, addr) != -1;
+}
+
+static int cbfs_pack(void)
+{
+	struct cbfs_image image;
+	if (cbfs_image_from_buffer(&image, param.image_region,
+							param.headeroffset))
+		return 1;
+	WARN("Packing a CBFS doesn't honor -b or -a of non-stage files added without -g!\n");
+	if (cbfs_pack_instance(&image, is_mmap_host_address))
+		return 1;
+	return maybe_update_metadata_hash(&image);
+}
+
 static int cbfs_expand(void)
 {
 	struct buffer src_buf;
@@ -1778,6 +1815,9 @@ static int cbfs_truncate(void)
 	return result;
 }
 
+/* Defined further down, it parses its commands like main() does. */
+static int cbfs_batch(void);
+
 static const struct command commands[] = {
 	{"add", "H:r:f:n:t:c:b:a:p:yvA:j:gh?", cbfs_add, true, true},
 	{"add-flat-binary", "H:r:f:n:l:e:c:b:p:vA:gh?", cbfs_add_flat_binary,
@@ -1788,11 +1828,13 @@ static const struct command commands[] = {
 				true, true},
 	{"add-int", "H:r:i:n:b:vgh?", cbfs_add_integer, true, true},
 	{"add-master-header", "H:r:vh?j:", cbfs_add_master_header, true, true},
+	{"batch", "f:J:vh?", cbfs_batch, false, true},
 	{"compact", "r:h?", cbfs_compact, true, true},
 	{"copy", "r:R:h?", cbfs_copy, true, true},
 	{"create", "M:r:s:B:b:H:o:m:vh?", cbfs_create, true, true},
 	{"extract", "H:r:m:n:f:Uvh?", cbfs_extract, true, false},
 	{"layout", "wvh?", cbfs_layout, false, false},
+	{"pack", "r:vh?", cbfs_pack, true, true},
 	{"print", "H:r:vkh?", cbfs_print, true, false},
 	{"read", "r:f:vh?", cbfs_read, true, false},
 	{"remove", "H:r:n:vh?", cbfs_remove, true, true},
@@ -1806,6 +1848,7 @@ enum {
 	LONGOPT_START = 256,
 	LONGOPT_IBB = LONGOPT_START,
 	LONGOPT_MMAP,
+	LONGOPT_PLACEMENT,
 	LONGOPT_END,
 };
 
@@ -1830,6 +1873,7 @@ static struct option long_options[] = {
 	{"help",          no_argument,       0, 'h' },
 	{"ignore-sec",    required_argument, 0, 'S' },
 	{"initrd",        required_argument, 0, 'I' },
+	{"jobs",          required_argument, 0, 'J' },
 	{"int",           required_argument, 0, 'i' },
 	{"load-address",  required_argument, 0, 'l' },
 	{"machine",       required_argument, 0, 'm' },
@@ -1848,6 +1892,7 @@ static struct option long_options[] = {
 	{"unprocessed",   no_argument,       0, 'U' },
 	{"ibb",           no_argument,       0, LONGOPT_IBB },
 	{"mmap",          required_argument, 0, LONGOPT_MMAP },
+	{"placement",     required_argument, 0, LONGOPT_PLACEMENT },
 	{NULL,            0,                 0,  0  }
 };
 
@@ -1954,6 +1999,8 @@ static void usage(char *name)
 	     "                   space(x86 only)\n"
 	     "  --ext-win-size   Size of extended decode window in host address\n"
 	     "                   space(x86 only)\n"
+	     "  --placement      Where new files go: first-fit (lowest address,\n"
+	     "                   default) or best-fit (smallest empty space)\n"
 	     "COMMANDs:\n"
 	     " add [-r image,regions] -f FILE -n NAME -t TYPE [-A hash] \\\n"
 	     "        [-c compression] [-b base-address | -a alignment] \\\n"
@@ -1982,10 +2029,14 @@ static void usage(char *name)
 	     " add-master-header [-r image,regions] \\                   \n"
 	     "        [-j topswap-size] (Intel CPUs only)                  "
 			"Add a legacy CBFS master header\n"
+	     " batch -f MANIFEST [-J jobs]                                 "
+			"Apply all commands in MANIFEST, then write once\n"
 	     " remove [-r image,regions] -n NAME                           "
 			"Remove a component\n"
 	     " compact -r image,regions                                    "
 			"Defragment CBFS image.\n"
+	     " pack [-r image,regions]                                     "
+			"Grow the largest empty space, keeping alignment\n"
 	     " copy -r image,regions -R source-region                      "
 			"Create a copy (duplicate) cbfs instance in fmap\n"
 	     " create -m ARCH -s size [-b bootblock offset] \\\n"
@@ -2012,7 +2063,19 @@ static void usage(char *name)
 	     "  in two possible formats: if their value is greater than\n"
 	     "  0x80000000, they are interpreted as a top-aligned x86 memory\n"
 	     "  address; otherwise, they are treated as an offset into flash.\n"
-	     "ARCHes:\n", name, name
+	     "BATCHes:\n"
+	     "  Each line of a batch MANIFEST holds one command and its\n"
+	     "  PARAMETERS, written as they would follow FILE on the command\n"
+	     "  line. Arguments are separated by whitespace and may be quoted\n"
+	     "  with ' or \", and a # outside of an argument starts a comment.\n"
+	     "  All commands except create and batch may be used. The image is\n"
+	     "  only written if every command succeeds. Files are compressed\n"
+	     "  in advance by up to -J worker processes (default: one per CPU).\n"
+	     "COMPRESSION CACHE:\n"
+	     "  If the environment variable %s names a\n"
+	     "  directory, compressed data is kept there and reused whenever\n"
+	     "  the same data is compressed again.\n"
+	     "ARCHes:\n", name, name, COMPRESSION_CACHE_ENV
 	    );
 	print_supported_architectures();
 
@@ -2055,346 +2118,708 @@ static bool valid_opt(size_t i, int c)
 	return false;
 }
 
-int main(int argc, char **argv)
+/*
+ * Parse the options of the command with index i into param. argv[0] is the name of the
+ * command. Returns 0 on success, 1 on error and -1 if the usage should be shown.
+ */
+static int parse_command_args(size_t i, int argc, char **argv)
 {
-	size_t i;
 	int c;
 
-	if (argc < 3) {
-		usage(argv[0]);
-		return 1;
-	}
-
-	char *image_name = argv[1];
-	char *cmd = argv[2];
-	optind += 2;
+	/* Start over, even if getopt_long() has already been used before. */
+	optind = 0;
 
-	for (i = 0; i < ARRAY_SIZE(commands); i++) {
-		if (strcmp(cmd, commands[i].name) != 0)
-			continue;
+	while (1) {
+		char *suffix = NULL;
+		int option_index = 0;
 
-		while (1) {
-			char *suffix = NULL;
-			int option_index = 0;
-
-			c = getopt_long(argc, argv, commands[i].optstring,
-						long_options, &option_index);
-			if (c == -1) {
-				if (optind < argc) {
-					ERROR("%s: excessive argument -- '%s'"
-						"\n", argv[0], argv[optind]);
-					return 1;
-				}
-				break;
+		c = getopt_long(argc, argv, commands[i].optstring,
+					long_options, &option_index);
+		if (c == -1) {
+			if (optind < argc) {
+				ERROR("%s: excessive argument -- '%s'"
+					"\n", argv[0], argv[optind]);
+				return 1;
 			}
+			break;
+		}
 
-			/* Filter out illegal long options */
-			if (!valid_opt(i, c)) {
-				ERROR("%s: invalid option -- '%d'\n",
-				      argv[0], c);
-				c = '?';
-			}
+		/* Filter out illegal long options */
+		if (!valid_opt(i, c)) {
+			ERROR("%s: invalid option -- '%d'\n",
+			      argv[0], c);
+			c = '?';
+		}
 
-			switch(c) {
-			case 'n':
-				param.name = optarg;
-				break;
-			case 't':
-				if (intfiletype(optarg) != ((uint64_t) - 1))
-					param.type = intfiletype(optarg);
-				else
-					param.type = strtoul(optarg, NULL, 0);
-				if (param.type == 0)
-					WARN("Unknown type '%s' ignored\n",
-							optarg);
-				break;
-			case 'c': {
-				if (strcmp(optarg, "precompression") == 0) {
-					param.precompression = 1;
-					break;
-				}
-				int algo = cbfs_parse_comp_algo(optarg);
-				if (algo >= 0)
-					param.compression = algo;
-				else
-					WARN("Unknown compression '%s' ignored.\n",
-									optarg);
-				break;
-			}
-			case 'A': {
-				if (!vb2_lookup_hash_alg(optarg, &param.hash)) {
-					ERROR("Unknown hash algorithm '%s'.\n",
+		switch(c) {
+		case 'n':
+			param.name = optarg;
+			break;
+		case 't':
+			if (intfiletype(optarg) != ((uint64_t) - 1))
+				param.type = intfiletype(optarg);
+			else
+				param.type = strtoul(optarg, NULL, 0);
+			if (param.type == 0)
+				WARN("Unknown type '%s' ignored\n",
 						optarg);
-					return 1;
-				}
+			break;
+		case 'c': {
+			if (strcmp(optarg, "precompression") == 0) {
+				param.precompression = 1;
 				break;
 			}
-			case 'M':
-				param.fmap = optarg;
-				break;
-			case 'r':
-				param.region_name = optarg;
-				break;
-			case 'R':
-				param.source_region = optarg;
-				break;
-			case 'b':
-				param.baseaddress_input = strtoll(optarg, &suffix, 0);
-				if (!*optarg || (suffix && *suffix)) {
-					ERROR("Invalid base address '%s'.\n",
-						optarg);
-					return 1;
-				}
-				// baseaddress may be zero on non-x86, so we
-				// need an explicit "baseaddress_assigned".
-				param.baseaddress_assigned = 1;
-				break;
-			case 'l':
-				param.loadaddress = strtoul(optarg, &suffix, 0);
-				if (!*optarg || (suffix && *suffix)) {
-					ERROR("Invalid load address '%s'.\n",
-						optarg);
-					return 1;
-				}
-				break;
-			case 'e':
-				param.entrypoint = strtoul(optarg, &suffix, 0);
-				if (!*optarg || (suffix && *suffix)) {
-					ERROR("Invalid entry point '%s'.\n",
-						optarg);
-					return 1;
-				}
-				break;
-			case 's':
-				param.size = strtoul(optarg, &suffix, 0);
-				if (!*optarg) {
-					ERROR("Empty size specified.\n");
-					return 1;
-				}
-				switch (tolower((int)suffix[0])) {
-				case 'k':
-					param.size *= 1024;
-					break;
-				case 'm':
-					param.size *= 1024 * 1024;
-					break;
-				case '\0':
-					break;
-				default:
-					ERROR("Invalid suffix for size '%s'.\n",
-						optarg);
-					return 1;
-				}
-				break;
-			case 'B':
-				param.bootblock = optarg;
-				break;
-			case 'H':
-				param.headeroffset_input = strtoll(optarg, &suffix, 0);
-				if (!*optarg || (suffix && *suffix)) {
-					ERROR("Invalid header offset '%s'.\n",
-						optarg);
-					return 1;
-				}
-				param.headeroffset_assigned = 1;
-				break;
-			case 'a':
-				param.alignment = strtoul(optarg, &suffix, 0);
-				if (!*optarg || (suffix && *suffix)) {
-					ERROR("Invalid alignment '%s'.\n",
-						optarg);
-					return 1;
-				}
-				break;
-			case 'p':
-				param.padding = strtoul(optarg, &suffix, 0);
-				if (!*optarg || (suffix && *suffix)) {
-					ERROR("Invalid pad size '%s'.\n",
-						optarg);
-					return 1;
-				}
-				break;
-			case 'Q':
-				param.force_pow2_pagesize = 1;
-				break;
-			case 'o':
-				param.cbfsoffset_input = strtoll(optarg, &suffix, 0);
-				if (!*optarg || (suffix && *suffix)) {
-					ERROR("Invalid cbfs offset '%s'.\n",
-						optarg);
-					return 1;
-				}
-				param.cbfsoffset_assigned = 1;
-				break;
-			case 'f':
-				param.filename = optarg;
-				break;
-			case 'F':
-				param.force = 1;
-				break;
-			case 'i':
-				param.u64val = strtoull(optarg, &suffix, 0);
-				param.u64val_assigned = 1;
-				if (!*optarg || (suffix && *suffix)) {
-					ERROR("Invalid int parameter '%s'.\n",
-						optarg);
-					return 1;
-				}
-				break;
-			case 'u':
-				param.fill_partial_upward = true;
-				break;
-			case 'd':
-				param.fill_partial_downward = true;
-				break;
-			case 'w':
-				param.show_immutable = true;
-				break;
-			case 'j':
-				param.topswap_size = strtol(optarg, NULL, 0);
-				if (!is_valid_topswap())
-					return 1;
-				break;
-			case 'q':
-				param.ucode_region = optarg;
-				break;
-			case 'v':
-				verbose++;
-				break;
-			case 'm':
-				param.arch = string_to_arch(optarg);
-				break;
-			case 'I':
-				param.initrd = optarg;
-				break;
-			case 'C':
-				param.cmdline = optarg;
-				break;
-			case 'S':
-				param.ignore_section = optarg;
-				break;
-			case 'y':
-				param.stage_xip = true;
-				break;
-			case 'g':
-				param.autogen_attr = true;
-				break;
+			int algo = cbfs_parse_comp_algo(optarg);
+			if (algo >= 0)
+				param.compression = algo;
+			else
+				WARN("Unknown compression '%s' ignored.\n",
+								optarg);
+			break;
+		}
+		case 'A': {
+			if (!vb2_lookup_hash_alg(optarg, &param.hash)) {
+				ERROR("Unknown hash algorithm '%s'.\n",
+					optarg);
+				return 1;
+			}
+			break;
+		}
+		case 'M':
+			param.fmap = optarg;
+			break;
+		case 'r':
+			param.region_name = optarg;
+			break;
+		case 'R':
+			param.source_region = optarg;
+			break;
+		case 'b':
+			param.baseaddress_input = strtoll(optarg, &suffix, 0);
+			if (!*optarg || (suffix && *suffix)) {
+				ERROR("Invalid base address '%s'.\n",
+					optarg);
+				return 1;
+			}
+			// baseaddress may be zero on non-x86, so we
+			// need an explicit "baseaddress_assigned".
+			param.baseaddress_assigned = 1;
+			break;
+		case 'l':
+			param.loadaddress = strtoul(optarg, &suffix, 0);
+			if (!*optarg || (suffix && *suffix)) {
+				ERROR("Invalid load address '%s'.\n",
+					optarg);
+				return 1;
+			}
+			break;
+		case 'e':
+			param.entrypoint = strtoul(optarg, &suffix, 0);
+			if (!*optarg || (suffix && *suffix)) {
+				ERROR("Invalid entry point '%s'.\n",
+					optarg);
+				return 1;
+			}
+			break;
+		case 's':
+			param.size = strtoul(optarg, &suffix, 0);
+			if (!*optarg) {
+				ERROR("Empty size specified.\n");
+				return 1;
+			}
+			switch (tolower((int)suffix[0])) {
 			case 'k':
-				param.machine_parseable = true;
+				param.size *= 1024;
 				break;
-			case 'U':
-				param.unprocessed = true;
-				break;
-			case LONGOPT_IBB:
-				param.ibb = true;
+			case 'm':
+				param.size *= 1024 * 1024;
 				break;
-			case LONGOPT_MMAP:
-				if (decode_mmap_arg(optarg))
-					return 1;
+			case '\0':
 				break;
-			case 'h':
-			case '?':
-				usage(argv[0]);
-				return 1;
 			default:
-				break;
+				ERROR("Invalid suffix for size '%s'.\n",
+					optarg);
+				return 1;
 			}
-		}
-
-		if (commands[i].function == cbfs_create) {
-			if (param.fmap) {
-				struct buffer flashmap;
-				if (buffer_from_file(&flashmap, param.fmap))
-					return 1;
-				param.image_file = partitioned_file_create(
-							image_name, &flashmap);
-				buffer_delete(&flashmap);
-			} else if (param.size) {
-				param.image_file = partitioned_file_create_flat(
-							image_name, param.size);
+			break;
+		case 'B':
+			param.bootblock = optarg;
+			break;
+		case 'H':
+			param.headeroffset_input = strtoll(optarg, &suffix, 0);
+			if (!*optarg || (suffix && *suffix)) {
+				ERROR("Invalid header offset '%s'.\n",
+					optarg);
+				return 1;
+			}
+			param.headeroffset_assigned = 1;
+			break;
+		case 'a':
+			param.alignment = strtoul(optarg, &suffix, 0);
+			if (!*optarg || (suffix && *suffix)) {
+				ERROR("Invalid alignment '%s'.\n",
+					optarg);
+				return 1;
+			}
+			break;
+		case 'p':
+			param.padding = strtoul(optarg, &suffix, 0);
+			if (!*optarg || (suffix && *suffix)) {
+				ERROR("Invalid pad size '%s'.\n",
+					optarg);
+				return 1;
+			}
+			break;
+		case 'Q':
+			param.force_pow2_pagesize = 1;
+			break;
+		case 'o':
+			param.cbfsoffset_input = strtoll(optarg, &suffix, 0);
+			if (!*optarg || (suffix && *suffix)) {
+				ERROR("Invalid cbfs offset '%s'.\n",
+					optarg);
+				return 1;
+			}
+			param.cbfsoffset_assigned = 1;
+			break;
+		case 'f':
+			param.filename = optarg;
+			break;
+		case 'F':
+			param.force = 1;
+			break;
+		case 'i':
+			param.u64val = strtoull(optarg, &suffix, 0);
+			param.u64val_assigned = 1;
+			if (!*optarg || (suffix && *suffix)) {
+				ERROR("Invalid int parameter '%s'.\n",
+					optarg);
+				return 1;
+			}
+			break;
+		case 'u':
+			param.fill_partial_upward = true;
+			break;
+		case 'd':
+			param.fill_partial_downward = true;
+			break;
+		case 'w':
+			param.show_immutable = true;
+			break;
+		case 'J':
+			param.jobs = strtol(optarg, &suffix, 0);
+			if (!*optarg || (suffix && *suffix) || param.jobs < 1) {
+				ERROR("Invalid number of jobs '%s'.\n",
+					optarg);
+				return 1;
+			}
+			break;
+		case 'j':
+			param.topswap_size = strtol(optarg, NULL, 0);
+			if (!is_valid_topswap())
+				return 1;
+			break;
+		case 'q':
+			param.ucode_region = optarg;
+			break;
+		case 'v':
+			verbose++;
+			break;
+		case 'm':
+			param.arch = string_to_arch(optarg);
+			break;
+		case 'I':
+			param.initrd = optarg;
+			break;
+		case 'C':
+			param.cmdline = optarg;
+			break;
+		case 'S':
+			param.ignore_section = optarg;
+			break;
+		case 'y':
+			param.stage_xip = true;
+			break;
+		case 'g':
+			param.autogen_attr = true;
+			break;
+		case 'k':
+			param.machine_parseable = true;
+			break;
+		case 'U':
+			param.unprocessed = true;
+			break;
+		case LONGOPT_IBB:
+			param.ibb = true;
+			break;
+		case LONGOPT_MMAP:
+			if (decode_mmap_arg(optarg))
+				return 1;
+			break;
+		case LONGOPT_PLACEMENT:
+			if (!strcmp(optarg, "first-fit")) {
+				param.placement = CBFS_PLACEMENT_FIRST_FIT;
+			} else if (!strcmp(optarg, "best-fit")) {
+				param.placement = CBFS_PLACEMENT_BEST_FIT;
 			} else {
-				ERROR("You need to specify a valid -M/--flashmap or -s/--size.\n");
+				ERROR("Unknown placement policy '%s'.\n",
+				      optarg);
 				return 1;
 			}
-		} else {
-			bool write_access = commands[i].modifies_region;
+			break;
+		case 'h':
+		case '?':
+			return -1;
+		default:
+			break;
+		}
+	}
 
-			param.image_file =
-				partitioned_file_reopen(image_name,
-							write_access);
+	return 0;
+}
+
+/*
+ * Run the command with index i on every region in param.region_name and write the modified
+ * regions back to param.image_file. Returns 0 on success.
+ */
+static int process_regions(size_t i)
+{
+	unsigned num_regions = 1;
+	for (const char *list = strchr(param.region_name, ','); list;
+					list = strchr(list + 1, ','))
+		++num_regions;
+
+	// If the action needs to read an image region, as indicated by
+	// having accesses_region set in its command struct, that
+	// region's buffer struct will be stored here and the client
+	// will receive a pointer to it via param.image_region. It
+	// need not write the buffer back to the image file itself,
+	// since this behavior can be requested via its modifies_region
+	// field. Additionally, it should never free the region buffer,
+	// as that is performed automatically once it completes.
+	struct buffer image_regions[num_regions];
+	memset(image_regions, 0, sizeof(image_regions));
+
+	bool seen_primary_cbfs = false;
+	char region_name_scratch[strlen(param.region_name) + 1];
+	strcpy(region_name_scratch, param.region_name);
+	param.region_name = strtok(region_name_scratch, ",");
+	for (unsigned region = 0; region < num_regions; ++region) {
+		if (!param.region_name) {
+			ERROR("Encountered illegal degenerate region name in -r list\n");
+			ERROR("The image will be left unmodified.\n");
+			return 1;
 		}
-		if (!param.image_file)
+
+		if (strcmp(param.region_name, SECTION_NAME_PRIMARY_CBFS)
+								== 0)
+			seen_primary_cbfs = true;
+
+		param.image_region = image_regions + region;
+		if (dispatch_command(commands[i]))
 			return 1;
 
-		unsigned num_regions = 1;
-		for (const char *list = strchr(param.region_name, ','); list;
-						list = strchr(list + 1, ','))
-			++num_regions;
-
-		// If the action needs to read an image region, as indicated by
-		// having accesses_region set in its command struct, that
-		// region's buffer struct will be stored here and the client
-		// will receive a pointer to it via param.image_region. It
-		// need not write the buffer back to the image file itself,
-		// since this behavior can be requested via its modifies_region
-		// field. Additionally, it should never free the region buffer,
-		// as that is performed automatically once it completes.
-		struct buffer image_regions[num_regions];
-		memset(image_regions, 0, sizeof(image_regions));
-
-		bool seen_primary_cbfs = false;
-		char region_name_scratch[strlen(param.region_name) + 1];
-		strcpy(region_name_scratch, param.region_name);
-		param.region_name = strtok(region_name_scratch, ",");
-		for (unsigned region = 0; region < num_regions; ++region) {
-			if (!param.region_name) {
-				ERROR("Encountered illegal degenerate region name in -r list\n");
-				ERROR("The image will be left unmodified.\n");
-				partitioned_file_close(param.image_file);
-				return 1;
-			}
+		param.region_name = strtok(NULL, ",");
+	}
+
+	if (commands[i].function == cbfs_create && !seen_primary_cbfs) {
+		ERROR("The creation -r list must include the mandatory '%s' section.\n",
+					SECTION_NAME_PRIMARY_CBFS);
+		ERROR("The image will be left unmodified.\n");
+		return 1;
+	}
 
-			if (strcmp(param.region_name, SECTION_NAME_PRIMARY_CBFS)
-									== 0)
-				seen_primary_cbfs = true;
+	if (commands[i].modifies_region) {
+		assert(param.image_file);
+		for (unsigned region = 0; region < num_regions;
+							++region) {
 
-			param.image_region = image_regions + region;
-			if (dispatch_command(commands[i])) {
-				partitioned_file_close(param.image_file);
+			if (!partitioned_file_write_region(
+						param.image_file,
+					image_regions + region))
 				return 1;
-			}
+		}
+	}
+
+	return 0;
+}
+
+static int find_command(const char *name)
+{
+	for (size_t i = 0; i < ARRAY_SIZE(commands); i++) {
+		if (strcmp(name, commands[i].name) == 0)
+			return i;
+	}
 
-			param.region_name = strtok(NULL, ",");
+	return -1;
+}
+
+/* Limit for the number of arguments on one line of a batch manifest. */
+#define BATCH_MAX_ARGS 64
+
+/*
+ * Split one line of a batch manifest into arguments, in place. Arguments are separated by
+ * whitespace and may be quoted with ' or ". A # outside of an argument starts a comment.
+ * Returns the number of arguments, or -1 if the line is malformed.
+ */
+static int split_batch_line(char *line, char **args, size_t max_args)
+{
+	char *src = line;
+	char *dst = line;
+	size_t num_args = 0;
+
+	while (1) {
+		char quote = '\0';
+
+		while (isspace((unsigned char)*src))
+			++src;
+		if (*src == '\0' || *src == '#')
+			break;
+		if (num_args == max_args) {
+			ERROR("Too many arguments\n");
+			return -1;
 		}
 
-		if (commands[i].function == cbfs_create && !seen_primary_cbfs) {
-			ERROR("The creation -r list must include the mandatory '%s' section.\n",
-						SECTION_NAME_PRIMARY_CBFS);
-			ERROR("The image will be left unmodified.\n");
-			partitioned_file_close(param.image_file);
-			return 1;
+		args[num_args++] = dst;
+		while (*src && (quote || !isspace((unsigned char)*src))) {
+			if (quote && *src == quote)
+				quote = '\0';
+			else if (!quote && (*src == '\'' || *src == '"'))
+				quote = *src;
+			else
+				*dst++ = *src;
+			++src;
 		}
+		if (quote) {
+			ERROR("Unterminated quote\n");
+			return -1;
+		}
+		if (*src)
+			++src;
+		*dst++ = '\0';
+	}
 
-		if (commands[i].modifies_region) {
-			assert(param.image_file);
-			for (unsigned region = 0; region < num_regions;
-								++region) {
-
-				if (!partitioned_file_write_region(
-							param.image_file,
-						image_regions + region)) {
-					partitioned_file_close(
-							param.image_file);
-					return 1;
-				}
-			}
+	args[num_args] = NULL;
+	return num_args;
+}
+
+/* Forget everything that was learned about the image by the previous command. */
+static void reset_image_caches(void)
+{
+	mh_cache_outdated = true;
+	mmap_window_table_size = 0;
+	mmap_windows_done = false;
+}
+
+struct batch_command {
+	unsigned int line_num;
+	int index;	/* into commands[] */
+	int argc;
+	char *argv[BATCH_MAX_ARGS + 1];
+};
+
+/*
+ * Split the manifest into commands, which point into its buffer. Returns the number of
+ * commands, or -1 if the manifest is invalid.
+ */
+static int parse_batch_manifest(const char *manifest_name,
+				struct buffer *manifest,
+				struct batch_command **cmds)
+{
+	unsigned int line_num = 0;
+	int num_cmds = 0;
+
+	*cmds = NULL;
+
+	/* Make sure the last line is terminated. */
+	if (buffer_size(manifest) == 0 ||
+	    manifest->data[buffer_size(manifest) - 1] != '\n') {
+		char *data = realloc(manifest->data, manifest->size + 1);
+		if (!data) {
+			ERROR("Could not allocate memory for manifest\n");
+			return -1;
 		}
+		data[manifest->size++] = '\n';
+		manifest->data = data;
+	}
 
-		partitioned_file_close(param.image_file);
-		return 0;
+	for (char *line = manifest->data;
+	     line < manifest->data + manifest->size; ) {
+		char *end = memchr(line, '\n',
+				   manifest->data + manifest->size - line);
+		struct batch_command *cmd, *new_cmds;
+
+		new_cmds = realloc(*cmds, (num_cmds + 1) * sizeof(**cmds));
+		if (!new_cmds) {
+			ERROR("Could not allocate memory for manifest\n");
+			return -1;
+		}
+		*cmds = new_cmds;
+		cmd = &new_cmds[num_cmds];
+
+		cmd->line_num = ++line_num;
+		*end = '\0';
+		cmd->argc = split_batch_line(line, cmd->argv, BATCH_MAX_ARGS);
+		line = end + 1;
+		if (cmd->argc < 0) {
+			ERROR("%s:%u: Invalid line\n", manifest_name, line_num);
+			return -1;
+		}
+		if (cmd->argc == 0)
+			continue;
+
+		cmd->index = find_command(cmd->argv[0]);
+		if (cmd->index < 0) {
+			ERROR("%s:%u: Unknown command '%s'.\n", manifest_name,
+			      line_num, cmd->argv[0]);
+			return -1;
+		}
+		if (commands[cmd->index].function == cbfs_create ||
+		    commands[cmd->index].function == cbfs_batch) {
+			ERROR("%s:%u: '%s' can't be used in a batch.\n",
+			      manifest_name, line_num, cmd->argv[0]);
+			return -1;
+		}
+		num_cmds++;
 	}
 
-	ERROR("Unknown command '%s'.\n", cmd);
-	usage(argv[0]);
-	return 1;
+	return num_cmds;
+}
+
+/* Set up param for a command of the batch like for a separate invocation. */
+static int prepare_batch_command(partitioned_file_t *image_file,
+				 int base_verbose, struct batch_command *cmd)
+{
+	param = param_defaults;
+	param.image_file = image_file;
+	verbose = base_verbose;
+	reset_image_caches();
+
+	return parse_command_args(cmd->index, cmd->argc, cmd->argv);
+}
+
+static bool may_compress(const struct command *command)
+{
+	return command->function == cbfs_add ||
+	       command->function == cbfs_add_flat_binary ||
+	       command->function == cbfs_add_payload ||
+	       command->function == cbfs_add_stage;
+}
+
+/* Remove a temporary compression cache directory and all entries in it. */
+static void remove_cache_dir(const char *dir)
+{
+	DIR *d = opendir(dir);
+	struct dirent *entry;
+
+	if (d) {
+		while ((entry = readdir(d))) {
+			char path[PATH_MAX];
+
+			if (entry->d_name[0] == '.')
+				continue;
+			snprintf(path, sizeof(path), "%s/%s", dir,
+				 entry->d_name);
+			unlink(path);
+		}
+		closedir(d);
+	}
+	rmdir(dir);
+}
+
+/*
+ * Run the commands that may compress files in worker processes, one per command. They all
+ * work on their own copy of the image, which is thrown away, and their output is discarded.
+ * What is left are the entries they put into the compression cache, so that compressing the
+ * same data in the actual run of the batch is only a lookup. Commands that end up
+ * compressing something else, e.g. because they depend on the result of an earlier command,
+ * simply miss the cache.
+ */
+static void precompress_batch(partitioned_file_t *image_file, int base_verbose,
+			      struct batch_command *cmds, int num_cmds,
+			      long jobs)
+{
+	long running = 0;
+
+	fflush(stdout);
+	fflush(stderr);
+
+	for (int i = 0; i < num_cmds; i++) {
+		pid_t pid;
+
+		if (!may_compress(&commands[cmds[i].index]))
+			continue;
+
+		if (running == jobs && wait(NULL) > 0)
+			running--;
+
+		pid = fork();
+		if (pid < 0) {
+			perror("fork");
+			break;
+		}
+		if (pid > 0) {
+			running++;
+			continue;
+		}
+
+		int null_fd = open("/dev/null", O_WRONLY);
+		if (null_fd < 0 || dup2(null_fd, STDOUT_FILENO) < 0 ||
+		    dup2(null_fd, STDERR_FILENO) < 0)
+			_exit(1);
+
+		/* Exit without cleaning up, the image is still open in the parent. */
+		if (prepare_batch_command(image_file, base_verbose, &cmds[i]) ||
+		    param.compression == CBFS_COMPRESS_NONE ||
+		    param.precompression)
+			_exit(0);
+		_exit(process_regions(cmds[i].index));
+	}
+
+	while (running > 0 && wait(NULL) > 0)
+		running--;
+}
+
+/*
+ * Apply every command in the manifest param.filename to the image. The regions modified by
+ * the commands stay in memory and are written to the image file only after all of them
+ * succeeded, so a failing command leaves the whole image untouched.
+ */
+static int cbfs_batch(void)
+{
+	partitioned_file_t *image_file = param.image_file;
+	const char *manifest_name = param.filename;
+	const int base_verbose = verbose;
+	long jobs = param.jobs;
+	char tmp_cache_dir[PATH_MAX] = "";
+	struct batch_command *cmds;
+	struct buffer manifest;
+	int num_cmds, num_compressing = 0;
+	int ret = 0;
+
+	if (!manifest_name) {
+		ERROR("You need to specify -f/--file.\n");
+		return 1;
+	}
+	if (buffer_from_file(&manifest, manifest_name))
+		return 1;
+
+	num_cmds = parse_batch_manifest(manifest_name, &manifest, &cmds);
+	if (num_cmds < 0) {
+		ret = 1;
+		goto out;
+	}
+
+	partitioned_file_defer_writes(image_file);
+
+	for (int i = 0; i < num_cmds; i++) {
+		if (may_compress(&commands[cmds[i].index]))
+			num_compressing++;
+	}
+	if (!jobs)
+		jobs = sysconf(_SC_NPROCESSORS_ONLN);
+	if (jobs > 1 && num_compressing > 1) {
+		/* The workers hand over their results through the cache. */
+		if (!getenv(COMPRESSION_CACHE_ENV)) {
+			const char *tmp = getenv("TMPDIR");
+
+			snprintf(tmp_cache_dir, sizeof(tmp_cache_dir),
+				 "%s/cbfstool-XXXXXX", tmp && *tmp ? tmp : "/tmp");
+			if (mkdtemp(tmp_cache_dir))
+				compression_set_cache_dir(tmp_cache_dir);
+			else
+				tmp_cache_dir[0] = '\0';
+		}
+		if (getenv(COMPRESSION_CACHE_ENV) || tmp_cache_dir[0])
+			precompress_batch(image_file, base_verbose, cmds,
+					  num_cmds, jobs);
+	}
+
+	for (int i = 0; i < num_cmds; i++) {
+		if (prepare_batch_command(image_file, base_verbose, &cmds[i]) ||
+		    process_regions(cmds[i].index)) {
+			ERROR("%s:%u: Command '%s' failed.\n", manifest_name,
+			      cmds[i].line_num, cmds[i].argv[0]);
+			ret = 1;
+			break;
+		}
+	}
+
+	if (tmp_cache_dir[0]) {
+		compression_set_cache_dir(NULL);
+		remove_cache_dir(tmp_cache_dir);
+	}
+
+out:
+	free(cmds);
+	buffer_delete(&manifest);
+	param.image_file = image_file;
+
+	if (ret) {
+		ERROR("The image will be left unmodified.\n");
+		return 1;
+	}
+
+	return partitioned_file_flush(image_file) ? 0 : 1;
+}
+
+int main(int argc, char **argv)
+{
+	char *image_name;
+	int i, ret;
+
+	if (argc < 3) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	image_name = argv[1];
+	i = find_command(argv[2]);
+	if (i < 0) {
+		ERROR("Unknown command '%s'.\n", argv[2]);
+		usage(argv[0]);
+		return 1;
+	}
+
+	compression_set_cache_dir(getenv(COMPRESSION_CACHE_ENV));
+
+	param = param_defaults;
+	ret = parse_command_args(i, argc - 2, argv + 2);
+	if (ret < 0)
+		usage(argv[0]);
+	if (ret)
+		return 1;
+
+	if (commands[i].function == cbfs_create) {
+		if (param.fmap) {
+			struct buffer flashmap;
+			if (buffer_from_file(&flashmap, param.fmap))
+				return 1;
+			param.image_file = partitioned_file_create(
+						image_name, &flashmap);
+			buffer_delete(&flashmap);
+		} else if (param.size) {
+			param.image_file = partitioned_file_create_flat(
+						image_name, param.size);
+		} else {
+			ERROR("You need to specify a valid -M/--flashmap or -s/--size.\n");
+			return 1;
+		}
+	} else {
+		bool write_access = commands[i].modifies_region;
+
+		param.image_file =
+			partitioned_file_reopen(image_name,
+						write_access);
+	}
+	if (!param.image_file)
+		return 1;
+
+	if (commands[i].function == cbfs_batch)
+		ret = cbfs_batch();
+	else
+		ret = process_regions(i);
+
+	partitioned_file_close(param.image_file);
+	return ret;
 }
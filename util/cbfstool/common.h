@@ -164,6 +164,13 @@ typedef int (*decomp_func_ptr) (char *in, int in_len, char *out, int out_len,
 comp_func_ptr compression_function(enum cbfs_compression algo);
 decomp_func_ptr decompression_function(enum cbfs_compression algo);
 
+/* Keep the results of all compression functions in directory dir and reuse
+ * them when the same data is compressed again. NULL disables the cache. */
+void compression_set_cache_dir(const char *dir);
+
+/* Environment variable naming the directory for compression_set_cache_dir() */
+#define COMPRESSION_CACHE_ENV "CBFSTOOL_COMPRESSION_CACHE"
+
 uint64_t intfiletype(const char *name);
 
 /* cbfs-mkpayload.c */
@@ -198,6 +205,9 @@ int do_lzma_compress(char *in, int in_len, char *out, int *out_len);
 int do_lzma_uncompress(char *dst, int dst_len, char *src, int src_len,
 			size_t *actual_size);
 
+/* zstd_compress.c */
+int do_zstd_compress(char *in, int in_len, char *out, int *out_len);
+
 /* xdr.c */
 struct xdr {
 	uint8_t (*get8)(struct buffer *input);
@@ -1,14 +1,135 @@
 /* compression handling for cbfstool */
 /* SPDX-License-Identifier: GPL-2.0-only */
 
+#include <inttypes.h>
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <unistd.h>
 #include "common.h"
 #include "lz4/lib/lz4frame.h"
+#include "lz4/lib/xxhash.h"
 #include <commonlib/bsd/compression.h>
 
-static int lz4_compress(char *in, int in_len, char *out, int *out_len)
+/*
+ * Compressed data can be kept in an on-disk cache, see compression_set_cache_dir(). An
+ * entry is named after the algorithm, the size of the input and its XXH64 hash. The tag of
+ * each algorithm below has to change whenever its encoder settings do. When an entry is
+ * found, it is decompressed and compared to the input, so that a hash collision can never
+ * hand out the wrong data.
+ */
+#define LZ4_CACHE_TAG	"lz4-l20-4M"
+#define LZMA_CACHE_TAG	"lzma-lc1-pb0-fb273"
+#define ZSTD_CACHE_TAG	"zstd-l22"
+
+static const char *cache_dir;
+
+void compression_set_cache_dir(const char *dir)
+{
+	cache_dir = dir && *dir ? dir : NULL;
+}
+
+static char *cache_entry_path(const char *tag, const char *in, int in_len)
+{
+	size_t len = strlen(cache_dir) + strlen(tag) + 64;
+	char *path = malloc(len);
+
+	if (path)
+		snprintf(path, len, "%s/%s-%x-%016" PRIx64, cache_dir, tag,
+			 in_len, (uint64_t)XXH64(in, in_len, 0));
+	return path;
+}
+
+static bool cache_lookup(enum cbfs_compression algo, const char *path,
+			 char *in, int in_len, char *out, int *out_len)
+{
+	FILE *fp = fopen(path, "rb");
+	bool hit = false;
+	char *check = NULL;
+	size_t actual_size;
+	long size;
+
+	if (!fp)
+		return false;
+
+	if (fseek(fp, 0, SEEK_END) || (size = ftell(fp)) <= 0 ||
+	    size > in_len || fseek(fp, 0, SEEK_SET) ||
+	    fread(out, size, 1, fp) != 1)
+		goto out;
+
+	check = malloc(in_len);
+	if (!check)
+		goto out;
+	if (decompression_function(algo)(out, size, check, in_len,
+					 &actual_size) ||
+	    actual_size != (size_t)in_len || memcmp(check, in, in_len)) {
+		WARN("Ignoring mismatching compression cache entry %s\n",
+		     path);
+		goto out;
+	}
+
+	*out_len = size;
+	hit = true;
+out:
+	free(check);
+	fclose(fp);
+	return hit;
+}
+
+/* Entries are written under a temporary name first, so that concurrent
+   cbfstool instances never see partial ones. */
+static void cache_store(const char *path, const char *out, int out_len)
+{
+	size_t len = strlen(path) + 32;
+	char *tmp_path = malloc(len);
+	FILE *fp;
+
+	if (!tmp_path)
+		return;
+	snprintf(tmp_path, len, "%s.%ld.tmp", path, (long)getpid());
+
+	fp = fopen(tmp_path, "wb");
+	if (!fp) {
+		DEBUG("Could not create compression cache entry %s\n",
+		      tmp_path);
+		free(tmp_path);
+		return;
+	}
+	if (fwrite(out, out_len, 1, fp) != 1 || fclose(fp) ||
+	    rename(tmp_path, path))
+		unlink(tmp_path);
+	free(tmp_path);
+}
+
+static int cached_compress(enum cbfs_compression algo, const char *tag,
+			   comp_func_ptr compress, char *in, int in_len,
+			   char *out, int *out_len)
+{
+	char *path;
+	int ret;
+
+	if (!cache_dir || in_len <= 0)
+		return compress(in, in_len, out, out_len);
+
+	path = cache_entry_path(tag, in, in_len);
+	if (!path)
+		return compress(in, in_len, out, out_len);
+
+	if (cache_lookup(algo, path, in, in_len, out, out_len)) {
+		DEBUG("Using cached %s compression of %d bytes\n", tag,
+		      in_len);
+		free(path);
+		return 0;
+	}
+
+	ret = compress(in, in_len, out, out_len);
+	if (!ret)
+		cache_store(path, out, *out_len);
+	free(path);
+	return ret;
+}
+
+static int lz4_compress_frame(char *in, int in_len, char *out, int *out_len)
 {
 	LZ4F_preferences_t prefs = {
 		.compressionLevel = 20,
@@ -32,6 +153,12 @@ static int lz4_compress(char *in, int in_len, char *out, int *out_len)
 	return 0;
 }
 
+static int lz4_compress(char *in, int in_len, char *out, int *out_len)
+{
+	return cached_compress(CBFS_COMPRESS_LZ4, LZ4_CACHE_TAG,
+			       lz4_compress_frame, in, in_len, out, out_len);
+}
+
 static int lz4_decompress(char *in, int in_len, char *out, int out_len,
 			  size_t *actual_size)
 {
@@ -45,7 +172,8 @@ static int lz4_decompress(char *in, int in_len, char *out, int out_len,
 
 static int lzma_compress(char *in, int in_len, char *out, int *out_len)
 {
-	return do_lzma_compress(in, in_len, out, out_len);
+	return cached_compress(CBFS_COMPRESS_LZMA, LZMA_CACHE_TAG,
+			       do_lzma_compress, in, in_len, out, out_len);
 }
 
 static int lzma_decompress(char *in, int in_len, char *out, unused int out_len,
@@ -53,6 +181,24 @@ static int lzma_decompress(char *in, int in_len, char *out, unused int out_len,
 {
 	return do_lzma_uncompress(out, out_len, in, in_len, actual_size);
 }
+
+static int zstd_compress(char *in, int in_len, char *out, int *out_len)
+{
+	return cached_compress(CBFS_COMPRESS_ZSTD, ZSTD_CACHE_TAG,
+			       do_zstd_compress, in, in_len, out, out_len);
+}
+
+static int zstd_decompress(char *in, int in_len, char *out, int out_len,
+			   size_t *actual_size)
+{
+	size_t result = uzstdn(in, in_len, out, out_len);
+	if (result == 0)
+		return -1;
+	if (actual_size != NULL)
+		*actual_size = result;
+	return 0;
+}
+
 static int none_compress(char *in, int in_len, char *out, int *out_len)
 {
 	memcpy(out, in, in_len);
@@ -82,6 +228,9 @@ comp_func_ptr compression_function(enum cbfs_compression algo)
 	case CBFS_COMPRESS_LZ4:
 		compress = lz4_compress;
 		break;
+	case CBFS_COMPRESS_ZSTD:
+		compress = zstd_compress;
+		break;
 	default:
 		ERROR("Unknown compression algorithm %d!\n", algo);
 		return NULL;
@@ -102,6 +251,9 @@ decomp_func_ptr decompression_function(enum cbfs_compression algo)
 	case CBFS_COMPRESS_LZ4:
 		decompress = lz4_decompress;
 		break;
+	case CBFS_COMPRESS_ZSTD:
+		decompress = zstd_decompress;
+		break;
 	default:
 		ERROR("Unknown compression algorithm %d!\n", algo);
 		return NULL;
@@ -8,16 +8,108 @@
 #include "cbfs_sections.h"
 
 #include <assert.h>
+#include <signal.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 struct partitioned_file {
 	struct fmap *fmap;
 	struct buffer buffer;
 	FILE *stream;
+	/*
+	 * Reopened files are mapped instead of read in. The buffer is a private
+	 * mapping, so it's only copied page by page as it gets modified and the
+	 * backing file doesn't change before the modified region is written.
+	 * The mapping is write-protected until a page is first written to, and
+	 * dirty_page_fault() then marks the page in dirty_pages. Only the dirty
+	 * pages are written back. Nothing may read(2) into the mapping, as the
+	 * kernel fails such writes with EFAULT instead of faulting.
+	 */
+	bool mapped;
+	size_t page_size;
+	uint8_t *dirty_pages;
+	struct partitioned_file *next_mapped;
+	/* Set by partitioned_file_defer_writes(), see partitioned_file_flush(). */
+	bool defer_writes;
+	size_t dirty_start;
+	size_t dirty_end;
 };
 
+/* All mapped files, for dirty_page_fault() */
+static struct partitioned_file *mapped_files;
+static struct sigaction previous_segv_action;
+static struct sigaction previous_bus_action;
+
+/*
+ * Writes to a write-protected page of a mapped file end up here. Mark the page
+ * dirty and let the write through. Anything else is a real fault, so hand it to
+ * the previous handler, and by default crash, when the access is retried.
+ */
+static void dirty_page_fault(int sig, siginfo_t *info, unused void *context)
+{
+	const uintptr_t addr = (uintptr_t)info->si_addr;
+
+	for (struct partitioned_file *file = mapped_files; file;
+					file = file->next_mapped) {
+		const uintptr_t base = (uintptr_t)file->buffer.data;
+
+		if (addr < base || addr - base >= file->buffer.size)
+			continue;
+
+		const size_t page = (addr - base) / file->page_size;
+		file->dirty_pages[page] = 1;
+		if (!mprotect(file->buffer.data + page * file->page_size,
+			      file->page_size, PROT_READ | PROT_WRITE))
+			return;
+		break;
+	}
+
+	sigaction(sig, sig == SIGBUS ? &previous_bus_action :
+		  &previous_segv_action, NULL);
+}
+
+static bool install_dirty_page_fault(void)
+{
+	static bool installed;
+	struct sigaction action;
+
+	if (installed)
+		return true;
+
+	memset(&action, 0, sizeof(action));
+	action.sa_sigaction = dirty_page_fault;
+	action.sa_flags = SA_SIGINFO;
+	sigemptyset(&action.sa_mask);
+
+	/* Some systems raise SIGBUS for writes to read-only mappings. */
+	if (sigaction(SIGSEGV, &action, &previous_segv_action) ||
+	    sigaction(SIGBUS, &action, &previous_bus_action))
+		return false;
+
+	installed = true;
+	return true;
+}
+
+/* Write-protect the pages that lie completely within [offset, end) again. */
+static void clean_pages(struct partitioned_file *file, size_t offset,
+								size_t end)
+{
+	const size_t first = DIV_ROUND_UP(offset, file->page_size);
+	const size_t last = end == file->buffer.size ?
+		DIV_ROUND_UP(end, file->page_size) : end / file->page_size;
+
+	if (first >= last)
+		return;
+
+	memset(file->dirty_pages + first, 0, last - first);
+	mprotect(file->buffer.data + first * file->page_size,
+		 (last - first) * file->page_size, PROT_READ);
+}
+
 static bool fill_ones_through(struct partitioned_file *file)
 {
 	assert(file);
@@ -40,6 +132,42 @@ static unsigned count_selected_fmap_entries(const struct fmap *fmap,
 	return count;
 }
 
+/* Map the locked file. Returns false if it can't be mapped, e.g. if it's empty. */
+static bool map_flat_file(struct partitioned_file *file, const char *filename)
+{
+	const int fd = fileno(file->stream);
+	const long page_size = sysconf(_SC_PAGESIZE);
+	struct stat st;
+	void *data;
+
+	if (fstat(fd, &st) || !S_ISREG(st.st_mode) || st.st_size <= 0 ||
+	    (uintmax_t)st.st_size > SIZE_MAX || page_size <= 0 ||
+	    !install_dirty_page_fault())
+		return false;
+
+	file->page_size = page_size;
+	file->dirty_pages = calloc(DIV_ROUND_UP((size_t)st.st_size,
+						file->page_size), 1);
+	if (!file->dirty_pages)
+		return false;
+
+	data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (data == MAP_FAILED) {
+		free(file->dirty_pages);
+		file->dirty_pages = NULL;
+		return false;
+	}
+
+	file->buffer.name = strdup(filename);
+	file->buffer.data = data;
+	file->buffer.offset = 0;
+	file->buffer.size = st.st_size;
+	file->mapped = true;
+	file->next_mapped = mapped_files;
+	mapped_files = file;
+	return true;
+}
+
 static partitioned_file_t *reopen_flat_file(const char *filename,
 					    bool write_access)
 {
@@ -52,11 +180,6 @@ static partitioned_file_t *reopen_flat_file(const char *filename,
 		return NULL;
 	}
 
-	if (buffer_from_file(&file->buffer, filename)) {
-		free(file);
-		return NULL;
-	}
-
 	access_mode = write_access ?  "rb+" : "rb";
 	file->stream = fopen(filename, access_mode);
 
@@ -66,6 +189,12 @@ static partitioned_file_t *reopen_flat_file(const char *filename,
 		return NULL;
 	}
 
+	if (!map_flat_file(file, filename) &&
+	    buffer_from_file(&file->buffer, filename)) {
+		partitioned_file_close(file);
+		return NULL;
+	}
+
 	return file;
 }
 
@@ -203,6 +332,63 @@ partitioned_file_t *partitioned_file_reopen(const char *filename,
 	return file;
 }
 
+static bool write_to_stream(struct partitioned_file *file, size_t offset,
+								size_t size)
+{
+	if (fseek(file->stream, offset, SEEK_SET)) {
+		ERROR("Failed to seek within image file\n");
+		return false;
+	}
+	if (!fwrite(file->buffer.data + offset, size, 1, file->stream) ||
+	    fflush(file->stream)) {
+		ERROR("Failed to write to image file\n");
+		return false;
+	}
+	return true;
+}
+
+/* Write back only the dirty pages of [offset, offset + size). */
+static bool write_dirty_pages(struct partitioned_file *file, size_t offset,
+								size_t size)
+{
+	const size_t end = offset + size;
+	size_t pos = ALIGN_DOWN(offset, file->page_size);
+	size_t run_start = 0, run_end = 0, written = 0;
+
+	while (pos < end) {
+		const size_t page_end = MIN(pos + file->page_size, end);
+		const bool dirty = file->dirty_pages[pos / file->page_size];
+
+		if (dirty) {
+			if (run_start == run_end)
+				run_start = MAX(pos, offset);
+			run_end = page_end;
+		}
+
+		/* Write a run of dirty pages once it ends. */
+		if (run_start != run_end && (!dirty || page_end == end)) {
+			if (!write_to_stream(file, run_start,
+					     run_end - run_start))
+				return false;
+			written += run_end - run_start;
+			run_start = run_end;
+		}
+		pos = page_end;
+	}
+
+	clean_pages(file, offset, end);
+	DEBUG("Wrote back %zu of %zu bytes\n", written, size);
+	return true;
+}
+
+static bool write_back(struct partitioned_file *file, size_t offset,
+							size_t size)
+{
+	if (file->mapped)
+		return write_dirty_pages(file, offset, size);
+	return write_to_stream(file, offset, size);
+}
+
 bool partitioned_file_write_region(partitioned_file_t *file,
 						const struct buffer *buffer)
 {
@@ -220,14 +406,42 @@ bool partitioned_file_write_region(partitioned_file_t *file,
 		return false;
 	}
 
-	if (fseek(file->stream, buffer->offset, SEEK_SET)) {
-		ERROR("Failed to seek within image file\n");
-		return false;
+	if (file->defer_writes) {
+		if (file->dirty_start == file->dirty_end) {
+			file->dirty_start = buffer->offset;
+			file->dirty_end = buffer->offset + buffer->size;
+		} else {
+			file->dirty_start = MIN(file->dirty_start, buffer->offset);
+			file->dirty_end = MAX(file->dirty_end,
+					      buffer->offset + buffer->size);
+		}
+		return true;
 	}
-	if (!fwrite(buffer->data, buffer->size, 1, file->stream)) {
-		ERROR("Failed to write to image file\n");
+
+	return write_back(file, buffer->offset, buffer->size);
+}
+
+void partitioned_file_defer_writes(partitioned_file_t *file)
+{
+	assert(file);
+	assert(file->stream);
+
+	file->defer_writes = true;
+}
+
+bool partitioned_file_flush(partitioned_file_t *file)
+{
+	assert(file);
+
+	if (file->dirty_start == file->dirty_end)
+		return true;
+
+	if (!write_back(file, file->dirty_start,
+			file->dirty_end - file->dirty_start))
 		return false;
-	}
+
+	file->dirty_start = 0;
+	file->dirty_end = 0;
 	return true;
 }
 
@@ -269,7 +483,19 @@ void partitioned_file_close(partitioned_file_t *file)
 		return;
 
 	file->fmap = NULL;
-	buffer_delete(&file->buffer);
+	if (file->mapped) {
+		struct partitioned_file **link = &mapped_files;
+
+		while (*link != file)
+			link = &(*link)->next_mapped;
+		*link = file->next_mapped;
+
+		munmap(file->buffer.data, file->buffer.size);
+		free(file->buffer.name);
+		free(file->dirty_pages);
+	} else {
+		buffer_delete(&file->buffer);
+	}
 	if (file->stream) {
 		flock(fileno(file->stream), LOCK_UN);
 		fclose(file->stream);
@@ -51,8 +51,11 @@ partitioned_file_t *partitioned_file_create(const char *filename,
 
 /**
  * Read a file back in from the disk.
- * An in-memory buffer is created and populated with the file's
- * contents. If the image contains an FMAP, it will be opened as a
+ * The file is mapped into memory privately, so that it is neither copied up
+ * front nor changed before a region is written back. (Files that can't be
+ * mapped are read into an in-memory buffer instead.) With write access,
+ * writing a region back only writes the pages that actually changed.
+ * If the image contains an FMAP, it will be opened as a
  * full partitioned file; otherwise, it will be opened as a flat file as
  * if it had been created by partitioned_file_create_flat().
  * The partitioned_file_t returned from this function is separately owned by the
@@ -79,6 +82,27 @@ partitioned_file_t *partitioned_file_reopen(const char *filename,
 bool partitioned_file_write_region(partitioned_file_t *file,
 						const struct buffer *buffer);
 
+/**
+ * Keep all further changes in memory until partitioned_file_flush().
+ * Afterwards, partitioned_file_write_region() only records which part of the
+ * in-memory buffer was modified instead of writing it to the backing file.
+ * This allows applying a whole series of operations to the image with a single
+ * write at the end, or leaving the backing file untouched if one of them fails.
+ *
+ * @param file Partitioned file opened with write access
+ */
+void partitioned_file_defer_writes(partitioned_file_t *file);
+
+/**
+ * Write all changes deferred by partitioned_file_defer_writes() to the backing
+ * file. Everything from the first to the last modified byte is written at once,
+ * or just the modified pages in that range if the file was reopened.
+ *
+ * @param file Partitioned file to flush
+ * @return     Whether the operation was successful
+ */
+bool partitioned_file_flush(partitioned_file_t *file);
+
 /**
  * Obtain one particular region of a segmented file.
  * The result is owned by the partitioned_file_t and shared among every caller
@@ -0,0 +1,71 @@
+#!/usr/bin/python3
+# SPDX-License-Identifier: BSD-3-Clause
+
+import pytest
+from cbfstool_helpers import cbfstool, write_manifest
+
+
+def cbfs_print(cbfstool_path, image) -> list:
+    output = cbfstool(cbfstool_path, image, 'print', '-k')
+    lines = output.stdout.decode("utf-8").strip().splitlines()
+    # Skip the header line and keep the names of the files only.
+    names = [line.split("\t")[0] for line in lines[1:]]
+    return [name for name in names if name != "(empty)"]
+
+
+def test_batch_matches_single_commands(cbfstool_path, image, payload,
+                                       tmp_path):
+    reference = tmp_path / "reference.bin"
+    reference.write_bytes(image.read_bytes())
+
+    cbfstool(cbfstool_path, reference, 'add', '-f', payload, '-n', 'a',
+             '-t', 'raw')
+    cbfstool(cbfstool_path, reference, 'add', '-f', payload, '-n', 'b c',
+             '-t', 'raw', '-c', 'lzma')
+    cbfstool(cbfstool_path, reference, 'add-int', '-i', '0x1234', '-n', 'int')
+    cbfstool(cbfstool_path, reference, 'remove', '-n', 'a')
+
+    manifest = write_manifest(tmp_path, f"""
+# Same as above, as one batch
+add -f {payload} -n a -t raw
+add -f {payload} -n "b c" -t raw -c lzma  # quoted name
+add-int -i 0x1234 -n 'int'
+remove -n a
+""")
+    cbfstool(cbfstool_path, image, 'batch', '-f', manifest)
+
+    assert image.read_bytes() == reference.read_bytes()
+    assert cbfs_print(cbfstool_path, image) == ["b c", "int"]
+
+
+def test_batch_failure_leaves_image_unmodified(cbfstool_path, image, payload,
+                                               tmp_path):
+    original = image.read_bytes()
+
+    manifest = write_manifest(tmp_path, f"""
+add -f {payload} -n a -t raw
+add -f {payload} -n a -t raw
+""")
+    result = cbfstool(cbfstool_path, image, 'batch', '-f', manifest,
+                      check=False)
+
+    assert result.returncode != 0
+    assert b"manifest.txt:3" in result.stderr
+    assert image.read_bytes() == original
+
+
+@pytest.mark.parametrize("line", [
+    "create -m x86 -s 256K",
+    "batch -f manifest.txt",
+    "no-such-command",
+    "add -n 'unterminated -t raw",
+])
+def test_batch_invalid_lines(cbfstool_path, image, tmp_path, line):
+    original = image.read_bytes()
+
+    manifest = write_manifest(tmp_path, line + "\n")
+    result = cbfstool(cbfstool_path, image, 'batch', '-f', manifest,
+                      check=False)
+
+    assert result.returncode != 0
+    assert image.read_bytes() == original
@@ -0,0 +1,49 @@
+#!/usr/bin/python3
+# SPDX-License-Identifier: BSD-3-Clause
+
+import os
+import pytest
+import subprocess
+from cbfstool_helpers import cbfstool, write_compressible_files, write_manifest
+
+
+@pytest.mark.parametrize("jobs", ["1", "4"])
+def test_batch_workers(cbfstool_path, image, tmp_path, jobs):
+    files = write_compressible_files(tmp_path, 4)
+    reference = tmp_path / "reference.bin"
+    reference.write_bytes(image.read_bytes())
+
+    lines = []
+    for i, path in enumerate(files):
+        algo = ["lzma", "lz4", "zstd"][i % 3]
+        args = ['add', '-f', str(path), '-n', f"f{i}", '-t', 'raw',
+                '-c', algo]
+        cbfstool(cbfstool_path, reference, *args)
+        lines.append(" ".join(args))
+
+    manifest = write_manifest(tmp_path, "\n".join(lines))
+    cbfstool(cbfstool_path, image, 'batch', '-f', manifest, '-J', jobs)
+
+    assert image.read_bytes() == reference.read_bytes()
+
+
+def test_compression_cache(cbfstool_path, image, tmp_path):
+    files = write_compressible_files(tmp_path, 2)
+    cache = tmp_path / "cache"
+    cache.mkdir()
+    env = dict(os.environ, CBFSTOOL_COMPRESSION_CACHE=str(cache))
+    images = []
+
+    for run in range(2):
+        path = tmp_path / f"image{run}.bin"
+        path.write_bytes(image.read_bytes())
+        for i, f in enumerate(files):
+            result = subprocess.run([cbfstool_path, path, 'add', '-f', f,
+                                     '-n', f"f{i}", '-t', 'raw', '-c', 'lzma',
+                                     '-v', '-v'],
+                                    capture_output=True, check=True, env=env)
+            assert (b"Using cached" in result.stderr) == (run > 0)
+        images.append(path.read_bytes())
+        assert len(list(cache.iterdir())) == len(files)
+
+    assert images[0] == images[1]
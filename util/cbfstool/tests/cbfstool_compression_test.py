@@ -0,0 +1,19 @@
+#!/usr/bin/python3
+# SPDX-License-Identifier: BSD-3-Clause
+
+import pytest
+from cbfstool_helpers import cbfstool, write_compressible_files
+
+
+@pytest.mark.parametrize("algo", ["lzma", "lz4", "zstd"])
+def test_extract_compressed(cbfstool_path, image, tmp_path, algo):
+    path = write_compressible_files(tmp_path, 1)[0]
+    extracted = tmp_path / "extracted.bin"
+
+    cbfstool(cbfstool_path, image, 'add', '-f', path, '-n', 'f', '-t', 'raw',
+             '-c', algo)
+    cbfstool(cbfstool_path, image, 'extract', '-f', extracted, '-n', 'f')
+
+    assert extracted.read_bytes() == path.read_bytes()
+    assert algo.upper() in cbfstool(cbfstool_path, image,
+                                    'print').stdout.decode("utf-8")
@@ -0,0 +1,25 @@
+# SPDX-License-Identifier: BSD-3-Clause
+
+# Helpers shared by the cbfstool tests.
+
+import subprocess
+
+
+def cbfstool(cbfstool_path, image, *args, check=True):
+    return subprocess.run([cbfstool_path, image] + list(args),
+                          capture_output=True, check=check)
+
+
+def write_manifest(tmp_path, text: str):
+    path = tmp_path / "manifest.txt"
+    path.write_text(text)
+    return path
+
+
+def write_compressible_files(tmp_path, count: int) -> list:
+    paths = []
+    for i in range(count):
+        path = tmp_path / f"file{i}.bin"
+        path.write_bytes(bytes([i]) * 4096 + bytes(range(256)) * 64)
+        paths.append(path)
+    return paths
@@ -0,0 +1,100 @@
+#!/usr/bin/python3
+# SPDX-License-Identifier: BSD-3-Clause
+
+import os
+import pytest
+import subprocess
+from cbfstool_helpers import cbfstool
+
+
+def cbfs_entries(cbfstool_path, image) -> list:
+    output = cbfstool(cbfstool_path, image, 'print', '-k')
+    lines = output.stdout.decode("utf-8").strip().splitlines()
+    # (name, offset, data offset, data size) of every entry
+    fields = [line.split("\t") for line in lines[1:]]
+    return [(f[0], int(f[1], 16), int(f[1], 16) + int(f[3], 16),
+             int(f[4], 16)) for f in fields]
+
+
+@pytest.mark.parametrize("placement,hole", [("first-fit", "big"),
+                                            ("best-fit", "small")])
+def test_placement(cbfstool_path, image, tmp_path, placement, hole):
+    for name, size in [("big", 8192), ("a", 1024), ("small", 2048),
+                       ("b", 1024)]:
+        path = tmp_path / name
+        path.write_bytes(os.urandom(size))
+        cbfstool(cbfstool_path, image, 'add', '-f', path, '-n', name,
+                 '-t', 'raw')
+    offsets = {e[0]: e[1] for e in cbfs_entries(cbfstool_path, image)}
+    cbfstool(cbfstool_path, image, 'remove', '-n', 'big')
+    cbfstool(cbfstool_path, image, 'remove', '-n', 'small')
+
+    cbfstool(cbfstool_path, image, 'add', '-f', tmp_path / 'a', '-n', 'new',
+             '-t', 'raw', '--placement', placement)
+    new = {e[0]: e[1] for e in cbfs_entries(cbfstool_path, image)}['new']
+    assert new == offsets[hole]
+
+
+def test_pack(cbfstool_path, image, tmp_path):
+    files = {}
+    for i, size in enumerate([3000, 20000, 500, 9000, 70000, 500, 1500]):
+        name = f"f{i}"
+        files[name] = os.urandom(size)
+        (tmp_path / name).write_bytes(files[name])
+        args = ['-a', '0x1000', '-g'] if i in (2, 5) else []
+        cbfstool(cbfstool_path, image, 'add', '-f', tmp_path / name,
+                 '-n', name, '-t', 'raw', *args)
+    for name in ("f1", "f4"):
+        cbfstool(cbfstool_path, image, 'remove', '-n', name)
+        del files[name]
+
+    def largest_empty():
+        return max(e[3] for e in cbfs_entries(cbfstool_path, image)
+                   if e[0] == "(empty)")
+
+    before = largest_empty()
+    cbfstool(cbfstool_path, image, 'pack')
+    assert largest_empty() > before
+
+    entries = {e[0]: e for e in cbfs_entries(cbfstool_path, image)}
+    assert entries["f2"][2] % 0x1000 == 0
+    assert entries["f5"][2] % 0x1000 == 0
+    for name, data in files.items():
+        extracted = tmp_path / "extracted.bin"
+        cbfstool(cbfstool_path, image, 'extract', '-f', extracted, '-n', name)
+        assert extracted.read_bytes() == data
+
+    # Packing again has nothing left to gain and keeps the image as it is.
+    packed = image.read_bytes()
+    cbfstool(cbfstool_path, image, 'pack')
+    assert image.read_bytes() == packed
+
+
+def test_pack_keeps_xip_stage(cbfstool_path, image, tmp_path):
+    # A single segment ELF with relocations, like an XIP romstage.
+    src = tmp_path / "romstage.c"
+    src.write_text("int x = 5;\nint *p = &x;\n"
+                   "void _start(void) { for (;;) x += *p; }\n")
+    elf = tmp_path / "romstage.elf"
+    try:
+        subprocess.run(['gcc', '-m32', '-fno-pic', '-fno-asynchronous-unwind-tables',
+                        '-nostdlib', '-static', '-no-pie', '-Wl,--build-id=none',
+                        '-Wl,--emit-relocs', '-Wl,-Ttext=0', '-Wl,-N',
+                        '-o', elf, src], capture_output=True, check=True)
+    except (OSError, subprocess.CalledProcessError):
+        pytest.skip("can't build a 32-bit x86 ELF")
+
+    hole = tmp_path / "hole"
+    hole.write_bytes(os.urandom(8192))
+    cbfstool(cbfstool_path, image, 'add', '-f', hole, '-n', 'hole', '-t', 'raw')
+    cbfstool(cbfstool_path, image, 'add-stage', '-f', elf, '-n',
+             'fallback/romstage', '--xip')
+    cbfstool(cbfstool_path, image, 'remove', '-n', 'hole')
+
+    def romstage_offset():
+        return {e[0]: e[1] for e in
+                cbfs_entries(cbfstool_path, image)}['fallback/romstage']
+
+    before = romstage_offset()
+    cbfstool(cbfstool_path, image, 'pack')
+    assert romstage_offset() == before
@@ -0,0 +1,17 @@
+#!/usr/bin/python3
+# SPDX-License-Identifier: BSD-3-Clause
+
+from cbfstool_helpers import cbfstool
+
+
+def test_write_back_changed_pages(cbfstool_path, image, payload, tmp_path):
+    result = cbfstool(cbfstool_path, image, 'add', '-f', payload, '-n', 'f',
+                      '-t', 'raw', '-v', '-v')
+    lines = result.stderr.decode("utf-8").splitlines()
+    written = [line.split() for line in lines if "Wrote back" in line]
+    assert written
+    assert int(written[0][3]) < int(written[0][5])
+
+    extracted = tmp_path / "extracted.bin"
+    cbfstool(cbfstool_path, image, 'extract', '-f', extracted, '-n', 'f')
+    assert extracted.read_bytes() == payload.read_bytes()
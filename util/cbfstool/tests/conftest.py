@@ -1,6 +1,9 @@
 # SPDX-License-Identifier: BSD-3-Clause
 
+import os
 import pathlib
+import pytest
+import subprocess
 
 
 def pytest_addoption(parser):
@@ -10,3 +13,30 @@ def pytest_addoption(parser):
         type=pathlib.Path,
         default=(here / ".." / "elogtool").resolve(),
     )
+    parser.addoption(
+        "--cbfstool-path",
+        type=pathlib.Path,
+        default=(here / ".." / "cbfstool").resolve(),
+    )
+
+
+@pytest.fixture(scope="session")
+def cbfstool_path(request):
+    exe = request.config.option.cbfstool_path
+    assert os.path.exists(exe)
+    return exe
+
+
+@pytest.fixture(scope="function")
+def image(cbfstool_path, tmp_path):
+    path = tmp_path / "image.bin"
+    subprocess.run([cbfstool_path, path, 'create', '-m', 'x86', '-s', '256K'],
+                   capture_output=True, check=True)
+    return path
+
+
+@pytest.fixture(scope="function")
+def payload(tmp_path):
+    path = tmp_path / "payload.bin"
+    path.write_bytes(bytes(range(256)) * 16)
+    return path
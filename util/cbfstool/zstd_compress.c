@@ -0,0 +1,48 @@
+/* Zstandard encoder for CBFS_COMPRESS_ZSTD, using the reference libzstd */
+/* SPDX-License-Identifier: GPL-2.0-only */
+
+/*
+ * Frames carry the content size and no checksum, because CBFS hashes files itself. The
+ * coreboot decoder (uzstdn()) uses the whole output as the window, so the window size that
+ * the compression level picks doesn't cost anything at decompression time.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <zstd.h>
+#include "common.h"
+
+int do_zstd_compress(char *in, int in_len, char *out, int *out_len)
+{
+	ZSTD_CCtx *cctx;
+	size_t bound, result;
+	void *bounce;
+	int ret = -1;
+
+	if (in_len <= 0)
+		return -1;
+
+	bound = ZSTD_compressBound(in_len);
+	bounce = malloc(bound);
+	cctx = ZSTD_createCCtx();
+	if (!bounce || !cctx)
+		goto out;
+
+	if (ZSTD_isError(ZSTD_CCtx_setParameter(cctx, ZSTD_c_compressionLevel,
+						ZSTD_maxCLevel())) ||
+	    ZSTD_isError(ZSTD_CCtx_setParameter(cctx, ZSTD_c_contentSizeFlag, 1)) ||
+	    ZSTD_isError(ZSTD_CCtx_setParameter(cctx, ZSTD_c_checksumFlag, 0)))
+		goto out;
+
+	result = ZSTD_compress2(cctx, bounce, bound, in, in_len);
+	if (ZSTD_isError(result) || result >= (size_t)in_len)
+		goto out;
+
+	memcpy(out, bounce, result);
+	*out_len = result;
+	ret = 0;
+out:
+	ZSTD_freeCCtx(cctx);
+	free(bounce);
+	return ret;
+}
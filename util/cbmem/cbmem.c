@@ -17,11 +17,15 @@
 #include <sys/mman.h>
 #include <libgen.h>
 #include <assert.h>
+#include <math.h>
 #include <regex.h>
 #include <commonlib/bsd/cbmem_id.h>
+#include <commonlib/heap_stats_serialized.h>
+#include <commonlib/memtest_serialized.h>
 #include <commonlib/loglevel.h>
 #include <commonlib/timestamp_serialized.h>
 #include <commonlib/tpm_log_serialized.h>
+#include <commonlib/trace_serialized.h>
 #include <commonlib/coreboot_tables.h>
 
 #ifdef __OpenBSD__
@@ -86,6 +90,47 @@ static inline size_t size_to_mib(size_t sz)
 	return sz >> 20;
 }
 
+/*
+ * A snapshot holds copies of the physical memory that cbmem looked at, so that the coreboot
+ * table and CBMEM of a machine can be looked at later and elsewhere. The file starts with a
+ * struct snapshot_header. It's followed by the chunks of memory in order of their address,
+ * each as a struct snapshot_chunk and its data, padded to a multiple of 8 bytes. Everything
+ * is in the byte order of the machine, like the coreboot table itself.
+ */
+#define SNAPSHOT_MAGIC "CBMEMSNP"
+#define SNAPSHOT_VERSION 1
+
+struct snapshot_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t num_chunks;
+	/* Where the coreboot table was found, as passed to parse_cbtable(). */
+	uint64_t cbtable_addr;
+	uint64_t cbtable_size;
+} __packed;
+
+struct snapshot_chunk {
+	uint64_t phys;
+	uint64_t size;
+} __packed;
+
+struct snapshot_region {
+	unsigned long long phys;
+	size_t size;
+	u8 *data;
+};
+
+static struct {
+	enum {
+		SNAPSHOT_NONE,
+		SNAPSHOT_SAVE,	/* Record everything that is mapped. */
+		SNAPSHOT_LOAD,	/* Map from the regions instead of /dev/mem. */
+	} mode;
+	struct snapshot_region *regions;
+	size_t count;
+	void *file_data;
+} snapshot;
+
 /* Return mapping of physical address requested. */
 static void *mapping_virt(const struct mapping *mapping)
 {
@@ -97,6 +142,52 @@ static void *mapping_virt(const struct mapping *mapping)
 	return v + mapping->offset;
 }
 
+static void *aligned_memcpy(void *dest, const void *src, size_t n);
+
+static void *map_snapshot(struct mapping *mapping, unsigned long long phys, size_t sz,
+			  int prot)
+{
+	if (prot & PROT_WRITE) {
+		fprintf(stderr, "A snapshot can't be modified.\n");
+		return NULL;
+	}
+
+	for (size_t i = 0; i < snapshot.count; i++) {
+		const struct snapshot_region *r = &snapshot.regions[i];
+
+		if (phys < r->phys || phys - r->phys > r->size ||
+		    sz > r->size - (phys - r->phys))
+			continue;
+
+		mapping->virt = r->data + (phys - r->phys);
+		mapping->offset = 0;
+		mapping->virt_size = sz;
+		mapping->size = sz;
+		mapping->phys = phys;
+		return mapping_virt(mapping);
+	}
+
+	debug("0x%zx bytes at 0x%llx are not in the snapshot.\n", sz, phys);
+	return NULL;
+}
+
+static void snapshot_record(unsigned long long phys, const void *v, size_t sz)
+{
+	struct snapshot_region *r;
+
+	snapshot.regions = realloc(snapshot.regions,
+				   (snapshot.count + 1) * sizeof(*snapshot.regions));
+	if (!snapshot.regions)
+		die("Failed to allocate memory");
+	r = &snapshot.regions[snapshot.count++];
+	r->phys = phys;
+	r->size = sz;
+	r->data = malloc(sz);
+	if (!r->data)
+		die("Failed to allocate memory");
+	aligned_memcpy(r->data, v, sz);
+}
+
 /* Returns virtual address on success, NULL on error. mapping is filled in. */
 static void *map_memory_with_prot(struct mapping *mapping,
 				  unsigned long long phys, size_t sz, int prot)
@@ -104,6 +195,9 @@ static void *map_memory_with_prot(struct mapping *mapping,
 	void *v;
 	unsigned long long page_size;
 
+	if (snapshot.mode == SNAPSHOT_LOAD)
+		return map_snapshot(mapping, phys, sz, prot);
+
 	page_size = system_page_size();
 
 	mapping->virt = NULL;
@@ -136,6 +230,9 @@ static void *map_memory_with_prot(struct mapping *mapping,
 		debug("  ... padding virtual address with 0x%zx bytes.\n",
 			mapping->offset);
 
+	if (snapshot.mode == SNAPSHOT_SAVE)
+		snapshot_record(phys, mapping_virt(mapping), sz);
+
 	return mapping_virt(mapping);
 }
 
@@ -153,7 +250,8 @@ static int unmap_memory(struct mapping *mapping)
 	if (mapping->virt == NULL)
 		return -1;
 
-	munmap(mapping->virt, mapping->virt_size);
+	if (snapshot.mode != SNAPSHOT_LOAD)
+		munmap(mapping->virt, mapping->virt_size);
 	mapping->virt = NULL;
 	mapping->offset = 0;
 	mapping->virt_size = 0;
@@ -219,28 +317,39 @@ static u16 ipchcksum(const void *addr, unsigned size)
 	return (u16) sum;
 }
 
+/*
+ * Return the record at offset in the coreboot table, or NULL at the end of the table. A record
+ * that doesn't fit into the table, e.g. of a corrupted snapshot, ends it, too.
+ */
+static const struct lb_record *lb_record_at(const struct mapping *table_mapping, size_t offset)
+{
+	const size_t table_size = mapping_size(table_mapping);
+	const struct lb_record *lbr;
+
+	if (offset >= table_size || table_size - offset < sizeof(*lbr))
+		return NULL;
+
+	lbr = (const void *)((const uint8_t *)mapping_virt(table_mapping) + offset);
+	if (lbr->size < sizeof(*lbr) || lbr->size > table_size - offset)
+		return NULL;
+
+	return lbr;
+}
+
 /* Find the first cbmem entry filling in the details. */
 static int find_cbmem_entry(uint32_t id, uint64_t *addr, size_t *size)
 {
-	const uint8_t *table;
+	const struct lb_record *lbr;
 	size_t offset;
 	int ret = -1;
 
-	table = mapping_virt(&lbtable_mapping);
-
-	if (table == NULL)
+	if (mapping_virt(&lbtable_mapping) == NULL)
 		return -1;
 
-	offset = 0;
-
-	while (offset < mapping_size(&lbtable_mapping)) {
-		const struct lb_record *lbr;
+	for (offset = 0; (lbr = lb_record_at(&lbtable_mapping, offset)); offset += lbr->size) {
 		struct lb_cbmem_entry lbe;
 
-		lbr = (const void *)(table + offset);
-		offset += lbr->size;
-
-		if (lbr->tag != LB_TAG_CBMEM_ENTRY)
+		if (lbr->tag != LB_TAG_CBMEM_ENTRY || lbr->size < sizeof(lbe))
 			continue;
 
 		aligned_memcpy(&lbe, lbr, sizeof(lbe));
@@ -281,7 +390,8 @@ static struct lb_cbmem_ref parse_cbmem_ref(const struct lb_cbmem_ref *cbmem_ref)
 {
 	struct lb_cbmem_ref ret;
 
-	aligned_memcpy(&ret, cbmem_ref, sizeof(ret));
+	memset(&ret, 0, sizeof(ret));
+	aligned_memcpy(&ret, cbmem_ref, MIN(cbmem_ref->size, sizeof(ret)));
 
 	if (cbmem_ref->size < sizeof(*cbmem_ref))
 		ret.cbmem_addr = (uint32_t)ret.cbmem_addr;
@@ -313,12 +423,10 @@ static int parse_cbtable_entries(const struct mapping *table_mapping)
 {
 	size_t i;
 	const struct lb_record *lbr_p;
-	size_t table_size = mapping_size(table_mapping);
 	const void *lbtable = mapping_virt(table_mapping);
 	int forwarding_table_found = 0;
 
-	for (i = 0; i < table_size; i += lbr_p->size) {
-		lbr_p = lbtable + i;
+	for (i = 0; (lbr_p = lb_record_at(table_mapping, i)); i += lbr_p->size) {
 		debug("  coreboot table entry 0x%02x\n", lbr_p->tag);
 		switch (lbr_p->tag) {
 		case LB_TAG_MEMORY:
@@ -344,17 +452,22 @@ static int parse_cbtable_entries(const struct mapping *table_mapping)
 		}
 		case LB_TAG_TSC_INFO:
 			debug("    Found TSC info.\n");
-			tsc_freq_khz = ((struct lb_tsc_info *)lbr_p)->freq_khz;
+			if (lbr_p->size >= sizeof(struct lb_tsc_info))
+				tsc_freq_khz = ((struct lb_tsc_info *)lbr_p)->freq_khz;
 			continue;
 		case LB_TAG_FORWARD: {
+			static int forwards;
 			int ret;
 			/*
 			 * This is a forwarding entry - repeat the
 			 * search at the new address.
 			 */
-			struct lb_forward lbf_p =
-			    *(const struct lb_forward *)lbr_p;
+			struct lb_forward lbf_p;
 			debug("    Found forwarding entry.\n");
+			/* A corrupted table could forward in circles. */
+			if (lbr_p->size < sizeof(lbf_p) || ++forwards > 8)
+				return -1;
+			aligned_memcpy(&lbf_p, lbr_p, sizeof(lbf_p));
 			ret = parse_cbtable(lbf_p.forward, 0);
 
 			/* Assume the forwarding entry is valid. If this fails
@@ -383,6 +496,8 @@ static int parse_cbtable(u64 address, size_t table_size)
 	/* Default to 4 KiB search space. */
 	if (req_size == 0)
 		req_size = 4 * 1024;
+	if (req_size < sizeof(struct lb_header))
+		return -1;
 
 	debug("Looking for coreboot table at %" PRIx64 " %zd bytes.\n",
 		address, req_size);
@@ -843,6 +958,589 @@ static void timestamp_add_now(uint32_t timestamp_id)
 	unmap_memory(&timestamp_mapping);
 }
 
+/*
+ * Boot time statistics over many boots, computed offline from saved timestamp
+ * tables. Each file holds one boot, either as printed by cbmem -T or as the
+ * raw CBMEM entry printed by cbmem -r 54494d45. Timestamps and ranges are
+ * identified by the IDs of timestamp_serialized.h, so new IDs just show up.
+ */
+
+enum boot_stat_kind {
+	BOOT_STAT_TIMESTAMP,	/* time since the start of coreboot */
+	BOOT_STAT_RANGE,	/* from a timestamp to its matching end */
+	BOOT_STAT_TOTAL,	/* time of the last timestamp */
+};
+
+struct boot_stat {
+	enum boot_stat_kind kind;
+	uint32_t id;
+	uint32_t id_end;
+	/* Value of the boot that is being added, ranges are summed up. */
+	int64_t pending;
+	bool has_pending;
+	int64_t *samples;	/* in microseconds */
+	size_t count;
+};
+
+struct boot_set {
+	struct boot_stat *stats;
+	size_t count;
+	size_t boots;
+};
+
+struct boot_summary {
+	size_t n;
+	double mean;
+	double variance;
+	int64_t median;
+	int64_t p95;
+};
+
+static void *read_whole_file(const char *path, size_t *size)
+{
+	FILE *f = fopen(path, "rb");
+	char *buf = NULL;
+	size_t len = 0, alloc = 0;
+
+	if (!f)
+		return NULL;
+
+	while (!feof(f) && !ferror(f)) {
+		if (len == alloc) {
+			alloc = alloc ? 2 * alloc : 64 * 1024;
+			buf = realloc(buf, alloc + 1);
+			if (!buf)
+				die("Failed to allocate memory");
+		}
+		len += fread(buf + len, 1, alloc - len, f);
+	}
+	if (ferror(f)) {
+		free(buf);
+		buf = NULL;
+	} else if (buf) {
+		buf[len] = '\0';
+		*size = len;
+	}
+	fclose(f);
+
+	return buf;
+}
+
+static struct timestamp_table *alloc_timestamp_table(uint32_t num_entries)
+{
+	struct timestamp_table *tst_p = calloc(1, sizeof(*tst_p) +
+					       num_entries * sizeof(tst_p->entries[0]));
+
+	if (!tst_p)
+		die("Failed to allocate memory");
+	tst_p->tick_freq_mhz = 1;
+	tst_p->num_entries = num_entries;
+	return tst_p;
+}
+
+/* Returns the raw CBMEM timestamp table in buf with stamps in microseconds, or NULL. */
+static struct timestamp_table *parse_raw_timestamps(const char *buf, size_t size)
+{
+	struct timestamp_table header, *tst_p;
+
+	if (size < sizeof(header))
+		return NULL;
+	memcpy(&header, buf, sizeof(header));
+	if (!header.tick_freq_mhz || header.num_entries > header.max_entries ||
+	    header.num_entries > (size - sizeof(header)) / sizeof(header.entries[0]))
+		return NULL;
+
+	tst_p = alloc_timestamp_table(header.num_entries);
+	memcpy(tst_p->entries, buf + sizeof(header),
+	       header.num_entries * sizeof(header.entries[0]));
+	for (uint32_t i = 0; i < tst_p->num_entries; i++)
+		tst_p->entries[i].entry_stamp /= header.tick_freq_mhz;
+
+	return tst_p;
+}
+
+/* Returns the cbmem -T output in buf as a timestamp table, or NULL. */
+static struct timestamp_table *parse_parseable_timestamps(char *buf)
+{
+	struct timestamp_table *tst_p = alloc_timestamp_table(0);
+	uint64_t base_time = 0;
+	uint32_t max_entries = 0;
+	char *line, *end;
+
+	for (line = strtok(buf, "\n"); line; line = strtok(NULL, "\n")) {
+		struct timestamp_entry *tse;
+		unsigned long id;
+		unsigned long long stamp;
+
+		/* ID<tab>absolute time<tab>relative time<tab>description */
+		id = strtoul(line, &end, 10);
+		if (end == line || *end != '\t')
+			goto error;
+		line = end + 1;
+		stamp = strtoull(line, &end, 10);
+		if (end == line || *end != '\t')
+			goto error;
+
+		/* The start of coreboot, which cbmem adds when printing. */
+		if (id == 0) {
+			base_time = stamp;
+			continue;
+		}
+
+		if (tst_p->num_entries == max_entries) {
+			max_entries = max_entries ? 2 * max_entries : 64;
+			tst_p = realloc(tst_p, sizeof(*tst_p) +
+					max_entries * sizeof(tst_p->entries[0]));
+			if (!tst_p)
+				die("Failed to allocate memory");
+		}
+		tse = &tst_p->entries[tst_p->num_entries++];
+		tse->entry_id = id;
+		tse->entry_stamp = stamp;
+	}
+
+	if (!tst_p->num_entries)
+		goto error;
+	for (uint32_t i = 0; i < tst_p->num_entries; i++)
+		tst_p->entries[i].entry_stamp -= base_time;
+
+	return tst_p;
+
+error:
+	free(tst_p);
+	return NULL;
+}
+
+static struct boot_stat *boot_set_stat(struct boot_set *set, enum boot_stat_kind kind,
+				       uint32_t id, uint32_t id_end)
+{
+	struct boot_stat *stat;
+
+	for (size_t i = 0; i < set->count; i++) {
+		stat = &set->stats[i];
+		if (stat->kind == kind && stat->id == id && stat->id_end == id_end)
+			return stat;
+	}
+
+	set->stats = realloc(set->stats, (set->count + 1) * sizeof(*set->stats));
+	if (!set->stats)
+		die("Failed to allocate memory");
+	stat = &set->stats[set->count++];
+	memset(stat, 0, sizeof(*stat));
+	stat->kind = kind;
+	stat->id = id;
+	stat->id_end = id_end;
+
+	return stat;
+}
+
+static const struct boot_stat *boot_set_find_stat(const struct boot_set *set,
+						   const struct boot_stat *like)
+{
+	for (size_t i = 0; i < set->count; i++) {
+		const struct boot_stat *stat = &set->stats[i];
+
+		if (stat->kind == like->kind && stat->id == like->id &&
+		    stat->id_end == like->id_end)
+			return stat;
+	}
+
+	return NULL;
+}
+
+static void boot_set_add_file(struct boot_set *set, const char *path)
+{
+	struct timestamp_table *tst_p;
+	struct boot_stat *stat;
+	size_t size;
+	char *buf;
+
+	buf = read_whole_file(path, &size);
+	if (!buf) {
+		fprintf(stderr, "Unable to read %s: %s\n", path, strerror(errno));
+		exit(1);
+	}
+	tst_p = parse_raw_timestamps(buf, size);
+	if (!tst_p)
+		tst_p = parse_parseable_timestamps(buf);
+	free(buf);
+	if (!tst_p) {
+		fprintf(stderr, "%s holds neither cbmem -T output nor a timestamp table.\n",
+			path);
+		exit(1);
+	}
+
+	qsort(&tst_p->entries[0], tst_p->num_entries, sizeof(struct timestamp_entry),
+	      compare_timestamp_entries);
+
+	for (uint32_t i = 0; i < tst_p->num_entries; i++) {
+		const struct timestamp_entry *tse = &tst_p->entries[i];
+		int match = find_matching_end(tst_p, i, tst_p->num_entries);
+
+		/* Only the first one counts if a timestamp was taken several times. */
+		stat = boot_set_stat(set, BOOT_STAT_TIMESTAMP, tse->entry_id, 0);
+		if (!stat->has_pending)
+			stat->pending = tse->entry_stamp;
+		stat->has_pending = true;
+
+		if (match == -1)
+			continue;
+		stat = boot_set_stat(set, BOOT_STAT_RANGE, tse->entry_id,
+				     tst_p->entries[match].entry_id);
+		stat->pending += tst_p->entries[match].entry_stamp - tse->entry_stamp;
+		stat->has_pending = true;
+	}
+
+	stat = boot_set_stat(set, BOOT_STAT_TOTAL, 0, 0);
+	stat->pending = tst_p->entries[tst_p->num_entries - 1].entry_stamp;
+	stat->has_pending = true;
+
+	for (size_t i = 0; i < set->count; i++) {
+		stat = &set->stats[i];
+		if (!stat->has_pending)
+			continue;
+		stat->samples = realloc(stat->samples,
+					(stat->count + 1) * sizeof(*stat->samples));
+		if (!stat->samples)
+			die("Failed to allocate memory");
+		stat->samples[stat->count++] = stat->pending;
+		stat->pending = 0;
+		stat->has_pending = false;
+	}
+
+	set->boots++;
+	free(tst_p);
+}
+
+static int compare_samples(const void *a, const void *b)
+{
+	const int64_t sa = *(const int64_t *)a;
+	const int64_t sb = *(const int64_t *)b;
+
+	return (sa > sb) - (sa < sb);
+}
+
+/* Summarizes a stat, or no boots at all if it is NULL. */
+static void boot_stat_summarize(const struct boot_stat *stat, struct boot_summary *sum)
+{
+	double sq = 0;
+	size_t n = stat ? stat->count : 0;
+	int64_t *samples;
+
+	memset(sum, 0, sizeof(*sum));
+	sum->n = n;
+	if (!n)
+		return;
+
+	/* Sort a copy, the samples stay in the order of the boots. */
+	samples = malloc(n * sizeof(*samples));
+	if (!samples)
+		die("Failed to allocate memory");
+	memcpy(samples, stat->samples, n * sizeof(*samples));
+	qsort(samples, n, sizeof(*samples), compare_samples);
+
+	for (size_t i = 0; i < n; i++)
+		sum->mean += samples[i];
+	sum->mean /= n;
+	for (size_t i = 0; i < n; i++)
+		sq += (samples[i] - sum->mean) * (samples[i] - sum->mean);
+	sum->variance = n > 1 ? sq / (n - 1) : 0;
+
+	sum->median = n % 2 ? samples[n / 2] : (samples[n / 2 - 1] + samples[n / 2]) / 2;
+	/* Nearest rank */
+	sum->p95 = samples[(n * 95 + 99) / 100 - 1];
+
+	free(samples);
+}
+
+static const char *boot_stat_name(const struct boot_stat *stat)
+{
+	static char name[128];
+
+	if (stat->kind == BOOT_STAT_TOTAL)
+		return "Total";
+
+	if (stat->kind == BOOT_STAT_RANGE)
+		snprintf(name, sizeof(name), "%s -> %s", get_timestamp_name(stat->id),
+			 get_timestamp_name(stat->id_end));
+	else
+		snprintf(name, sizeof(name), "%s", get_timestamp_name(stat->id));
+
+	/* Keep IDs that this version of cbmem doesn't know apart. */
+	if (strstr(name, "UNKNOWN"))
+		snprintf(name, sizeof(name), stat->kind == BOOT_STAT_RANGE ?
+			 "%u -> %u" : "%u", stat->id, stat->id_end);
+
+	return name;
+}
+
+/*
+ * Two-sided 95% critical values of Student's t distribution for 1 to 30 degrees of
+ * freedom. Beyond that, the normal distribution is close enough.
+ */
+static const double t_critical_95[] = {
+	12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+	2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+	2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042,
+};
+
+/* Welch's t-test on the means of two sets of boots. */
+static bool boot_stat_significant(const struct boot_summary *a, const struct boot_summary *b)
+{
+	double va, vb, t, df;
+
+	if (a->n < 2 || b->n < 2)
+		return false;
+
+	va = a->variance / a->n;
+	vb = b->variance / b->n;
+	if (va + vb == 0)
+		return a->mean != b->mean;
+
+	t = fabs(a->mean - b->mean) / sqrt(va + vb);
+	df = (va + vb) * (va + vb) /
+		(va * va / (a->n - 1) + vb * vb / (b->n - 1));
+
+	if (df < 1)
+		df = 1;
+	if (df > ARRAY_SIZE(t_critical_95))
+		return t > 1.960;
+	return t > t_critical_95[(size_t)df - 1];
+}
+
+static void dump_boot_stats(const struct boot_set *set)
+{
+	struct boot_summary sum;
+
+	printf("%zu boots, times in microseconds:\n\n", set->boots);
+	printf("%-50s %5s %10s %10s %10s %10s\n", "", "boots", "mean", "median",
+	       "p95", "stddev");
+
+	for (size_t i = 0; i < set->count; i++) {
+		boot_stat_summarize(&set->stats[i], &sum);
+		printf("%-50s %5zu %10.0f %10lld %10lld %10.0f\n",
+		       boot_stat_name(&set->stats[i]), sum.n, sum.mean,
+		       (long long)sum.median, (long long)sum.p95, sqrt(sum.variance));
+	}
+}
+
+static void dump_boot_diff(const struct boot_set *base, const struct boot_set *new)
+{
+	struct boot_summary sum_base, sum_new;
+	size_t significant = 0;
+
+	printf("%zu boots compared to %zu boots, mean times in microseconds:\n\n",
+	       new->boots, base->boots);
+	printf("%-50s %10s %10s %10s\n", "", "before", "after", "change");
+
+	for (size_t i = 0; i < new->count; i++) {
+		const struct boot_stat *stat = &new->stats[i];
+
+		boot_stat_summarize(boot_set_find_stat(base, stat), &sum_base);
+		boot_stat_summarize(stat, &sum_new);
+		printf("%-50s ", boot_stat_name(stat));
+		if (!sum_base.n) {
+			printf("%10s %10.0f\n", "-", sum_new.mean);
+			continue;
+		}
+		printf("%10.0f %10.0f %+10.0f", sum_base.mean, sum_new.mean,
+		       sum_new.mean - sum_base.mean);
+		if (sum_base.mean)
+			printf(" %+7.1f%%", 100 * (sum_new.mean - sum_base.mean) /
+			       fabs(sum_base.mean));
+		if (boot_stat_significant(&sum_base, &sum_new)) {
+			printf(" *");
+			significant++;
+		}
+		printf("\n");
+	}
+
+	/* Whatever is left only happened before. */
+	for (size_t i = 0; i < base->count; i++) {
+		const struct boot_stat *stat = &base->stats[i];
+
+		const struct boot_stat *after = boot_set_find_stat(new, stat);
+
+		if (stat->count && (!after || !after->count)) {
+			boot_stat_summarize(stat, &sum_base);
+			printf("%-50s %10.0f %10s\n", boot_stat_name(stat), sum_base.mean, "-");
+		}
+	}
+
+	printf("\n%zu significant changes (*: Welch's t-test, 95%% confidence)\n",
+	       significant);
+}
+
+static void free_boot_set(struct boot_set *set)
+{
+	for (size_t i = 0; i < set->count; i++)
+		free(set->stats[i].samples);
+	free(set->stats);
+}
+
+static int compare_snapshot_regions(const void *a, const void *b)
+{
+	const struct snapshot_region *ra = a, *rb = b;
+
+	return (ra->phys > rb->phys) - (ra->phys < rb->phys);
+}
+
+/* Sort the recorded regions and merge the ones that overlap or touch. */
+static void merge_snapshot_regions(void)
+{
+	size_t i, n = 0;
+
+	qsort(snapshot.regions, snapshot.count, sizeof(*snapshot.regions),
+	      compare_snapshot_regions);
+
+	for (i = 0; i < snapshot.count; i++) {
+		struct snapshot_region *r = &snapshot.regions[i];
+		struct snapshot_region *last = n ? &snapshot.regions[n - 1] : NULL;
+
+		if (!last || r->phys > last->phys + last->size) {
+			snapshot.regions[n++] = *r;
+			continue;
+		}
+
+		if (r->phys + r->size > last->phys + last->size) {
+			size_t skip = last->phys + last->size - r->phys;
+
+			last->data = realloc(last->data, last->size + r->size - skip);
+			if (!last->data)
+				die("Failed to allocate memory");
+			memcpy(last->data + last->size, r->data + skip, r->size - skip);
+			last->size += r->size - skip;
+		}
+		free(r->data);
+	}
+	snapshot.count = n;
+}
+
+static void write_snapshot(const char *path, u64 cbtable_addr, size_t cbtable_size)
+{
+	static const u8 padding[8];
+	struct snapshot_header header = {
+		.magic = SNAPSHOT_MAGIC,
+		.version = SNAPSHOT_VERSION,
+		.cbtable_addr = cbtable_addr,
+		.cbtable_size = cbtable_size,
+	};
+	FILE *f;
+	size_t total = 0;
+
+	merge_snapshot_regions();
+	header.num_chunks = snapshot.count;
+
+	f = fopen(path, "wb");
+	if (!f) {
+		fprintf(stderr, "Unable to create %s: %s\n", path, strerror(errno));
+		exit(1);
+	}
+
+	fwrite(&header, sizeof(header), 1, f);
+	for (size_t i = 0; i < snapshot.count; i++) {
+		const struct snapshot_region *r = &snapshot.regions[i];
+		struct snapshot_chunk chunk = { .phys = r->phys, .size = r->size };
+
+		fwrite(&chunk, sizeof(chunk), 1, f);
+		fwrite(r->data, r->size, 1, f);
+		fwrite(padding, ALIGN_UP(r->size, sizeof(padding)) - r->size, 1, f);
+		total += r->size;
+	}
+
+	if (ferror(f) | fclose(f)) {
+		fprintf(stderr, "Unable to write %s\n", path);
+		exit(1);
+	}
+	debug("Saved 0x%zx bytes in %zu chunks to %s\n", total, snapshot.count, path);
+}
+
+static void load_snapshot(const char *path, u64 *cbtable_addr, size_t *cbtable_size)
+{
+	struct snapshot_header header;
+	size_t size, offset;
+	u8 *buf;
+
+	buf = read_whole_file(path, &size);
+	if (!buf) {
+		fprintf(stderr, "Unable to read %s: %s\n", path, strerror(errno));
+		exit(1);
+	}
+
+	if (size < sizeof(header))
+		goto invalid;
+	memcpy(&header, buf, sizeof(header));
+	if (memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic)))
+		goto invalid;
+	if (header.version != SNAPSHOT_VERSION) {
+		fprintf(stderr, "%s is a version %u snapshot, this cbmem reads version %u\n",
+			path, header.version, SNAPSHOT_VERSION);
+		exit(1);
+	}
+
+	/* Every chunk needs at least its struct snapshot_chunk. */
+	if (header.num_chunks > (size - sizeof(header)) / sizeof(struct snapshot_chunk))
+		goto invalid;
+
+	snapshot.regions = calloc(header.num_chunks, sizeof(*snapshot.regions));
+	if (header.num_chunks && !snapshot.regions)
+		die("Failed to allocate memory");
+
+	offset = sizeof(header);
+	for (uint32_t i = 0; i < header.num_chunks; i++) {
+		struct snapshot_region *r = &snapshot.regions[i];
+		struct snapshot_chunk chunk;
+
+		if (size - offset < sizeof(chunk))
+			goto invalid;
+		memcpy(&chunk, buf + offset, sizeof(chunk));
+		offset += sizeof(chunk);
+		if (chunk.size > size - offset)
+			goto invalid;
+
+		r->phys = chunk.phys;
+		r->size = chunk.size;
+		r->data = buf + offset;
+		offset += MIN(ALIGN_UP(chunk.size, 8), size - offset);
+	}
+
+	snapshot.count = header.num_chunks;
+	snapshot.file_data = buf;
+	snapshot.mode = SNAPSHOT_LOAD;
+	*cbtable_addr = header.cbtable_addr;
+	*cbtable_size = header.cbtable_size;
+	return;
+
+invalid:
+	fprintf(stderr, "%s is not a valid cbmem snapshot.\n", path);
+	exit(1);
+}
+
+/* Record the CBMEM entries that are worth keeping by default. */
+static void snapshot_add_default_entries(void)
+{
+	static const uint32_t ids[] = {
+		CBMEM_ID_CONSOLE,
+		CBMEM_ID_TIMESTAMP,
+		CBMEM_ID_TPM_CB_LOG,
+		CBMEM_ID_COVERAGE,
+		CBMEM_ID_HEAP_STATS,
+		CBMEM_ID_TRACE,
+		CBMEM_ID_MEMTEST,
+	};
+	struct mapping entry_mapping;
+	uint64_t addr;
+	size_t size;
+
+	for (size_t i = 0; i < ARRAY_SIZE(ids); i++) {
+		if (find_cbmem_entry(ids[i], &addr, &size))
+			continue;
+		if (!map_memory(&entry_mapping, addr, size))
+			die("Unable to map CBMEM entry\n");
+		unmap_memory(&entry_mapping);
+	}
+}
+
 /* dump the TPM CB log table */
 static void dump_tpm_cb_log(void)
 {
@@ -884,6 +1582,288 @@ static void dump_tpm_cb_log(void)
 	unmap_memory(&log_mapping);
 }
 
+static void dump_heap_stats(void)
+{
+	uint64_t start;
+	size_t size;
+	const struct heap_stats *stats;
+	struct mapping stats_mapping;
+
+	if (find_cbmem_entry(CBMEM_ID_HEAP_STATS, &start, &size)) {
+		fprintf(stderr, "No heap statistics found in coreboot table.\n");
+		return;
+	}
+
+	if (size < sizeof(*stats))
+		die("Heap statistics entry too small.\n");
+
+	stats = map_memory(&stats_mapping, start, sizeof(*stats));
+	if (!stats)
+		die("Unable to map heap statistics\n");
+
+	printf("ramstage heap statistics:\n\n");
+	printf(" heap size:        %10" PRIu64 " bytes\n", stats->heap_size);
+	printf(" in use:           %10" PRIu64 " bytes\n", stats->in_use);
+	printf(" peak in use:      %10" PRIu64 " bytes (%" PRIu64 "%%)\n", stats->peak_in_use,
+	       stats->heap_size ? stats->peak_in_use * 100 / stats->heap_size : 0);
+	printf(" free:             %10" PRIu64 " bytes in %u blocks\n", stats->free_bytes,
+	       stats->free_blocks);
+	printf(" largest free:     %10" PRIu64 " bytes\n", stats->largest_free);
+	/* Share of free memory that is not usable for a single allocation. */
+	printf(" fragmentation:    %10" PRIu64 "%%\n",
+	       stats->free_bytes ? 100 - stats->largest_free * 100 / stats->free_bytes : 0);
+	printf(" allocations:      %10u\n", stats->allocations);
+	printf(" frees:            %10u\n", stats->frees);
+
+	printf("\n free blocks by size:\n");
+	for (int i = 0; i < HEAP_STATS_NUM_CLASSES; i++) {
+		if (!stats->class_free_blocks[i])
+			continue;
+		if (i == HEAP_STATS_NUM_CLASSES - 1)
+			printf("  >= %8llu bytes: %u\n",
+			       (unsigned long long)stats->class_unit << i,
+			       stats->class_free_blocks[i]);
+		else
+			printf("  %8llu-%8llu bytes: %u\n",
+			       (unsigned long long)stats->class_unit << i,
+			       ((unsigned long long)stats->class_unit << (i + 1)) - 1,
+			       stats->class_free_blocks[i]);
+	}
+
+	unmap_memory(&stats_mapping);
+}
+
+static void dump_memtest(void)
+{
+	static const char *const pattern_names[] = {
+		[MEMTEST_WALKING_ONES] = "walking ones",
+		[MEMTEST_ADDRESS] = "address in address",
+		[MEMTEST_RANDOM] = "random",
+	};
+	const struct memtest_results *results;
+	struct mapping results_mapping;
+	uint64_t start, errors = 0;
+	size_t size;
+	uint32_t i;
+
+	if (find_cbmem_entry(CBMEM_ID_MEMTEST, &start, &size)) {
+		fprintf(stderr, "No memory test results found in coreboot table.\n");
+		return;
+	}
+
+	if (size < sizeof(*results))
+		die("Memory test results too small.\n");
+
+	results = map_memory(&results_mapping, start, size);
+	if (!results)
+		die("Unable to map memory test results\n");
+
+	if (results->num_patterns > MEMTEST_NUM_PATTERNS ||
+	    size < sizeof(*results) + results->num_cpus * sizeof(results->cpus[0]))
+		die("Memory test results are corrupted.\n");
+
+	printf("memory test: %" PRIu64 " MiB on %u CPUs, seed 0x%" PRIx64 "\n\n",
+	       results->tested >> 20, results->num_cpus, results->seed);
+
+	for (i = 0; i < results->num_patterns; i++) {
+		const struct memtest_pattern_result *p = &results->patterns[i];
+
+		printf(" %-20s %8" PRIu64 " ms %8.2f GB/s\n", pattern_names[i],
+		       p->usecs / 1000, p->usecs ? (double)p->bytes / p->usecs / 1000 : 0.0);
+	}
+
+	printf("\n");
+	for (i = 0; i < results->num_cpus; i++) {
+		const struct memtest_cpu_result *cpu = &results->cpus[i];
+
+		errors += cpu->errors;
+		if (!cpu->errors)
+			continue;
+		printf(" CPU %-4u %" PRIu64 " errors, first at 0x%" PRIx64
+		       " (%s): expected 0x%016" PRIx64 ", got 0x%016" PRIx64 "\n",
+		       i, cpu->errors, cpu->error_addr,
+		       cpu->error_pattern < MEMTEST_NUM_PATTERNS ?
+		       pattern_names[cpu->error_pattern] : "unknown",
+		       cpu->expected, cpu->actual);
+	}
+	printf(" %" PRIu64 " errors\n", errors);
+
+	unmap_memory(&results_mapping);
+}
+
+enum trace_print_type {
+	TRACE_PRINT_NONE,
+	TRACE_PRINT_JSON,
+	TRACE_PRINT_FOLDED,
+};
+
+static void print_json_string(const char *str)
+{
+	putchar('"');
+	for (; *str; str++) {
+		if (*str == '"' || *str == '\\')
+			printf("\\%c", *str);
+		else if ((unsigned char)*str < 0x20)
+			printf("\\u%04x", *str);
+		else
+			putchar(*str);
+	}
+	putchar('"');
+}
+
+/* Print the names of a span and all its ancestors, outermost first, separated by ';'. */
+static void print_span_path(const struct trace_span *spans, uint32_t i, int depth)
+{
+	/* Parents always precede their children, guard against corrupted tables anyway. */
+	if (spans[i].parent && spans[i].parent <= i && depth < 64) {
+		print_span_path(spans, spans[i].parent - 1, depth + 1);
+		putchar(';');
+	}
+	printf("%.*s", TRACE_SPAN_NAME_LEN, spans[i].name);
+}
+
+/* Part of a span that lies within its parent */
+struct child_interval {
+	uint32_t parent;
+	uint64_t start;
+	uint64_t end;
+};
+
+static int compare_child_intervals(const void *a, const void *b)
+{
+	const struct child_interval *x = a, *y = b;
+
+	if (x->parent != y->parent)
+		return x->parent < y->parent ? -1 : 1;
+	if (x->start != y->start)
+		return x->start < y->start ? -1 : 1;
+	return 0;
+}
+
+/*
+ * Subtract the time covered by the children of every span from its self time. Children
+ * that ran on other CPUs or threads can overlap, so it's the union of their intervals.
+ */
+static void subtract_child_time(uint64_t *self, struct child_interval *children,
+				uint32_t count)
+{
+	uint32_t i = 0;
+
+	qsort(children, count, sizeof(*children), compare_child_intervals);
+
+	while (i < count) {
+		const uint32_t parent = children[i].parent;
+		uint64_t run_start = children[i].start;
+		uint64_t run_end = children[i].end;
+		uint64_t covered = 0;
+
+		for (i++; i < count && children[i].parent == parent; i++) {
+			if (children[i].start > run_end) {
+				covered += run_end - run_start;
+				run_start = children[i].start;
+			}
+			run_end = MAX(run_end, children[i].end);
+		}
+		covered += run_end - run_start;
+
+		self[parent] -= MIN(self[parent], covered);
+	}
+}
+
+/* dump the trace spans as Chrome trace events or as folded stacks for flame graphs */
+static void dump_trace(enum trace_print_type output_type)
+{
+	const struct trace_table *trace;
+	struct mapping trace_mapping;
+	struct child_interval *children;
+	uint64_t start, *end, *self;
+	size_t size;
+	uint32_t i, n, num_children = 0;
+	double freq;
+
+	if (find_cbmem_entry(CBMEM_ID_TRACE, &start, &size)) {
+		fprintf(stderr, "No trace spans found in coreboot table.\n");
+		return;
+	}
+
+	if (size < sizeof(*trace))
+		die("Trace table too small.\n");
+
+	trace = map_memory(&trace_mapping, start, size);
+	if (!trace)
+		die("Unable to map trace spans\n");
+
+	n = trace->num_entries;
+	if (n > (size - sizeof(*trace)) / sizeof(trace->spans[0]))
+		die("Trace table truncated.\n");
+
+	freq = trace->tick_freq_mhz ? trace->tick_freq_mhz : 1;
+
+	/* Spans that were still open when the payload was started end with the last span. */
+	end = calloc(n + 1, sizeof(*end));
+	self = calloc(n + 1, sizeof(*self));
+	children = calloc(n + 1, sizeof(*children));
+	if (!end || !self || !children)
+		die("Out of memory\n");
+	for (i = 0; i < n; i++)
+		end[n] = MAX(end[n], MAX(trace->spans[i].start, trace->spans[i].end));
+	for (i = 0; i < n; i++) {
+		const struct trace_span *span = &trace->spans[i];
+
+		end[i] = MAX(span->start, span->end ? span->end : end[n]);
+		self[i] = end[i] - span->start;
+
+		/* Parents always precede their children, guard against corrupted tables. */
+		if (span->parent && span->parent <= i) {
+			const uint32_t parent = span->parent - 1;
+			struct child_interval *child = &children[num_children];
+
+			child->parent = parent;
+			child->start = MAX(span->start, trace->spans[parent].start);
+			child->end = MIN(end[i], end[parent]);
+			if (child->start < child->end)
+				num_children++;
+		}
+	}
+	subtract_child_time(self, children, num_children);
+
+	if (output_type == TRACE_PRINT_JSON)
+		printf("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+
+	for (i = 0; i < n; i++) {
+		const struct trace_span *span = &trace->spans[i];
+		char name[TRACE_SPAN_NAME_LEN + 1];
+
+		if (output_type == TRACE_PRINT_FOLDED) {
+			print_span_path(trace->spans, i, 0);
+			printf(" %.0f\n", self[i] / freq);
+			continue;
+		}
+
+		memcpy(name, span->name, TRACE_SPAN_NAME_LEN);
+		name[TRACE_SPAN_NAME_LEN] = '\0';
+
+		printf("{\"name\":");
+		print_json_string(name);
+		printf(",\"cat\":");
+		print_json_string(span->id ? timestamp_name(span->id) : "span");
+		printf(",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":0,\"tid\":%u,",
+		       span->start / freq, (end[i] - span->start) / freq,
+		       span->cpu * 256 + span->thread);
+		printf("\"args\":{\"cpu\":%u,\"thread\":%u,\"payload\":%" PRIu64 "%s}}%s\n",
+		       span->cpu, span->thread, span->payload, span->end ? "" : ",\"open\":true",
+		       i + 1 < n ? "," : "");
+	}
+
+	if (output_type == TRACE_PRINT_JSON)
+		printf("]}\n");
+
+	free(children);
+	free(end);
+	free(self);
+	unmap_memory(&trace_mapping);
+}
+
 struct cbmem_console {
 	u32 size;
 	u32 cursor;
@@ -1114,6 +2094,7 @@ static void rawdump(uint64_t base, uint64_t size)
 
 static void dump_cbmem_raw(unsigned int id)
 {
+	const struct lb_record *lbr;
 	const uint8_t *table;
 	size_t offset;
 	uint64_t base = 0;
@@ -1124,16 +2105,10 @@ static void dump_cbmem_raw(unsigned int id)
 	if (table == NULL)
 		return;
 
-	offset = 0;
-
-	while (offset < mapping_size(&lbtable_mapping)) {
-		const struct lb_record *lbr;
+	for (offset = 0; (lbr = lb_record_at(&lbtable_mapping, offset)); offset += lbr->size) {
 		struct lb_cbmem_entry lbe;
 
-		lbr = (const void *)(table + offset);
-		offset += lbr->size;
-
-		if (lbr->tag != LB_TAG_CBMEM_ENTRY)
+		if (lbr->tag != LB_TAG_CBMEM_ENTRY || lbr->size < sizeof(lbe))
 			continue;
 
 		aligned_memcpy(&lbe, lbr, sizeof(lbe));
@@ -1194,6 +2169,7 @@ static void cbmem_print_entry(int n, uint32_t id, uint64_t base, uint64_t size)
 static void dump_cbmem_toc(void)
 {
 	int i;
+	const struct lb_record *lbr;
 	const uint8_t *table;
 	size_t offset;
 
@@ -1207,16 +2183,11 @@ static void dump_cbmem_toc(void)
 			"LENGTH");
 
 	i = 0;
-	offset = 0;
 
-	while (offset < mapping_size(&lbtable_mapping)) {
-		const struct lb_record *lbr;
+	for (offset = 0; (lbr = lb_record_at(&lbtable_mapping, offset)); offset += lbr->size) {
 		struct lb_cbmem_entry lbe;
 
-		lbr = (const void *)(table + offset);
-		offset += lbr->size;
-
-		if (lbr->tag != LB_TAG_CBMEM_ENTRY)
+		if (lbr->tag != LB_TAG_CBMEM_ENTRY || lbr->size < sizeof(lbe))
 			continue;
 
 		aligned_memcpy(&lbe, lbr, sizeof(lbe));
@@ -1325,7 +2296,10 @@ static void print_version(void)
 
 static void print_usage(const char *name, int exit_code)
 {
-	printf("usage: %s [-cCltTLxVvh?]\n", name);
+	printf("usage: %s [-cCltTLHMjFxVvh?]\n", name);
+	printf("       %s -b FILE... [-d FILE...]\n", name);
+	printf("       %s -s FILE [OPTIONS]\n", name);
+	printf("       %s -f FILE [OPTIONS]\n", name);
 	printf("\n"
 	     "   -c | --console:                   print cbmem console\n"
 	     "   -1 | --oneboot:                   print cbmem console for last boot only\n"
@@ -1339,7 +2313,18 @@ static void print_usage(const char *name, int exit_code)
 	     "   -T | --parseable-timestamps:      print parseable timestamps\n"
 	     "   -S | --stacked-timestamps:        print stacked timestamps (e.g. for flame graph tools)\n"
 	     "   -a | --add-timestamp ID:          append timestamp with ID\n"
+	     "   -b | --boot-stats FILE...:        print timestamp statistics over the boots saved in FILEs,\n"
+	     "                                     each holding the output of -T or of -r 54494d45\n"
+	     "   -d | --boot-diff FILE...:         compare the boots saved in FILEs to those of --boot-stats\n"
+	     "   -s | --snapshot FILE:             save the coreboot table, CBMEM console, timestamps, TPM log,\n"
+	     "                                     coverage, heap stats, trace, memory test results and what\n"
+	     "                                     else the other options look at to FILE\n"
+	     "   -f | --file FILE:                 read from a snapshot FILE instead of /dev/mem\n"
 	     "   -L | --tcpa-log                   print TPM log\n"
+	     "   -H | --heap-stats:                print ramstage heap statistics\n"
+	     "   -M | --memtest:                   print ramstage memory test results\n"
+	     "   -j | --trace-json:                print trace spans as Chrome trace events (JSON)\n"
+	     "   -F | --trace-folded:              print trace spans as folded stacks (e.g. for flame graph tools)\n"
 	     "   -V | --verbose:                   verbose (debugging) output\n"
 	     "   -v | --version:                   print the version\n"
 	     "   -h | --help:                      print this help\n"
@@ -1462,6 +2447,77 @@ static char *dt_find_compat(const char *parent, const char *compat,
 }
 #endif /* defined(__arm__) || defined(__aarch64__) */
 
+/* Find and parse the coreboot table in /dev/mem. Return < 0 if it can't be looked for. */
+static int parse_live_cbtable(u64 *cbtable_addr, size_t *cbtable_size)
+{
+#if defined(__arm__) || defined(__aarch64__)
+	int addr_cells, size_cells;
+	char *coreboot_node = dt_find_compat("/proc/device-tree", "coreboot",
+					     &addr_cells, &size_cells);
+
+	if (!coreboot_node) {
+		fprintf(stderr, "Could not find 'coreboot' compatible node!\n");
+		return -1;
+	}
+
+	if (addr_cells < 0) {
+		fprintf(stderr, "Warning: no #address-cells node in tree!\n");
+		addr_cells = 1;
+	}
+
+	int nlen = strlen(coreboot_node);
+	char *reg = alloca(nlen + sizeof("/reg"));
+
+	strcpy(reg, coreboot_node);
+	strcpy(reg + nlen, "/reg");
+	free(coreboot_node);
+
+	int fd = open(reg, O_RDONLY);
+	if (fd < 0) {
+		perror(reg);
+		return -1;
+	}
+
+	int i;
+	size_t size_to_read = addr_cells * 4 + size_cells * 4;
+	u8 *dtbuffer = alloca(size_to_read);
+	if (read(fd, dtbuffer, size_to_read) < 0) {
+		perror(reg);
+		return -1;
+	}
+	close(fd);
+
+	/* No variable-length byte swap function anywhere in C... how sad. */
+	u64 baseaddr = 0;
+	for (i = 0; i < addr_cells * 4; i++) {
+		baseaddr <<= 8;
+		baseaddr |= *dtbuffer;
+		dtbuffer++;
+	}
+	u64 cb_table_size = 0;
+	for (i = 0; i < size_cells * 4; i++) {
+		cb_table_size <<= 8;
+		cb_table_size |= *dtbuffer;
+		dtbuffer++;
+	}
+
+	*cbtable_addr = baseaddr;
+	*cbtable_size = cb_table_size;
+	parse_cbtable(baseaddr, cb_table_size);
+#else
+	unsigned long long possible_base_addresses[] = { 0, 0xf0000 };
+
+	/* Find and parse coreboot table */
+	for (size_t j = 0; j < ARRAY_SIZE(possible_base_addresses); j++) {
+		*cbtable_addr = possible_base_addresses[j];
+		*cbtable_size = 0;
+		if (!parse_cbtable(possible_base_addresses[j], 0))
+			break;
+	}
+#endif
+	return 0;
+}
+
 int main(int argc, char** argv)
 {
 	int print_defaults = 1;
@@ -1471,12 +2527,22 @@ int main(int argc, char** argv)
 	int print_hexdump = 0;
 	int print_rawdump = 0;
 	int print_tcpa_log = 0;
+	int print_heap_stats = 0;
+	int print_memtest = 0;
 	enum timestamps_print_type timestamp_type = TIMESTAMPS_PRINT_NONE;
+	enum trace_print_type trace_type = TRACE_PRINT_NONE;
 	enum console_print_type console_type = CONSOLE_PRINT_FULL;
 	unsigned int rawdump_id = 0;
 	int max_loglevel = BIOS_NEVER;
 	int print_unknown_logs = 1;
 	uint32_t timestamp_id = 0;
+	struct boot_set boot_sets[2] = { 0 };
+	struct boot_set *boot_set = NULL;
+	bool memory_options = false;
+	const char *snapshot_in = NULL;
+	const char *snapshot_out = NULL;
+	u64 cbtable_addr = 0;
+	size_t cbtable_size = 0;
 
 	int opt, option_index = 0;
 	static struct option long_options[] = {
@@ -1487,10 +2553,18 @@ int main(int argc, char** argv)
 		{"coverage", 0, 0, 'C'},
 		{"list", 0, 0, 'l'},
 		{"tcpa-log", 0, 0, 'L'},
+		{"heap-stats", 0, 0, 'H'},
+		{"memtest", 0, 0, 'M'},
+		{"trace-json", 0, 0, 'j'},
+		{"trace-folded", 0, 0, 'F'},
 		{"timestamps", 0, 0, 't'},
 		{"parseable-timestamps", 0, 0, 'T'},
 		{"stacked-timestamps", 0, 0, 'S'},
 		{"add-timestamp", required_argument, 0, 'a'},
+		{"boot-stats", 0, 0, 'b'},
+		{"boot-diff", 0, 0, 'd'},
+		{"snapshot", required_argument, 0, 's'},
+		{"file", required_argument, 0, 'f'},
 		{"hexdump", 0, 0, 'x'},
 		{"rawdump", required_argument, 0, 'r'},
 		{"verbose", 0, 0, 'V'},
@@ -1498,9 +2572,33 @@ int main(int argc, char** argv)
 		{"help", 0, 0, 'h'},
 		{0, 0, 0, 0}
 	};
-	while ((opt = getopt_long(argc, argv, "c12B:CltTSa:LxVvh?r:",
+	/* The leading '-' returns the files of --boot-stats and --boot-diff in order. */
+	while ((opt = getopt_long(argc, argv, "-c12B:CltTSa:bds:f:LHMjFxVvh?r:",
 				  long_options, &option_index)) != EOF) {
+		if (opt != 1 && opt != 'b' && opt != 'd' && opt != 'V')
+			memory_options = true;
+
 		switch (opt) {
+		case 1:
+			if (!boot_set) {
+				fprintf(stderr, "Error: Extra parameter found.\n");
+				print_usage(argv[0], 1);
+			}
+			boot_set_add_file(boot_set, optarg);
+			break;
+		case 'b':
+			boot_set = &boot_sets[0];
+			break;
+		case 'd':
+			boot_set = &boot_sets[1];
+			break;
+		case 's':
+			snapshot_out = optarg;
+			print_defaults = 0;
+			break;
+		case 'f':
+			snapshot_in = optarg;
+			break;
 		case 'c':
 			print_console = 1;
 			print_defaults = 0;
@@ -1530,6 +2628,22 @@ int main(int argc, char** argv)
 			print_tcpa_log = 1;
 			print_defaults = 0;
 			break;
+		case 'H':
+			print_heap_stats = 1;
+			print_defaults = 0;
+			break;
+		case 'M':
+			print_memtest = 1;
+			print_defaults = 0;
+			break;
+		case 'j':
+			trace_type = TRACE_PRINT_JSON;
+			print_defaults = 0;
+			break;
+		case 'F':
+			trace_type = TRACE_PRINT_FOLDED;
+			print_defaults = 0;
+			break;
 		case 'x':
 			print_hexdump = 1;
 			print_defaults = 0;
@@ -1580,78 +2694,53 @@ int main(int argc, char** argv)
 		print_usage(argv[0], 1);
 	}
 
-	mem_fd = open("/dev/mem", timestamp_id ? O_RDWR : O_RDONLY, 0);
-	if (mem_fd < 0) {
-		fprintf(stderr, "Failed to gain memory access: %s\n",
-			strerror(errno));
-		return 1;
-	}
-
-#if defined(__arm__) || defined(__aarch64__)
-	int addr_cells, size_cells;
-	char *coreboot_node = dt_find_compat("/proc/device-tree", "coreboot",
-					     &addr_cells, &size_cells);
-
-	if (!coreboot_node) {
-		fprintf(stderr, "Could not find 'coreboot' compatible node!\n");
-		return 1;
-	}
-
-	if (addr_cells < 0) {
-		fprintf(stderr, "Warning: no #address-cells node in tree!\n");
-		addr_cells = 1;
-	}
-
-	int nlen = strlen(coreboot_node);
-	char *reg = alloca(nlen + sizeof("/reg"));
-
-	strcpy(reg, coreboot_node);
-	strcpy(reg + nlen, "/reg");
-	free(coreboot_node);
-
-	int fd = open(reg, O_RDONLY);
-	if (fd < 0) {
-		perror(reg);
-		return 1;
-	}
-
-	int i;
-	size_t size_to_read = addr_cells * 4 + size_cells * 4;
-	u8 *dtbuffer = alloca(size_to_read);
-	if (read(fd, dtbuffer, size_to_read) < 0) {
-		perror(reg);
-		return 1;
+	if (snapshot_in && snapshot_out) {
+		fprintf(stderr, "Error: A snapshot can't be taken of a snapshot.\n");
+		print_usage(argv[0], 1);
 	}
-	close(fd);
 
-	/* No variable-length byte swap function anywhere in C... how sad. */
-	u64 baseaddr = 0;
-	for (i = 0; i < addr_cells * 4; i++) {
-		baseaddr <<= 8;
-		baseaddr |= *dtbuffer;
-		dtbuffer++;
-	}
-	u64 cb_table_size = 0;
-	for (i = 0; i < size_cells * 4; i++) {
-		cb_table_size <<= 8;
-		cb_table_size |= *dtbuffer;
-		dtbuffer++;
+	/* Saved boots are looked at offline, without any access to memory. */
+	if (boot_set) {
+		if (memory_options) {
+			fprintf(stderr, "Error: --boot-stats and --boot-diff only take files.\n");
+			print_usage(argv[0], 1);
+		}
+		if (!boot_sets[0].boots || (boot_set == &boot_sets[1] && !boot_sets[1].boots)) {
+			fprintf(stderr, "Error: No boots to look at.\n");
+			print_usage(argv[0], 1);
+		}
+		if (boot_sets[1].boots)
+			dump_boot_diff(&boot_sets[0], &boot_sets[1]);
+		else
+			dump_boot_stats(&boot_sets[0]);
+		free_boot_set(&boot_sets[0]);
+		free_boot_set(&boot_sets[1]);
+		return 0;
 	}
 
-	parse_cbtable(baseaddr, cb_table_size);
-#else
-	unsigned long long possible_base_addresses[] = { 0, 0xf0000 };
+	if (snapshot_in) {
+		load_snapshot(snapshot_in, &cbtable_addr, &cbtable_size);
+		parse_cbtable(cbtable_addr, cbtable_size);
+	} else {
+		mem_fd = open("/dev/mem", timestamp_id ? O_RDWR : O_RDONLY, 0);
+		if (mem_fd < 0) {
+			fprintf(stderr, "Failed to gain memory access: %s\n",
+				strerror(errno));
+			return 1;
+		}
 
-	/* Find and parse coreboot table */
-	for (size_t j = 0; j < ARRAY_SIZE(possible_base_addresses); j++) {
-		if (!parse_cbtable(possible_base_addresses[j], 0))
-			break;
+		if (snapshot_out)
+			snapshot.mode = SNAPSHOT_SAVE;
+		if (parse_live_cbtable(&cbtable_addr, &cbtable_size) < 0)
+			return 1;
 	}
-#endif
 
 	if (mapping_virt(&lbtable_mapping) == NULL)
 		die("Table not found.\n");
 
+	if (snapshot_out)
+		snapshot_add_default_entries();
+
 	if (print_console)
 		dump_console(console_type, max_loglevel, print_unknown_logs);
 
@@ -1679,8 +2768,23 @@ int main(int argc, char** argv)
 	if (print_tcpa_log)
 		dump_tpm_cb_log();
 
+	if (print_heap_stats)
+		dump_heap_stats();
+
+	if (print_memtest)
+		dump_memtest();
+
+	if (trace_type != TRACE_PRINT_NONE)
+		dump_trace(trace_type);
+
+	if (snapshot_out)
+		write_snapshot(snapshot_out, cbtable_addr, cbtable_size);
+
 	unmap_memory(&lbtable_mapping);
 
-	close(mem_fd);
+	if (snapshot_in)
+		free(snapshot.file_data);
+	else
+		close(mem_fd);
 	return 0;
 }
@@ -0,0 +1,56 @@
+#!/usr/bin/python3
+# SPDX-License-Identifier: BSD-3-Clause
+
+import pytest
+
+from cbmem_helpers import cbmem
+
+# IDs that cbmem doesn't know, so they are printed as numbers.
+TS_A = 60001
+TS_B = 60002
+
+
+def save_boot(tmp_path, name: str, stamps: dict):
+    # As printed by cbmem -T, with the start of coreboot as ID 0.
+    path = tmp_path / name
+    lines = ["0\t1000\t0\tstart"]
+    lines += [f"{id}\t{1000 + stamp}\t0\tstamp" for id, stamp in stamps.items()]
+    path.write_text("\n".join(lines) + "\n")
+    return path
+
+
+def rows(output: bytes) -> dict:
+    return {line.split()[0]: line.split()[1:]
+            for line in output.decode("utf-8").splitlines()[3:] if line.strip()}
+
+
+def test_boot_stats(cbmem_path, tmp_path):
+    boots = [save_boot(tmp_path, f"boot{i}", {TS_A: a, TS_B: 100})
+             for i, a in enumerate([30, 10, 20])]
+    stats = rows(cbmem(cbmem_path, '-b', *boots).stdout)
+    # boots, mean, median, p95, stddev
+    assert stats[str(TS_A)] == ["3", "20", "20", "30", "10"]
+    assert stats["Total"][:2] == ["3", "100"]
+
+
+def test_boot_diff(cbmem_path, tmp_path):
+    before = [save_boot(tmp_path, f"before{i}", {TS_A: a, TS_B: 100})
+              for i, a in enumerate([10, 11, 12])]
+    after = [save_boot(tmp_path, f"after{i}", {TS_A: a})
+             for i, a in enumerate([50, 51, 52])]
+    diff = rows(cbmem(cbmem_path, '-b', *before, '-d', *after).stdout)
+    assert diff[str(TS_A)] == ["11", "51", "+40", "+363.6%", "*"]
+    # Only happened before
+    assert diff[str(TS_B)] == ["100", "-"]
+
+
+@pytest.mark.parametrize("option", [['-l'], ['-t'], ['-f', 'snapshot.bin'],
+                                    ['-B', 'INFO'], ['-r', '54494d45']])
+def test_boot_stats_only_take_files(cbmem_path, tmp_path, option):
+    boot = save_boot(tmp_path, "boot", {TS_A: 10})
+    result = cbmem(cbmem_path, '-b', boot, *option, check=False)
+    assert result.returncode == 1
+    assert b"only take files" in result.stderr
+    result = cbmem(cbmem_path, *option, '-b', boot, '-d', boot, check=False)
+    assert result.returncode == 1
+    assert b"only take files" in result.stderr
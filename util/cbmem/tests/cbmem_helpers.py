@@ -0,0 +1,84 @@
+# SPDX-License-Identifier: BSD-3-Clause
+
+# Helpers to build the snapshots that cbmem -s saves, see util/cbmem/cbmem.c.
+
+import struct
+import subprocess
+
+# Defined in commonlib/coreboot_tables.h and commonlib/bsd/cbmem_id.h
+LB_TAG_FORWARD = 0x11
+LB_TAG_CBMEM_ENTRY = 0x31
+CBMEM_ID_TRACE = 0x54524143
+
+SNAPSHOT_MAGIC = b"CBMEMSNP"
+SNAPSHOT_VERSION = 1
+
+# Where the snapshots built here keep the coreboot table and the CBMEM entries
+CBTABLE_ADDR = 0x1000
+CBMEM_ADDR = 0x100000
+
+
+def cbmem(cbmem_path, *args, check=True):
+    # Corrupted tables must not make cbmem loop forever.
+    return subprocess.run([cbmem_path] + list(args), capture_output=True,
+                          check=check, timeout=10)
+
+
+def ipchcksum(data: bytes) -> int:
+    data = data[:len(data) & ~1]
+    total = sum(struct.unpack(f"<{len(data) // 2}H", data))
+    total = (total >> 16) + (total & 0xffff)
+    total += total >> 16
+    return ~total & 0xffff
+
+
+def cbmem_entry_record(cbmem_id: int, address: int, size: int) -> bytes:
+    return struct.pack("<IIQII", LB_TAG_CBMEM_ENTRY, 24, address, size,
+                       cbmem_id)
+
+
+def forward_record(address: int) -> bytes:
+    return struct.pack("<IIQ", LB_TAG_FORWARD, 16, address)
+
+
+def coreboot_table(records: list) -> bytes:
+    table = b"".join(records)
+    header = struct.pack("<4sIIIII", b"LBIO", 24, 0, len(table),
+                         ipchcksum(table), len(records))
+    checksum = ipchcksum(header)
+    return header[:8] + struct.pack("<I", checksum) + header[12:] + table
+
+
+def snapshot(chunks: list, cbtable_addr=CBTABLE_ADDR,
+             cbtable_size=None) -> bytes:
+    """Snapshot of the (address, data) chunks, the first one holding the
+    coreboot table."""
+    if cbtable_size is None:
+        cbtable_size = len(chunks[0][1])
+    out = struct.pack("<8sIIQQ", SNAPSHOT_MAGIC, SNAPSHOT_VERSION,
+                      len(chunks), cbtable_addr, cbtable_size)
+    for phys, data in chunks:
+        out += struct.pack("<QQ", phys, len(data)) + data
+        out += bytes(-len(data) % 8)
+    return out
+
+
+def cbmem_snapshot(entries: dict) -> bytes:
+    """Snapshot of a coreboot table with the CBMEM entries {id: data}."""
+    records = []
+    chunks = []
+    addr = CBMEM_ADDR
+    for cbmem_id, data in entries.items():
+        records.append(cbmem_entry_record(cbmem_id, addr, len(data)))
+        chunks.append((addr, data))
+        addr += (len(data) + 0xfff) & ~0xfff
+    return snapshot([(CBTABLE_ADDR, coreboot_table(records))] + chunks)
+
+
+def trace_table(spans: list, tick_freq_mhz=1) -> bytes:
+    """Trace table of the spans (name, start, end, parent, cpu)."""
+    out = struct.pack("<QHII", 0, tick_freq_mhz, len(spans), len(spans))
+    for name, start, end, parent, cpu in spans:
+        out += struct.pack("<QQQIHBB32s", start, end, 0, 0, parent, cpu, 0,
+                           name.encode())
+    return out
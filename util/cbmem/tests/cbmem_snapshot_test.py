@@ -0,0 +1,147 @@
+#!/usr/bin/python3
+# SPDX-License-Identifier: BSD-3-Clause
+
+import pytest
+import struct
+from cbmem_helpers import (CBMEM_ADDR, CBTABLE_ADDR, cbmem, cbmem_entry_record,
+                           cbmem_snapshot, coreboot_table, forward_record,
+                           snapshot)
+
+RAW_ID = 0x12345678
+RAW_DATA = bytes(range(256)) * 3
+
+
+def run_snapshot(cbmem_path, tmp_path, data: bytes, *args):
+    path = tmp_path / "snapshot.bin"
+    path.write_bytes(data)
+    result = cbmem(cbmem_path, '-f', path, *args, check=False)
+    # Whatever the file holds, cbmem has to fail cleanly.
+    assert result.returncode >= 0
+    assert b"Sanitizer" not in result.stderr
+    return result
+
+
+def test_read_entries(cbmem_path, tmp_path):
+    data = cbmem_snapshot({RAW_ID: RAW_DATA, 0x11111111: b"x" * 8})
+
+    result = run_snapshot(cbmem_path, tmp_path, data, '-l')
+    assert result.returncode == 0
+    assert b"12345678" in result.stdout
+    assert b"11111111" in result.stdout
+
+    result = run_snapshot(cbmem_path, tmp_path, data, '-r', '12345678')
+    assert result.returncode == 0
+    assert result.stdout == RAW_DATA
+
+
+def test_search_and_forward(cbmem_path, tmp_path):
+    # Like a live table: cbmem searches 4KiB at the start address for the
+    # table header and follows the forwarding entry to the real table.
+    low = bytearray(b"\x5a" * 4096)
+    low[0x40:0x40 + 40] = coreboot_table([forward_record(0x8000)])
+    table = coreboot_table([cbmem_entry_record(RAW_ID, CBMEM_ADDR,
+                                               len(RAW_DATA))])
+    table += bytes(4096 - len(table))
+    data = snapshot([(0, bytes(low)), (0x8000, table),
+                     (CBMEM_ADDR, RAW_DATA)], cbtable_addr=0, cbtable_size=0)
+
+    result = run_snapshot(cbmem_path, tmp_path, data, '-r', '12345678')
+    assert result.returncode == 0
+    assert result.stdout == RAW_DATA
+
+
+def test_snapshot_is_read_only(cbmem_path, tmp_path):
+    result = run_snapshot(cbmem_path, tmp_path,
+                          cbmem_snapshot({RAW_ID: RAW_DATA}), '-a', '1')
+    assert result.returncode != 0
+
+
+def test_truncated(cbmem_path, tmp_path):
+    data = cbmem_snapshot({RAW_ID: RAW_DATA})
+    # The padding after the last chunk may be missing.
+    complete = len(data) - (-len(RAW_DATA) % 8)
+
+    for size in range(len(data)):
+        result = run_snapshot(cbmem_path, tmp_path, data[:size], '-l')
+        if size < complete:
+            assert result.returncode != 0, size
+            assert b"not a valid cbmem snapshot" in result.stderr, size
+        else:
+            assert result.returncode == 0, size
+
+
+@pytest.mark.parametrize("offset,value,message", [
+    (0, b"X", b"not a valid cbmem snapshot"),
+    (8, struct.pack("<I", 2), b"version 2 snapshot"),
+    (12, struct.pack("<I", 0xffffffff), b"not a valid cbmem snapshot"),
+    (40, struct.pack("<Q", 0xffffffffffffffff), b"not a valid cbmem snapshot"),
+])
+def test_corrupted_header(cbmem_path, tmp_path, offset, value, message):
+    data = bytearray(cbmem_snapshot({RAW_ID: RAW_DATA}))
+    data[offset:offset + len(value)] = value
+
+    result = run_snapshot(cbmem_path, tmp_path, bytes(data), '-l')
+    assert result.returncode != 0
+    assert message in result.stderr
+
+
+def table_snapshot(table: bytes, cbtable_size=None) -> bytes:
+    return snapshot([(CBTABLE_ADDR, table), (CBMEM_ADDR, RAW_DATA)],
+                    cbtable_size=cbtable_size)
+
+
+def test_bad_table_checksum(cbmem_path, tmp_path):
+    table = bytearray(coreboot_table([cbmem_entry_record(RAW_ID, CBMEM_ADDR,
+                                                         len(RAW_DATA))]))
+    table[-1] ^= 1
+
+    result = run_snapshot(cbmem_path, tmp_path, table_snapshot(bytes(table)),
+                          '-l')
+    assert result.returncode != 0
+    assert b"Table not found" in result.stderr
+
+
+@pytest.mark.parametrize("record", [
+    # Records that are too small, too large or cut short
+    struct.pack("<II", 0x31, 0),
+    struct.pack("<II", 0x31, 4),
+    struct.pack("<II", 0x31, 0x1000),
+    struct.pack("<IIQ", 0x31, 16, CBMEM_ADDR),
+    struct.pack("<IIQ", 0x11, 8, 0),
+    struct.pack("<II", 0x10, 8),
+    struct.pack("<II", 0x01, 8),
+])
+def test_corrupted_records(cbmem_path, tmp_path, record):
+    table = coreboot_table([record, cbmem_entry_record(RAW_ID, CBMEM_ADDR,
+                                                       len(RAW_DATA))])
+
+    for args in (['-l'], ['-r', '12345678'], ['-t']):
+        run_snapshot(cbmem_path, tmp_path, table_snapshot(table), *args)
+
+
+def test_forward_loop(cbmem_path, tmp_path):
+    table = coreboot_table([forward_record(CBTABLE_ADDR)])
+
+    result = run_snapshot(cbmem_path, tmp_path, table_snapshot(table), '-l')
+    assert result.returncode != 0
+
+
+@pytest.mark.parametrize("cbtable_size", [1, 8, 23])
+def test_table_size_too_small(cbmem_path, tmp_path, cbtable_size):
+    table = coreboot_table([cbmem_entry_record(RAW_ID, CBMEM_ADDR,
+                                               len(RAW_DATA))])
+
+    result = run_snapshot(cbmem_path, tmp_path,
+                          table_snapshot(table, cbtable_size), '-l')
+    assert result.returncode != 0
+    assert b"Table not found" in result.stderr
+
+
+def test_entry_outside_snapshot(cbmem_path, tmp_path):
+    table = coreboot_table([cbmem_entry_record(RAW_ID, CBMEM_ADDR,
+                                               len(RAW_DATA) + 1)])
+
+    result = run_snapshot(cbmem_path, tmp_path, table_snapshot(table),
+                          '-r', '12345678')
+    assert result.returncode != 0
+    assert b"Unable to map" in result.stderr
@@ -0,0 +1,46 @@
+#!/usr/bin/python3
+# SPDX-License-Identifier: BSD-3-Clause
+
+from cbmem_helpers import CBMEM_ID_TRACE, cbmem, cbmem_snapshot, trace_table
+
+
+def folded_stacks(cbmem_path, tmp_path, spans: list) -> dict:
+    path = tmp_path / "snapshot.bin"
+    path.write_bytes(cbmem_snapshot({CBMEM_ID_TRACE: trace_table(spans)}))
+    output = cbmem(cbmem_path, '-f', path, '-F').stdout.decode("utf-8")
+    return {line.rsplit(" ", 1)[0]: int(line.rsplit(" ", 1)[1])
+            for line in output.splitlines()}
+
+
+def test_self_time(cbmem_path, tmp_path):
+    stacks = folded_stacks(cbmem_path, tmp_path, [
+        ("main", 0, 100, 0, 0),
+        ("a", 10, 40, 1, 0),
+        ("b", 50, 60, 1, 0),
+        ("c", 52, 55, 3, 0),
+    ])
+    assert stacks == {"main": 60, "main;a": 30, "main;b": 7, "main;b;c": 3}
+
+
+def test_self_time_parallel_children(cbmem_path, tmp_path):
+    # Work on the APs overlaps, the time is only subtracted from the parent
+    # once. Children can also outlast their parent, e.g. threads.
+    stacks = folded_stacks(cbmem_path, tmp_path, [
+        ("main", 0, 100, 0, 0),
+        ("ap1", 10, 50, 1, 1),
+        ("ap2", 30, 70, 1, 2),
+        ("ap3", 40, 45, 1, 3),
+        ("thread", 90, 120, 1, 0),
+    ])
+    assert stacks["main"] == 30
+    assert stacks["main;ap1"] == 40
+    assert stacks["main;thread"] == 30
+
+
+def test_open_spans_end_with_the_last_span(cbmem_path, tmp_path):
+    stacks = folded_stacks(cbmem_path, tmp_path, [
+        ("main", 0, 0, 0, 0),
+        ("a", 10, 0, 1, 0),
+        ("b", 20, 80, 2, 0),
+    ])
+    assert stacks == {"main": 10, "main;a": 10, "main;a;b": 60}
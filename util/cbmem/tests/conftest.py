@@ -0,0 +1,21 @@
+# SPDX-License-Identifier: BSD-3-Clause
+
+import os
+import pathlib
+import pytest
+
+
+def pytest_addoption(parser):
+    here = pathlib.Path(__file__).parent
+    parser.addoption(
+        "--cbmem-path",
+        type=pathlib.Path,
+        default=(here / ".." / "cbmem").resolve(),
+    )
+
+
+@pytest.fixture(scope="session")
+def cbmem_path(request):
+    exe = request.config.option.cbmem_path
+    assert os.path.exists(exe)
+    return exe
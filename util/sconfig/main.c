@@ -1948,6 +1948,72 @@ static void parse_override_devicetree(const char *file, struct device *dev)
 	override_devicetree(&base_root_bus, dev->bus);
 }
 
+static struct device *pci_root_domain;
+
+static void find_pci_root_domain(FILE *fil, FILE *head, struct device *ptr,
+				 struct device *next)
+{
+	if (!pci_root_domain && ptr->bustype == DOMAIN)
+		pci_root_domain = ptr;
+}
+
+static int pci_dev_compare(const void *a, const void *b)
+{
+	const struct device *dev_a = *(struct device *const *)a;
+	const struct device *dev_b = *(struct device *const *)b;
+	const int devfn_a = (dev_a->path_a << 3) | (dev_a->path_b & 7);
+	const int devfn_b = (dev_b->path_a << 3) | (dev_b->path_b & 7);
+
+	return devfn_a - devfn_b;
+}
+
+/*
+ * Emit the devices on the PCI root bus sorted by devfn, so that lookups on the
+ * root bus don't have to walk the list of children. pci_root_bus() is the first
+ * link of the first domain in all_devices order, which is the BFS order here.
+ */
+static void emit_pci_root_index(FILE *fil)
+{
+	struct device **devs = NULL;
+	struct device *ptr;
+	size_t count = 0, i;
+
+	walk_device_tree(NULL, NULL, &base_root_dev, find_pci_root_domain);
+
+	fprintf(fil, "\n/* PCI root bus index */\n");
+	if (!pci_root_domain || !dev_has_children(pci_root_domain)) {
+		fprintf(fil, "DEVTREE_CONST struct bus *const pci_root_index_bus = NULL;\n");
+	} else {
+		fprintf(fil, "DEVTREE_CONST struct bus *const pci_root_index_bus = &%s_links[0];\n",
+			pci_root_domain->name);
+
+		for (ptr = pci_root_domain->bus->children; ptr; ptr = ptr->sibling) {
+			if (ptr->bustype == PCI)
+				count++;
+		}
+	}
+
+	if (count) {
+		devs = S_ALLOC(count * sizeof(*devs));
+		count = 0;
+		for (ptr = pci_root_domain->bus->children; ptr; ptr = ptr->sibling) {
+			if (ptr->bustype == PCI)
+				devs[count++] = ptr;
+		}
+		qsort(devs, count, sizeof(*devs), pci_dev_compare);
+	}
+
+	/* Devices with the same path on a bus are merged, so each devfn is unique. */
+	fprintf(fil, "const struct pci_root_index_entry pci_root_index[] = {\n");
+	for (i = 0; i < count; i++)
+		fprintf(fil, "\t{ .devfn = PCI_DEVFN(0x%x,%d), .dev = &%s },\n",
+			devs[i]->path_a, devs[i]->path_b, devs[i]->name);
+	fprintf(fil, "};\n");
+	fprintf(fil, "const size_t pci_root_index_count = ARRAY_SIZE(pci_root_index);\n");
+
+	free(devs);
+}
+
 static void generate_outputh(FILE *f, const char *fw_conf_header, const char *device_header)
 {
 	fprintf(f, "#ifndef __STATIC_DEVICE_TREE_H\n");
@@ -1979,6 +2045,7 @@ static void generate_outputc(FILE *f, const char *static_header)
 	emit_chip_configs(f);
 	fprintf(f, "\n/* pass 1 */\n");
 	walk_device_tree(f, NULL, &base_root_dev, pass1);
+	emit_pci_root_index(f);
 }
 
 static void generate_outputd(FILE *gen, FILE *dev)